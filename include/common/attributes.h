@@ -35,6 +35,16 @@ __pragma( pack(pop) )
 struct __attribute__((packed)) sname sbody;
 #endif
 
+/* Keeps data written by one thread off the cache lines of data written by others */
+#define RIST_CACHE_LINE_SIZE (64)
+#if defined(__GNUC__)
+# define RIST_CACHE_ALIGNED __attribute__((aligned(RIST_CACHE_LINE_SIZE)))
+#elif defined(_MSC_VER)
+# define RIST_CACHE_ALIGNED __declspec(align(64))
+#else
+# define RIST_CACHE_ALIGNED
+#endif
+
 /* Branch prediction */
 #ifdef __GNUC__
 # define RIST_LIKELY(p)   __builtin_expect(!!(p), 1)
@@ -107,6 +107,32 @@ struct rist_udp_config
 	char multiplex_filter[RIST_MAX_STRING_SHORT];//Future usage
 };
 
+enum rist_impairment_loss_model
+{
+	RIST_IMPAIRMENT_LOSS_NONE = 0,
+	RIST_IMPAIRMENT_LOSS_BERNOULLI = 1, // Every datagram is lost with probability loss
+	RIST_IMPAIRMENT_LOSS_GILBERT_ELLIOTT = 2, // Two state burst loss, loss in the good and loss_bad in the bad state
+};
+
+/* Emulated network conditions applied to the datagrams a context sends.
+ * Probabilities are in parts per million, times in milliseconds */
+struct rist_impairment_config
+{
+	uint64_t seed; // Same seed, same traffic: same datagrams get lost, duplicated and delayed
+	enum rist_impairment_loss_model loss_model;
+	uint32_t loss;
+	uint32_t loss_bad;
+	uint32_t good_to_bad; // Gilbert-Elliott chance per datagram to enter the bad state
+	uint32_t bad_to_good; // Gilbert-Elliott chance per datagram to leave the bad state
+	uint32_t duplicate;
+	uint32_t reorder; // Chance a datagram is held back reorder_delay longer than the others
+	uint32_t reorder_delay;
+	uint32_t delay;
+	uint32_t jitter; // Uniformly distributed +/- on top of delay
+	uint32_t rate; // Bandwidth cap in kbps, 0 for none
+	uint32_t queue_limit; // Datagrams held back at most before dropping, 0 for the default
+};
+
 #ifdef __cplusplus
 }
 #endif
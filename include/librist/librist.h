@@ -35,6 +35,22 @@ extern "C" {
  */
 RIST_API int rist_jitter_max_set(struct rist_ctx *ctx, int t);
 
+/**
+ * @brief Impair the traffic sent by a RIST context
+ *
+ * Emulates a lossy network without root privileges or netem for testing
+ * and measuring recovery: Bernoulli or Gilbert-Elliott burst loss,
+ * duplication, reordering, fixed and jittered delay and a bandwidth cap.
+ * Every peer draws from its own PRNG seeded from config->seed and the peer
+ * id, so runs with the same seed and traffic are reproducible. Can be
+ * changed at any time, NULL turns the impairment off.
+ *
+ * @param ctx RIST context
+ * @param config impairment settings, copied, or NULL
+ * @return 0 on success, -1 on error
+ */
+RIST_API int rist_impairment_set(struct rist_ctx *ctx, const struct rist_impairment_config *config);
+
 /**
  * @brief Starts the RIST sender or receiver
  *
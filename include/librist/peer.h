@@ -101,7 +101,10 @@ struct rist_peer_config
 	int key_size;
 	uint32_t key_rotation;
 
-	/* Compression (sender only as receiver is auto detect) */
+	/* LZ4 compression level, 0 disables it and 3 and up use LZ4HC
+	 * (sender only as receiver is auto detect). Payloads are compressed once
+	 * per sender context, so all its peers get the highest level any peer
+	 * asked for, including peers left at 0 */
 	int compression;
 
 	/* cname identifier for rtcp packets */
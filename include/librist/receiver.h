@@ -60,6 +60,21 @@ RIST_API int rist_receiver_nack_type_set(struct rist_ctx *ctx, enum rist_nack_ty
  */
 RIST_API int rist_receiver_set_output_fifo_size(struct rist_ctx *ctx, uint32_t desired_size);
 
+/**
+ * @brief Set the number of receiver worker threads
+ *
+ * Shards flow processing over a pool of worker threads. Each flow is assigned
+ * to a worker by a hash of its flow id, the worker owns its reorder buffer,
+ * missing packet tracking, NACK timer and statistics. The protocol thread keeps
+ * polling the sockets and authenticating packets. 0 (the default) processes all
+ * flows on the protocol thread. Can only be set before starting.
+ *
+ * @param ctx RIST receiver context
+ * @param count number of worker threads, at most 64
+ * @return 0 for success
+ */
+RIST_API int rist_receiver_set_worker_threads(struct rist_ctx *ctx, uint32_t count);
+
 /**
  * @brief Reads rist data
  *
@@ -73,6 +88,21 @@ RIST_API int rist_receiver_set_output_fifo_size(struct rist_ctx *ctx, uint32_t d
 RIST_DEPRECATED RIST_API int rist_receiver_data_read(struct rist_ctx *ctx, const struct rist_data_block **data_block, int timeout);
 RIST_API int rist_receiver_data_read2(struct rist_ctx *ctx, struct rist_data_block **data_block, int timeout);
 
+/**
+ * @brief Reads a batch of rist data blocks
+ *
+ * Same as rist_receiver_data_read2 but drains up to max blocks in one call,
+ * claiming runs of blocks from a flow fifo at once. Blocks are returned in
+ * order per flow, each one MUST be freed via rist_receiver_data_block_free2
+ *
+ * @param ctx RIST receiver context
+ * @param[out] data_blocks array receiving up to max data block pointers
+ * @param max size of the data_blocks array
+ * @param timeout How long to wait for queue data (ms), 0 for no wait
+ * @return number of blocks returned (0 if none), negative on error
+ */
+RIST_API int rist_receiver_data_read_batch(struct rist_ctx *ctx, struct rist_data_block **data_blocks, size_t max, int timeout);
+
 /**
  * @brief Data callback function
  *
@@ -130,6 +160,21 @@ RIST_API void rist_receiver_data_block_free2(struct rist_data_block **block);
  */
 RIST_API int rist_receiver_data_notify_fd_set(struct rist_ctx *ctx, int fd);
 
+/**
+ * @brief Get an eventfd signaled when data is ready for reading
+ *
+ * Alternative to rist_receiver_data_notify_fd_set owned by the library. The
+ * eventfd is non blocking and only signaled when a read found the fifo queue
+ * empty and new data arrived since, so the calling application must read
+ * (rist_receiver_data_read_batch / rist_receiver_data_read2) until no more
+ * data is returned before polling again, and read the eventfd to reset it.
+ * Repeated calls return the same fd, it is closed by rist_destroy.
+ * Only available on Linux.
+ * @param ctx RIST receiver context
+ * @return the eventfd on success, -1 on error
+ */
+RIST_API int rist_receiver_data_notify_eventfd(struct rist_ctx *ctx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,6 +57,61 @@ RIST_API int rist_sender_npd_enable(struct rist_ctx *ctx);
  */
 RIST_API int rist_sender_npd_disable(struct rist_ctx *ctx);
 
+/**
+ * @brief Enable output pacing
+ *
+ *  Spaces out the datagrams sent instead of bursting the queued data and
+ *  retransmissions. Data is paced to the measured input bitrate with some
+ *  headroom, retransmissions to what the peers' recovery_maxbitrate leaves
+ *  on top of that. Where the kernel supports SO_TXTIME the spacing is done
+ *  by the fq qdisc, otherwise with a millisecond granularity.
+ *  Trades a little latency for fewer drops on links with shallow buffers.
+ * @param ctx RIST sender ctx
+ * @return 0 on success, -1 in case of error.
+ */
+RIST_API int rist_sender_pacing_enable(struct rist_ctx *ctx);
+
+/**
+ * @brief Disable output pacing
+ *
+ * @param ctx RIST sender ctx
+ * @return 0 on success, -1 in case of error.
+ */
+RIST_API int rist_sender_pacing_disable(struct rist_ctx *ctx);
+
+/**
+ * @brief Configure SMPTE 2022-1 style row/column FEC
+ *
+ *  Sends XOR parity packets for every row of columns consecutive packets
+ *  and every column of rows packets spaced columns apart, so the receiver
+ *  rebuilds single losses per row or column without waiting a round trip
+ *  for a retransmission. Overhead is (columns + rows) / (columns * rows),
+ *  a row or column of 1 sends no parity for that dimension. Parity is only
+ *  sent to peers on main or advanced profile that speak RIST GRE version 2,
+ *  receivers without FEC support ignore it. Can be changed at any time.
+ * @param ctx RIST sender ctx
+ * @param columns packets per row (L), 1 to 20, 0 together with rows to disable
+ * @param rows packets per column (D), 1 to 20, columns * rows at most 100
+ * @return 0 on success, -1 in case of error.
+ */
+RIST_API int rist_sender_fec_set(struct rist_ctx *ctx, uint32_t columns, uint32_t rows);
+
+/**
+ * @brief Set the number of transmit worker threads
+ *
+ * Moves encryption and sending of data packets and retransmissions off the
+ * protocol thread. Each data peer is assigned to the worker with the fewest
+ * peers, so with as many workers as peers every peer of a 2022-7 duplicated
+ * stream is sent from its own thread. The workers share the queued packets,
+ * nothing is copied before a worker picks it up. 0 (the default) sends
+ * everything from the protocol thread. Can only be set before starting.
+ *
+ * @param ctx RIST sender context
+ * @param count number of worker threads, at most 64
+ * @return 0 for success
+ */
+RIST_API int rist_sender_set_transmit_threads(struct rist_ctx *ctx, uint32_t count);
+
 /**
  * @brief Retrieve the current flow_id value
  *
@@ -32,6 +32,27 @@ struct rist_stats_sender_peer
 	double quality;
 	/* current RTT */
 	uint32_t rtt;
+	/* fields below were added in stats version 1 */
+	/* flow id (set by sender) */
+	uint32_t flow_id;
+	/* data (1) or rtcp (0) peer */
+	int is_data;
+	/* last and average RTT in ms */
+	double last_rtt;
+	double avg_rtt;
+	/* retries not sent: bloat protection, out of bandwidth, failed resend, already queued */
+	uint32_t bloat_skipped;
+	uint32_t bandwidth_skipped;
+	uint32_t retransmit_skipped;
+	uint32_t duplicate_skipped;
+	/* retries waiting to be sent */
+	size_t retry_buffer_size;
+	uint32_t cooldown_time;
+	/* sender queue */
+	size_t queue_slots;
+	size_t queue_memory;
+	uint64_t buffer_pool_hits;
+	uint64_t buffer_pool_misses;
 };
 
 struct rist_stats_receiver_flow
@@ -70,6 +91,46 @@ struct rist_stats_receiver_flow
 	uint64_t max_inter_packet_spacing;
 	/* avg rtt all non dead peers */
 	uint32_t rtt;
+	/* fields below were added in stats version 1 */
+	uint32_t dropped_late;
+	uint32_t dropped_full;
+	/* nacks sent */
+	uint32_t retries;
+	/* recovered after 2, 3, 4 and more retries */
+	uint32_t recovered_two_retries;
+	uint32_t recovered_three_retries;
+	uint32_t recovered_four_retries;
+	uint32_t recovered_more_retries;
+	uint32_t duplicates;
+	/* average time spent in the buffer (ticks) */
+	uint64_t avg_buffer_time;
+	/* missing queue */
+	uint32_t missing_queue;
+	uint32_t missing_queue_max;
+	/* receiver queue */
+	size_t queue_slots;
+	size_t queue_memory;
+	uint64_t buffer_pool_hits;
+	uint64_t buffer_pool_misses;
+	/* rebuilt from row/column parity */
+	uint32_t fec_recovered;
+};
+
+/* Running totals of a receiver flow since it was created */
+struct rist_receiver_flow_counters
+{
+	uint32_t flow_id;
+	uint64_t received;
+	/* holes found, less the ones given up on without asking for a retransmit */
+	uint64_t missing;
+	uint64_t recovered;
+	uint64_t fec_recovered;
+	uint64_t reordered;
+	uint64_t retries;
+	uint64_t duplicates;
+	uint64_t dropped_late;
+	uint64_t dropped_full;
+	uint64_t lost;
 };
 
 enum rist_stats_type
@@ -78,7 +139,17 @@ enum rist_stats_type
 	RIST_STATS_RECEIVER_FLOW
 };
 
-#define RIST_STATS_VERSION (0)
+/* 1: fields appended to rist_stats_sender_peer and rist_stats_receiver_flow */
+#define RIST_STATS_VERSION (1)
+
+enum rist_stats_format
+{
+	/* stats_json is filled in, the callback owns the container */
+	RIST_STATS_FORMAT_JSON,
+	/* Only the stats structs are filled in and stats_json is NULL. The container
+	 * belongs to librist and is only valid during the callback */
+	RIST_STATS_FORMAT_BINARY
+};
 
 struct rist_stats
 {
@@ -90,6 +161,9 @@ struct rist_stats
 		struct rist_stats_sender_peer sender_peer;
 		struct rist_stats_receiver_flow receiver_flow;
 	} stats;
+	/* set on RIST_STATS_FORMAT_BINARY containers, they belong to librist and
+	 * rist_stats_free leaves them alone */
+	bool library_owned;
 };
 
 
@@ -103,9 +177,47 @@ struct rist_stats
  */
 RIST_API int rist_stats_callback_set(struct rist_ctx *ctx, int statsinterval, int (*stats_cb)(void *arg, const struct rist_stats *stats_container), void *arg);
 
+/**
+ * @brief Choose what the stats callback receives
+ *
+ * RIST_STATS_FORMAT_BINARY skips building the JSON and allocating a container on every
+ * report, use rist_stats_to_json for the reports that need it.
+ *
+ * @param ctx RIST context
+ * @param format RIST_STATS_FORMAT_JSON (default) or RIST_STATS_FORMAT_BINARY
+ * @return 0 on success or non-zero on error.
+ */
+RIST_API int rist_stats_format_set(struct rist_ctx *ctx, enum rist_stats_format format);
+
+/**
+ * @brief Read the running totals of a receiver flow
+ *
+ * The counters are atomics with the thread owning the flow as only writer. They are read
+ * without taking the stats lock or stopping that thread, so they can be polled from any
+ * thread at any rate. The flow list lock is only held to keep the flow alive meanwhile.
+ *
+ * @param ctx RIST receiver context
+ * @param flow_id flow to read
+ * @param[out] counters filled in with the flow totals
+ * @return 0 on success, -1 on error or when there is no such flow
+ */
+RIST_API int rist_receiver_flow_counters_get(struct rist_ctx *ctx, uint32_t flow_id, struct rist_receiver_flow_counters *counters);
+
+/**
+ * @brief Serialize the stats structs of a container to JSON
+ *
+ * Per peer details of a receiver flow are only part of RIST_STATS_FORMAT_JSON reports.
+ *
+ * @param stats_container container as passed to the stats callback
+ * @return JSON string that must be free()'d, NULL on error
+ */
+RIST_API char *rist_stats_to_json(const struct rist_stats *stats_container);
+
 /**
  * @brief Free the rist_stats structure memory allocations
  *
+ * Containers of RIST_STATS_FORMAT_BINARY reports belong to librist and are left alone.
+ *
  * @return 0 on success or non-zero on error.
  */
 RIST_API int rist_stats_free(const struct rist_stats *stats_container);
@@ -0,0 +1,161 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "aes-ni.h"
+#include "psk.h"
+
+#include <cpuid.h>
+#include <immintrin.h>
+#include <string.h>
+
+// Counter blocks generated per pass: 8 VAES lanes of 2 blocks or 2 rounds of 8 AES-NI lanes
+#define RIST_AESNI_BATCH_BLOCKS 16
+
+static enum rist_aesni_impl aesni_detect(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_AES))
+		return RIST_AESNI_NONE;
+	enum rist_aesni_impl impl = RIST_AESNI_AES;
+#if HAVE_VAES
+	// VAES needs the OS to preserve the ymm registers
+	if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX) && __get_cpuid_max(0, NULL) >= 7) {
+		unsigned int xcr0, xcr0_hi;
+		__asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+		RIST_MARK_UNUSED(xcr0_hi);
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if ((xcr0 & 0x6) == 0x6 && (ebx & bit_AVX2) && (ecx & (1u << 9)))
+			impl = RIST_AESNI_VAES;
+	}
+#endif
+	return impl;
+}
+
+bool _librist_crypto_aesni_set_key(struct rist_aesni_key *k, const uint32_t w[], int key_size)
+{
+	k->impl = aesni_detect();
+	if (k->impl == RIST_AESNI_NONE)
+		return false;
+	k->rounds = key_size / 32 + 6;
+	// The schedule words are big endian packed, the instructions want the plain byte stream
+	for (int i = 0; i < 4 * (k->rounds + 1); i++) {
+		uint8_t *rk = &k->round_keys[i / 4][(i % 4) * 4];
+		rk[0] = (uint8_t)(w[i] >> 24);
+		rk[1] = (uint8_t)(w[i] >> 16);
+		rk[2] = (uint8_t)(w[i] >> 8);
+		rk[3] = (uint8_t)w[i];
+	}
+	return true;
+}
+
+__attribute__((target("aes,sse2")))
+static void aesni_keystream(const struct rist_aesni_key *k, __m128i blocks[], size_t n)
+{
+	__m128i rk[RIST_AESNI_MAX_ROUNDS + 1];
+	for (int r = 0; r <= k->rounds; r++)
+		rk[r] = _mm_loadu_si128((const __m128i *)k->round_keys[r]);
+	for (size_t base = 0; base < n; base += 8) {
+		__m128i *b = &blocks[base];
+		size_t lanes = (n - base) < 8 ? (n - base) : 8;
+		for (size_t i = 0; i < lanes; i++)
+			b[i] = _mm_xor_si128(b[i], rk[0]);
+		for (int r = 1; r < k->rounds; r++)
+			for (size_t i = 0; i < lanes; i++)
+				b[i] = _mm_aesenc_si128(b[i], rk[r]);
+		for (size_t i = 0; i < lanes; i++)
+			b[i] = _mm_aesenclast_si128(b[i], rk[k->rounds]);
+	}
+}
+
+#if HAVE_VAES
+/* blocks must have room for an even number of entries */
+__attribute__((target("vaes,avx2,aes")))
+static void vaes_keystream(const struct rist_aesni_key *k, __m128i blocks[], size_t n)
+{
+	__m256i rk[RIST_AESNI_MAX_ROUNDS + 1];
+	__m256i s[RIST_AESNI_BATCH_BLOCKS / 2];
+	size_t lanes = (n + 1) / 2;
+	for (int r = 0; r <= k->rounds; r++)
+		rk[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)k->round_keys[r]));
+	for (size_t i = 0; i < lanes; i++)
+		s[i] = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&blocks[2 * i]), rk[0]);
+	for (int r = 1; r < k->rounds; r++)
+		for (size_t i = 0; i < lanes; i++)
+			s[i] = _mm256_aesenc_epi128(s[i], rk[r]);
+	for (size_t i = 0; i < lanes; i++) {
+		s[i] = _mm256_aesenclast_epi128(s[i], rk[k->rounds]);
+		_mm256_storeu_si256((__m256i *)&blocks[2 * i], s[i]);
+	}
+}
+#endif
+
+static inline uint64_t aesni_load_be64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+__attribute__((target("aes,sse2")))
+void _librist_crypto_aesni_ctr(struct rist_crypto_ctr_job *jobs, size_t count)
+{
+	if (count == 0)
+		return;
+	const struct rist_aesni_key *k = &jobs[0].key->aesni;
+	__m128i blocks[RIST_AESNI_BATCH_BLOCKS];
+	uint8_t *dst[RIST_AESNI_BATCH_BLOCKS];
+	size_t dst_len[RIST_AESNI_BATCH_BLOCKS];
+	size_t j = 0;
+	size_t off = 0;
+	// 128 bit big endian counter, same increment as contrib/aes.c, mbedtls and the kernel
+	uint64_t ctr_hi = aesni_load_be64(&jobs[0].iv[0]);
+	uint64_t ctr_lo = aesni_load_be64(&jobs[0].iv[8]);
+
+	while (j < count) {
+		size_t n = 0;
+		while (n < RIST_AESNI_BATCH_BLOCKS && j < count) {
+			struct rist_crypto_ctr_job *job = &jobs[j];
+			if (off >= job->len) {
+				if (++j < count) {
+					ctr_hi = aesni_load_be64(&jobs[j].iv[0]);
+					ctr_lo = aesni_load_be64(&jobs[j].iv[8]);
+				}
+				off = 0;
+				continue;
+			}
+			blocks[n] = _mm_set_epi64x((long long)__builtin_bswap64(ctr_lo), (long long)__builtin_bswap64(ctr_hi));
+			dst[n] = &job->buf[off];
+			dst_len[n] = (job->len - off) < 16 ? (job->len - off) : 16;
+			n++;
+			off += 16;
+			if (++ctr_lo == 0)
+				ctr_hi++;
+		}
+		if (n == 0)
+			break;
+
+#if HAVE_VAES
+		if (k->impl == RIST_AESNI_VAES) {
+			if (n & 1)
+				blocks[n] = blocks[n - 1];
+			vaes_keystream(k, blocks, n);
+		} else
+#endif
+			aesni_keystream(k, blocks, n);
+
+		for (size_t i = 0; i < n; i++) {
+			if (dst_len[i] == 16) {
+				__m128i d = _mm_loadu_si128((const __m128i *)dst[i]);
+				_mm_storeu_si128((__m128i *)dst[i], _mm_xor_si128(d, blocks[i]));
+			} else {
+				uint8_t ks[16];
+				_mm_storeu_si128((__m128i *)ks, blocks[i]);
+				for (size_t b = 0; b < dst_len[i]; b++)
+					dst[i][b] ^= ks[b];
+			}
+		}
+	}
+}
@@ -0,0 +1,41 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef RIST_CRYPTO_AES_NI_H
+#define RIST_CRYPTO_AES_NI_H
+
+#include "config.h"
+#include "common/attributes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RIST_AESNI_MAX_ROUNDS 14
+
+enum rist_aesni_impl {
+	RIST_AESNI_NONE = 0,
+	RIST_AESNI_AES,
+	RIST_AESNI_VAES,
+};
+
+/* Round keys in the byte order the AES instructions expect */
+struct rist_aesni_key {
+	uint8_t round_keys[RIST_AESNI_MAX_ROUNDS + 1][16];
+	int rounds;
+	enum rist_aesni_impl impl;
+};
+
+struct rist_crypto_ctr_job;
+
+#if HAVE_AESNI
+/* Derives the round keys from a FIPS-197 key schedule (contrib/aes.c aes_key_setup), returns
+   false when the cpu has no AES instructions and the caller should use its own fallback */
+RIST_PRIV bool _librist_crypto_aesni_set_key(struct rist_aesni_key *k, const uint32_t w[], int key_size);
+/* CTR crypts the jobs in place, all jobs must use the same key. Counter blocks of consecutive
+   jobs are interleaved so short packets still keep the AES pipeline full */
+RIST_PRIV void _librist_crypto_aesni_ctr(struct rist_crypto_ctr_job *jobs, size_t count);
+#endif
+
+#endif
@@ -140,13 +140,18 @@ static void _librist_crypto_aes_key(struct rist_key *key)
 	default:
 		nettle_aes128_set_encrypt_key(&key->nettle_ctx.u.ctx128, aes_key);
     }
-#elif defined(LINUX_CRYPTO)
-    if (key->linux_crypto_ctx)
-		linux_crypto_set_key(aes_key, key->key_size / 8, key->linux_crypto_ctx);
-    else
-        aes_key_setup(aes_key, key->aes_key_sched, key->key_size);
 #else
     aes_key_setup(aes_key, key->aes_key_sched, key->key_size);
+    bool hw_aes = false;
+#if HAVE_AESNI
+    hw_aes = _librist_crypto_aesni_set_key(&key->aesni, key->aes_key_sched, key->key_size);
+#endif
+#if defined(LINUX_CRYPTO)
+    //The kernel costs a syscall per packet, only use it when the cpu has no AES instructions
+    if (!hw_aes && key->linux_crypto_ctx)
+		linux_crypto_set_key(aes_key, key->key_size / 8, key->linux_crypto_ctx);
+#endif
+    RIST_MARK_UNUSED(hw_aes);
 #endif
     key->used_times = 0;
 }
@@ -183,7 +188,7 @@ void _librist_crypto_aes_ctr(const uint8_t key[], int key_size, uint8_t iv[], co
 #endif
 }
 
-static void _librist_crypto_psk_aes_ctr(struct rist_key *key, const uint8_t inbuf[], uint8_t outbuf[], size_t payload_len)
+static void _librist_crypto_psk_ctr_crypt(struct rist_key *key, const uint8_t inbuf[], uint8_t outbuf[], size_t payload_len)
 {
 #if HAVE_MBEDTLS
 	mbedtls_aes_crypt_ctr(&key->mbedtls_aes_ctx, payload_len, &key->aes_offset, key->iv, key->strean_block, inbuf, outbuf);
@@ -202,14 +207,30 @@ static void _librist_crypto_psk_aes_ctr(struct rist_key *key, const uint8_t inbu
 		f = (nettle_cipher_func *)nettle_aes128_encrypt;
 	}
 	nettle_ctr_crypt(&key->nettle_ctx.u, f, AES_BLOCK_SIZE, key->iv,payload_len, outbuf, inbuf);
-#elif defined(LINUX_CRYPTO)
-	if (key->linux_crypto_ctx)
-		linux_crypto_decrypt(inbuf, outbuf, payload_len, key->iv, key->linux_crypto_ctx);
-	else
-		aes_decrypt_ctr(inbuf, payload_len, outbuf,	key->aes_key_sched, key->key_size, key->iv);
 #else
+#if HAVE_AESNI
+	if (key->aesni.impl != RIST_AESNI_NONE) {
+		struct rist_crypto_ctr_job job = { .key = key, .buf = outbuf, .len = payload_len };
+		memcpy(job.iv, key->iv, sizeof(job.iv));
+		if (outbuf != inbuf)
+			memcpy(outbuf, inbuf, payload_len);
+		_librist_crypto_aesni_ctr(&job, 1);
+		return;
+	}
+#endif
+#if defined(LINUX_CRYPTO)
+	if (key->linux_crypto_ctx) {
+		linux_crypto_decrypt(inbuf, outbuf, payload_len, key->iv, key->linux_crypto_ctx);
+		return;
+	}
+#endif
 	aes_decrypt_ctr(inbuf, payload_len, outbuf, key->aes_key_sched, key->key_size, key->iv);
 #endif
+}
+
+static void _librist_crypto_psk_aes_ctr(struct rist_key *key, const uint8_t inbuf[], uint8_t outbuf[], size_t payload_len)
+{
+	_librist_crypto_psk_ctr_crypt(key, inbuf, outbuf, payload_len);
     key->used_times++;
 }
 
@@ -258,10 +279,16 @@ void _librist_crypto_psk_decrypt(struct rist_key *key, uint8_t nonce[4], uint32_
     return;
 }
 
+bool _librist_crypto_psk_encrypt_rekey_due(const struct rist_key *key)
+{
+    uint32_t nonce_val;
+    memcpy(&nonce_val, key->gre_nonce, sizeof(nonce_val));
+    return !nonce_val || (key->used_times +1) > RIST_AES_KEY_REUSE_TIMES || (key->key_rotation > 0 && key->used_times >= key->key_rotation);
+}
+
 void _librist_crypto_psk_encrypt(struct rist_key *key, uint32_t seq_nbe, uint8_t gre_version,const uint8_t inbuf[], uint8_t outbuf[], size_t payload_len)
 {
-    uint32_t nonce_val = *((uint32_t *)key->gre_nonce);
-    if (!nonce_val || (key->used_times +1) > RIST_AES_KEY_REUSE_TIMES || (key->key_rotation > 0 && key->used_times >= key->key_rotation)) {
+    if (_librist_crypto_psk_encrypt_rekey_due(key)) {
         _librist_crypto_psk_generate_nonce(key);
         _librist_crypto_aes_key(key);
     }
@@ -273,6 +300,45 @@ void _librist_crypto_psk_encrypt(struct rist_key *key, uint32_t seq_nbe, uint8_t
     return;
 }
 
+/* Does the nonce/key rotation bookkeeping of _librist_crypto_psk_encrypt and hands out the
+   counter block, the actual crypt is left to a later _librist_crypto_psk_ctr_batch call.
+   Callers must flush their pending jobs for this key first when a rekey is due. */
+void _librist_crypto_psk_encrypt_prepare(struct rist_key *key, uint32_t seq_nbe, uint8_t gre_version, uint8_t iv[AES_BLOCK_SIZE])
+{
+    if (_librist_crypto_psk_encrypt_rekey_due(key)) {
+        _librist_crypto_psk_generate_nonce(key);
+        _librist_crypto_aes_key(key);
+    }
+    _librist_crypto_psk_prepare_iv(key, gre_version, seq_nbe);
+    memcpy(iv, key->iv, AES_BLOCK_SIZE);
+    key->used_times++;
+}
+
+void _librist_crypto_psk_ctr_batch(struct rist_crypto_ctr_job *jobs, size_t count)
+{
+	size_t i = 0;
+	while (i < count) {
+		struct rist_key *key = jobs[i].key;
+#if HAVE_AESNI
+		if (key->aesni.impl != RIST_AESNI_NONE) {
+			// Runs of the same key share one interleaved keystream pass
+			size_t end = i + 1;
+			while (end < count && jobs[end].key == key)
+				end++;
+			_librist_crypto_aesni_ctr(&jobs[i], end - i);
+			i = end;
+			continue;
+		}
+#endif
+		memcpy(key->iv, jobs[i].iv, AES_BLOCK_SIZE);
+#if HAVE_MBEDTLS
+		key->aes_offset = 0;
+#endif
+		_librist_crypto_psk_ctr_crypt(key, jobs[i].buf, jobs[i].buf, jobs[i].len);
+		i++;
+	}
+}
+
 int _librist_crypto_psk_set_passphrase(struct rist_key *key, const uint8_t *passsphrase, size_t passphrase_len) {
 	if (passphrase_len > sizeof(key->password) -1) {
 		return -1;
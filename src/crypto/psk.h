@@ -21,6 +21,7 @@
 #endif
 #include "contrib/aes.h"
 #endif
+#include "aes-ni.h"
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
@@ -43,6 +44,9 @@ struct rist_key {
 	struct linux_crypto *linux_crypto_ctx;
 #endif
 	uint32_t aes_key_sched[60];//Do we still need this fallback?
+#if HAVE_AESNI
+	struct rist_aesni_key aesni;
+#endif
 	uint32_t key_rotation;
     uint64_t used_times;
 	uint8_t password[128];
@@ -52,11 +56,22 @@ struct rist_key {
 	bool odd;
 };
 
+/* One packet of a batched CTR pass, buf is crypted in place */
+struct rist_crypto_ctr_job {
+	struct rist_key *key;
+	uint8_t iv[AES_BLOCK_SIZE];
+	uint8_t *buf;
+	size_t len;
+};
+
 RIST_PRIV int _librist_crypto_psk_rist_key_init(struct rist_key *key, uint32_t key_size, uint32_t rotation, const char *password, bool odd);
 RIST_PRIV int _librist_crypto_psk_rist_key_destroy(struct rist_key *key);
 RIST_PRIV int _librist_crypto_psk_rist_key_clone(struct rist_key *key_in, struct rist_key *key_out);
 RIST_PRIV void _librist_crypto_psk_decrypt(struct rist_key *key, uint8_t nonce[4], uint32_t seq_nbe, uint8_t gre_version, const uint8_t inbuf[], uint8_t outbuf[], size_t payload_len);
 RIST_PRIV void _librist_crypto_psk_encrypt(struct rist_key *key, uint32_t seq_nbe, uint8_t gre_version, const uint8_t inbuf[], uint8_t outbuf[], size_t payload_len);
+RIST_PRIV bool _librist_crypto_psk_encrypt_rekey_due(const struct rist_key *key);
+RIST_PRIV void _librist_crypto_psk_encrypt_prepare(struct rist_key *key, uint32_t seq_nbe, uint8_t gre_version, uint8_t iv[AES_BLOCK_SIZE]);
+RIST_PRIV void _librist_crypto_psk_ctr_batch(struct rist_crypto_ctr_job *jobs, size_t count);
 RIST_PRIV void _librist_crypto_psk_encrypt_continue(struct rist_key *key, const uint8_t inbuf[], uint8_t outbuf[], size_t payload_len);
 RIST_PRIV int _librist_crypto_psk_set_passphrase(struct rist_key *key, const uint8_t *passsphrase, size_t passphrase_len);
 RIST_PRIV void _librist_crypto_psk_get_passphrase(struct rist_key *key, const uint8_t **passphrase, size_t *passphrase_len);
@@ -11,17 +11,86 @@
 #include "udp-private.h"
 #include "proto/rist_time.h"
 #include <assert.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static inline unsigned missing_ctz64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(v);
+#else
+	unsigned n = 0;
+	while (!(v & 1)) {
+		v >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+static inline void missing_bit_set(struct rist_flow *f, size_t idx)
+{
+	f->missing_bitmap[idx / 64] |= (uint64_t)1 << (idx % 64);
+	f->missing_summary[idx / 4096] |= (uint64_t)1 << ((idx / 64) % 64);
+}
+
+static inline bool missing_bit_test(struct rist_flow *f, size_t idx)
+{
+	return (f->missing_bitmap[idx / 64] >> (idx % 64)) & 1;
+}
+
+void rist_receiver_missing_remove(struct rist_flow *f, size_t idx)
+{
+	size_t word = idx / 64;
+	if (f->missing[idx].nack_count != 0)
+		f->missing_counter--;
+	f->missing_bitmap[word] &= ~((uint64_t)1 << (idx % 64));
+	if (!f->missing_bitmap[word])
+		f->missing_summary[word / 64] &= ~((uint64_t)1 << (word % 64));
+}
+
+/* Returns the first outstanding slot at or after idx, receiver_queue_max if there is none */
+size_t rist_receiver_missing_next(struct rist_flow *f, size_t idx)
+{
+	const size_t words = f->receiver_queue_max / 64;
+	if (idx >= f->receiver_queue_max)
+		return f->receiver_queue_max;
+	size_t word = idx / 64;
+	uint64_t bits = f->missing_bitmap[word] & (UINT64_MAX << (idx % 64));
+	if (bits)
+		return word * 64 + missing_ctz64(bits);
+	word++;
+	while (word < words) {
+		/* Skip empty bitmap words using the summary */
+		uint64_t summary = f->missing_summary[word / 64] & (UINT64_MAX << (word % 64));
+		if (!summary) {
+			word = (word / 64 + 1) * 64;
+			continue;
+		}
+		word = (word / 64) * 64 + missing_ctz64(summary);
+		return word * 64 + missing_ctz64(f->missing_bitmap[word]);
+	}
+	return f->receiver_queue_max;
+}
 
 void rist_receiver_missing(struct rist_flow *f, struct rist_peer *peer,uint64_t nack_time, uint32_t seq, uint64_t rtt)
 {
-	struct rist_missing_buffer *m = calloc(1, sizeof(*m));
+	size_t idx = seq & (f->receiver_queue_max - 1);
+	struct rist_missing_buffer *m = &f->missing[idx];
 	uint64_t now = timestampNTP_u64();
 	if (nack_time > now)
 		nack_time = now;
 	if (nack_time < (now - f->recovery_buffer_ticks))
 		nack_time = now;
+
+	/* A stale hole from a previous lap of the ring gets overwritten */
+	if (missing_bit_test(f, idx) && m->nack_count != 0)
+		f->missing_counter--;
+
 	m->seq = seq;
 	m->insertion_time = nack_time;
+	m->nack_count = 0;
 
 	m->next_nack = now + rtt;
 	m->peer = peer;
@@ -32,15 +101,9 @@ void rist_receiver_missing(struct rist_flow *f, struct rist_peer *peer,uint64_t
 			"with deadline in %" PRIu64 "ms (queue=%d), last_seq_found %"PRIu32"\n",
 		seq, m->next_nack > now? (m->next_nack - now)/ RIST_CLOCK: 0, f->missing_counter, f->last_seq_found);
 
-	m->next = NULL;
-	// Insert it at the end of the queue
-	if (!f->missing) {
-		f->missing = m;
-		f->missing_tail = m;
-	} else {
-		f->missing_tail->next = m;
-		f->missing_tail = m;
-	}
+	missing_bit_set(f, idx);
+	// The flow's NACK timer fires for the earliest outstanding deadline
+	rist_timer_arm_before(f->timers, &f->nack_timer, m->next_nack);
 }
 
 void empty_receiver_queue(struct rist_flow *f, struct rist_common_ctx *ctx)
@@ -65,20 +128,269 @@ void empty_receiver_queue(struct rist_flow *f, struct rist_common_ctx *ctx)
 
 void rist_flush_missing_flow_queue(struct rist_flow *flow)
 {
-	struct rist_missing_buffer *current = flow->missing;
-	while (current)
-	{
-		struct rist_missing_buffer *delme = current;
-		current = current->next;
-		free(delme);
-		delme = NULL;
+	if (flow->missing_bitmap) {
+		size_t words = flow->receiver_queue_max / 64;
+		memset(flow->missing_bitmap, 0, words * sizeof(*flow->missing_bitmap));
+		memset(flow->missing_summary, 0, ((words + 63) / 64) * sizeof(*flow->missing_summary));
 	}
-	flow->missing = NULL;
 	flow->missing_counter = 0;
 }
 
+/* Called by the thread that enqueues into the flow, with f->mutex held so the output
+ * thread is parked. Slots are addressed by seq, so every entry is rehashed into the
+ * larger ring rather than copied */
+int rist_receiver_queue_grow(struct rist_flow *f, size_t slots)
+{
+	const size_t cap = f->short_seq ? UINT16_SIZE : RIST_SERVER_QUEUE_BUFFERS;
+	const size_t old_max = f->receiver_queue_max;
+	size_t new_max = old_max;
+	while (new_max < slots && new_max < cap)
+		new_max <<= 1;
+	if (new_max == old_max)
+		return -1;
+
+	const size_t words = new_max / 64;
+	struct rist_buffer **queue = calloc(new_max, sizeof(*queue));
+	struct rist_missing_buffer *missing = calloc(new_max, sizeof(*missing));
+	uint64_t *bitmap = calloc(words, sizeof(*bitmap));
+	uint64_t *summary = calloc((words + 63) / 64, sizeof(*summary));
+	if (!queue || !missing || !bitmap || !summary) {
+		free(queue);
+		free(missing);
+		free(bitmap);
+		free(summary);
+		return -1;
+	}
+
+	for (size_t i = 0; i < old_max; i++) {
+		struct rist_buffer *b = f->receiver_queue[i];
+		if (b)
+			queue[b->seq & (new_max - 1)] = b;
+	}
+
+	for (size_t i = rist_receiver_missing_next(f, 0); i < old_max; i = rist_receiver_missing_next(f, i + 1)) {
+		size_t n = f->missing[i].seq & (new_max - 1);
+		if ((bitmap[n / 64] >> (n % 64)) & 1) {
+			// Stale entry from a previous lap landing on the same slot
+			if (missing[n].nack_count != 0)
+				f->missing_counter--;
+		}
+		missing[n] = f->missing[i];
+		bitmap[n / 64] |= (uint64_t)1 << (n % 64);
+		summary[n / 4096] |= (uint64_t)1 << ((n / 64) % 64);
+	}
+
+	/* The output index is a slot, turn it back into the seq it stands for */
+	size_t output_idx = atomic_load_explicit(&f->receiver_queue_output_idx, memory_order_acquire);
+	uint32_t output_seq = f->last_seq_output + 1;
+	output_seq += (uint32_t)((output_idx - output_seq) & (old_max - 1));
+	if (f->short_seq)
+		output_seq = (uint16_t)output_seq;
+
+	free(f->receiver_queue);
+	free(f->missing);
+	free(f->missing_bitmap);
+	free(f->missing_summary);
+	f->receiver_queue = queue;
+	f->missing = missing;
+	f->missing_bitmap = bitmap;
+	f->missing_summary = summary;
+	f->receiver_queue_max = new_max;
+	atomic_store_explicit(&f->receiver_queue_output_idx, output_seq & (new_max - 1), memory_order_release);
+
+	rist_log_priv2(f->logging_settings, RIST_LOG_INFO, "FLOW #%"PRIu32" receiver queue grown from %zu to %zu slots\n",
+		f->flow_id, old_max, new_max);
+	return 0;
+}
+
+size_t rist_receiver_queue_footprint(struct rist_flow *f)
+{
+	size_t words = f->receiver_queue_max / 64;
+	return f->receiver_queue_max * (sizeof(*f->receiver_queue) + sizeof(*f->missing)) +
+		(words + (words + 63) / 64) * sizeof(uint64_t);
+}
+
+static inline size_t flow_hash(uint32_t key)
+{
+	// Knuth multiplicative hash folded down, flow ids are even so the low bits alone would waste half the slots
+	uint32_t h = key * 2654435761u;
+	return h ^ (h >> 16);
+}
+
+/* Linear probing removal shifts later entries of the run back into the hole, an entry
+ * at j whose home slot is at or before the hole may take its place */
+static inline bool probe_can_fill(size_t home, size_t hole, size_t j, size_t mask)
+{
+	return ((j - home) & mask) >= ((j - hole) & mask);
+}
+
+static void flow_table_insert(struct rist_flow **table, size_t size, struct rist_flow *f)
+{
+	size_t i = flow_hash(f->flow_id) & (size - 1);
+	while (table[i])
+		i = (i + 1) & (size - 1);
+	table[i] = f;
+}
+
+/* Makes room for one more flow, called with flows_lock held */
+static int flow_table_reserve(struct rist_common_ctx *cctx)
+{
+	if ((cctx->flow_table_count + 1) * 2 <= cctx->flow_table_size)
+		return 0;
+	size_t size = cctx->flow_table_size ? cctx->flow_table_size * 2 : 16;
+	struct rist_flow **table = calloc(size, sizeof(*table));
+	if (!table)
+		return -1;
+	for (struct rist_flow *f = cctx->FLOWS; f != NULL; f = f->next)
+		flow_table_insert(table, size, f);
+	free(cctx->flow_table);
+	cctx->flow_table = table;
+	cctx->flow_table_size = size;
+	return 0;
+}
+
+static void flow_table_remove(struct rist_common_ctx *cctx, struct rist_flow *f)
+{
+	if (!cctx->flow_table)
+		return;
+	const size_t mask = cctx->flow_table_size - 1;
+	struct rist_flow **table = cctx->flow_table;
+	size_t hole = flow_hash(f->flow_id) & mask;
+	while (table[hole] != f) {
+		if (!table[hole])
+			return;
+		hole = (hole + 1) & mask;
+	}
+	for (size_t j = (hole + 1) & mask; table[j]; j = (j + 1) & mask) {
+		if (probe_can_fill(flow_hash(table[j]->flow_id) & mask, hole, j, mask)) {
+			table[hole] = table[j];
+			hole = j;
+		}
+	}
+	table[hole] = NULL;
+	cctx->flow_table_count--;
+}
+
+struct rist_flow *rist_flow_table_lookup(struct rist_common_ctx *cctx, uint32_t flow_id)
+{
+	if (!cctx->flow_table)
+		return NULL;
+	const size_t mask = cctx->flow_table_size - 1;
+	for (size_t i = flow_hash(flow_id) & mask; cctx->flow_table[i]; i = (i + 1) & mask) {
+		if (cctx->flow_table[i]->flow_id == flow_id)
+			return cctx->flow_table[i];
+	}
+	return NULL;
+}
+
+static void flow_peer_set_insert(struct rist_flow_peer_slot *set, size_t size, struct rist_peer *p, size_t idx)
+{
+	size_t i = flow_hash(p->adv_peer_id) & (size - 1);
+	while (set[i].peer)
+		i = (i + 1) & (size - 1);
+	set[i].peer = p;
+	set[i].idx = idx;
+}
+
+/* Slot holding p, SIZE_MAX if it is not a member */
+static size_t flow_peer_set_find(struct rist_flow *f, struct rist_peer *p)
+{
+	if (!f->peer_set)
+		return SIZE_MAX;
+	const size_t mask = f->peer_set_size - 1;
+	for (size_t i = flow_hash(p->adv_peer_id) & mask; f->peer_set[i].peer; i = (i + 1) & mask) {
+		if (f->peer_set[i].peer == p)
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+static int flow_add_peer(struct rist_flow *f, struct rist_peer *p)
+{
+	if ((f->peer_lst_len + 1) * 2 > f->peer_set_size) {
+		size_t size = f->peer_set_size ? f->peer_set_size * 2 : 8;
+		struct rist_flow_peer_slot *set = calloc(size, sizeof(*set));
+		if (!set)
+			return -1;
+		for (size_t i = 0; i < f->peer_lst_len; i++)
+			flow_peer_set_insert(set, size, f->peer_lst[i], i);
+		free(f->peer_set);
+		f->peer_set = set;
+		f->peer_set_size = size;
+	}
+	struct rist_peer **peer_lst = realloc(f->peer_lst, (f->peer_lst_len + 1) * sizeof(*f->peer_lst));
+	if (!peer_lst)
+		return -1;
+	f->peer_lst = peer_lst;
+	f->peer_lst[f->peer_lst_len] = p;
+	flow_peer_set_insert(f->peer_set, f->peer_set_size, p, f->peer_lst_len);
+	f->peer_lst_len++;
+	return 0;
+}
+
+bool rist_flow_remove_peer(struct rist_flow *f, struct rist_peer *p)
+{
+	size_t hole = flow_peer_set_find(f, p);
+	if (hole == SIZE_MAX)
+		return false;
+	const size_t mask = f->peer_set_size - 1;
+	struct rist_flow_peer_slot *set = f->peer_set;
+	size_t idx = set[hole].idx;
+	for (size_t j = (hole + 1) & mask; set[j].peer; j = (j + 1) & mask) {
+		if (probe_can_fill(flow_hash(set[j].peer->adv_peer_id) & mask, hole, j, mask)) {
+			set[hole] = set[j];
+			hole = j;
+		}
+	}
+	set[hole].peer = NULL;
+
+	// The last member takes the freed spot in peer_lst
+	size_t last = f->peer_lst_len - 1;
+	if (idx != last) {
+		f->peer_lst[idx] = f->peer_lst[last];
+		set[flow_peer_set_find(f, f->peer_lst[idx])].idx = idx;
+	}
+	if (f->peer_lst_len > 1) {
+		f->peer_lst = realloc(f->peer_lst, sizeof(*f->peer_lst) * last);
+		f->peer_lst_len--;
+	} else {
+		free(f->peer_lst);
+		f->peer_lst_len = 0;
+		f->peer_lst = NULL;
+	}
+	return true;
+}
+
+/* The flow keeps counters on cache lines of their own, so it is allocated cache line aligned */
+static struct rist_flow *flow_alloc(void)
+{
+	void *f = NULL;
+#ifdef _WIN32
+	f = _aligned_malloc(sizeof(struct rist_flow), RIST_CACHE_LINE_SIZE);
+#else
+	if (posix_memalign(&f, RIST_CACHE_LINE_SIZE, sizeof(struct rist_flow)) != 0)
+		f = NULL;
+#endif
+	if (f)
+		memset(f, 0, sizeof(struct rist_flow));
+	return f;
+}
+
+static void flow_free(struct rist_flow *f)
+{
+#ifdef _WIN32
+	_aligned_free(f);
+#else
+	free(f);
+#endif
+}
+
 void rist_delete_flow(struct rist_receiver *ctx, struct rist_flow *f)
 {
+	// Take the flow away from its worker before tearing it down
+	rist_receiver_worker_detach_flow(f);
+	rist_timer_cancel(&f->checks_timer);
+	rist_timer_cancel(&f->nack_timer);
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Triggering data output thread termination\n");
 	//This needs to be before the lock, as we may (happens rarely) fail to acquire it at all, due to output thread
 	//locking/unlocking too quickly.
@@ -129,62 +441,77 @@ void rist_delete_flow(struct rist_receiver *ctx, struct rist_flow *f)
 	f->peer_lst_len = 0;
 	free(f->peer_lst);
 	f->peer_lst = NULL;
+	free(f->peer_set);
+	f->peer_set = NULL;
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Deleting missing queue elements\n");
 	/* Delete all missing queue elements (if any) */
 	rist_flush_missing_flow_queue(f);
+	free(f->missing);
+	free(f->missing_bitmap);
+	free(f->missing_summary);
+	rist_fec_decoder_free(f->fec);
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Deleting output buffer data\n");
 	/* Delete all buffer data (if any) */
 	empty_receiver_queue(f, &ctx->common);
+	free(f->receiver_queue);
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Freeing data fifo queue\n");
-	for (size_t i = 0; i < ctx->fifo_queue_size; i++)
-	{
-		if (f->dataout_fifo_queue[i])
+	/* Only the unread slots are still ours, the reader does not clear the ones it claimed */
+	if (ctx->fifo_queue_size) {
+		const size_t mask = ctx->fifo_queue_size - 1;
+		size_t write_index = atomic_load_explicit(&f->dataout_fifo_queue_write_index, memory_order_acquire);
+		for (size_t i = atomic_load_explicit(&f->dataout_fifo_queue_read_index, memory_order_acquire); i != write_index; i = (i + 1) & mask)
 		{
-			free_data_block(&f->dataout_fifo_queue[i]);
+			if (f->dataout_fifo_queue[i])
+			{
+				free_data_block(&f->dataout_fifo_queue[i]);
+			}
 		}
 	}
 	free(f->dataout_fifo_queue);
 	// Delete flow
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Deleting flow\n");
-	struct rist_flow **prev_flow = &ctx->common.FLOWS;
-	struct rist_flow *current_flow = *prev_flow;
-	while (current_flow)
-	{
-		if (current_flow == f) {
-			*prev_flow = current_flow->next;
-			free(current_flow);
-			current_flow = NULL;
-			break;
-		}
-		prev_flow = &current_flow->next;
-		current_flow = current_flow->next;
-	}
+	pthread_mutex_lock(&ctx->common.flows_lock);
+	flow_table_remove(&ctx->common, f);
+	if (f->prev)
+		f->prev->next = f->next;
+	else
+		ctx->common.FLOWS = f->next;
+	if (f->next)
+		f->next->prev = f->prev;
+	else
+		ctx->common.FLOWS_tail = f->prev;
+	flow_free(f);
+	pthread_mutex_unlock(&ctx->common.flows_lock);
 
 }
 
-static void rist_flow_append(struct rist_flow **FLOWS, struct rist_flow *f)
+/* Called with flows_lock held, after flow_table_reserve */
+static void rist_flow_append(struct rist_common_ctx *cctx, struct rist_flow *f)
 {
-	if (*FLOWS == NULL) {
-		// First entry
-		*FLOWS = f;
-		return;
-	}
-
-	// Append
-	struct rist_flow *last = *FLOWS;
-	while (last->next) {
-		last = last->next;
-	}
-
-	last->next = f;
+	f->prev = cctx->FLOWS_tail;
+	if (cctx->FLOWS_tail)
+		cctx->FLOWS_tail->next = f;
+	else
+		cctx->FLOWS = f;
+	cctx->FLOWS_tail = f;
+	flow_table_insert(cctx->flow_table, cctx->flow_table_size, f);
+	cctx->flow_table_count++;
 }
 
-static struct rist_flow *create_flow(struct rist_receiver *ctx, uint32_t flow_id)
+static struct rist_flow *create_flow(struct rist_receiver *ctx, uint32_t flow_id, struct rist_peer *p)
 {
-	struct rist_flow *f = calloc(1, sizeof(*f));
+	pthread_mutex_lock(&ctx->common.flows_lock);
+	int reserved = flow_table_reserve(&ctx->common);
+	pthread_mutex_unlock(&ctx->common.flows_lock);
+	if (reserved != 0) {
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not grow the flow table, OOM\n");
+		return NULL;
+	}
+
+	struct rist_flow *f = flow_alloc();
 	if (!f) {
 		rist_log_priv(&ctx->common, RIST_LOG_ERROR,
 			"Could not create receiver buffer of size %d MB, OOM\n", sizeof(*f) / 1000000);
@@ -194,11 +521,40 @@ static struct rist_flow *create_flow(struct rist_receiver *ctx, uint32_t flow_id
 	f->flow_id = flow_id;
 	f->receiver_id = ctx->id;
 	f->stats_next_time = timestampNTP_u64();
+	rist_receiver_flow_timers_init(ctx, f);
 	f->max_output_jitter = ctx->common.rist_max_jitter;
 	f->dataout_fifo_queue = calloc(ctx->fifo_queue_size, sizeof(*f->dataout_fifo_queue));
+
+	size_t queue_cap = RIST_SERVER_QUEUE_BUFFERS;
+	if (ctx->common.profile < RIST_PROFILE_ADVANCED) {
+		f->short_seq = true;
+		queue_cap = UINT16_SIZE;
+	}
+	// Start out sized for the peer's bitrate and buffer, receiver_enqueue grows it when needed
+	f->receiver_queue_max = rist_queue_slots_for(p->config.recovery_maxbitrate, p->config.recovery_length_max, queue_cap);
+
+	f->receiver_queue = calloc(f->receiver_queue_max, sizeof(*f->receiver_queue));
+	f->missing = calloc(f->receiver_queue_max, sizeof(*f->missing));
+	f->missing_bitmap = calloc(f->receiver_queue_max / 64, sizeof(*f->missing_bitmap));
+	f->missing_summary = calloc((f->receiver_queue_max / 64 + 63) / 64, sizeof(*f->missing_summary));
+	if (!f->receiver_queue || !f->missing || !f->missing_bitmap || !f->missing_summary) {
+		free(f->receiver_queue);
+		free(f->missing);
+		free(f->missing_bitmap);
+		free(f->missing_summary);
+		free(f->dataout_fifo_queue);
+		flow_free(f);
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not allocate receiver queue, OOM\n");
+		return NULL;
+	}
+
 	int ret = pthread_cond_init(&f->condition, NULL);
 	if (ret) {
-		free(f);
+		free(f->receiver_queue);
+		free(f->missing);
+		free(f->missing_bitmap);
+		free(f->missing_summary);
+		flow_free(f);
 		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Error %d calling pthread_cond_init\n", ret);
 		return NULL;
 	}
@@ -206,7 +562,11 @@ static struct rist_flow *create_flow(struct rist_receiver *ctx, uint32_t flow_id
 	ret = pthread_mutex_init(&f->mutex, NULL);
 	if (ret){
 		pthread_cond_destroy(&f->condition);
-		free(f);
+		free(f->receiver_queue);
+		free(f->missing);
+		free(f->missing_bitmap);
+		free(f->missing_summary);
+		flow_free(f);
 		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Error %d calling pthread_mutex_init\n", ret);
 		return NULL;
 	}
@@ -222,7 +582,7 @@ static struct rist_flow *create_flow(struct rist_receiver *ctx, uint32_t flow_id
 
 	/* Append flow to list */
 	pthread_mutex_lock(&ctx->common.flows_lock);
-	rist_flow_append(&ctx->common.FLOWS, f);
+	rist_flow_append(&ctx->common, f);
 	pthread_mutex_unlock(&ctx->common.flows_lock);
 	f->logging_settings = ctx->common.logging_settings;
 
@@ -231,8 +591,11 @@ static struct rist_flow *create_flow(struct rist_receiver *ctx, uint32_t flow_id
 
 static bool flow_has_peer(struct rist_flow *f, uint32_t flow_id, uint32_t peer_id)
 {
-	for (size_t j = 0; j < f->peer_lst_len; j++) {
-		struct rist_peer *p = f->peer_lst[j];
+	if (!f->peer_set)
+		return false;
+	const size_t mask = f->peer_set_size - 1;
+	for (size_t i = flow_hash(peer_id) & mask; f->peer_set[i].peer; i = (i + 1) & mask) {
+		struct rist_peer *p = f->peer_set[i].peer;
 		if (p->adv_flow_id == flow_id && p->adv_peer_id == peer_id) {
 			return true;
 		}
@@ -250,11 +613,9 @@ int rist_receiver_associate_flow(struct rist_peer *p, uint32_t flow_id)
 	struct rist_flow *f;
 	if (ctx->common.profile > RIST_PROFILE_SIMPLE)
 	{
-		for (f = ctx->common.FLOWS; f != NULL; f = f->next) {
-			if (f->flow_id == flow_id) {
-				break;
-			}
-		}
+		pthread_mutex_lock(&ctx->common.flows_lock);
+		f = rist_flow_table_lookup(&ctx->common, flow_id);
+		pthread_mutex_unlock(&ctx->common.flows_lock);
 	} else
 	{
 		if (!p->parent) {
@@ -266,7 +627,7 @@ int rist_receiver_associate_flow(struct rist_peer *p, uint32_t flow_id)
 
 	/* create flow if necessary */
 	if (!f) {
-		f = create_flow(ctx, flow_id);
+		f = create_flow(ctx, flow_id, p);
 		ret = 1;
 		if (!f) {
 			return -1;
@@ -274,15 +635,9 @@ int rist_receiver_associate_flow(struct rist_peer *p, uint32_t flow_id)
 		if (p->config.timing_mode == RIST_TIMING_MODE_RTC)
 			f->rtc_timing_mode = true;
 
-		if (ctx->common.profile < RIST_PROFILE_ADVANCED) {
-			f->short_seq = true;
-			f->receiver_queue_max = UINT16_SIZE;
-		}
-		else
-			f->receiver_queue_max = RIST_SERVER_QUEUE_BUFFERS;
-
 		f->recovery_buffer_ticks = p->recovery_buffer_ticks;
 		rist_log_priv(&ctx->common, RIST_LOG_INFO, "FLOW #%"PRIu32" created (short=%d)\n", flow_id, f->short_seq);
+		rist_receiver_worker_attach_flow(ctx, f);
 	} else {
 		/* double check that this peer is not a member of this flow already */
 		if (flow_has_peer(f, flow_id, p->adv_peer_id)) {
@@ -314,14 +669,12 @@ int rist_receiver_associate_flow(struct rist_peer *p, uint32_t flow_id)
 		f->missing_counter_max = p->missing_counter_max;
 
 	/* now assign flow to peer and add to list */
-	p->flow = f;
 	p->adv_flow_id = flow_id;
-	if (ret == 1) {
-		// TODO: lock the list?
-		f->peer_lst = realloc(f->peer_lst, (f->peer_lst_len + 1) * sizeof(*f->peer_lst));
-		f->peer_lst[f->peer_lst_len] = p;
-		f->peer_lst_len++;
+	if (ret == 1 && flow_add_peer(f, p) != 0) {
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "FLOW #%"PRIu32": could not add peer %"PRIu32", OOM\n", flow_id, p->adv_peer_id);
+		return -1;
 	}
+	p->flow = f;
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO,
 		"Peer with id #%u associated with flow #%" PRIu64 "\n", p->adv_peer_id, flow_id);
@@ -6,6 +6,7 @@
  */
 
 #include "common/attributes.h"
+#include "config.h"
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -31,6 +32,9 @@ typedef unsigned long int nfds_t;
 
 #else
 # include <poll.h>
+# if HAVE_EPOLL
+#  include <sys/epoll.h>
+# endif
 #endif
 
 #include "stdio-shim.h"
@@ -39,6 +43,9 @@ typedef unsigned long int nfds_t;
 #include "pthread-shim.h"
 #include "librist/udpsocket.h"
 
+/* Maximum number of ready events fetched per epoll_wait call */
+#define EVSOCKET_EPOLL_MAX_EVENTS 128
+
 struct evsocket_event {
 	int fd;
 	short events;
@@ -46,6 +53,9 @@ struct evsocket_event {
 	void (*err_callback)(struct evsocket_ctx *ctx, int fd, short revents, void *arg);
 	void *arg;
 	struct evsocket_event *next;
+#if HAVE_EPOLL
+	int deleted;
+#endif
 };
 
 struct evsocket_ctx {
@@ -57,6 +67,12 @@ struct evsocket_ctx {
 	struct evsocket_event *_array;
 	int giveup;
 	struct evsocket_ctx *next;
+#if HAVE_EPOLL
+	int epfd;
+	/* events deleted while they may still be referenced by a pending epoll result */
+	struct evsocket_event *garbage;
+	struct epoll_event ep_events[EVSOCKET_EPOLL_MAX_EVENTS];
+#endif
 };
 #if !defined(_WIN32) || HAVE_PTHREADS
 static pthread_mutex_t ctx_list_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -121,22 +137,48 @@ struct evsocket_event *evsocket_addevent(struct evsocket_ctx *ctx, int fd, short
 	e->err_callback = err_callback;
 	e->arg = arg;
 
+#if HAVE_EPOLL
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = ((events & POLLIN) ? EPOLLIN : 0) | ((events & POLLOUT) ? EPOLLOUT : 0);
+	ev.data.ptr = e;
+	if (epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		rist_log_priv3( RIST_LOG_ERROR, "libevsocket, evsocket_addevent: epoll_ctl failed for fd %d, error = %d\n",
+			fd, errno);
+		free(e);
+		return NULL;
+	}
+	e->deleted = 0;
+	e->next = NULL;
+#else
 	ctx->changed = 1;
 
 	e->next = ctx->events;
 	ctx->events = e;
+#endif
 	ctx->n_events++;
 	return e;
 }
 
 void evsocket_delevent(struct evsocket_ctx *ctx, struct evsocket_event *e)
 {
-	struct evsocket_event *cur, *prev;
-
 	if (!ctx) {
 		return;
 	}
 
+#if HAVE_EPOLL
+	if (!e || e->deleted)
+		return;
+	// The fd may already be closed, which removes it from the epoll set by itself
+	epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, e->fd, NULL);
+	// Freed on the next loop iteration, a pending epoll result may still point at it
+	e->deleted = 1;
+	e->next = ctx->garbage;
+	ctx->garbage = e;
+	ctx->n_events--;
+#else
+	struct evsocket_event *cur, *prev;
+
 	ctx->changed = 1;
 	cur = ctx->events;
 	prev = NULL;
@@ -157,9 +199,10 @@ void evsocket_delevent(struct evsocket_ctx *ctx, struct evsocket_event *e)
 		cur = cur->next;
 	}
 	ctx->n_events--;
+#endif
 }
 
-
+#if !HAVE_EPOLL
 static void rebuild_poll(struct evsocket_ctx *ctx)
 {
 	struct evsocket_event *e;
@@ -236,7 +279,18 @@ static void serve_event(struct evsocket_ctx *ctx, int n)
 		}
 	}
 }
-
+#else
+static void collect_garbage(struct evsocket_ctx *ctx)
+{
+	struct evsocket_event *e = ctx->garbage;
+	while (e) {
+		struct evsocket_event *next = e->next;
+		free(e);
+		e = next;
+	}
+	ctx->garbage = NULL;
+}
+#endif
 
 /*** PUBLIC API ***/
 
@@ -254,6 +308,14 @@ struct evsocket_ctx *evsocket_create(void)
 	ctx->giveup = 0;
 	ctx->n_events = 0;
 	ctx->changed = 0;
+#if HAVE_EPOLL
+	ctx->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (ctx->epfd < 0) {
+		rist_log_priv3( RIST_LOG_ERROR, "libevsocket, evsocket_create: epoll_create1 failed, error = %d\n", errno);
+		free(ctx);
+		return NULL;
+	}
+#endif
 	ctx_add(ctx);
 	return ctx;
 }
@@ -270,6 +332,52 @@ void evsocket_loop(struct evsocket_ctx *ctx, int timeout)
 
 int evsocket_loop_single(struct evsocket_ctx *ctx, int timeout, int max_events)
 {
+#if HAVE_EPOLL
+	int retval = 0;
+
+	if (!ctx || ctx->giveup) {
+		retval = -1;
+		goto loop_error;
+	}
+
+	collect_garbage(ctx);
+
+	if (ctx->n_events < 1) {
+		retval = -2;
+		goto loop_error;
+	}
+
+	int maxevents = EVSOCKET_EPOLL_MAX_EVENTS;
+	if (max_events > 0 && max_events < maxevents)
+		maxevents = max_events;
+
+	int pollret = epoll_wait(ctx->epfd, ctx->ep_events, maxevents, timeout);
+	if (pollret <= 0) {
+		if (pollret < 0 && errno != EINTR) {
+			rist_log_priv3( RIST_LOG_ERROR, "libevsocket, evsocket_loop: epoll_wait returned %d, n_events = %d, error = %d\n",
+				pollret, ctx->n_events, errno);
+			retval = -4;
+			goto loop_error;
+		}
+		return 0;
+	}
+
+	for (int i = 0; i < pollret; i++) {
+		struct evsocket_event *e = ctx->ep_events[i].data.ptr;
+		// A previous callback in this batch may have removed the event
+		if (e->deleted)
+			continue;
+		uint32_t ep = ctx->ep_events[i].events;
+		short revents = (short)(((ep & EPOLLIN) ? POLLIN : 0) | ((ep & EPOLLOUT) ? POLLOUT : 0) |
+			((ep & EPOLLERR) ? POLLERR : 0) | ((ep & EPOLLHUP) ? POLLHUP : 0));
+		if ((revents & (POLLHUP | POLLERR)) && e->err_callback)
+			e->err_callback(ctx, e->fd, revents, e->arg);
+		else if (e->callback)
+			e->callback(ctx, e->fd, revents, e->arg);
+	}
+
+	return 0;
+#else
 	int pollret, i;
 	int event_count = 0;
 	int retval = 0;
@@ -327,6 +435,7 @@ int evsocket_loop_single(struct evsocket_ctx *ctx, int timeout, int max_events)
 	}
 
 	return 0;
+#endif
 
 loop_error:
 	if (timeout > 0)
@@ -337,6 +446,10 @@ loop_error:
 void evsocket_destroy(struct evsocket_ctx *ctx)
 {
 	ctx_del(ctx);
+#if HAVE_EPOLL
+	collect_garbage(ctx);
+	close(ctx->epfd);
+#endif
 	if (ctx->pfd)
 		free(ctx->pfd);
 	if (ctx->_array)
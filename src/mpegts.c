@@ -9,70 +9,90 @@
 #include "udp-private.h"
 #include "endian-shim.h"
 
-int suppress_null_packets(const uint8_t payload_in[],uint8_t payload_out[], size_t *payload_len, struct rist_rtp_hdr_ext *header_ext) {
+static inline bool is_null_packet(const uint8_t *packet)
+{
+	const struct mpegts_header *hdr = (const struct mpegts_header *)packet;
+	return be16toh(hdr->flags1) == 0x1FFF;
+}
+
+int scan_null_packets(const uint8_t payload[], size_t payload_len, uint8_t *npd_bits, size_t *suppressed_len) {
 	size_t packet_size = 188;
-	if (RIST_UNLIKELY(*payload_len % packet_size !=0)) {
+	uint8_t bits = 0;
+	if (RIST_UNLIKELY(payload_len % packet_size != 0)) {
 		packet_size = 204;
-		if (RIST_UNLIKELY(*payload_len % packet_size != 0)) {
-			return -1;
-		}
-		SET_BIT(header_ext->npd_bits, 7);
+		if (RIST_UNLIKELY(payload_len % packet_size != 0))
+			return 0;
+		SET_BIT(bits, 7);
 	}
-	size_t count = *payload_len / packet_size;
-	if (RIST_UNLIKELY(count > 7))
-		return -1;
-	SET_BIT(header_ext->flags, 7);
-	size_t offset = 0;
+	size_t count = payload_len / packet_size;
+	if (count == 0 || count > RIST_NPD_MAX_PACKETS)
+		return 0;
+	// No early exits, every header is looked at and a single bad sync byte rejects the datagram
+	uint8_t sync = 0;
+	size_t suppressed = 0;
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t *packet = &payload[i * packet_size];
+		bool null_packet = is_null_packet(packet);
+		sync |= packet[0] ^ 0x47;
+		bits |= (uint8_t)(null_packet << (RIST_NPD_MAX_PACKETS - 1 - i));
+		suppressed += null_packet;
+	}
+	if (sync != 0 || suppressed == 0)
+		return 0;
+	*npd_bits = bits;
+	*suppressed_len = payload_len - suppressed * packet_size;
+	return (int)suppressed;
+}
+
+void suppress_null_packets(const uint8_t payload_in[], size_t payload_len, uint8_t npd_bits, uint8_t payload_out[]) {
+	size_t packet_size = CHECK_BIT(npd_bits, 7) == 0? 188: 204;
+	size_t count = payload_len / packet_size;
 	size_t output_offset = 0;
-	//size_t bytes_remaining = *payload_len - packet_size;
-	struct mpegts_header *hdr = (struct mpegts_header *)&payload_in[offset];
-	int suppressed = 0;
-	if (RIST_UNLIKELY(hdr->syncbyte  != 0x47))
-		goto fail;
-	for (int i = (int)count -1; i >= 0; i--) {
-		if (be16toh(hdr->flags1) == 0x1FFF) {
-			*payload_len -= packet_size;
-			SET_BIT(header_ext->npd_bits, i);
-			suppressed++;
-		} else {
-			if (i == 0 && suppressed == 0)
-				return 0;
-			memcpy(&payload_out[output_offset], &payload_in[offset], packet_size);
-			output_offset += packet_size;
+	size_t i = 0;
+	while (i < count) {
+		if (CHECK_BIT(npd_bits, RIST_NPD_MAX_PACKETS - 1 - i)) {
+			i++;
+			continue;
 		}
-		offset += packet_size;
-		//bytes_remaining -= packet_size;
-		hdr = (struct mpegts_header *)&payload_in[offset];
+		// Consecutive kept packets go out in one copy
+		size_t run = 1;
+		while (i + run < count && !CHECK_BIT(npd_bits, RIST_NPD_MAX_PACKETS - 1 - (i + run)))
+			run++;
+		memcpy(&payload_out[output_offset], &payload_in[i * packet_size], run * packet_size);
+		output_offset += run * packet_size;
+		i += run;
 	}
-	return suppressed;
-fail:
-	UNSET_BIT(header_ext->flags, 7);
-	return -1;
 }
 
 int expand_null_packets(uint8_t payload[], size_t *payload_len, uint8_t npd_bits) {
 	size_t packet_size = CHECK_BIT(npd_bits, 7) == 0? 188: 204;
-	size_t offset = 0;
-	ssize_t remaining_bytes = *payload_len;
-	//We will be modifying the payload in a 10k byte pre-allocated buffer, so we should be able to get away without any memory management
-	int counter = 0;
-	for (int i = 6; i >= 0; i--)
-	{
-		if (CHECK_BIT(npd_bits, i))
-		{
-			if (remaining_bytes > 0)
-				memmove(&payload[offset + packet_size], &payload[offset], remaining_bytes);
-			struct mpegts_header * hdr = (struct mpegts_header *)&payload[offset];
+	size_t suppressed = 0;
+	for (int i = 0; i < RIST_NPD_MAX_PACKETS; i++)
+		suppressed += CHECK_BIT(npd_bits, i);
+	if (suppressed == 0)
+		return 0;
+	size_t count = *payload_len / packet_size + suppressed;
+	// Bits of packets past the end would mean the sender laid them out differently
+	if (*payload_len % packet_size != 0 || count > RIST_NPD_MAX_PACKETS ||
+		(npd_bits & ((1 << (RIST_NPD_MAX_PACKETS - count)) - 1)) != 0)
+		return -1;
+	// Working from the back every kept packet moves once, to a spot nothing still needs
+	size_t offset = *payload_len;
+	for (size_t i = count; i-- > 0;) {
+		uint8_t *packet = &payload[i * packet_size];
+		if (CHECK_BIT(npd_bits, RIST_NPD_MAX_PACKETS - 1 - i)) {
+			struct mpegts_header *hdr = (struct mpegts_header *)packet;
 			memset(hdr, 0, sizeof(*hdr));
 			hdr->syncbyte = 0x47;
 			hdr->flags1 = htobe16(0x1FFF);
 			SET_BIT(hdr->flags2,4);
-			memset(&payload[offset + sizeof(*hdr)], 0xff, (packet_size - sizeof(*hdr)));
-			*payload_len += packet_size;
-			counter++;
-		} else
-			remaining_bytes -= packet_size;//Use this packet, so decrease remaining bytes to move
-		offset += packet_size;
+			memset(&packet[sizeof(*hdr)], 0xff, (packet_size - sizeof(*hdr)));
+		} else {
+			offset -= packet_size;
+			if (offset != i * packet_size)
+				memmove(packet, &payload[offset], packet_size);
+		}
 	}
-	return counter;
+	*payload_len = count * packet_size;
+	return (int)suppressed;
 }
@@ -35,7 +35,17 @@ RIST_PACKED_STRUCT(mpegts_header, {
 	uint8_t flags2;
 })
 
-RIST_PRIV int suppress_null_packets(const uint8_t payload_in[], uint8_t payload_out[], size_t *payload_len, struct rist_rtp_hdr_ext *header_ext);
+/* The RIST header extension has one npd bit per TS packet, first packet in bit 6, and
+ * bit 7 set for 204 byte packets */
+#define RIST_NPD_MAX_PACKETS (7)
+
+/* Returns how many null packets can be suppressed, with their npd bits and the payload length
+ * left without them */
+RIST_PRIV int scan_null_packets(const uint8_t payload[], size_t payload_len, uint8_t *npd_bits, size_t *suppressed_len);
+/* Gathers the packets scan_null_packets kept into payload_out */
+RIST_PRIV void suppress_null_packets(const uint8_t payload_in[], size_t payload_len, uint8_t npd_bits, uint8_t payload_out[]);
+/* Expands in place, payload needs room for RIST_NPD_MAX_PACKETS packets. Returns the number
+ * of null packets restored or -1 when npd_bits do not match the payload */
 RIST_PRIV int expand_null_packets(uint8_t payload[], size_t *payload_len, uint8_t npd_bits);
 
 #endif
@@ -95,10 +95,96 @@ static inline bool _librist_peer_equal_address(uint16_t family, struct sockaddr
 	return result;
 }
 
+static inline size_t _librist_peer_addr_hash(uint16_t family, const struct sockaddr *addr)
+{
+	uint32_t h;
+	if (family == AF_INET) {
+		const struct sockaddr_in *a = (const struct sockaddr_in *)addr;
+		h = (uint32_t)a->sin_addr.s_addr * 2654435761u ^ a->sin_port;
+	} else {
+		const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)addr;
+		uint32_t words[4];
+		memcpy(words, &a->sin6_addr, sizeof(words));
+		h = 0;
+		for (int i = 0; i < 4; i++)
+			h = (h ^ words[i]) * 2654435761u;
+		h ^= a->sin6_port;
+	}
+	h *= 2654435761u;
+	return h ^ (h >> 16);
+}
+
+static void _librist_peer_child_index_insert(struct rist_peer **index, size_t size, struct rist_peer *child)
+{
+	size_t i = _librist_peer_addr_hash(child->address_family, &child->u.address) & (size - 1);
+	while (index[i])
+		i = (i + 1) & (size - 1);
+	index[i] = child;
+}
+
+/* child is already linked in as a sibling, on OOM the index is dropped and lookups walk the children */
+void _librist_peer_child_index_add(struct rist_peer *parent, struct rist_peer *child)
+{
+	if (parent->child_index && (parent->child_index_count + 1) * 2 <= parent->child_index_size) {
+		_librist_peer_child_index_insert(parent->child_index, parent->child_index_size, child);
+		parent->child_index_count++;
+		return;
+	}
+	// Rebuild from the sibling list, which also picks up after an earlier OOM
+	size_t count = 0;
+	for (struct rist_peer *c = parent->child; c; c = c->sibling_next)
+		count++;
+	size_t size = 16;
+	while (size < count * 2)
+		size <<= 1;
+	free(parent->child_index);
+	parent->child_index = calloc(size, sizeof(*parent->child_index));
+	parent->child_index_size = 0;
+	parent->child_index_count = 0;
+	if (!parent->child_index)
+		return;
+	for (struct rist_peer *c = parent->child; c; c = c->sibling_next)
+		_librist_peer_child_index_insert(parent->child_index, size, c);
+	parent->child_index_size = size;
+	parent->child_index_count = count;
+}
+
+void _librist_peer_child_index_remove(struct rist_peer *parent, struct rist_peer *child)
+{
+	if (!parent->child_index)
+		return;
+	const size_t mask = parent->child_index_size - 1;
+	struct rist_peer **index = parent->child_index;
+	size_t hole = _librist_peer_addr_hash(child->address_family, &child->u.address) & mask;
+	while (index[hole] != child) {
+		if (!index[hole])
+			return;
+		hole = (hole + 1) & mask;
+	}
+	// Shift the rest of the probe run back, an entry may fill the hole if its home slot is not past it
+	for (size_t j = (hole + 1) & mask; index[j]; j = (j + 1) & mask) {
+		size_t home = _librist_peer_addr_hash(index[j]->address_family, &index[j]->u.address) & mask;
+		if (((j - home) & mask) >= ((j - hole) & mask)) {
+			index[hole] = index[j];
+			hole = j;
+		}
+	}
+	index[hole] = NULL;
+	parent->child_index_count--;
+}
+
 struct rist_peer * _librist_peer_match_peer_addr(struct rist_peer *p, uint16_t family, struct sockaddr *addr) {
 	if (p->listening) {
 		if (_librist_peer_equal_address(family, addr, p))
 			return p;
+		if (p->child_index) {
+			const size_t mask = p->child_index_size - 1;
+			for (size_t i = _librist_peer_addr_hash(family, addr) & mask; p->child_index[i]; i = (i + 1) & mask) {
+				if (_librist_peer_equal_address(family, addr, p->child_index[i]))
+					return p->child_index[i];
+			}
+			return NULL;
+		}
 		p = p->child;
 		while (p) {
 			if (_librist_peer_equal_address(family, addr, p))
@@ -20,14 +20,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* A rollover or rekey of the transmit key is due, caller holds peer_lock */
+static bool gre_key_change_due(struct rist_peer *key_peer)
+{
+#if HAVE_SRP_SUPPORT
+	if (librist_peer_should_rollover_passphrase(key_peer))
+		return true;
+#endif
+	struct rist_key *key = key_peer->key_tx_odd_active ? &key_peer->key_tx_odd : &key_peer->key_tx;
+	return _librist_crypto_psk_encrypt_rekey_due(key);
+}
+
 ssize_t _librist_proto_gre_send_data(struct rist_peer *p, uint8_t payload_type, uint16_t proto, uint8_t *payload, size_t payload_len, uint16_t src_port, uint16_t dst_port, uint8_t gre_version) {
 	bool encrypt = (p->key_tx.key_size > 0) && proto != RIST_GRE_PROTOCOL_TYPE_EAPOL;
-
-	/* Our encryption and compression operations directly modify the payload buffer we receive as a pointer
-	   so we create a local pointer that points to the payload pointer, if we would either encrypt or compress we instead
-	   malloc and mempcy, to ensure our source stays clean. We only do this with RAW data as these buffers are the only
-	   assumed to be reused by retransmits */
-    bool modifying_payload = encrypt && (payload_type == RIST_PAYLOAD_TYPE_DATA_RAW || payload_type == RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT);//Need to make a copy of our data if we'd resend it in the future, otherwise we can safely overwrite the buffer
+	bool data_packet = payload_type == RIST_PAYLOAD_TYPE_DATA_RAW || payload_type == RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT;
 
 	uint8_t *payload_wr = payload;
 	uint8_t hdr_buf[MAX_GRE_SIZE];
@@ -57,7 +63,7 @@ ssize_t _librist_proto_gre_send_data(struct rist_peer *p, uint8_t payload_type,
 	//For now default to always considering us capable to do that.
 	if (true || encrypt) {
 		SET_BIT(hdr->flags1, 4); // set seq bit
-		seq = key_peer->seq++;
+		seq = (uint32_t)atomic_fetch_add_explicit(&key_peer->seq, 1, memory_order_relaxed);
 		//Write sequence number
 		hdr_buf[hdr_len] = seq >> 24;
 		hdr_buf[hdr_len+1] = seq >> 16;
@@ -69,7 +75,7 @@ ssize_t _librist_proto_gre_send_data(struct rist_peer *p, uint8_t payload_type,
 	size_t hdr_payload_offset = hdr_len;
 
 	//If we can use the new VSF ethertype (rist GRE version >= 2), we should, as the other way is considered deprecated
-	if ((gre_version >= 2 && (proto == RIST_GRE_PROTOCOL_TYPE_REDUCED || proto == RIST_GRE_PROTOCOL_TYPE_KEEPALIVE || proto == RIST_VSF_PROTOCOL_SUBTYPE_BUFFER_NEGOTIATION))) {
+	if ((gre_version >= 2 && (proto == RIST_GRE_PROTOCOL_TYPE_REDUCED || proto == RIST_GRE_PROTOCOL_TYPE_KEEPALIVE || proto == RIST_VSF_PROTOCOL_SUBTYPE_BUFFER_NEGOTIATION || proto == RIST_VSF_PROTOCOL_SUBTYPE_FEC))) {
 		struct rist_vsf_proto *vsf = (struct rist_vsf_proto *)&hdr_buf[hdr_len];
 		hdr_len += sizeof(*vsf);
 		vsf->type = RIST_VSF_PROTOCOL_TYPE_RIST;//Network byte order! these are 0 values, so safe to do without htobe16
@@ -77,6 +83,8 @@ ssize_t _librist_proto_gre_send_data(struct rist_peer *p, uint8_t payload_type,
 			vsf->subtype = RIST_VSF_PROTOCOL_SUBTYPE_REDUCED;
 		else if (proto == RIST_VSF_PROTOCOL_SUBTYPE_BUFFER_NEGOTIATION)
 			vsf->subtype = htobe16(RIST_VSF_PROTOCOL_SUBTYPE_BUFFER_NEGOTIATION);
+		else if (proto == RIST_VSF_PROTOCOL_SUBTYPE_FEC)
+			vsf->subtype = htobe16(RIST_VSF_PROTOCOL_SUBTYPE_FEC);
 		else
 			vsf->subtype = htobe16(RIST_VSF_PROTOCOL_SUBTYPE_KEEPALIVE);
 
@@ -85,20 +93,32 @@ ssize_t _librist_proto_gre_send_data(struct rist_peer *p, uint8_t payload_type,
 		hdr->prot_type = htobe16(proto);
 	}
 
-	if (proto == RIST_GRE_PROTOCOL_TYPE_REDUCED) {
+	// Parity carries the same virtual ports as the data it protects
+	if (proto == RIST_GRE_PROTOCOL_TYPE_REDUCED || proto == RIST_VSF_PROTOCOL_SUBTYPE_FEC) {
 		struct rist_reduced *red = (struct rist_reduced *)(&hdr_buf[hdr_len]);
 		hdr_len += sizeof(*red);
 		red->dst_port = htobe16(dst_port);
 		red->src_port = htobe16(src_port);
 	}
 
+	/* The payload buffer is shared with retransmits, so encryption always works on a copy. Data packets
+	   of the sender protocol loop are copied into the tx batch scratch area and crypted together right
+	   before the batch goes out, everything else uses the peer scratch buffer under peer_lock. */
+	bool scratch_locked = false;
 	if (encrypt) {
-		if (modifying_payload || (hdr_payload_offset != hdr_len && !HAVE_MBEDTLS)) {
-			payload_wr = malloc(payload_len + 8);//Let's get rid of this malloc in the hotpath here
-			modifying_payload = true;
-			assert(payload_wr);
-		}
+		size_t crypt_hdr_len = hdr_len - hdr_payload_offset;
+		size_t crypt_len = crypt_hdr_len + payload_len;
+		uint8_t *crypt_buf = data_packet ? rist_tx_batch_reserve(p, crypt_len) : NULL;
+		bool batched = crypt_buf != NULL;
+
 		pthread_mutex_lock(&key_peer->peer_lock);
+		// Queued datagrams still have to be crypted with the key that is going to be rolled over
+		// or rekeyed. That takes peer_lock itself, only this thread queues, so nothing new comes in
+		if (rist_tx_batch_has_pending_crypt(p) && gre_key_change_due(key_peer)) {
+			pthread_mutex_unlock(&key_peer->peer_lock);
+			rist_tx_batch_encrypt_pending(p);
+			pthread_mutex_lock(&key_peer->peer_lock);
+		}
 		struct rist_key *key = &key_peer->key_tx;
 
 #if HAVE_SRP_SUPPORT
@@ -111,27 +131,49 @@ ssize_t _librist_proto_gre_send_data(struct rist_peer *p, uint8_t payload_type,
 		if (key_peer->key_tx_odd_active)
 			key = &p->key_tx_odd;
 
-		//Data that should be encrypted is part of the header
-		if (hdr_payload_offset != hdr_len) {
-#if HAVE_MBEDTLS
-			//MbedTLS allows us to continue encryption, so we can encrypt hdr & payload in 2 ops
-			_librist_crypto_psk_encrypt(key, htobe32(seq), gre_version, &hdr_buf[hdr_payload_offset], &hdr_buf[hdr_payload_offset], hdr_len - hdr_payload_offset);
-			_librist_crypto_psk_encrypt_continue(key, payload, payload_wr, payload_len);
-#else
-			memcpy(payload_wr, &hdr_buf[hdr_payload_offset], hdr_len - hdr_payload_offset);
-			memcpy(&payload_wr[hdr_len - hdr_payload_offset], payload, payload_len);
-			payload_len += (hdr_len - hdr_payload_offset);
-			hdr_len -= (hdr_len - hdr_payload_offset);
-			_librist_crypto_psk_encrypt(key, htobe32(seq), gre_version, payload_wr, payload_wr, payload_len);
-#endif
-		} else {
-			//Single encryption pass suffices
-			_librist_crypto_psk_encrypt(key, htobe32(seq), gre_version, payload, payload_wr, payload_len);
+		if (!batched) {
+			if (!key_peer->tx_scratch)
+				key_peer->tx_scratch = malloc(RIST_TX_SCRATCH_SIZE);
+			if (RIST_UNLIKELY(!key_peer->tx_scratch || crypt_len > RIST_TX_SCRATCH_SIZE)) {
+				pthread_mutex_unlock(&key_peer->peer_lock);
+				rist_log_priv(get_cctx(p), RIST_LOG_ERROR, "Cannot encrypt %zu byte datagram\n", crypt_len);
+				return -1;
+			}
+			crypt_buf = key_peer->tx_scratch;
+			scratch_locked = true;
 		}
-		pthread_mutex_unlock(&key_peer->peer_lock);
+
+		//Data that should be encrypted is part of the header, it goes in front of the payload copy
+		memcpy(crypt_buf, &hdr_buf[hdr_payload_offset], crypt_hdr_len);
+		memcpy(&crypt_buf[crypt_hdr_len], payload, payload_len);
+		hdr_len = hdr_payload_offset;
+		payload_wr = crypt_buf;
+		payload_len = crypt_len;
+
+		uint8_t iv[AES_BLOCK_SIZE];
+		if (batched)
+			_librist_crypto_psk_encrypt_prepare(key, htobe32(seq), gre_version, iv);
+		else
+			_librist_crypto_psk_encrypt(key, htobe32(seq), gre_version, crypt_buf, crypt_buf, crypt_len);
 		SET_BIT(hdr->flags1, 5); // set key bit
 		//Write key, our nonce is stored in network byte order so just memcpy it
 		memcpy(&hdr_buf[nonce_offset], key->gre_nonce, sizeof(p->key_tx.gre_nonce));
+		if (batched) {
+			pthread_mutex_unlock(&key_peer->peer_lock);
+			rist_tx_batch_add_encrypted(p, key_peer, hdr_buf, hdr_len, crypt_buf, crypt_len, key, iv);
+			return (ssize_t)(hdr_len + payload_len);
+		}
+	}
+
+	// Data packets of the sender protocol loop are collected and flushed with sendmmsg/GSO
+	if (!encrypt && data_packet && rist_tx_batch_add(p, hdr_buf, hdr_len, payload_wr, payload_len))
+		return (ssize_t)(hdr_len + payload_len);
+
+	struct rist_impairment *imp = &get_cctx(p)->impairment;
+	if (RIST_UNLIKELY(rist_impairment_active(imp)) && proto != RIST_GRE_PROTOCOL_TYPE_EAPOL && rist_impairment_filter(imp, p, hdr_buf, hdr_len, payload_wr, payload_len)) {
+		if (scratch_locked)
+			pthread_mutex_unlock(&key_peer->peer_lock);
+		return (ssize_t)(hdr_len + payload_len);
 	}
 
 	ssize_t ret;
@@ -177,9 +219,8 @@ ssize_t _librist_proto_gre_send_data(struct rist_peer *p, uint8_t payload_type,
 	}
 #endif
 
-	if (modifying_payload) {
-		free(payload_wr);
-	}
+	if (scratch_locked)
+		pthread_mutex_unlock(&key_peer->peer_lock);
 
 	if (RIST_UNLIKELY(errorcode)) {
         struct rist_common_ctx *ctx = get_cctx(p);
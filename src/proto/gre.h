@@ -17,6 +17,8 @@
 #define RIST_VSF_PROTOCOL_TYPE_RIST 0x0000
 
 #define RIST_VSF_PROTOCOL_SUBTYPE_REDUCED 0x0000
+//librist SMPTE 2022-1 parity, a data subtype so receivers without FEC drop it
+#define RIST_VSF_PROTOCOL_SUBTYPE_FEC 0x7F00
 #define RIST_VSF_PROTOCOL_SUBTYPE_KEEPALIVE 0x8000
 #define RIST_VSF_PROTOCOL_SUBTYPE_FUTURE_NONCE 0x8001
 #define RIST_VSF_PROTOCOL_SUBTYPE_BUFFER_NEGOTIATION 0x8002
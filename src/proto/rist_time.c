@@ -6,6 +6,19 @@
 
 #include <stdint.h>
 
+static inline uint64_t timestampNTP_from_timespec(const timespec_t *ts) {
+  // Convert nanoseconds to 32-bits fraction (232 picosecond units) without a
+  // division: ns * 2^32 / 10^9 = 4 * ns + ns * 0.294967296, the second term
+  // as a 32.32 fixed point multiply. Stays below 2^32 and is at most one unit
+  // above the exact value.
+  uint64_t ns = (uint64_t)ts->tv_nsec;
+  uint64_t t = (ns << 2) + ((ns * 1266874890ULL) >> 32);
+  // There is 70 years (incl. 17 leap ones) offset to the Unix Epoch.
+  // No leap seconds during that period since they were not invented yet.
+  t |= (uint64_t)((70LL * 365 + 17) * 24 * 60 * 60 + ts->tv_sec) << 32;
+  return t;
+}
+
 uint64_t timestampNTP_u64(void) {
   // We use clock_gettime instead of gettimeofday even though we only need
   // microseconds because gettimeofday implementation under linux is dependent
@@ -25,13 +38,7 @@ uint64_t timestampNTP_u64(void) {
 #else
   clock_gettime(CLOCK_MONOTONIC, &ts);
 #endif
-  // Convert nanoseconds to 32-bits fraction (232 picosecond units)
-  uint64_t t = (uint64_t)(ts.tv_nsec) << 32;
-  t /= 1000000000;
-  // There is 70 years (incl. 17 leap ones) offset to the Unix Epoch.
-  // No leap seconds during that period since they were not invented yet.
-  t |= (uint64_t)((70LL * 365 + 17) * 24 * 60 * 60 + ts.tv_sec) << 32;
-  return t; // nanoseconds (technically, 232.831 picosecond units)
+  return timestampNTP_from_timespec(&ts); // nanoseconds (technically, 232.831 picosecond units)
 }
 
 uint64_t timestampNTP_RTC_u64(void) {
@@ -41,13 +48,7 @@ uint64_t timestampNTP_RTC_u64(void) {
 #else
   clock_gettime(CLOCK_REALTIME, &ts);
 #endif
-  // Convert nanoseconds to 32-bits fraction (232 picosecond units)
-  uint64_t t = (uint64_t)(ts.tv_nsec) << 32;
-  t /= 1000000000;
-  // There is 70 years (incl. 17 leap ones) offset to the Unix Epoch.
-  // No leap seconds during that period since they were not invented yet.
-  t |= (uint64_t)((70LL * 365 + 17) * 24 * 60 * 60 + ts.tv_sec) << 32;
-  return t;
+  return timestampNTP_from_timespec(&ts);
 }
 
 uint32_t timestampRTP_u32(int advanced, uint64_t i_ntp) {
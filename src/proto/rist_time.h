@@ -17,4 +17,18 @@ RIST_PRIV uint32_t timestampRTP_u32(int advanced, uint64_t i_ntp);
 RIST_PRIV uint64_t convertRTPtoNTP(uint8_t ptype, uint32_t time_extension, uint32_t i_rtp);
 RIST_PRIV uint64_t calculate_rtt_delay(uint64_t request, uint64_t response, uint32_t delay);
 
+/* Microseconds in an NTP duration, ticks * 10^6 / 2^32 without a division.
+ * Only meant for differences, absolute timestamps overflow the multiply */
+static inline uint64_t rist_ntp_to_us(uint64_t ticks)
+{
+	return ((ticks >> 8) * 15625) >> 18;
+}
+
+/* CLOCK_MONOTONIC nanoseconds of a timestampNTP_u64 value */
+static inline uint64_t rist_ntp_to_monotonic_ns(uint64_t ntp)
+{
+	uint64_t sec = (ntp >> 32) - SEVENTY_YEARS_OFFSET;
+	return sec * 1000000000ULL + (((ntp & UINT32_MAX) * 1000000000ULL) >> 32);
+}
+
 #endif /* RIST_TIME_H */
@@ -114,6 +114,8 @@ RTCP Control Channel:
 #define RTP_PTYPE_MPEGTS_CLOCKHZ (90000)
 #define RTP_PTYPE_RIST (21)
 #define RTP_PTYPE_RIST_CLOCKHZ (UINT16_MAX + 1)
+// SMPTE 2022-1 parity packets
+#define RTP_PTYPE_FEC (96)
 
 RIST_PACKED_STRUCT(rist_rtp_hdr,{
 	uint8_t flags;
@@ -123,6 +125,11 @@ RIST_PACKED_STRUCT(rist_rtp_hdr,{
 	uint32_t ssrc;
 })
 
+// rist_rtp_hdr_ext flags: null packet deletion (npd_bits is valid) and LZ4 compressed payload
+// (librist extension, the payload following the header is a single LZ4 block)
+#define RIST_RTP_EXT_FLAG_NPD 7
+#define RIST_RTP_EXT_FLAG_LZ4 5
+
 RIST_PACKED_STRUCT(rist_rtp_hdr_ext, {
 	uint16_t identifier; /* set to 0x5249 */
 	uint16_t length; /*shall be set to 1 */
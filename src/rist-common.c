@@ -24,7 +24,9 @@
 #include "proto/eap.h"
 #endif
 #include "mpegts.h"
+#include <lz4.h>
 #include "rist_ref.h"
+#include "rist_block_pool.h"
 #include "config.h"
 #include "rist-thread.h"
 #include "peer.h"
@@ -41,6 +43,7 @@ static void store_peer_settings(const struct rist_peer_config *settings, struct
 static struct rist_peer *peer_initialize(const char *url, struct rist_sender *sender_ctx,
 										struct rist_receiver *receiver_ctx);
 void remove_peer_from_flow(struct rist_peer *peer);
+static void rist_peer_timer(struct rist_timer *timer, void *arg, uint64_t now);
 
 int parse_url_udp_options(const char* url, struct rist_udp_config *output_udp_config)
 {
@@ -270,6 +273,18 @@ int rist_max_jitter_set(struct rist_common_ctx *ctx, int t)
 	return -1;
 }
 
+/* Slots needed to hold buffer_ms worth of packets at bitrate_kbps with 2x headroom, rounded up
+ * to a power of two between RIST_QUEUE_MIN_SLOTS and max_slots */
+size_t rist_queue_slots_for(uint32_t bitrate_kbps, uint32_t buffer_ms, size_t max_slots)
+{
+	uint64_t packets = (uint64_t)bitrate_kbps * 1000 / 8 * buffer_ms / 1000 / RIST_QUEUE_SIZING_PACKET_SIZE;
+	packets *= 2;
+	size_t slots = RIST_QUEUE_MIN_SLOTS;
+	while (slots < packets && slots < max_slots)
+		slots <<= 1;
+	return slots < max_slots ? slots : max_slots;
+}
+
 static void init_peer_settings(struct rist_peer *peer)
 {
 	peer->eight_times_rtt = peer->config.recovery_rtt_min * 8;
@@ -291,6 +306,8 @@ static void init_peer_settings(struct rist_peer *peer)
 				peer->config.recovery_rtt_min /RIST_CLOCK, peer->config.recovery_rtt_max /RIST_CLOCK, peer->config.congestion_control_mode, peer->config.min_retries, peer->config.max_retries);
 		if (peer->config.recovery_length_min != peer->config.recovery_length_max)
 			rist_log_priv(get_cctx(peer), RIST_LOG_INFO, "Enabling automatic buffer scaling\n");
+		// Enough buffers up front for a receiver queue sized the same way as in create_flow
+		rist_buffer_pool_reserve(get_cctx(peer), rist_queue_slots_for(peer->config.recovery_maxbitrate, peer->config.recovery_length_max, RIST_SERVER_QUEUE_BUFFERS));
 	}
 	else {
 		assert(peer->sender_ctx != NULL);
@@ -326,43 +343,244 @@ static void init_peer_settings(struct rist_peer *peer)
 			rist_log_priv(&ctx->common, RIST_LOG_INFO, "Setting buffer size to %zums (Max buffer size + 2 * Max RTT)\n", ctx->sender_recover_min_time);
 			// TODO: adjust this size based on the dynamic RTT measurement
 		}
+		/* The protocol thread grows the sender queue towards this, see rist_sender_queue_check_size */
+		size_t slots = rist_queue_slots_for(peer->config.recovery_maxbitrate, (uint32_t)ctx->sender_recover_min_time, RIST_SERVER_QUEUE_BUFFERS);
+		unsigned long target = atomic_load_explicit(&ctx->sender_queue_target, memory_order_relaxed);
+		while (slots > target && !atomic_compare_exchange_weak(&ctx->sender_queue_target, &target, slots))
+			;
+		rist_buffer_pool_reserve(&ctx->common, slots);
 
 	}
 }
 
-struct rist_buffer *rist_new_buffer(struct rist_common_ctx *ctx, const void *buf, size_t len, uint8_t type, uint32_t seq, uint64_t source_time, uint16_t src_port, uint16_t dst_port)
+static const size_t rist_buffer_pool_sizes[RIST_BUFFER_POOL_CLASSES] = { 1316, 1472, RIST_MAX_PACKET_SIZE };
+
+static inline int rist_buffer_pool_class(size_t len)
 {
-	RIST_MARK_UNUSED(ctx);
-	// TODO: we will ran out of stack before heap and when that happens malloc will crash not just
-	// return NULL ... We need to find and remove all heap allocations
-	struct rist_buffer *b;
-	b = malloc(sizeof(*b));
-	if (!b) {
-		fprintf(stderr, "OOM\n");
+	for (int i = 0; i < RIST_BUFFER_POOL_CLASSES; i++)
+	{
+		if (len <= rist_buffer_pool_sizes[i])
+			return i;
+	}
+	return -1;
+}
+
+static inline uint32_t rist_buffer_stack_pop_index(atomic_uint_fast64_t *head, atomic_uint *next)
+{
+	uint_fast64_t old = atomic_load_explicit(head, memory_order_acquire);
+	uint64_t top;
+	uint64_t desired;
+	do {
+		top = (uint32_t)old;
+		if (!top)
+			return 0;
+		desired = ((((uint64_t)old >> 32) + 1) << 32) | atomic_load_explicit(&next[top - 1], memory_order_relaxed);
+	} while (!atomic_compare_exchange_weak_explicit(head, &old, desired, memory_order_acquire, memory_order_acquire));
+	return (uint32_t)top;
+}
+
+static inline void rist_buffer_stack_push_index(atomic_uint_fast64_t *head, atomic_uint *next, uint32_t index)
+{
+	uint_fast64_t old = atomic_load_explicit(head, memory_order_relaxed);
+	uint64_t desired;
+	do {
+		atomic_store_explicit(&next[index - 1], (uint32_t)old, memory_order_relaxed);
+		desired = ((((uint64_t)old >> 32) + 1) << 32) | index;
+	} while (!atomic_compare_exchange_weak_explicit(head, &old, desired, memory_order_release, memory_order_relaxed));
+}
+
+static struct rist_buffer *rist_buffer_stack_pop(struct rist_buffer_stack *stack)
+{
+	uint32_t index = rist_buffer_stack_pop_index(&stack->full, stack->next);
+	if (!index)
 		return NULL;
+	struct rist_buffer *b = stack->slots[index - 1];
+	rist_buffer_stack_push_index(&stack->empty, stack->next, index);
+	atomic_fetch_sub_explicit(&stack->count, 1, memory_order_relaxed);
+	return b;
+}
+
+/* Returns false when the stack is full */
+static bool rist_buffer_stack_push(struct rist_buffer_stack *stack, struct rist_buffer *b)
+{
+	uint32_t index = rist_buffer_stack_pop_index(&stack->empty, stack->next);
+	if (!index)
+		return false;
+	stack->slots[index - 1] = b;
+	atomic_fetch_add_explicit(&stack->count, 1, memory_order_relaxed);
+	rist_buffer_stack_push_index(&stack->full, stack->next, index);
+	return true;
+}
+
+static int rist_buffer_stack_init(struct rist_buffer_stack *stack, uint32_t max)
+{
+	stack->slots = calloc(max, sizeof(*stack->slots));
+	stack->next = malloc(max * sizeof(*stack->next));
+	if (!stack->slots || !stack->next) {
+		free(stack->slots);
+		free(stack->next);
+		stack->slots = NULL;
+		stack->next = NULL;
+		return -1;
+	}
+	// Every slot starts out on the empty list
+	for (uint32_t i = 0; i < max; i++)
+		atomic_init(&stack->next[i], i + 1 < max ? i + 2 : 0);
+	atomic_init(&stack->full, 0);
+	atomic_init(&stack->empty, max ? 1 : 0);
+	atomic_init(&stack->count, 0);
+	stack->max = max;
+	return 0;
+}
+
+/* Only once no other thread uses the context anymore */
+static void rist_buffer_stack_destroy(struct rist_buffer_stack *stack)
+{
+	if (!stack->slots)
+		return;
+	struct rist_buffer *b;
+	while ((b = rist_buffer_stack_pop(stack))) {
+		free(b->data);
+		free(b);
+	}
+	free(stack->slots);
+	free(stack->next);
+	stack->slots = NULL;
+	stack->next = NULL;
+}
+
+int rist_buffer_pool_init(struct rist_common_ctx *ctx)
+{
+	for (int i = 0; i < RIST_BUFFER_POOL_CLASSES; i++)
+	{
+		if (rist_buffer_stack_init(&ctx->rist_buffer_pool[i], (uint32_t)(RIST_BUFFER_POOL_MAX_BYTES / (rist_buffer_pool_sizes[i] + RIST_MAX_PAYLOAD_OFFSET))) != 0)
+			return -1;
 	}
+	if (rist_buffer_stack_init(&ctx->rist_free_buffer, RIST_BUFFER_POOL_MAX_EMPTY) != 0)
+		return -1;
+	atomic_init(&ctx->rist_buffer_pool_hits, 0);
+	atomic_init(&ctx->rist_buffer_pool_misses, 0);
+	// Preallocation waits for the peers, rist_buffer_pool_reserve sizes it from their buffer and bitrate
+	return 0;
+}
 
-	if (buf != NULL && len > 0)
+/* Tops the smallest class up to slots cached buffers (bounded by the class budget). Only that class
+ * is preallocated, it matches the common 7 TS packets per datagram case */
+void rist_buffer_pool_reserve(struct rist_common_ctx *ctx, size_t slots)
+{
+	struct rist_buffer_stack *stack = &ctx->rist_buffer_pool[0];
+	size_t count = atomic_load_explicit(&stack->count, memory_order_relaxed);
+	size_t target = slots < stack->max ? slots : stack->max;
+	// The data path keeps using the pool meanwhile
+	for (; count < target; count++)
 	{
-		b->data = malloc(len + RIST_MAX_PAYLOAD_OFFSET);
+		struct rist_buffer *b = malloc(sizeof(*b));
+		if (!b)
+			break;
+		b->data = malloc(rist_buffer_pool_sizes[0] + RIST_MAX_PAYLOAD_OFFSET);
 		if (!b->data) {
 			free(b);
+			break;
+		}
+		b->alloc_size = rist_buffer_pool_sizes[0];
+		b->free = true;
+		if (!rist_buffer_stack_push(stack, b)) {
+			free(b->data);
+			free(b);
+			break;
+		}
+	}
+}
+
+void rist_buffer_pool_destroy(struct rist_common_ctx *ctx)
+{
+	for (int i = 0; i < RIST_BUFFER_POOL_CLASSES; i++)
+		rist_buffer_stack_destroy(&ctx->rist_buffer_pool[i]);
+	rist_buffer_stack_destroy(&ctx->rist_free_buffer);
+}
+
+void rist_buffer_pool_get_stats(struct rist_common_ctx *ctx, uint64_t *hits, uint64_t *misses)
+{
+	*hits = atomic_load_explicit(&ctx->rist_buffer_pool_hits, memory_order_relaxed);
+	*misses = atomic_load_explicit(&ctx->rist_buffer_pool_misses, memory_order_relaxed);
+}
+
+void rist_receiver_zero_copy_init(struct rist_common_ctx *ctx)
+{
+	// Zero-copy receive relies on the recvmmsg ring, without it datagrams are copied as before
+	if (!ctx->recv_ring)
+		return;
+	ctx->block_pool = rist_block_pool_create(RIST_BLOCK_POOL_PREALLOC, RIST_BLOCK_POOL_MAX_FREE);
+	if (!ctx->block_pool) {
+		rist_log_priv3(RIST_LOG_WARN, "Failed to create the receive block pool, zero-copy receive is disabled\n");
+		return;
+	}
+	for (int i = 0; i < RIST_RECV_BATCH_SIZE; i++)
+		ctx->recv_blocks[i] = rist_block_pool_get(ctx->block_pool);
+}
+
+void rist_receiver_zero_copy_destroy(struct rist_common_ctx *ctx)
+{
+	if (!ctx->block_pool)
+		return;
+	for (int i = 0; i < RIST_RECV_BATCH_SIZE; i++)
+	{
+		if (ctx->recv_blocks[i])
+			rist_block_pool_put(ctx->recv_blocks[i]);
+		ctx->recv_blocks[i] = NULL;
+	}
+	rist_block_pool_release(ctx->block_pool);
+	ctx->block_pool = NULL;
+}
+
+struct rist_buffer *rist_new_buffer(struct rist_common_ctx *ctx, const void *buf, size_t len, uint8_t type, uint32_t seq, uint64_t source_time, uint16_t src_port, uint16_t dst_port, uint64_t now)
+{
+	// A NULL buf with a length leaves the payload for the caller to fill in
+	bool has_payload = len > 0;
+	int pool_class = has_payload ? rist_buffer_pool_class(len) : -1;
+	struct rist_buffer *b = NULL;
+
+	if (pool_class >= 0)
+		b = rist_buffer_stack_pop(&ctx->rist_buffer_pool[pool_class]);
+	if (!b)
+		b = rist_buffer_stack_pop(&ctx->rist_free_buffer);
+	if (b && (!has_payload || b->data))
+		atomic_fetch_add_explicit(&ctx->rist_buffer_pool_hits, 1, memory_order_relaxed);
+	else
+		atomic_fetch_add_explicit(&ctx->rist_buffer_pool_misses, 1, memory_order_relaxed);
+
+	// TODO: we will ran out of stack before heap and when that happens malloc will crash not just
+	// return NULL ... We need to find and remove all heap allocations
+	if (!b) {
+		b = malloc(sizeof(*b));
+		if (!b) {
 			fprintf(stderr, "OOM\n");
 			return NULL;
 		}
+		b->data = NULL;
+		b->alloc_size = 0;
 	}
-	b->alloc_size = len;
-	if (buf != NULL && len > 0)
+
+	if (has_payload)
 	{
-		memcpy((uint8_t *)b->data + RIST_MAX_PAYLOAD_OFFSET, buf, len);
+		if (!b->data) {
+			size_t alloc_size = pool_class >= 0 ? rist_buffer_pool_sizes[pool_class] : len;
+			b->data = malloc(alloc_size + RIST_MAX_PAYLOAD_OFFSET);
+			if (!b->data) {
+				free(b);
+				fprintf(stderr, "OOM\n");
+				return NULL;
+			}
+			b->alloc_size = alloc_size;
+		}
+		if (buf)
+			memcpy((uint8_t *)b->data + RIST_MAX_PAYLOAD_OFFSET, buf, len);
 	}
-	b->alloc_size = len;
-	b->next_free = NULL;
 	b->free = false;
 	b->size = len;
 	b->source_time = source_time;
 	b->seq = seq;
-	b->time = timestampNTP_u64();
+	b->time = now;
 	b->type = type;
 	b->src_port = src_port;
 	b->dst_port = dst_port;
@@ -370,15 +588,39 @@ struct rist_buffer *rist_new_buffer(struct rist_common_ctx *ctx, const void *buf
 	b->transmit_count = 0;
 	b->use_seq = 0;
 	b->retry_queued = false;
+	b->data_offset = RIST_MAX_PAYLOAD_OFFSET;
+	b->pooled_block = NULL;
+	atomic_init(&b->tx_refs, 0);
 	return b;
 }
 
 void free_rist_buffer(struct rist_common_ctx *ctx, struct rist_buffer *b)
 {
-	RIST_MARK_UNUSED(ctx);
-	free(b->data);
+	if (b->pooled_block) {
+		// Zero-copy payload that never made it to the application
+		rist_block_pool_put(b->pooled_block);
+		b->pooled_block = NULL;
+		b->data = NULL;
+		b->alloc_size = 0;
+	}
+	void *data = b->data;
+	int pool_class = -1;
+	if (data) {
+		pool_class = rist_buffer_pool_class(b->alloc_size);
+		// Payloads allocated outside of the size classes are never cached
+		if (pool_class >= 0 && rist_buffer_pool_sizes[pool_class] != b->alloc_size)
+			pool_class = -1;
+	}
+
+	b->free = true;
+	if (pool_class >= 0 && rist_buffer_stack_push(&ctx->rist_buffer_pool[pool_class], b))
+		return;
+	b->data = NULL;
+	b->alloc_size = 0;
+	if (rist_buffer_stack_push(&ctx->rist_free_buffer, b))
+		b = NULL;
+	free(data);
 	free(b);
-
 }
 
 static uint64_t receiver_calculate_packet_time(struct rist_flow *f, const uint64_t source_time, uint64_t now, bool retry, uint8_t payload_type)
@@ -398,7 +640,7 @@ static uint64_t receiver_calculate_packet_time(struct rist_flow *f, const uint64
 				f->time_offset += convertRTPtoNTP(payload_type, 0, UINT32_MAX);
 			else
 				f->time_offset += ((uint64_t)UINT32_MAX << 32) / RTP_PTYPE_MPEGTS_CLOCKHZ;
-			rist_log_priv(get_cctx(f->peer_lst[0]), RIST_LOG_INFO, "Clock wrapped, old offset: %" PRId64 " new offset %" PRId64 "\n", f->time_offset / RIST_CLOCK, f->time_offset_old / RIST_CLOCK);
+			rist_log_priv2(f->logging_settings, RIST_LOG_INFO, "Clock wrapped, old offset: %" PRId64 " new offset %" PRId64 "\n", f->time_offset / RIST_CLOCK, f->time_offset_old / RIST_CLOCK);
 			f->offset_recalc_sample_count = 0;
 			f->max_source_time = 0;
 			f->time_offset_changed_ts = now;
@@ -416,14 +658,27 @@ static uint64_t receiver_calculate_packet_time(struct rist_flow *f, const uint64
 	return packet_time;
 }
 
-static int receiver_insert_queue_packet(struct rist_flow *f, struct rist_peer *peer, size_t idx, const void *buf, size_t len, uint32_t seq, uint64_t source_time, uint16_t src_port, uint16_t dst_port, uint64_t packet_time)
+static int receiver_insert_queue_packet(struct rist_flow *f, struct rist_peer *peer, struct rist_pooled_block **rx_block, size_t idx, const void *buf, size_t len, uint32_t seq, uint64_t source_time, uint16_t src_port, uint16_t dst_port, uint64_t packet_time, uint64_t now_monotonic)
 {
 	/*
 	   rist_log_priv(get_cctx(peer), RIST_LOG_INFO,
 	   "Inserting seq %"PRIu32" len %zu source_time %"PRIu32" at idx %zu\n",
 	   seq, len, source_time, idx);
 	   */
-	f->receiver_queue[idx] = rist_new_buffer(get_cctx(peer), buf, len, RIST_PAYLOAD_TYPE_DATA_RAW, seq, source_time, src_port, dst_port);
+	struct rist_common_ctx *cctx = get_cctx(peer);
+	struct rist_pooled_block *pb = *rx_block;
+	if (pb && (const uint8_t *)buf >= pb->data && (const uint8_t *)buf + len <= pb->data + RIST_BLOCK_POOL_DATA_SIZE) {
+		// Zero-copy: the datagram was received into a pooled block, take ownership of it
+		f->receiver_queue[idx] = rist_new_buffer(cctx, NULL, 0, RIST_PAYLOAD_TYPE_DATA_RAW, seq, source_time, src_port, dst_port, now_monotonic);
+		if (f->receiver_queue[idx]) {
+			*rx_block = NULL;
+			f->receiver_queue[idx]->pooled_block = pb;
+			f->receiver_queue[idx]->data = pb->data;
+			f->receiver_queue[idx]->data_offset = (size_t)((const uint8_t *)buf - pb->data);
+			f->receiver_queue[idx]->size = len;
+		}
+	} else
+		f->receiver_queue[idx] = rist_new_buffer(cctx, buf, len, RIST_PAYLOAD_TYPE_DATA_RAW, seq, source_time, src_port, dst_port, now_monotonic);
 	if (RIST_UNLIKELY(!f->receiver_queue[idx])) {
 		rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Could not create packet buffer inside receiver buffer, OOM, decrease max bitrate or buffer time length\n");
 		return -1;
@@ -439,14 +694,15 @@ static int receiver_insert_queue_packet(struct rist_flow *f, struct rist_peer *p
 static inline void receiver_mark_missing(struct rist_flow *f, struct rist_peer *peer, uint32_t current_seq, uint64_t rtt) {
 	uint32_t counter = 1;
 	uint64_t packet_time_last = 0;
-	if (RIST_UNLIKELY(!f->receiver_queue[f->last_seq_found]))
+	const size_t mask = f->receiver_queue_max - 1;
+	if (RIST_UNLIKELY(!f->receiver_queue[f->last_seq_found & mask]))
 		if (RIST_LIKELY(!f->rtc_timing_mode))
 			packet_time_last = timestampNTP_u64();
 		else
 			packet_time_last = timestampNTP_RTC_u64();
 	else
-		packet_time_last = f->receiver_queue[f->last_seq_found]->packet_time;
-	uint64_t packet_time_now = f->receiver_queue[current_seq]->packet_time;
+		packet_time_last = f->receiver_queue[f->last_seq_found & mask]->packet_time;
+	uint64_t packet_time_now = f->receiver_queue[current_seq & mask]->packet_time;
 	uint32_t missing_count = (current_seq - f->last_seq_found) & UINT16_MAX;
 	//arbitrary large number to prevent incorrectly marking packets as missing when wrap-around occurs & we did not correctly detect as out of order
 	if (missing_count > 32768)
@@ -513,9 +769,8 @@ static void recalculate_clock_offset(struct rist_flow *flow)
 }
 
 
-static int receiver_enqueue(struct rist_peer *peer, uint64_t source_time, uint64_t packet_recv_time, const void *buf, size_t len, uint32_t seq, uint64_t rtt, bool retry, uint16_t src_port, uint16_t dst_port, uint8_t payload_type)
+static int receiver_enqueue(struct rist_flow *f, struct rist_peer *peer, struct rist_pooled_block **rx_block, uint64_t source_time, uint64_t packet_recv_time, const void *buf, size_t len, uint32_t seq, uint64_t rtt, bool retry, uint16_t src_port, uint16_t dst_port, uint8_t payload_type)
 {
-	struct rist_flow *f = peer->flow;
 
 	//	fprintf(stderr,"receiver enqueue seq is %"PRIu32", source_time %"PRIu64"\n",
 	//	seq, source_time);
@@ -545,6 +800,7 @@ static int receiver_enqueue(struct rist_peer *peer, uint64_t source_time, uint64
 		f->flag_flow_buffer_start = true;
 		f->last_recv_ts = now_monotonic;
 		f->checks_next_time = now_monotonic;
+		rist_timer_arm(f->timers, &f->checks_timer, now_monotonic + 1);
 		/* Calculate and store clock offset with respect to source */
 		if (!f->rtc_timing_mode)
 			f->time_offset = (int64_t)now_monotonic - (int64_t)source_time;
@@ -556,23 +812,33 @@ static int receiver_enqueue(struct rist_peer *peer, uint64_t source_time, uint64
 		size_t idx_initial = seq & (f->receiver_queue_max -1);
 			rist_log_priv(get_cctx(peer), RIST_LOG_INFO,
 				"Storing first packet seq %" PRIu32 ", idx %zu, %" PRIu64 ", offset %" PRId64 " ms, output_idx %zu\n",
-				seq, idx_initial, source_time, peer->flow->time_offset / RIST_CLOCK, idx_initial);
+				seq, idx_initial, source_time, f->time_offset / RIST_CLOCK, idx_initial);
 		uint64_t packet_time = source_time + f->time_offset;
 
-		receiver_insert_queue_packet(f, peer, idx_initial, buf, len, seq, source_time, src_port, dst_port, packet_time);
+		receiver_insert_queue_packet(f, peer, rx_block, idx_initial, buf, len, seq, source_time, src_port, dst_port, packet_time, now_monotonic);
 		atomic_store_explicit(&f->receiver_queue_output_idx, idx_initial, memory_order_release);
 
 		/* reset stats */
-		pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
 		memset(&f->stats_instant, 0, sizeof(f->stats_instant));
-		pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+		rist_flow_counters_rebase(f);
 		f->receiver_queue_has_items = true;
 		pthread_mutex_unlock(&f->mutex);
 		return 0; // not a dupe
 	}
 
 	uint64_t packet_time = receiver_calculate_packet_time(f, source_time, now, retry, payload_type);
-    size_t idx = seq & (f->receiver_queue_max - 1);
+	/* Grow the queue before the packet runs into the output position */
+	uint32_t ahead = seq - f->last_seq_output;
+	if (f->short_seq)
+		ahead = (uint16_t)ahead;
+	const size_t queue_cap = f->short_seq ? UINT16_SIZE : RIST_SERVER_QUEUE_BUFFERS;
+	if (RIST_UNLIKELY(f->receiver_queue_max < queue_cap && ahead < (UINT32_MAX >> 1) &&
+			ahead >= f->receiver_queue_max - f->receiver_queue_max / 4)) {
+		pthread_mutex_lock(&f->mutex);
+		rist_receiver_queue_grow(f, (size_t)ahead * 2);
+		pthread_mutex_unlock(&f->mutex);
+	}
+	size_t idx = seq & (f->receiver_queue_max - 1);
     if (RIST_UNLIKELY(peer->config.timing_mode == RIST_TIMING_MODE_ARRIVAL && retry))
 	{
 		//arrival packet time would be incorrect for a retry packet, so instead we interpolate between packets.
@@ -622,16 +888,12 @@ static int receiver_enqueue(struct rist_peer *peer, uint64_t source_time, uint64
 		if (now > (packet_time + (f->recovery_buffer_ticks *1.1)))
 		{
 			rist_log_priv(get_cctx(peer), RIST_LOG_DEBUG, "Packet %"PRIu32" too late, dropping!\n", seq);
-			pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
-			f->stats_instant.dropped_late++;
-                        if (f->stats_instant.dropped_late > 5 * f->stats_instant.received)
-                            f->receiver_queue_has_items = false;
-			if ((f->stats_instant.dropped_late > (f->stats_instant.received * 5) && f->stats_instant.received > 100) ||
-				(f->stats_instant.dropped_late > 100 && f->stats_instant.received == 0)) {
-					rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Too many late packets received, resetting flow");
-					f->receiver_queue_has_items = false;
-			}
-			pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+			rist_stats_counter_add(&f->counters.dropped_late, 1);
+			bool too_many;
+			if (rist_flow_dropped_late_reset(f, &too_many))
+				f->receiver_queue_has_items = false;
+			if (too_many)
+				rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Too many late packets received, resetting flow");
 			return -1;
 		}
 		if (!retry) {
@@ -648,11 +910,9 @@ static int receiver_enqueue(struct rist_peer *peer, uint64_t source_time, uint64
 		rist_log_priv(get_cctx(peer), RIST_LOG_DEBUG, "Buffer is full, dropping packet %"PRIu32"/%zu\n", seq, idx);
 		if (packet_time > f->last_packet_ts)
 			f->last_seq_found  = seq;
-		pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
-		f->stats_instant.dropped_full++;
-		pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+		rist_stats_counter_add(&f->counters.dropped_full, 1);
 		//Something is wrong, and we should reset
-		if (f->stats_instant.dropped_full > 100) {
+		if (rist_flow_dropped_full_reset(f)) {
 			rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Buffer is full, resetting buffer\n");
 			f->receiver_queue_has_items = false;
 		}
@@ -663,9 +923,7 @@ static int receiver_enqueue(struct rist_peer *peer, uint64_t source_time, uint64
 		struct rist_buffer *b = f->receiver_queue[idx];
 		if (b->source_time == source_time) {
 			rist_log_priv(get_cctx(peer), RIST_LOG_DEBUG, "Dupe! %"PRIu32"/%zu\n", seq, idx);
-			pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
-			f->stats_instant.dupe++;
-			pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+			rist_stats_counter_add(&f->counters.duplicates, 1);
 			return 1;
 		}
 		else {
@@ -677,15 +935,13 @@ static int receiver_enqueue(struct rist_peer *peer, uint64_t source_time, uint64
 
 
 	/* Now, we insert the packet into receiver queue */
-	if (receiver_insert_queue_packet(f, peer, idx, buf, len, seq, source_time, src_port, dst_port, packet_time)) {
+	if (receiver_insert_queue_packet(f, peer, rx_block, idx, buf, len, seq, source_time, src_port, dst_port, packet_time, now_monotonic)) {
 		// only error is OOM, safe to exit here ...
 		return 0;
 	}
-	pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
 	if (out_of_order)
-		f->stats_instant.reordered++;
-	f->stats_instant.received++;
-	pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+		rist_stats_counter_add(&f->counters.reordered, 1);
+	rist_stats_counter_add(&f->counters.received, 1);
 	// Check for missing data and queue retries
 	if (!retry) {
 		/* check for missing packets */
@@ -754,9 +1010,7 @@ static int rist_process_nack(struct rist_flow *f, struct rist_missing_buffer *b)
 			}
 			if (b->nack_count == 0) {
 				f->missing_counter++;
-				pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
-				f->stats_instant.missing++;
-				pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+				rist_stats_counter_add(&f->counters.missing, 1);
 			}
 
 			// TODO: make this 10% overhead configurable?
@@ -777,9 +1031,7 @@ static int rist_process_nack(struct rist_flow *f, struct rist_missing_buffer *b)
 			// update peer information
 			f->nacks.array[f->nacks.counter] = b->seq;
 			f->nacks.counter++;
-			pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
-			f->stats_instant.retries++;
-			pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+			rist_stats_counter_add(&f->counters.retries, 1);
 		}
 	}
 
@@ -796,6 +1048,12 @@ void free_data_block(struct rist_data_block **const block)
 	if (atomic_fetch_sub(&b->ref->refcnt, 1) == 1)
 	{
 		assert(b->ref->ptr == b);
+		if (b->ref->pooled) {
+			// block, ref and payload share one pooled allocation
+			rist_block_pool_put((struct rist_pooled_block *)b);
+			*block = NULL;
+			return;
+		}
 		uint8_t *payload = ((uint8_t*)b->payload - RIST_MAX_PAYLOAD_OFFSET);//this is extremely ugly, though these offsets will stop existing in next release
 		free(payload);
 		free((void *)b->ref);
@@ -843,13 +1101,30 @@ static struct rist_data_block *new_data_block(struct rist_data_block *output_buf
 	return output_buffer;
 }
 
+static struct rist_data_block *pooled_data_block(struct rist_buffer *b, uint8_t *payload, uint32_t flow_id, uint32_t flags)
+{
+	struct rist_data_block *output_buffer = &b->pooled_block->block;
+	output_buffer->peer = b->peer;
+	output_buffer->flow_id = flow_id;
+	output_buffer->payload = payload;
+	output_buffer->payload_len = b->size;
+	output_buffer->virt_src_port = b->src_port;
+	output_buffer->virt_dst_port = b->dst_port;
+	output_buffer->ts_ntp = b->source_time;
+	output_buffer->seq = b->seq;
+	output_buffer->flags = flags;
+	return output_buffer;
+}
+
 static void receiver_output(struct rist_receiver *ctx, struct rist_flow *f)
 {
 
 	uint64_t recovery_buffer_ticks = f->recovery_buffer_ticks;
 	uint64_t now;
+	// Only refreshed when the application callback ran, everything else in the loop is quick
+	uint64_t now_monotonic = timestampNTP_u64();
 	if (RIST_LIKELY(!f->rtc_timing_mode))
-		now = timestampNTP_u64();
+		now = now_monotonic;
 	else
 		now = timestampNTP_RTC_u64();
 	size_t output_idx = atomic_load_explicit(&f->receiver_queue_output_idx, memory_order_acquire);
@@ -884,9 +1159,7 @@ static void receiver_output(struct rist_receiver *ctx, struct rist_flow *f)
 					break;
 				}
 			}
-			pthread_mutex_lock(&ctx->common.stats_lock);
-			f->stats_instant.lost += holes;
-			pthread_mutex_unlock(&ctx->common.stats_lock);
+			rist_stats_counter_add(&f->output_stats.lost, holes);
 			output_idx = counter;
 			rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
 					"Empty buffer element, flushing %"PRIu32" hole(s), now at index %zu, size is %zu\n",
@@ -895,7 +1168,7 @@ static void receiver_output(struct rist_receiver *ctx, struct rist_flow *f)
 		if (b) {
 			if (b->type == RIST_PAYLOAD_TYPE_DATA_RAW) {
 
-				now = timestampNTP_u64();
+				now = now_monotonic;
 				uint64_t delay_rtc = (now - b->time);
 				if (RIST_UNLIKELY(delay_rtc > (1.1 * recovery_buffer_ticks) )) {
 					// Double check the age of the packet within our receiver queue
@@ -942,9 +1215,7 @@ static void receiver_output(struct rist_receiver *ctx, struct rist_flow *f)
 					rist_log_priv(&ctx->common, RIST_LOG_ERROR,
 							"Discontinuity, expected %" PRIu32 " got %" PRIu32 "\n",
 							f->last_seq_output + 1, b->seq);
-					pthread_mutex_lock(&ctx->common.stats_lock);
-					f->stats_instant.lost++;
-					pthread_mutex_unlock(&ctx->common.stats_lock);
+					rist_stats_counter_add(&f->output_stats.lost, 1);
 					holes = 1;
 				}
 				if (b->type == RIST_PAYLOAD_TYPE_DATA_RAW) {
@@ -957,15 +1228,22 @@ static void receiver_output(struct rist_receiver *ctx, struct rist_flow *f)
 					}
 					/* insert into fifo queue */
 					uint8_t *payload = b->data;
-					struct rist_data_block *block = new_data_block(
+					struct rist_data_block *block;
+					if (b->pooled_block) {
+						// Zero-copy: the pooled block carries the payload to the application
+						block = pooled_data_block(b, &payload[b->data_offset], f->flow_id, flags);
+						b->pooled_block = NULL;
+					} else
+						block = new_data_block(
 							NULL, b,
-							&payload[RIST_MAX_PAYLOAD_OFFSET], f->flow_id, flags);
+							&payload[b->data_offset], f->flow_id, flags);
 					b->data = NULL;
 					if (ctx->receiver_data_callback && block) {
 						rist_ref_inc(block->ref);
 						// send to callback synchronously
 						ctx->receiver_data_callback(ctx->receiver_data_callback_argument,
 								block);
+						now_monotonic = timestampNTP_u64();
 					}
 
 					size_t dataout_fifo_write_index = atomic_load_explicit(&f->dataout_fifo_queue_write_index, memory_order_relaxed);
@@ -979,8 +1257,22 @@ static void receiver_output(struct rist_receiver *ctx, struct rist_flow *f)
 					} else
 					{
 						f->dataout_fifo_queue[dataout_fifo_write_index] = block;
-						atomic_store_explicit(&f->dataout_fifo_queue_write_index, (dataout_fifo_write_index + 1)& (ctx->fifo_queue_size-1), memory_order_relaxed);
+						atomic_store_explicit(&f->dataout_fifo_queue_write_index, (dataout_fifo_write_index + 1)& (ctx->fifo_queue_size-1), memory_order_release);
 						// Wake up the fifo read thread (poll)
+#if HAVE_EVENTFD
+						int data_ready_eventfd = atomic_load_explicit(&ctx->receiver_data_ready_eventfd, memory_order_acquire);
+						if (data_ready_eventfd >= 0) {
+							// Only signal a reader that went idle on an empty fifo, pairs with the fence in the read path
+							atomic_thread_fence(memory_order_seq_cst);
+							if (atomic_exchange_explicit(&ctx->receiver_data_ready_armed, false, memory_order_acq_rel)) {
+								uint64_t one = 1;
+								if (write(data_ready_eventfd, &one, sizeof(one)) == -1)
+								{
+									// The counter can only overflow when nobody reads it, nothing to do
+								}
+							}
+						} else
+#endif
 						if (ctx->receiver_data_ready_notify_fd) {
 							// send a data ready signal by writing a single byte of value 0
 							char empty = '\0';
@@ -991,13 +1283,8 @@ static void receiver_output(struct rist_receiver *ctx, struct rist_flow *f)
 							}
 						}
 					}
-					pthread_mutex_lock(&ctx->common.stats_lock);
-					if (f->stats_instant.buffer_duration_count < 2048)
-					{
-						f->stats_instant.buffer_duration[f->stats_instant.buffer_duration_count] = (uint32_t)(delay_rtc / RIST_CLOCK);
-						f->stats_instant.buffer_duration_count++;
-					}
-					pthread_mutex_unlock(&ctx->common.stats_lock);
+					rist_stats_counter_add(&f->output_stats.buffer_duration_sum, (unsigned long)(delay_rtc / RIST_CLOCK));
+					rist_stats_counter_add(&f->output_stats.buffer_duration_count, 1);
 					if (pthread_cond_signal(&(ctx->condition)))
 						rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Call to pthread_cond_signal failed.\n");
 				}
@@ -1036,12 +1323,13 @@ next:
 
 }
 
+/* Caller holds peerlist_lock */
 static void send_nack_group(struct rist_receiver *ctx, struct rist_flow *f)
 {
 	// Now actually send all the nack IP packets for this flow (the above routing will process/group them)
+	RIST_MARK_UNUSED(ctx);
 	if (f->nacks.counter == 0)
 		return;
-	pthread_mutex_lock(&ctx->common.peerlist_lock);
 	struct rist_peer *peer = NULL;
 	uint64_t last_rtt = UINT64_MAX;
 	if (f->peer_lst_len == 0 || f->peer_lst == NULL)
@@ -1073,45 +1361,61 @@ static void send_nack_group(struct rist_receiver *ctx, struct rist_flow *f)
 	}
 	f->nacks.counter = 0;
 out:
-	pthread_mutex_unlock(&ctx->common.peerlist_lock);
+	return;
 }
 
 void receiver_nack_output(struct rist_receiver *ctx, struct rist_flow *f)
 {
 
 	if (!f->authenticated) {
+		// Holes found before the flow got authenticated are looked at again later
+		if (rist_receiver_missing_next(f, 0) != f->receiver_queue_max)
+			rist_timer_arm(f->timers, &f->nack_timer, timestampNTP_u64() + ctx->common.rist_max_jitter);
 		return;
 	}
 
 	const size_t maxcounter = RIST_MAX_NACKS;
+	uint64_t next_nack = UINT64_MAX;
 
-	/* Now loop through missing queue and process items */
-	struct rist_missing_buffer *mb = f->missing;
-	struct rist_missing_buffer **prev = &f->missing;
-	struct rist_missing_buffer *previous = NULL;
+	/* Now walk the outstanding holes of the missing ring, oldest first:
+	 * from the output position to the end of the ring and then wrapping */
+	const size_t start = (f->last_seq_output + 1) & (f->receiver_queue_max - 1);
+	size_t idx = rist_receiver_missing_next(f, start);
+	bool wrapped = false;
 	int empty = 0;
 	uint32_t seq_msb = 0;
-	if (mb)
-		seq_msb = mb->seq >> 16;
+	bool seq_msb_set = false;
 
-	while (mb) {
+	for (;;) {
+		if (idx == f->receiver_queue_max) {
+			if (wrapped || start == 0)
+				break;
+			wrapped = true;
+			idx = rist_receiver_missing_next(f, 0);
+			continue;
+		}
+		if (wrapped && idx >= start)
+			break;
+		struct rist_missing_buffer *mb = &f->missing[idx];
+		if (!seq_msb_set) {
+			seq_msb = mb->seq >> 16;
+			seq_msb_set = true;
+		}
 		int remove_from_queue_reason = 0;
 		struct rist_peer *peer = mb->peer;
-		ssize_t idx = mb->seq& (f->receiver_queue_max -1);
 		if (peer->config.recovery_mode == RIST_RECOVERY_MODE_DISABLED) {
 			rist_log_priv(&ctx->common, RIST_LOG_ERROR,
 					"Nack processing is disabled for this peer, removing seq %"PRIu32" from queue ...\n",
 					mb->seq);
 			remove_from_queue_reason = 10;
-			f->stats_instant.missing--;
+			rist_stats_counter_sub(&f->counters.missing, 1);
 			goto nack_loop_continue;
 		} else if (f->receiver_queue[idx]) {
 			if (f->receiver_queue[idx]->seq == mb->seq) {
-				pthread_mutex_lock(&ctx->common.stats_lock);
 				// We filled in the hole already ... packet has been recovered
 				remove_from_queue_reason = 3;
 				if (mb->nack_count > 0)
-					f->stats_instant.recovered++;
+					rist_stats_counter_add(&f->counters.recovered, 1);
 				switch(mb->nack_count) {
 					case 0:
 						break;
@@ -1132,7 +1436,6 @@ void receiver_nack_output(struct rist_receiver *ctx, struct rist_flow *f)
 						break;
 				}
 				f->stats_instant.recovered_sum += mb->nack_count;
-				pthread_mutex_unlock(&ctx->common.stats_lock);
 			}
 			else {
 				// Message with wrong seq!!!
@@ -1140,9 +1443,7 @@ void receiver_nack_output(struct rist_receiver *ctx, struct rist_flow *f)
 						"Retry queue has the wrong seq %"PRIu32" != %"PRIu32", removing ...\n",
 						f->receiver_queue[idx]->seq, mb->seq);
 				remove_from_queue_reason = 4;
-				pthread_mutex_lock(&ctx->common.stats_lock);
-				f->stats_instant.missing--;
-				pthread_mutex_unlock(&ctx->common.stats_lock);
+				rist_stats_counter_sub(&f->counters.missing, 1);
 				goto nack_loop_continue;
 			}
 		} else if (peer->buffer_bloat_active) {
@@ -1178,6 +1479,7 @@ void receiver_nack_output(struct rist_receiver *ctx, struct rist_flow *f)
 							seq_msb, mb->seq >> 16, mb->seq, f->nacks.counter,
 							f->missing_counter);
 				send_nack_group(ctx, f);
+				seq_msb = mb->seq >> 16;
 			}
 			else if (f->nacks.counter == (maxcounter - 1)) {
 				rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
@@ -1201,26 +1503,23 @@ nack_loop_continue:
 				rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
 						"Removing seq %" PRIu32 " from missing, queue size is %d, retry #%u, age %"PRIu64"ms, reason %d\n",
 						mb->seq, f->missing_counter, mb->nack_count, (timestampNTP_u64() - mb->insertion_time) / RIST_CLOCK, remove_from_queue_reason);
-			struct rist_missing_buffer *next = mb->next;
-			if (!next)
-				f->missing_tail = previous;
-			*prev = next;
-			if (mb->nack_count != 0)
-				f->missing_counter--;
-			free(mb);
-			mb = next;
-		} else {
-			/* Move it to the end of the queue */
-			// TODO: I think this is wrong and we loose nacks when we get here
-			previous = mb;
-			prev = &mb->next;
-			mb = mb->next;
-		}
+			rist_receiver_missing_remove(f, idx);
+		} else if (mb->next_nack < next_nack)
+			next_nack = mb->next_nack;
+		idx = rist_receiver_missing_next(f, idx + 1);
 	}
 
 	// Empty all peer nack queues, i.e. send them
 	send_nack_group(ctx, f);
 
+	// Come back for the earliest outstanding deadline, holes that could not be
+	// nacked yet (collapsed link) are retried at the rist_max_jitter interval
+	if (next_nack != UINT64_MAX) {
+		uint64_t now = timestampNTP_u64();
+		uint64_t flow_now = RIST_LIKELY(!f->rtc_timing_mode) ? now : timestampNTP_RTC_u64();
+		uint64_t delay = next_nack > flow_now ? next_nack - flow_now : (uint64_t)ctx->common.rist_max_jitter;
+		rist_timer_arm(f->timers, &f->nack_timer, now + delay);
+	}
 }
 
 static int rist_set_manual_sockdata(struct rist_peer *peer, const struct rist_peer_config *config)
@@ -1434,14 +1733,10 @@ void rist_peer_authenticate(struct rist_peer *peer)
 			"Successfully Authenticated peer %"PRIu32"\n", peer->adv_peer_id);
 }
 
-void rist_calculate_bitrate(size_t len, struct rist_bandwidth_estimation *bw)
+void rist_calculate_bitrate(size_t len, struct rist_bandwidth_estimation *bw, uint64_t now)
 {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	uint64_t now = (uint64_t)tv.tv_sec * 1000000;
-	now += tv.tv_usec;
-	uint64_t time = now - bw->last_bitrate_calctime;
-	uint64_t time_fast = now - bw->last_bitrate_calctime_fast;
+	uint64_t time = rist_ntp_to_us(now - bw->last_bitrate_calctime);
+	uint64_t time_fast = rist_ntp_to_us(now - bw->last_bitrate_calctime_fast);
 
 	if (!bw->last_bitrate_calctime) {
 		bw->last_bitrate_calctime = now;
@@ -1479,17 +1774,14 @@ void rist_calculate_bitrate(size_t len, struct rist_bandwidth_estimation *bw)
 	}
 }
 
-static void rist_calculate_flow_bitrate(struct rist_flow *flow, size_t len, struct rist_bandwidth_estimation *bw)
+static void rist_calculate_flow_bitrate(struct rist_flow *flow, size_t len, struct rist_bandwidth_estimation *bw, uint64_t now)
 {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	uint64_t now = (uint64_t)tv.tv_sec * 1000000;
-	now += tv.tv_usec;
-	uint64_t time = now - bw->last_bitrate_calctime;
-	uint64_t time_fast = now - bw->last_bitrate_calctime_fast;
+	uint64_t time = rist_ntp_to_us(now - bw->last_bitrate_calctime);
+	uint64_t time_fast = rist_ntp_to_us(now - bw->last_bitrate_calctime_fast);
 
 	if (!bw->last_bitrate_calctime) {
 		bw->last_bitrate_calctime = now;
+		bw->last_bitrate_calctime_fast = now;
 		bw->eight_times_bitrate = 0;
 		bw->bitrate = 0;
 		bw->bytes = 0;
@@ -1506,7 +1798,7 @@ static void rist_calculate_flow_bitrate(struct rist_flow *flow, size_t len, stru
 		flow->stats_instant.max_ips = 0ULL;
 		flow->stats_instant.avg_count = 0UL;
 	} else {
-		flow->stats_instant.cur_ips = now - flow->last_ipstats_time;
+		flow->stats_instant.cur_ips = rist_ntp_to_us(now - flow->last_ipstats_time);
 		/* Set new min */
 		if (flow->stats_instant.cur_ips < flow->stats_instant.min_ips)
 			flow->stats_instant.min_ips = flow->stats_instant.cur_ips;
@@ -1566,6 +1858,8 @@ static void rist_sender_recv_nack(struct rist_peer *peer,
 
 	struct rist_rtcp_hdr *rtcp = (struct rist_rtcp_hdr *) payload;
 	uint32_t i,j;
+	// One timestamp for every seq requested by this nack
+	uint64_t now = timestampNTP_u64();
 
 	if ((rtcp->flags & 0xc0) != 0x80) {
 		rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Malformed nack packet flags=%d.\n", rtcp->flags);
@@ -1586,10 +1880,10 @@ static void rist_sender_recv_nack(struct rist_peer *peer,
 			struct rist_rtp_nack_record *nr = (struct rist_rtp_nack_record *)(payload + sizeof(struct rist_rtcp_nack_range) + i * sizeof(struct rist_rtp_nack_record));
 			missing =  ntohs(nr->start);
 			additional = ntohs(nr->extra);
-			rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + (uint32_t)missing, peer);
+			rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + (uint32_t)missing, peer, now);
 			//rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Record %"PRIu32": base packet: %"PRIu32" range len: %d\n", i, nack_seq_msb + missing, additional);
 			for (j = 0; j < additional; j++) {
-				rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + (uint32_t)missing + j + 1, peer);
+				rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + (uint32_t)missing + j + 1, peer, now);
 			}
 		}
 	} else if (rtcp->ptype == PTYPE_NACK_BITMASK) {
@@ -1603,11 +1897,11 @@ static void rist_sender_recv_nack(struct rist_peer *peer,
 			struct rist_rtp_nack_record *nr = (struct rist_rtp_nack_record *)(payload + sizeof(struct rist_rtcp_nack_bitmask) + i * sizeof(struct rist_rtp_nack_record));
 			missing = ntohs(nr->start);
 			bitmask = ntohs(nr->extra);
-			rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + (uint32_t)missing, peer);
+			rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + (uint32_t)missing, peer, now);
 			//rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Record %"PRIu32": base packet: %"PRIu32" bitmask: %04x\n", i, nack_seq_msb + missing, bitmask);
 			for (j = 0; j < 16; j++) {
 				if ((bitmask & (1 << j)) == (1 << j))
-					rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + missing + j + 1, peer);
+					rist_retry_enqueue(peer->sender_ctx, nack_seq_msb + missing + j + 1, peer, now);
 			}
 		}
 	} else {
@@ -1862,6 +2156,256 @@ static bool rist_receiver_rtcp_authenticate(struct rist_peer *peer, uint32_t seq
 	}
 }
 
+/* Member seq of a row or column, extended to 32 bits around the last seq found */
+static uint32_t receiver_fec_seq(struct rist_flow *f, uint16_t seq16)
+{
+	if (f->short_seq)
+		return seq16;
+	uint32_t seq = (f->last_seq_found & ~(uint32_t)UINT16_MAX) | seq16;
+	int32_t diff = (int32_t)(seq - f->last_seq_found);
+	if (diff > INT16_MAX)
+		seq -= UINT16_SIZE;
+	else if (diff < INT16_MIN)
+		seq += UINT16_SIZE;
+	return seq;
+}
+
+/* Rebuilds the one packet missing from the row or column of a parity packet and queues it
+ * ahead of its NACK. Returns 1 when it did, 0 when the parity has to wait for more packets
+ * and -1 when it is of no further use */
+static int receiver_fec_repair(struct rist_flow *f, struct rist_peer *peer, struct rist_fec_pending *e, uint8_t *buf,
+		uint16_t src_port, uint16_t dst_port, uint64_t now)
+{
+	const uint32_t seq_mask = f->short_seq ? UINT16_MAX : UINT32_MAX;
+	uint32_t missing_seq = 0;
+	int missing = 0;
+
+	// The output thread frees what it hands out under the flow mutex
+	pthread_mutex_lock(&f->mutex);
+	const size_t mask = f->receiver_queue_max - 1;
+	for (int i = 0; i < e->hdr.na; i++) {
+		uint32_t seq = receiver_fec_seq(f, (uint16_t)(e->hdr.sn_base + i * e->hdr.offset));
+		uint32_t ahead = (seq - f->last_seq_output) & seq_mask;
+		if (ahead == 0 || ahead > seq_mask / 2) {
+			// Already output, its payload is gone
+			pthread_mutex_unlock(&f->mutex);
+			return -1;
+		}
+		struct rist_buffer *b = f->receiver_queue[seq & mask];
+		if (b && b->seq == seq)
+			continue;
+		// Not overdue yet, it may still be on its way
+		if (((f->last_seq_found - seq) & seq_mask) > seq_mask / 2 || ++missing > 1) {
+			pthread_mutex_unlock(&f->mutex);
+			return 0;
+		}
+		missing_seq = seq;
+	}
+	if (missing == 0) {
+		pthread_mutex_unlock(&f->mutex);
+		return -1;
+	}
+	memcpy(buf, e->payload, e->size);
+	uint16_t length = e->hdr.length_recovery;
+	uint32_t ts = e->hdr.ts_recovery;
+	for (int i = 0; i < e->hdr.na; i++) {
+		uint32_t seq = receiver_fec_seq(f, (uint16_t)(e->hdr.sn_base + i * e->hdr.offset));
+		if (seq == missing_seq)
+			continue;
+		struct rist_buffer *b = f->receiver_queue[seq & mask];
+		if (b->size > e->size) {
+			pthread_mutex_unlock(&f->mutex);
+			return -1;
+		}
+		rist_fec_xor(buf, (const uint8_t *)b->data + b->data_offset, b->size);
+		length ^= (uint16_t)b->size;
+		ts ^= rist_fec_rtp_ts(b->source_time);
+	}
+	pthread_mutex_unlock(&f->mutex);
+	if (length == 0 || length > e->size)
+		return -1;
+
+	uint64_t source_time;
+	if (RIST_UNLIKELY(peer->config.timing_mode == RIST_TIMING_MODE_ARRIVAL))
+		source_time = now;
+	else
+		source_time = convertRTPtoNTP(RTP_PTYPE_MPEGTS, 0, ts);
+	// Queued like a retransmit, so it fills the hole without marking anything missing
+	struct rist_pooled_block *no_block = NULL;
+	if (receiver_enqueue(f, peer, &no_block, source_time, now, buf, length, missing_seq, 0, true, src_port, dst_port, RTP_PTYPE_MPEGTS) != 0)
+		return -1;
+	rist_stats_counter_add(&f->counters.fec_recovered, 1);
+	rist_log_priv(get_cctx(peer), RIST_LOG_DEBUG, "Rebuilt seq %"PRIu32" from %s parity\n", missing_seq, e->hdr.row ? "row" : "column");
+	return 1;
+}
+
+static void receiver_fec_receive(struct rist_receiver_worker_item *item)
+{
+	struct rist_flow *f = item->flow;
+	struct rist_fec_header hdr;
+	if (!f->receiver_queue_has_items || rist_fec_header_read(item->data, item->len, &hdr) != 0)
+		return;
+	size_t size = item->len - RIST_FEC_HEADER_SIZE;
+	if (size > RIST_MAX_PACKET_SIZE)
+		return;
+	if (!f->fec) {
+		f->fec = calloc(1, sizeof(*f->fec));
+		if (!f->fec)
+			return;
+	}
+	if (!rist_fec_decoder_add(f->fec, &hdr, item->data + RIST_FEC_HEADER_SIZE, size))
+		return;
+
+	// A rebuilt packet can complete another row or column, go over them until nothing changes
+	uint8_t buf[RIST_MAX_PACKET_SIZE];
+	bool repaired;
+	do {
+		repaired = false;
+		for (size_t i = 0; i < f->fec->count;) {
+			int ret = receiver_fec_repair(f, item->peer, &f->fec->pending[i], buf, item->src_port, item->dst_port, item->packet_recv_time);
+			if (ret == 0) {
+				i++;
+				continue;
+			}
+			rist_fec_decoder_remove(f->fec, i);
+			if (ret > 0)
+				repaired = true;
+		}
+	} while (repaired);
+}
+
+/* Per-flow half of data reception, runs on the thread owning the flow */
+static void receiver_deliver_data(struct rist_receiver *ctx, struct rist_receiver_worker_item *item, struct rist_pooled_block **rx_block)
+{
+	struct rist_flow *f = item->flow;
+
+	if (RIST_UNLIKELY(item->fec)) {
+		receiver_fec_receive(item);
+		return;
+	}
+
+	if (item->ssrc_mismatch && f->flow_id_actual != item->flow_id)
+	{
+          rist_log_priv(&ctx->common, RIST_LOG_NOTICE,
+                        "Detected flow id change, old flow id: %u new id: %u, "
+                        "resetting state\n",
+                        f->flow_id_actual, item->flow_id);
+        f->receiver_queue_has_items = false;
+        f->flow_id_actual = item->flow_id;
+	}
+
+	// Wake up output thread when data comes in
+	if (pthread_cond_signal(&(f->condition)))
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Call to pthread_cond_signal failed.\n");
+	if (!receiver_enqueue(f, item->peer, rx_block, item->source_time, item->packet_recv_time, item->data, item->len, item->seq, item->rtt, item->retry, item->src_port, item->dst_port, item->payload_type)) {
+		rist_calculate_flow_bitrate(f, item->len, &f->bw, item->packet_recv_time); // update bitrate only if not a dupe
+
+	}
+}
+
+/* Hands a data packet to the worker owning its flow. The payload must outlive the receive
+ * buffer, so the zero-copy block is stolen when the payload lives in it, otherwise it is copied */
+static void receiver_worker_post(struct rist_receiver_worker *w, struct rist_receiver_worker_item *item)
+{
+	struct rist_common_ctx *cctx = &w->ctx->common;
+	struct rist_pooled_block *pb = cctx->rx_block;
+	if (pb && item->data >= pb->data && item->data + item->len <= pb->data + RIST_BLOCK_POOL_DATA_SIZE) {
+		item->block = pb;
+		cctx->rx_block = NULL;
+	} else if (cctx->block_pool && item->len <= RIST_BLOCK_POOL_DATA_SIZE) {
+		item->block = rist_block_pool_get(cctx->block_pool);
+		if (!item->block)
+			return;
+		memcpy(item->block->data, item->data, item->len);
+		item->data = item->block->data;
+	} else {
+		item->copy = malloc(item->len);
+		if (!item->copy)
+			return;
+		memcpy(item->copy, item->data, item->len);
+		item->data = item->copy;
+	}
+
+	struct rist_receiver *ctx = w->ctx;
+	if (ctx->worker_staging) {
+		if (ctx->worker_stage_count == RIST_RECV_BATCH_SIZE)
+			rist_receiver_worker_stage_flush(ctx);
+		ctx->worker_stage[ctx->worker_stage_count++] = *item;
+		return;
+	}
+
+	pthread_mutex_lock(&w->lock);
+	if (w->queue_count == RIST_RECEIVER_WORKER_QUEUE_SIZE) {
+		uint64_t dropped = ++w->queue_dropped;
+		pthread_mutex_unlock(&w->lock);
+		if (dropped == 1 || (dropped % 1000) == 0)
+			rist_log_priv(cctx, RIST_LOG_WARN, "Receiver worker %zu queue is full, %"PRIu64" packets dropped\n", w->index, dropped);
+		if (item->block)
+			rist_block_pool_put(item->block);
+		free(item->copy);
+		return;
+	}
+	w->queue[(w->queue_head + w->queue_count) & (RIST_RECEIVER_WORKER_QUEUE_SIZE - 1)] = *item;
+	if (w->queue_count++ == 0)
+		pthread_cond_signal(&w->condition);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* Posts the staged items in order, taking each worker's lock and waking it once */
+void rist_receiver_worker_stage_flush(struct rist_receiver *ctx)
+{
+	size_t count = ctx->worker_stage_count;
+	bool posted[RIST_RECV_BATCH_SIZE] = { false };
+	ctx->worker_stage_count = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (posted[i])
+			continue;
+		struct rist_receiver_worker *w = ctx->worker_stage[i].flow->worker;
+		uint64_t dropped = 0;
+		pthread_mutex_lock(&w->lock);
+		bool was_empty = w->queue_count == 0;
+		for (size_t j = i; j < count; j++) {
+			struct rist_receiver_worker_item *item = &ctx->worker_stage[j];
+			if (posted[j] || item->flow->worker != w)
+				continue;
+			posted[j] = true;
+			if (w->queue_count == RIST_RECEIVER_WORKER_QUEUE_SIZE) {
+				dropped++;
+				if (item->block)
+					rist_block_pool_put(item->block);
+				free(item->copy);
+				continue;
+			}
+			w->queue[(w->queue_head + w->queue_count) & (RIST_RECEIVER_WORKER_QUEUE_SIZE - 1)] = *item;
+			w->queue_count++;
+		}
+		if (was_empty && w->queue_count > 0)
+			pthread_cond_signal(&w->condition);
+		w->queue_dropped += dropped;
+		uint64_t total = w->queue_dropped;
+		pthread_mutex_unlock(&w->lock);
+		if (dropped && (total == dropped || total / 1000 != (total - dropped) / 1000))
+			rist_log_priv(&ctx->common, RIST_LOG_WARN, "Receiver worker %zu queue is full, %"PRIu64" packets dropped\n", w->index, total);
+	}
+}
+
+/* Drops staged items of a flow or peer that is going away before the batch is flushed */
+static void receiver_worker_stage_purge(struct rist_receiver *ctx, struct rist_flow *f, struct rist_peer *peer)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < ctx->worker_stage_count; i++) {
+		struct rist_receiver_worker_item *item = &ctx->worker_stage[i];
+		if ((f && item->flow == f) || (peer && item->peer == peer)) {
+			if (item->block)
+				rist_block_pool_put(item->block);
+			free(item->copy);
+			continue;
+		}
+		ctx->worker_stage[kept++] = *item;
+	}
+	ctx->worker_stage_count = kept;
+}
+
 static void rist_receiver_recv_data(struct rist_peer *peer, uint32_t seq, uint32_t flow_id,
 		uint64_t source_time, uint64_t packet_recv_time, struct rist_buffer *payload, uint8_t retry, uint8_t payload_type)
 {
@@ -1902,27 +2446,49 @@ static void rist_receiver_recv_data(struct rist_peer *peer, uint32_t seq, uint32
 		rtt = peer->config.recovery_reorder_buffer;
 	}
 
-	if (peer->peer_rtcp != NULL &&
-		peer->peer_ssrc != peer->peer_rtcp->peer_ssrc &&
-		peer->flow->flow_id_actual != flow_id)
-	{
-          rist_log_priv(&ctx->common, RIST_LOG_NOTICE,
-                        "Detected flow id change, old flow id: %u new id: %u, "
-                        "resetting state\n",
-                        peer->flow->flow_id_actual, flow_id);
-        peer->flow->receiver_queue_has_items = false;
-        peer->flow->flow_id_actual = flow_id;
-	}
-
-	// Wake up output thread when data comes in
-	if (pthread_cond_signal(&(peer->flow->condition)))
-		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Call to pthread_cond_signal failed.\n");
-	if (!receiver_enqueue(peer, source_time, packet_recv_time, payload->data, payload->size, seq, rtt, retry, payload->src_port, payload->dst_port, payload_type)) {
-		pthread_mutex_lock(&ctx->common.stats_lock);
-		rist_calculate_flow_bitrate(peer->flow, payload->size, &peer->flow->bw); // update bitrate only if not a dupe
-		pthread_mutex_unlock(&ctx->common.stats_lock);
+	struct rist_receiver_worker_item item = {
+		.flow = peer->flow,
+		.peer = peer,
+		.data = payload->data,
+		.len = payload->size,
+		.source_time = source_time,
+		.packet_recv_time = packet_recv_time,
+		.rtt = rtt,
+		.seq = seq,
+		.flow_id = flow_id,
+		.src_port = payload->src_port,
+		.dst_port = payload->dst_port,
+		.payload_type = payload_type,
+		.retry = retry,
+		.ssrc_mismatch = peer->peer_rtcp != NULL && peer->peer_ssrc != peer->peer_rtcp->peer_ssrc,
+	};
+	if (peer->flow->worker)
+		receiver_worker_post(peer->flow->worker, &item);
+	else
+		receiver_deliver_data(ctx, &item, &ctx->common.rx_block);
+}
 
-	}
+/* Parity packets take the same way to the thread owning the flow as data */
+static void rist_receiver_recv_fec(struct rist_peer *peer, uint64_t packet_recv_time, struct rist_buffer *payload)
+{
+	// Only useful to a flow the data set up already
+	if (!peer->flow)
+		return;
+	struct rist_receiver *ctx = peer->receiver_ctx;
+	struct rist_receiver_worker_item item = {
+		.flow = peer->flow,
+		.peer = peer,
+		.data = payload->data,
+		.len = payload->size,
+		.packet_recv_time = packet_recv_time,
+		.src_port = payload->src_port,
+		.dst_port = payload->dst_port,
+		.fec = true,
+	};
+	if (peer->flow->worker)
+		receiver_worker_post(peer->flow->worker, &item);
+	else
+		receiver_deliver_data(ctx, &item, &ctx->common.rx_block);
 }
 
 static void rist_recv_oob_data(struct rist_peer *peer, struct rist_buffer *payload)
@@ -2337,33 +2903,124 @@ static void rist_new_connection(struct rist_peer *peer, struct rist_peer *p, uin
 	}
 }
 
-static void rist_peer_recv(struct evsocket_ctx *evctx, int fd, short revents, void *arg, bool *again)
+static void rist_peer_recv_packet(struct rist_peer *peer, uint8_t *recv_buf, size_t recv_bufsize, struct sockaddr *addr, socklen_t addrlen, uint64_t now);
+
+#if HAVE_RECVMMSG
+static void rist_peer_recv_batch(struct rist_peer *peer, int fd, bool *again)
 {
-	RIST_MARK_UNUSED(evctx);
-	RIST_MARK_UNUSED(revents);
-	RIST_MARK_UNUSED(fd);
+	struct rist_common_ctx *cctx = get_cctx(peer);
+	struct mmsghdr msgs[RIST_RECV_BATCH_SIZE];
+	struct iovec iovecs[RIST_RECV_BATCH_SIZE][2];
+	struct sockaddr_storage addrs[RIST_RECV_BATCH_SIZE];
 
-	struct rist_peer *peer = (struct rist_peer *) arg;
-	if (atomic_load_explicit(&peer->shutdown, memory_order_acquire)) {
-		return;
+	for (int i = 0; i < RIST_RECV_BATCH_SIZE; i++)
+	{
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+		msgs[i].msg_hdr.msg_iov = iovecs[i];
+		if (cctx->block_pool && !cctx->recv_blocks[i])
+			cctx->recv_blocks[i] = rist_block_pool_get(cctx->block_pool);
+		if (cctx->recv_blocks[i]) {
+			// Zero-copy: land the datagram in a pooled block, anything larger spills into the ring entry
+			iovecs[i][0].iov_base = cctx->recv_blocks[i]->data;
+			iovecs[i][0].iov_len = RIST_BLOCK_POOL_DATA_SIZE;
+			iovecs[i][1].iov_base = &cctx->recv_ring[i][RIST_BLOCK_POOL_DATA_SIZE];
+			iovecs[i][1].iov_len = RIST_MAX_PACKET_SIZE - RIST_BLOCK_POOL_DATA_SIZE;
+			msgs[i].msg_hdr.msg_iovlen = 2;
+		} else {
+			iovecs[i][0].iov_base = cctx->recv_ring[i];
+			iovecs[i][0].iov_len = RIST_MAX_PACKET_SIZE;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
 	}
-	uint64_t now = timestampNTP_u64();
-	struct rist_common_ctx *cctx = get_cctx(peer);
 
-	socklen_t addrlen = peer->address_len;
-	size_t recv_bufsize = 0;
-	uint16_t family = peer->address_family;
+	int ret = recvmmsg(peer->sd, msgs, RIST_RECV_BATCH_SIZE, MSG_DONTWAIT, NULL);
+	if (ret <= 0) {
+		*again = false;
+		int errorcode = errno;
+		if (errorcode == EAGAIN || errorcode == EWOULDBLOCK)
+			return;
+		if (errorcode == ENOSYS) {
+			// Kernel without recvmmsg support, permanently switch to recvfrom
+			rist_log_priv(cctx, RIST_LOG_WARN, "recvmmsg is not supported, falling back to single datagram receive\n");
+			cctx->recvmmsg_disabled = true;
+			*again = true;
+			return;
+		}
+		rist_log_priv(cctx, RIST_LOG_ERROR, "Receive failed: errno=%d, ret=%d, socket=%d\n", errorcode, ret, fd);
+		rist_log_priv(cctx, RIST_LOG_ERROR, "%s\n", strerror(errorcode));
+		return;
+	}
+
+	// The whole batch was already queued in the socket, so it shares one arrival timestamp
+	uint64_t now = timestampNTP_u64();
+	// Datagrams are still parsed, decrypted and queued one at a time. Decrypting them all first
+	// would hold peer_lock across the replies rist_peer_recv_packet sends (gre.c takes it too),
+	// and a nonce change or bad decryption must take effect from the next datagram on.
+	// Data for the receiver workers is collected over the batch and handed over at its end
+	struct rist_receiver *receiver_ctx = peer->receiver_ctx;
+	if (receiver_ctx && receiver_ctx->workers)
+		receiver_ctx->worker_staging = true;
+	for (int i = 0; i < ret; i++)
+	{
+		if (atomic_load_explicit(&peer->shutdown, memory_order_acquire))
+			break;
+		struct rist_pooled_block *pb = cctx->recv_blocks[i];
+		if (!pb) {
+			rist_peer_recv_packet(peer, cctx->recv_ring[i], msgs[i].msg_len, (struct sockaddr *)&addrs[i], msgs[i].msg_hdr.msg_namelen, now);
+			continue;
+		}
+		if (msgs[i].msg_len > RIST_BLOCK_POOL_DATA_SIZE) {
+			// Spilled over, reassemble it in the ring entry and take the copy path
+			memcpy(cctx->recv_ring[i], pb->data, RIST_BLOCK_POOL_DATA_SIZE);
+			rist_peer_recv_packet(peer, cctx->recv_ring[i], msgs[i].msg_len, (struct sockaddr *)&addrs[i], msgs[i].msg_hdr.msg_namelen, now);
+			continue;
+		}
+		cctx->rx_block = pb;
+		rist_peer_recv_packet(peer, pb->data, msgs[i].msg_len, (struct sockaddr *)&addrs[i], msgs[i].msg_hdr.msg_namelen, now);
+		// The block is consumed when its payload was queued, it is replaced on the next call
+		if (!cctx->rx_block)
+			cctx->recv_blocks[i] = NULL;
+		cctx->rx_block = NULL;
+	}
+	if (receiver_ctx && receiver_ctx->worker_staging) {
+		rist_receiver_worker_stage_flush(receiver_ctx);
+		receiver_ctx->worker_staging = false;
+	}
+	// A short batch means the socket has been drained
+	if (ret < RIST_RECV_BATCH_SIZE)
+		*again = false;
+}
+#endif
+
+static void rist_peer_recv(struct evsocket_ctx *evctx, int fd, short revents, void *arg, bool *again)
+{
+	RIST_MARK_UNUSED(evctx);
+	RIST_MARK_UNUSED(revents);
+	RIST_MARK_UNUSED(fd);
+
+	struct rist_peer *peer = (struct rist_peer *) arg;
+	if (atomic_load_explicit(&peer->shutdown, memory_order_acquire)) {
+		*again = false;
+		return;
+	}
+	struct rist_common_ctx *cctx = get_cctx(peer);
+#if HAVE_RECVMMSG
+	if (RIST_LIKELY(cctx->recv_ring != NULL && !cctx->recvmmsg_disabled)) {
+		rist_peer_recv_batch(peer, fd, again);
+		return;
+	}
+#endif
+	uint64_t now = timestampNTP_u64();
+
+	socklen_t addrlen = peer->address_len;
+	size_t recv_bufsize = 0;
 	struct sockaddr_storage ss = {0};
 	struct sockaddr *addr = (struct sockaddr *)&ss;
-	struct rist_peer *p = NULL;
 	uint8_t *recv_buf = cctx->buf.recv;
-	uint16_t port = 0;
 
 	ssize_t ret = recvfrom(peer->sd, (char*)recv_buf, RIST_MAX_PACKET_SIZE, MSG_DONTWAIT, (struct sockaddr *)addr, &addrlen);
-	if (ss.ss_family == AF_INET)
-		port = htons(((struct sockaddr_in *)addr)->sin_port);
-	else
-		port = htons(((struct sockaddr_in6 *)addr)->sin6_port);
 
 #ifndef _WIN32
 	if (ret <= 0) {
@@ -2384,6 +3041,19 @@ static void rist_peer_recv(struct evsocket_ctx *evctx, int fd, short revents, vo
 	}
 
 	recv_bufsize = ret;
+	rist_peer_recv_packet(peer, recv_buf, recv_bufsize, addr, addrlen, now);
+}
+
+static void rist_peer_recv_packet(struct rist_peer *peer, uint8_t *recv_buf, size_t recv_bufsize, struct sockaddr *addr, socklen_t addrlen, uint64_t now)
+{
+	struct rist_common_ctx *cctx = get_cctx(peer);
+	uint16_t family = peer->address_family;
+	struct rist_peer *p = NULL;
+	uint16_t port = 0;
+	if (addr->sa_family == AF_INET)
+		port = htons(((struct sockaddr_in *)addr)->sin_port);
+	else
+		port = htons(((struct sockaddr_in6 *)addr)->sin6_port);
 
 	struct rist_key *k = &peer->key_rx;
 	uint32_t seq = 0;
@@ -2534,13 +3204,15 @@ static void rist_peer_recv(struct evsocket_ctx *evctx, int fd, short revents, vo
 					rist_log_priv(get_cctx(peer), RIST_LOG_DEBUG, "Receiving unknown RIST control packet\n");
 					return;
 				}
+			} else if (vsf_subtype == RIST_VSF_PROTOCOL_SUBTYPE_FEC) {
+				gre_proto = RIST_VSF_PROTOCOL_SUBTYPE_FEC;
 			} else {
 				rist_log_priv(get_cctx(peer), RIST_LOG_DEBUG, "Receiving unknown RIST packet\n");
 				return;
 			}
 		}
 
-		if (gre_proto != RIST_GRE_PROTOCOL_TYPE_REDUCED)
+		if (gre_proto != RIST_GRE_PROTOCOL_TYPE_REDUCED && gre_proto != RIST_VSF_PROTOCOL_SUBTYPE_FEC)
 			goto protocol_bypass;
 
 		if (recv_bufsize < payload_offset + 4) {
@@ -2559,7 +3231,7 @@ protocol_bypass:
 		p = _librist_peer_match_peer_addr(peer, family, addr);
 
     struct rist_rtp_hdr *rtp = (struct rist_rtp_hdr *)&recv_buf[payload_offset];
-	if (cctx->profile == RIST_PROFILE_SIMPLE || gre_proto == RIST_GRE_PROTOCOL_TYPE_REDUCED) {
+	if (cctx->profile == RIST_PROFILE_SIMPLE || gre_proto == RIST_GRE_PROTOCOL_TYPE_REDUCED || gre_proto == RIST_VSF_PROTOCOL_SUBTYPE_FEC) {
 		/* Double check for a valid rtp header */
 		if ((rtp->flags & 0xc0) != 0x80)
 		{
@@ -2764,8 +3436,23 @@ protocol_bypass:
 				{
 					payload.size -= sizeof(*hdr_ext);
 					data_payload += sizeof(*hdr_ext);
-					if (CHECK_BIT(hdr_ext->flags, 7))
-						expand_null_packets(data_payload, &payload.size, hdr_ext->npd_bits);
+					if (CHECK_BIT(hdr_ext->flags, RIST_RTP_EXT_FLAG_LZ4)) {
+						// Decompressed into the context scratch buffer, queueing copies it out
+						int decompressed_len = LZ4_decompress_safe((const char *)data_payload, (char *)cctx->buf.dec,
+							(int)payload.size, (int)sizeof(cctx->buf.dec));
+						if (decompressed_len < 0) {
+							rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Could not decompress LZ4 payload of %zu bytes, dropping packet\n", payload.size);
+							return;
+						}
+						data_payload = cctx->buf.dec;
+						payload.size = (size_t)decompressed_len;
+					}
+					if (CHECK_BIT(hdr_ext->flags, RIST_RTP_EXT_FLAG_NPD) &&
+						expand_null_packets(data_payload, &payload.size, hdr_ext->npd_bits) < 0) {
+						rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "Null packet deletion bits %02x do not match a payload of %zu bytes, dropping packet\n",
+							hdr_ext->npd_bits, payload.size);
+						return;
+					}
 				}
 				payload.data = (void *)data_payload;
 			}
@@ -2780,6 +3467,14 @@ protocol_bypass:
 			flow_id = be32toh(rtcp->ssrc);
 			payload.type = RIST_PAYLOAD_TYPE_RTCP;
 		}
+	} else if (gre_proto == RIST_VSF_PROTOCOL_SUBTYPE_FEC) {
+		if (recv_bufsize < payload_offset + sizeof(*rtp) + RIST_FEC_HEADER_SIZE)
+			return;
+		flow_id = be32toh(rtp->ssrc);
+		payload_offset += sizeof(*rtp);
+		payload.size = recv_bufsize - payload_offset;
+		payload.data = (void *)&recv_buf[payload_offset];
+		payload.type = RIST_PAYLOAD_TYPE_FEC;
 	}
 
 	// We need this protocol bypass to manage keepalives of any kind,
@@ -2860,7 +3555,7 @@ protocol_bypass:
 			}
 			rtp_time = be32toh(rtp->ts);
 			if (RIST_UNLIKELY(p->config.timing_mode == RIST_TIMING_MODE_ARRIVAL))
-				source_time = timestampNTP_u64();
+				source_time = now;
 			else
 				source_time = convertRTPtoNTP(rtp->payload_type, time_extension, rtp_time);
 			seq = (uint32_t)be16toh(rtp->seq);
@@ -2868,10 +3563,14 @@ protocol_bypass:
 				rist_log_priv(get_cctx(peer), RIST_LOG_WARN,
 						"Received data packet on sender, ignoring (%d bytes)...\n", payload.size);
 			else {
-				rist_calculate_bitrate((recv_bufsize - payload_offset), &p->bw);//use the unexpanded size to show real BW
+				rist_calculate_bitrate((recv_bufsize - payload_offset), &p->bw, now);//use the unexpanded size to show real BW
 				rist_receiver_recv_data(p, seq, flow_id, source_time, now, &payload, retry, rtp->payload_type);
 			}
 			break;
+		case RIST_PAYLOAD_TYPE_FEC:
+			if (p->receiver_mode)
+				rist_receiver_recv_fec(p, now, &payload);
+			break;
 		case RIST_PAYLOAD_TYPE_EAPOL:
 #if HAVE_SRP_SUPPORT
 			if (p->eap_ctx == NULL) {
@@ -2947,7 +3646,7 @@ int rist_oob_enqueue(struct rist_common_ctx *ctx, struct rist_peer *peer, const
 
 	/* insert into oob fifo queue */
 	pthread_rwlock_wrlock(&ctx->oob_queue_lock);
-	ctx->oob_queue[ctx->oob_queue_write_index] = rist_new_buffer(ctx, buf, len, RIST_PAYLOAD_TYPE_DATA_OOB, 0, 0, 0, 0);
+	ctx->oob_queue[ctx->oob_queue_write_index] = rist_new_buffer(ctx, buf, len, RIST_PAYLOAD_TYPE_DATA_OOB, 0, 0, 0, 0, timestampNTP_u64());
 	if (RIST_UNLIKELY(!ctx->oob_queue[ctx->oob_queue_write_index])) {
 		rist_log_priv(get_cctx(peer), RIST_LOG_ERROR, "\t Could not create oob packet buffer, OOM\n");
 		pthread_rwlock_unlock(&ctx->oob_queue_lock);
@@ -2995,6 +3694,57 @@ static void rist_oob_dequeue(struct rist_common_ctx *ctx, int maxcount)
 	return;
 }
 
+/* Idle time a pacer makes up at line rate, covers oversleeping the wakeup it asked for */
+#define RIST_PACER_BURST (2 * RIST_CLOCK)
+/* How far ahead of its departure a paced datagram is handed to the kernel when SO_TXTIME
+ * does the spacing, one wakeup of the protocol loop */
+#define RIST_PACER_TXTIME_HORIZON (RIST_CLOCK)
+
+static uint64_t sender_pacing_horizon(struct rist_sender *ctx, uint64_t now)
+{
+	return now + (rist_tx_batch_txtime_usable(ctx) ? RIST_PACER_TXTIME_HORIZON : 0);
+}
+
+/* Data is paced to the input bitrate plus a quarter, so a backlog still drains, and
+ * retransmits to what the largest recovery_maxbitrate leaves on top of that */
+static void sender_pacing_update(struct rist_sender *ctx, size_t collected, uint64_t now)
+{
+	rist_calculate_bitrate(collected, &ctx->input_bw, now);
+	if (!ctx->pacing)
+		return;
+	// The last 100 ms window follows a rising input before the average catches up
+	uint64_t input = ctx->input_bw.eight_times_bitrate_fast / 8;
+	if (ctx->input_bw.bitrate_fast > input)
+		input = ctx->input_bw.bitrate_fast;
+	input /= 8;
+	uint64_t data_rate = input + input / 4;
+	uint64_t budget = (uint64_t)ctx->recovery_maxbitrate_max * 1000 / 8;
+	uint64_t retry_rate = budget > data_rate ? budget - data_rate : data_rate / 8;
+	rist_pacer_set_rate(&ctx->data_pacer, data_rate, RIST_PACER_BURST);
+	rist_pacer_set_rate(&ctx->retry_pacer, retry_rate, RIST_PACER_BURST);
+}
+
+/* Shortens the protocol loop sleep to when a queued datagram may leave the pacer */
+static int sender_pacing_wait_ms(struct rist_sender *ctx, uint64_t now, int wait_ms)
+{
+	uint64_t next = UINT64_MAX;
+	size_t read_index = atomic_load_explicit(&ctx->sender_queue_read_index, memory_order_relaxed);
+	if (((read_index + 1) & (ctx->sender_queue_max - 1)) != atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_relaxed))
+		next = rist_pacer_departure(&ctx->data_pacer, now);
+	if (((ctx->sender_retry_queue_read_index + 1) & (ctx->sender_retry_queue_size - 1)) != ctx->sender_retry_queue_write_index) {
+		uint64_t retry = rist_pacer_departure(&ctx->retry_pacer, now);
+		if (retry < next)
+			next = retry;
+	}
+	if (next == UINT64_MAX)
+		return wait_ms;
+	uint64_t horizon = sender_pacing_horizon(ctx, now);
+	if (next <= horizon)
+		return 0;
+	uint64_t pace_ms = (next - horizon + RIST_CLOCK - 1) / RIST_CLOCK;
+	return pace_ms < (uint64_t)wait_ms ? (int)pace_ms : wait_ms;
+}
+
 static void sender_send_nacks(struct rist_sender *ctx)
 {
 	// Send retries from the queue (if any)
@@ -3005,13 +3755,26 @@ static void sender_send_nacks(struct rist_sender *ctx)
 	if (ctx->max_nacksperloop == 0)
 		return; // No peers yet
 
+	rist_tx_batch_begin(ctx);
+
 	// Send nack retries. Stop when the retry queue is empty or when the data in the
 	// send fifo queue grows to 10 packets (we do not want to harm real-time data)
 	// We also stop on maxcounter (jitter control and max bandwidth protection)
+	// Paced retries have their own budget, they only wait for the retry pacer
 	size_t queued_items = (atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_acquire) - atomic_load_explicit(&ctx->sender_queue_read_index, memory_order_acquire)) &ctx->sender_queue_max;
 	uint64_t start_time = timestampNTP_u64();
-	while (queued_items < 10) {
-		ssize_t ret = rist_retry_dequeue(ctx);
+	uint64_t now = start_time;
+	bool paced = ctx->pacing;
+	uint64_t horizon = sender_pacing_horizon(ctx, now);
+	while (paced || queued_items < 10) {
+		uint64_t departure = 0;
+		if (paced) {
+			departure = rist_pacer_departure(&ctx->retry_pacer, now);
+			if (departure > horizon)
+				break;
+			rist_tx_batch_departure(ctx, departure, now);
+		}
+		ssize_t ret = rist_retry_dequeue(ctx, now);
 		if (ret == 0) {
 			// ret == 0 is valid (nothing to send)
 			break;
@@ -3020,11 +3783,14 @@ static void sender_send_nacks(struct rist_sender *ctx)
 		} else {
 			total_bytes += ret;
 			counter++;
+			if (paced)
+				rist_pacer_sent(&ctx->retry_pacer, departure, (size_t)ret);
 		}
 		if (counter > ctx->max_nacksperloop) {
 			break;
 		}
-		if (((timestampNTP_u64() - start_time) / RIST_CLOCK) > 100)
+		now = timestampNTP_u64();
+		if (((now - start_time) / RIST_CLOCK) > 100)
 		{
 			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Nack processing loop took longer than 100ms. Something is wrong!\n");
 			// TODO: clear out the nack queue here?
@@ -3032,6 +3798,7 @@ static void sender_send_nacks(struct rist_sender *ctx)
 		}
 		queued_items = (atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_acquire) - atomic_load_explicit(&ctx->sender_queue_read_index, memory_order_acquire)) & ctx->sender_queue_max;
 	}
+	rist_tx_batch_flush(ctx);
 	if (ctx->common.debug && 2 * (counter - 1) > ctx->max_nacksperloop)
 	{
 		rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
@@ -3045,12 +3812,24 @@ static void sender_send_nacks(struct rist_sender *ctx)
 static void sender_send_data(struct rist_sender *ctx, int maxcount)
 {
 	int counter = 0;
+	// One timestamp for the whole batch, peer selection does not need more precision
+	uint64_t now = timestampNTP_u64();
+	bool paced = ctx->pacing;
+	uint64_t horizon = sender_pacing_horizon(ctx, now);
+
+	rist_tx_batch_begin(ctx);
 
 	while (1) {
 		// If we fall behind, only empty 100 every 5ms (master loop)
 		if (counter++ > maxcount) {
 			break;
 		}
+		uint64_t departure = 0;
+		if (paced) {
+			departure = rist_pacer_departure(&ctx->data_pacer, now);
+			if (departure > horizon)
+				break;
+		}
 
 		size_t idx = ((size_t)atomic_load_explicit(&ctx->sender_queue_read_index, memory_order_acquire) + 1)& (ctx->sender_queue_max-1);
 
@@ -3062,30 +3841,41 @@ static void sender_send_data(struct rist_sender *ctx, int maxcount)
 		}
 
 		atomic_store_explicit(&ctx->sender_queue_read_index, idx, memory_order_release);
-		if (RIST_UNLIKELY(ctx->sender_queue[idx] == NULL)) {
+		if (RIST_UNLIKELY(rist_sender_queue_get(ctx, idx) == NULL)) {
 			// This should never happen!
 			rist_log_priv(&ctx->common, RIST_LOG_ERROR,
 					"FIFO data block was null (read/write) (%zu/%zu)\n",
 					idx, atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_relaxed));
 			continue;
 		} else {
-			struct rist_buffer *buffer =  ctx->sender_queue[idx];
+			struct rist_buffer *buffer =  rist_sender_queue_get(ctx, idx);
+			if (paced) {
+				rist_tx_batch_departure(ctx, departure, now);
+				rist_pacer_sent(&ctx->data_pacer, departure, buffer->size);
+			}
 			// Send  fifo data (handshake and data payloads)
 			if (buffer->type == RIST_PAYLOAD_TYPE_RTCP) {
 				// TODO can we ever have a null or dead buffer->peer?
 				uint8_t *payload = buffer->data;
 				rist_send_common_rtcp(buffer->peer, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, buffer->src_port, buffer->dst_port, 0);
 				buffer->seq = ctx->common.seq;
-				buffer->seq_rtp = ctx->common.seq_rtp;
+				buffer->seq_rtp = rist_sender_claim_seq(atomic_load_explicit(&ctx->sender_queue_claim, memory_order_relaxed));
 			}
 			else {
-				rist_sender_send_data_balanced(ctx, buffer);
+				if (RIST_UNLIKELY(rist_fec_encoder_active(&ctx->fec)))
+					rist_sender_fec_add(ctx, buffer);
+				rist_sender_send_data_balanced(ctx, buffer, now);
 				// For non-advanced mode seq to index mapping
 				ctx->seq_index[buffer->seq_rtp] = (uint32_t)idx;
+				ctx->fec_sent_seq = buffer->seq_rtp;
 			}
 		}
 
 	}
+	rist_tx_batch_flush(ctx);
+	// Parity follows the data it covers out
+	if (RIST_UNLIKELY(rist_fec_encoder_active(&ctx->fec)))
+		rist_sender_send_fec(ctx, now);
 }
 
 static struct rist_peer *peer_initialize(const char *url, struct rist_sender *sender_ctx,
@@ -3120,6 +3910,7 @@ static struct rist_peer *peer_initialize(const char *url, struct rist_sender *se
 	p->receiver_ctx = receiver_ctx;
 	p->birthtime_local = timestampNTP_u64();
 	p->handled_first = true;
+	rist_timer_init(&p->timer, rist_peer_timer, p);
 
 	return p;
 }
@@ -3250,59 +4041,102 @@ static void rist_peer_periodic(struct rist_peer *p, uint64_t now) {
 #endif
 }
 
-static void sender_peer_events(struct rist_sender *ctx, uint64_t now)
+/* Session timeout of a peer, returns true when the peer got removed */
+static bool rist_peer_timeout_check(struct rist_common_ctx *cctx, struct rist_peer *peer, uint64_t now)
 {
-	pthread_mutex_lock(&ctx->common.peerlist_lock);
-	for (size_t j = 0; j < ctx->peer_lst_len; j++) {
-		rist_peer_periodic(ctx->peer_lst[j], now);
+	uint64_t last_rtcp_received = peer->last_pkt_received;
+	if (cctx->profile == RIST_PROFILE_SIMPLE &&
+		!peer->is_rtcp && peer->peer_rtcp != NULL &&
+		peer->peer_rtcp->last_pkt_received > last_rtcp_received)
+		last_rtcp_received = peer->peer_rtcp->last_pkt_received;
+	if (!peer->dead && now > last_rtcp_received && last_rtcp_received > 0)
+	{
+		if ((now - last_rtcp_received) > peer->session_timeout)
+		{
+			rist_log_priv2(cctx->logging_settings, RIST_LOG_WARN, "Listening peer %u timed out after %"PRIu64" ms\n", peer->adv_peer_id,
+				(now - last_rtcp_received)/ RIST_CLOCK);
+			kill_peer(peer);
+		}
+	} else if (peer->dead && peer->parent)
+	{
+		if ( peer->dead_since < now && (now - peer->dead_since) > 5000 * RIST_CLOCK)
+		{
+			rist_log_priv2(cctx->logging_settings, RIST_LOG_INFO, "Removing timed-out peer %u\n", peer->adv_peer_id);
+			rist_peer_remove(cctx, peer, NULL);
+			return true;
+		}
+	} else if (!peer->timed_out && peer->dead && peer->dead_since < now && (now - peer->dead_since) > 5000 * RIST_CLOCK) {
+		peer->timed_out = 1;
+		if (cctx->connection_status_callback && peer->send_first_connection_event)
+			cctx->connection_status_callback( cctx->connection_status_callback_argument, peer, RIST_CONNECTION_TIMED_OUT);
 	}
-	pthread_mutex_unlock(&ctx->common.peerlist_lock);
+	return false;
 }
 
+/* Earliest of the peer's keepalive, rtcp, eap and timeout deadlines. The session timeout
+ * is re-checked lazily: last_pkt_received only moves forward, so checking at the deadline
+ * it implies now is never late, and an idle or dead peer is looked at once per timeout */
+static uint64_t rist_peer_next_event(struct rist_common_ctx *cctx, struct rist_peer *p, uint64_t now)
+{
+	uint64_t next = now + p->session_timeout + 1;
+	if (p->send_keepalive) {
+		if (p->next_periodic_rtcp + 1 < next)
+			next = p->next_periodic_rtcp + 1;
+		if (cctx->profile == RIST_PROFILE_MAIN && p->next_keepalive_packet < next)
+			next = p->next_keepalive_packet;
+	}
+#if HAVE_SRP_SUPPORT
+	if (p->eap_ctx && (!p->listening || p->parent) && !p->multicast_sender) {
+		uint64_t eap_next = now + RIST_EAP_PERIODIC_INTERVAL * RIST_CLOCK;
+		if (eap_next < next)
+			next = eap_next;
+	}
+#endif
+	uint64_t last_rtcp_received = p->last_pkt_received;
+	if (cctx->profile == RIST_PROFILE_SIMPLE && !p->is_rtcp && p->peer_rtcp != NULL &&
+		p->peer_rtcp->last_pkt_received > last_rtcp_received)
+		last_rtcp_received = p->peer_rtcp->last_pkt_received;
+	if (!p->dead && last_rtcp_received > 0 && last_rtcp_received + p->session_timeout + 1 < next)
+		next = last_rtcp_received + p->session_timeout + 1;
+	else if (p->dead && (p->parent || !p->timed_out) && p->dead_since + 5000 * RIST_CLOCK + 1 < next)
+		next = p->dead_since + 5000 * RIST_CLOCK + 1;
+	return next;
+}
 
-static void receiver_peer_events(struct rist_receiver *ctx, uint64_t now)
+/* Runs on the context wheel with peerlist_lock held */
+static void rist_peer_timer(struct rist_timer *timer, void *arg, uint64_t now)
 {
-	pthread_mutex_lock(&ctx->common.peerlist_lock);
+	struct rist_peer *p = arg;
+	struct rist_common_ctx *cctx = get_cctx(p);
+	if (rist_peer_timeout_check(cctx, p, now))
+		return;
+	rist_peer_periodic(p, now);
+	rist_timer_arm(&cctx->timers, timer, rist_peer_next_event(cctx, p, now));
+}
 
-	for (struct rist_peer *p = ctx->common.PEERS; p != NULL; p = p->next) {
-		rist_peer_periodic(p, now);
-	}
-	pthread_mutex_unlock(&ctx->common.peerlist_lock);
+/* Called with peerlist_lock held when the peer joins the peer list, the first run
+ * happens right away and picks up the keepalive state set up by rist_fsm_init_comm */
+void rist_peer_timer_start(struct rist_peer *peer)
+{
+	struct rist_common_ctx *cctx = get_cctx(peer);
+	rist_timer_arm(&cctx->timers, &peer->timer, timestampNTP_u64());
 }
 
-void rist_timeout_check(struct rist_common_ctx *cctx, uint64_t now)
+static void sender_stats_timer(struct rist_timer *timer, void *arg, uint64_t now)
 {
-	struct rist_peer *peer = cctx->PEERS;
-	while (peer)
-	{
-		struct rist_peer *next = peer->next;
-		uint64_t last_rtcp_received = peer->last_pkt_received;
-		if (cctx->profile == RIST_PROFILE_SIMPLE &&
-			!peer->is_rtcp && peer->peer_rtcp != NULL &&
-			peer->peer_rtcp->last_pkt_received > last_rtcp_received)
-			last_rtcp_received = peer->peer_rtcp->last_pkt_received;
-		if (!peer->dead && now > last_rtcp_received && last_rtcp_received > 0)
-		{
-			if ((now - last_rtcp_received) > peer->session_timeout)
-			{
-				rist_log_priv2(cctx->logging_settings, RIST_LOG_WARN, "Listening peer %u timed out after %"PRIu64" ms\n", peer->adv_peer_id,
-					(now - last_rtcp_received)/ RIST_CLOCK);
-				kill_peer(peer);
-			}
-		} else if (peer->dead && peer->parent)
-		{
-			if ( peer->dead_since < now && (now - peer->dead_since) > 5000 * RIST_CLOCK)
-			{
-				rist_log_priv2(cctx->logging_settings, RIST_LOG_INFO, "Removing timed-out peer %u\n", peer->adv_peer_id);
-				rist_peer_remove(cctx, peer, NULL);
-			}
-		} else if (!peer->timed_out && peer->dead && peer->dead_since < now && (now - peer->dead_since) > 5000 * RIST_CLOCK) {
-			peer->timed_out = 1;
-			if (cctx->connection_status_callback && peer->send_first_connection_event)
-				cctx->connection_status_callback( cctx->connection_status_callback_argument, peer, RIST_CONNECTION_TIMED_OUT);
+	struct rist_sender *ctx = arg;
+	RIST_MARK_UNUSED(now);
+	for (size_t j = 0; j < ctx->peer_lst_len; j++) {
+		struct rist_peer *peer = ctx->peer_lst[j];
+		// TODO: print warning if the peer is dead?, i.e. no stats
+		if (!peer->dead) {
+			rist_sender_peer_statistics(peer);
 		}
-		peer = next;
 	}
+	// TODO: remove dead peers after stale flow time (both sender list and peer chain)
+	// sender_peer_delete(peer->sender_ctx, peer);
+	ctx->stats_next_time += ctx->common.stats_report_time;
+	rist_timer_arm(&ctx->common.timers, timer, ctx->stats_next_time + 1);
 }
 
 PTHREAD_START_FUNC(sender_pthread_protocol, arg)
@@ -3313,19 +4147,29 @@ PTHREAD_START_FUNC(sender_pthread_protocol, arg)
 	int max_oobperloop = 100;
 
 	int max_jitter_ms = ctx->common.rist_max_jitter / RIST_CLOCK;
-	uint64_t rist_stats_interval = ctx->common.stats_report_time; // 1 second
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Starting master sender loop at %d ms max jitter\n",
 			max_jitter_ms);
 
 	uint64_t now  = timestampNTP_u64();
-	ctx->stats_next_time = now;
-	ctx->checks_next_time = now;
 	uint64_t nacks_next_time = now;
+	pthread_mutex_lock(&ctx->common.peerlist_lock);
+	ctx->stats_next_time = now;
+	rist_timer_init(&ctx->stats_timer, sender_stats_timer, ctx);
+	rist_timer_arm(&ctx->common.timers, &ctx->stats_timer, now + 1);
+	pthread_mutex_unlock(&ctx->common.peerlist_lock);
 	while(!atomic_load_explicit(&ctx->common.shutdown, memory_order_acquire)) {
-		// Conditional 5ms sleep that is woken by data coming in
+		// Conditional sleep that is woken by data coming in, at most 5ms as the sockets
+		// are only polled in between, earlier when a peer or stats timer is due
+		pthread_mutex_lock(&ctx->common.peerlist_lock);
+		int wait_ms = rist_timer_wheel_wait_ms(&ctx->common.timers, timestampNTP_u64(), max_jitter_ms);
+		pthread_mutex_unlock(&ctx->common.peerlist_lock);
+		if (ctx->pacing)
+			wait_ms = sender_pacing_wait_ms(ctx, timestampNTP_u64(), wait_ms);
+		if (rist_impairment_active(&ctx->common.impairment))
+			wait_ms = rist_impairment_wait_ms(&ctx->common.impairment, timestampNTP_u64(), wait_ms);
 		pthread_mutex_lock(&(ctx->mutex));
-		int ret = pthread_cond_timedwait_ms(&(ctx->condition), &(ctx->mutex), max_jitter_ms);
+		int ret = wait_ms > 0 ? pthread_cond_timedwait_ms(&(ctx->condition), &(ctx->mutex), wait_ms) : 0;
 		if (RIST_UNLIKELY(!atomic_load_explicit(&ctx->common.startup_complete, memory_order_acquire))) {
 			pthread_mutex_unlock(&(ctx->mutex));
 			continue;
@@ -3336,59 +4180,46 @@ PTHREAD_START_FUNC(sender_pthread_protocol, arg)
 
 		now  = timestampNTP_u64();
 
-		/* marks peer as dead, run every second */
-		if (now > ctx->checks_next_time)
-		{
-			ctx->checks_next_time += (uint64_t)1000 * (uint64_t)RIST_CLOCK;
-			pthread_mutex_lock(&ctx->common.peerlist_lock);
-			rist_timeout_check(&ctx->common, now);
-			pthread_mutex_unlock(&ctx->common.peerlist_lock);
-		}
-
-		// stats timer
-		if (now > ctx->stats_next_time) {
-			ctx->stats_next_time += rist_stats_interval;
-
-			pthread_mutex_lock(&ctx->common.peerlist_lock);
-			for (size_t j = 0; j < ctx->peer_lst_len; j++) {
-				struct rist_peer *peer = ctx->peer_lst[j];
-				// TODO: print warning if the peer is dead?, i.e. no stats
-				if (!peer->dead) {
-					rist_sender_peer_statistics(peer);
-				}
-			}
-			pthread_mutex_unlock(&ctx->common.peerlist_lock);
-			// TODO: remove dead peers after stale flow time (both sender list and peer chain)
-			// sender_peer_delete(peer->sender_ctx, peer);
-		}
-
-		// socket polls (returns as fast as possible and processes the next 100 socket events)
 		pthread_mutex_lock(&ctx->common.peerlist_lock);
+		// keepalive, session timeout and stats timers that are due
+		rist_timer_wheel_run(&ctx->common.timers, now);
+		// socket polls (returns as fast as possible and processes the next 100 socket events)
 		evsocket_loop_single(ctx->common.evctx, 0, 100);
 		pthread_mutex_unlock(&ctx->common.peerlist_lock);
 
-		// keepalive timer
-		sender_peer_events(ctx, now);
-
 
 		// Send data and process nacks
-		pthread_mutex_lock(&ctx->queue_lock);
+		size_t collected = rist_sender_queue_collect(ctx);
+		sender_pacing_update(ctx, collected, now);
+		rist_sender_queue_check_size(ctx);
 		if (ctx->sender_queue_bytesize > 0) {
 			pthread_mutex_lock(&ctx->common.peerlist_lock);
 			sender_send_data(ctx, max_dataperloop);
 			pthread_mutex_unlock(&ctx->common.peerlist_lock);
-			// Group nacks and send them all at rist_max_jitter intervals
-			if (now > nacks_next_time) {
+			// Group nacks and send them all at rist_max_jitter intervals, when paced
+			// the retry pacer spaces them out instead
+			// Retries handed to a transmit worker must not outlive their peer, removal
+			// drains the worker under peerlist_lock
+			if (ctx->tx_workers)
+				pthread_mutex_lock(&ctx->common.peerlist_lock);
+			if (ctx->pacing) {
+				sender_send_nacks(ctx);
+				nacks_next_time = now;
+			} else if (now > nacks_next_time) {
 				sender_send_nacks(ctx);
 				nacks_next_time += ctx->common.rist_max_jitter;
 			}
+			if (ctx->tx_workers)
+				pthread_mutex_unlock(&ctx->common.peerlist_lock);
 			/* perform queue cleanup */
-			rist_clean_sender_enqueue(ctx);
+			rist_clean_sender_enqueue(ctx, now);
 		}
-		pthread_mutex_unlock(&ctx->queue_lock);
 		// Send oob data
 		if (ctx->common.oob_queue_bytesize > 0)
 			rist_oob_dequeue(&ctx->common, max_oobperloop);
+		// Datagrams held back by the impairment that are due
+		if (rist_impairment_active(&ctx->common.impairment))
+			rist_impairment_flush(&ctx->common.impairment, timestampNTP_u64());
 
 	}
 
@@ -3427,15 +4258,25 @@ int init_common_ctx(struct rist_common_ctx *ctx, enum rist_profile profile)
 
 	ctx->profile = profile;
 	ctx->stats_report_time = 0;
+	rist_timer_wheel_init(&ctx->timers, timestampNTP_u64());
 
 	if (pthread_mutex_init(&ctx->peerlist_lock, NULL) != 0) {
 		rist_log_priv3( RIST_LOG_ERROR, "Failed to init ctx->peerlist_lock\n");
 		return -1;
 	}
-	if (pthread_mutex_init(&ctx->rist_free_buffer_mutex, NULL) != 0) {
-		rist_log_priv3( RIST_LOG_ERROR, "Failed to init ctx->rist_free_buffer_mutex\n");
+	if (rist_impairment_init(&ctx->impairment) != 0) {
+		rist_log_priv3( RIST_LOG_ERROR, "Failed to init ctx->impairment\n");
 		return -1;
 	}
+	if (rist_buffer_pool_init(ctx) != 0) {
+		rist_log_priv3( RIST_LOG_ERROR, "Failed to allocate the buffer pool\n");
+		return -1;
+	}
+#if HAVE_RECVMMSG
+	ctx->recv_ring = malloc(RIST_RECV_BATCH_SIZE * sizeof(*ctx->recv_ring));
+	if (!ctx->recv_ring)
+		rist_log_priv3( RIST_LOG_WARN, "Failed to allocate the receive ring, using single datagram receive\n");
+#endif
 	if (pthread_mutex_init(&ctx->flows_lock, NULL) != 0) {
 		rist_log_priv3( RIST_LOG_ERROR, "Failed to init ctx->flows_lock\n");
 		return -1;
@@ -3477,29 +4318,7 @@ static inline void peer_remove_linked_list(struct rist_peer *peer) {
 
 void remove_peer_from_flow(struct rist_peer *peer)
 {
-	bool found = false;
-	for (size_t i = 0; i < peer->flow->peer_lst_len; i++)
-	{
-		if (peer->flow->peer_lst[i] == peer)
-		{
-			peer->flow->peer_lst[i] = peer->flow->peer_lst[(peer->flow->peer_lst_len -1)];
-			found = true;
-			break;
-		}
-	}
-	if (found)
-	{
-		if (peer->flow->peer_lst_len > 1)
-		{
-			peer->flow->peer_lst = realloc(peer->flow->peer_lst, sizeof(peer) * (peer->flow->peer_lst_len -1));
-			peer->flow->peer_lst_len--;
-		} else
-		{
-			free(peer->flow->peer_lst);
-			peer->flow->peer_lst_len = 0;
-			peer->flow->peer_lst = NULL;
-		}
-	}
+	rist_flow_remove_peer(peer->flow, peer);
 }
 
 int rist_peer_remove(struct rist_common_ctx *ctx, struct rist_peer *peer, struct rist_peer **next)
@@ -3510,6 +4329,12 @@ int rist_peer_remove(struct rist_common_ctx *ctx, struct rist_peer *peer, struct
 			*next = NULL;
 	}
 	atomic_store_explicit(&peer->shutdown, true, memory_order_release);
+	rist_timer_cancel(&peer->timer);
+	if (peer->receiver_ctx)
+		rist_receiver_workers_forget_peer(peer->receiver_ctx, peer);
+	if (peer->sender_ctx)
+		rist_sender_tx_workers_forget_peer(peer->sender_ctx, peer);
+	rist_impairment_forget_peer(&ctx->impairment, peer);
 	if (peer->send_first_connection_event  && !peer->timed_out && ctx->connection_status_callback && (ctx->profile != RIST_PROFILE_SIMPLE || peer->is_rtcp))
 		ctx->connection_status_callback(ctx->connection_status_callback_argument, peer, RIST_CONNECTION_TIMED_OUT);
 	if (peer->child)
@@ -3530,6 +4355,7 @@ int rist_peer_remove(struct rist_common_ctx *ctx, struct rist_peer *peer, struct
 		check = check->next;
 	}
 	if (peer->parent) {
+		_librist_peer_child_index_remove(peer->parent, peer);
 		peer_remove_child(peer);
 		if (peer->parent->child == NULL) {
 			peer->parent->authenticated = false;
@@ -3568,25 +4394,7 @@ int rist_peer_remove(struct rist_common_ctx *ctx, struct rist_peer *peer, struct
 
 	if (peer->receiver_ctx != NULL && peer->flow != NULL) {
 		pthread_mutex_lock(&peer->flow->mutex);
-		bool found = false;
-		for (size_t i=0; i < peer->flow->peer_lst_len; i++) {
-			if (peer->flow->peer_lst[i] == peer) {
-				peer->flow->peer_lst[i] = peer->flow->peer_lst[(peer->flow->peer_lst_len -1)];
-				found = true;
-				break;
-			}
-		}
-
-		if (found) {
-			if (peer->flow->peer_lst_len > 1) {
-				peer->flow->peer_lst = realloc(peer->flow->peer_lst, sizeof(peer) * (peer->flow->peer_lst_len -1));
-				peer->flow->peer_lst_len--;
-			} else {
-				free(peer->flow->peer_lst);
-				peer->flow->peer_lst_len = 0;
-				peer->flow->peer_lst = NULL;
-			}
-		}
+		rist_flow_remove_peer(peer->flow, peer);
 		pthread_mutex_unlock(&peer->flow->mutex);
 	}
 
@@ -3617,6 +4425,7 @@ int rist_peer_remove(struct rist_common_ctx *ctx, struct rist_peer *peer, struct
 	_librist_crypto_psk_rist_key_destroy(&peer->key_rx_odd);
 	_librist_crypto_psk_rist_key_destroy(&peer->key_tx);
 	_librist_crypto_psk_rist_key_destroy(&peer->key_tx_odd);
+	free(peer->tx_scratch);
 #if HAVE_SRP_SUPPORT
 	eap_delete_ctx(&peer->eap_ctx);
 #endif
@@ -3634,6 +4443,7 @@ int rist_peer_remove(struct rist_common_ctx *ctx, struct rist_peer *peer, struct
 		ctx->oob_current_peer = NULL;
 	}
 
+	free(peer->child_index);
 	free(peer);
 	return 0;
 }
@@ -3747,13 +4557,9 @@ void rist_empty_oob_queue(struct rist_common_ctx *ctx)
 			break;
 		}
 		struct rist_buffer *oob_buffer = ctx->oob_queue[index];
-		if (oob_buffer->data) {
-			free(oob_buffer->data);
-			oob_buffer->data = NULL;
-		}
 		if (oob_buffer) {
-			free(oob_buffer);
-			oob_buffer = NULL;
+			free_rist_buffer(ctx, oob_buffer);
+			ctx->oob_queue[index] = NULL;
 		}
 		index++;
 	}
@@ -3763,6 +4569,8 @@ void rist_empty_oob_queue(struct rist_common_ctx *ctx)
 void rist_receiver_destroy_local(struct rist_receiver *ctx)
 {
 
+	rist_receiver_workers_stop(ctx);
+
 	pthread_mutex_lock(&ctx->common.peerlist_lock);
 
 	// Destroy all flows
@@ -3773,6 +4581,8 @@ void rist_receiver_destroy_local(struct rist_receiver *ctx)
 		rist_delete_flow(ctx, f);
 		f = nextflow;
 	}
+	free(ctx->common.flow_table);
+	ctx->common.flow_table = NULL;
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Flows cleanup complete\n");
 
 	// Destroy all peers
@@ -3789,29 +4599,33 @@ void rist_receiver_destroy_local(struct rist_receiver *ctx)
 
 	pthread_mutex_unlock(&ctx->common.peerlist_lock);
 
-	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Freeing main data buffers\n");
-	struct rist_buffer *b = ctx->common.rist_free_buffer;
-	struct rist_buffer *next_buf;
-	while (b) {
-		next_buf = b->next_free;
-		free_rist_buffer(&ctx->common, b);
-		b = next_buf;
-	}
 	evsocket_destroy(ctx->common.evctx);
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Removing peerlist_lock\n");
 	pthread_mutex_destroy(&ctx->common.peerlist_lock);
+	rist_impairment_destroy(&ctx->common.impairment);
 	if (ctx->common.oob_data_enabled) {
 		rist_log_priv(&ctx->common, RIST_LOG_INFO, "Freeing oob fifo queue\n");
 		rist_empty_oob_queue(&ctx->common);
+		free(ctx->common.oob_queue);
 		rist_log_priv(&ctx->common, RIST_LOG_INFO, "Removing oob_queue_lock\n");
 		pthread_rwlock_destroy(&ctx->common.oob_queue_lock);
 	}
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Removing data fifo signaling variables (condition and mutex)\n");
+#if HAVE_EVENTFD
+	int data_ready_eventfd = atomic_load_explicit(&ctx->receiver_data_ready_eventfd, memory_order_acquire);
+	if (data_ready_eventfd >= 0)
+		close(data_ready_eventfd);
+#endif
 	pthread_cond_destroy(&ctx->condition);
 	pthread_mutex_destroy(&ctx->mutex);
 
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Freeing buffer pool\n");
+	rist_receiver_zero_copy_destroy(&ctx->common);
+	rist_buffer_pool_destroy(&ctx->common);
+	free(ctx->common.recv_ring);
+
 	free(ctx);
 	ctx = NULL;
 }
@@ -3829,8 +4643,11 @@ void _librist_receiver_buffer_calc(struct rist_receiver *ctx) {
 
 			//Modify our buffersize based on some magic numbers, these likely still need tuning
 			pthread_mutex_lock(&p->flow->mutex);
-			modifier += p->flow->stats_instant.lost * 0.05;//5% extra per packet lost
-			if (p->flow->stats_instant.lost > 25)
+			// Losses since the last stats report
+			unsigned long lost = atomic_load_explicit(&p->flow->output_stats.lost, memory_order_relaxed) -
+				atomic_load_explicit(&p->flow->output_stats.lost_reported, memory_order_relaxed);
+			modifier += lost * 0.05;//5% extra per packet lost
+			if (lost > 25)
 				has_high_loss = true;
 
 			modifier += p->flow->stats_instant.recovered_morenack * 0.02;
@@ -3868,87 +4685,335 @@ void _librist_receiver_buffer_calc(struct rist_receiver *ctx) {
 	pthread_mutex_unlock(&ctx->common.peerlist_lock);
 }
 
+/* Stats and session timeout timers of a flow, returns true when the session timed out */
+static bool receiver_flow_checks(struct rist_receiver *ctx, struct rist_flow *f, uint64_t now)
+{
+	pthread_mutex_lock(&f->mutex);
+	if (!f->receiver_queue_has_items) {
+		pthread_mutex_unlock(&f->mutex);
+		return false;
+	}
+	if (now > f->checks_next_time) {
+		if (f->last_recv_ts == 0)
+			f->last_recv_ts = now;
+		uint64_t flow_age = (now - f->last_recv_ts);
+		f->checks_next_time += f->recovery_buffer_ticks;
+		if (flow_age > f->flow_timeout) {
+			if (f->dead != 1) {
+				f->dead = 1;
+				rist_log_priv(&ctx->common, RIST_LOG_WARN,
+					"Flow with id %"PRIu32" is dead, age is %"PRIu64"ms\n",
+						f->flow_id, flow_age / RIST_CLOCK);
+			}
+		}
+		else {
+			if (f->dead != 0) {
+				f->dead = 0;
+				rist_log_priv(&ctx->common, RIST_LOG_INFO,
+					"Flow with id %"PRIu32" was dead and is now alive again\n", f->flow_id);
+			}
+		}
+		if (flow_age > f->session_timeout) {
+			f->dead = 2;
+			rist_receiver_flow_statistics(ctx, f);
+			rist_log_priv(&ctx->common, RIST_LOG_INFO,
+					"\t************** Session Timeout after %" PRIu64 "s of no data, deleting flow with id %"PRIu32" ***************\n",
+					flow_age / RIST_CLOCK / 1000, f->flow_id);
+			pthread_mutex_unlock(&f->mutex);
+			return true;
+		}
+	}
+	if (now > f->stats_next_time) {
+		f->stats_next_time += f->stats_report_time;
+		rist_receiver_flow_statistics(ctx, f);
+	}
+	pthread_mutex_unlock(&f->mutex);
+	return false;
+}
+
+/* Caller holds peerlist_lock */
+static void receiver_flow_timeout(struct rist_receiver *ctx, struct rist_flow *f)
+{
+	for (size_t i = 0; i < f->peer_lst_len; i++) {
+		struct rist_peer *peer = f->peer_lst[i];
+		peer->flow = NULL;
+	}
+	rist_delete_flow(ctx, f);
+}
+
+/* Runs on the wheel of the thread owning the flow, with peerlist_lock held */
+static void receiver_flow_checks_timer(struct rist_timer *timer, void *arg, uint64_t now)
+{
+	struct rist_flow *f = arg;
+	struct rist_receiver *ctx = (void *)f->receiver_id;
+	if (receiver_flow_checks(ctx, f, now)) {
+		if (f->worker) {
+			// The worker holds busy while its wheel runs, it deletes the flow afterwards
+			f->expired_next = f->worker->expired;
+			f->worker->expired = f;
+		} else
+			receiver_flow_timeout(ctx, f);
+		return;
+	}
+	// An emptied queue stops the timer, the next first packet starts it again
+	pthread_mutex_lock(&f->mutex);
+	bool has_items = f->receiver_queue_has_items;
+	uint64_t next = f->checks_next_time < f->stats_next_time ? f->checks_next_time : f->stats_next_time;
+	pthread_mutex_unlock(&f->mutex);
+	if (has_items)
+		rist_timer_arm(f->timers, timer, next + 1);
+}
+
+static void receiver_nack_timer(struct rist_timer *timer, void *arg, uint64_t now)
+{
+	RIST_MARK_UNUSED(timer);
+	RIST_MARK_UNUSED(now);
+	struct rist_flow *f = arg;
+	receiver_nack_output((void *)f->receiver_id, f);
+}
+
+void rist_receiver_flow_timers_init(struct rist_receiver *ctx, struct rist_flow *f)
+{
+	f->timers = &ctx->common.timers;
+	rist_timer_init(&f->checks_timer, receiver_flow_checks_timer, f);
+	rist_timer_init(&f->nack_timer, receiver_nack_timer, f);
+}
+
+static void receiver_worker_item_release(struct rist_receiver_worker_item *item)
+{
+	if (item->block)
+		rist_block_pool_put(item->block);
+	free(item->copy);
+	item->block = NULL;
+	item->copy = NULL;
+}
+
+/* Drops queued items matching flow or peer, caller holds w->busy */
+static void receiver_worker_purge(struct rist_receiver_worker *w, struct rist_flow *f, struct rist_peer *peer)
+{
+	pthread_mutex_lock(&w->lock);
+	size_t kept = 0;
+	for (size_t i = 0; i < w->queue_count; i++) {
+		struct rist_receiver_worker_item *item = &w->queue[(w->queue_head + i) & (RIST_RECEIVER_WORKER_QUEUE_SIZE - 1)];
+		if ((f && item->flow == f) || (peer && item->peer == peer)) {
+			receiver_worker_item_release(item);
+			continue;
+		}
+		w->queue[(w->queue_head + kept) & (RIST_RECEIVER_WORKER_QUEUE_SIZE - 1)] = *item;
+		kept++;
+	}
+	w->queue_count = kept;
+	pthread_mutex_unlock(&w->lock);
+}
+
+void rist_receiver_worker_attach_flow(struct rist_receiver *ctx, struct rist_flow *f)
+{
+	if (ctx->worker_count == 0 || !ctx->workers)
+		return;
+	// Knuth multiplicative hash, spreads sequential flow ids over the workers
+	uint32_t h = f->flow_id * 2654435761u;
+	struct rist_receiver_worker *w = &ctx->workers[((uint64_t)h * ctx->worker_count) >> 32];
+	pthread_mutex_lock(&w->busy);
+	if (w->flow_count == w->flow_capacity) {
+		size_t capacity = w->flow_capacity ? w->flow_capacity * 2 : 8;
+		struct rist_flow **flows = realloc(w->flows, capacity * sizeof(*flows));
+		if (!flows) {
+			pthread_mutex_unlock(&w->busy);
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not attach flow %"PRIu32" to a receiver worker, OOM\n", f->flow_id);
+			return;
+		}
+		w->flows = flows;
+		w->flow_capacity = capacity;
+	}
+	w->flows[w->flow_count++] = f;
+	f->worker = w;
+	rist_timer_cancel(&f->checks_timer);
+	rist_timer_cancel(&f->nack_timer);
+	f->timers = &w->timers;
+	pthread_mutex_unlock(&w->busy);
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Flow %"PRIu32" assigned to receiver worker %zu\n", f->flow_id, w->index);
+}
+
+/* Caller holds peerlist_lock, afterwards the flow is only touched by the caller */
+void rist_receiver_worker_detach_flow(struct rist_flow *f)
+{
+	struct rist_receiver_worker *w = f->worker;
+	if (!w)
+		return;
+	pthread_mutex_lock(&w->busy);
+	receiver_worker_stage_purge(w->ctx, f, NULL);
+	receiver_worker_purge(w, f, NULL);
+	for (size_t i = 0; i < w->flow_count; i++) {
+		if (w->flows[i] == f) {
+			w->flows[i] = w->flows[--w->flow_count];
+			break;
+		}
+	}
+	f->worker = NULL;
+	rist_timer_cancel(&f->checks_timer);
+	rist_timer_cancel(&f->nack_timer);
+	f->timers = &w->ctx->common.timers;
+	pthread_mutex_unlock(&w->busy);
+}
+
+/* Caller holds peerlist_lock, waits for the workers to let go of the peer before it is freed */
+void rist_receiver_workers_forget_peer(struct rist_receiver *ctx, struct rist_peer *peer)
+{
+	receiver_worker_stage_purge(ctx, NULL, peer);
+	for (uint32_t i = 0; ctx->workers && i < ctx->worker_count; i++) {
+		struct rist_receiver_worker *w = &ctx->workers[i];
+		pthread_mutex_lock(&w->busy);
+		receiver_worker_purge(w, NULL, peer);
+		pthread_mutex_unlock(&w->busy);
+	}
+}
+
+static PTHREAD_START_FUNC(receiver_pthread_worker, arg)
+{
+	struct rist_receiver_worker *w = (struct rist_receiver_worker *)arg;
+	struct rist_receiver *ctx = w->ctx;
+	struct rist_receiver_worker_item batch[RIST_RECV_BATCH_SIZE];
+
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Starting receiver worker %zu\n", w->index);
+
+	while (!atomic_load_explicit(&ctx->common.shutdown, memory_order_acquire)) {
+		// NACK deadlines and stats/session timeouts of the flows owned by this worker
+		pthread_mutex_lock(&w->busy);
+		bool timers_due = rist_timer_wheel_next(&w->timers) <= timestampNTP_u64();
+		pthread_mutex_unlock(&w->busy);
+		if (timers_due) {
+			pthread_mutex_lock(&ctx->common.peerlist_lock);
+			pthread_mutex_lock(&w->busy);
+			// The protocol thread stamps last_recv_ts under the lock, so sample the clock after taking it
+			rist_timer_wheel_run(&w->timers, timestampNTP_u64());
+			pthread_mutex_unlock(&w->busy);
+			// Deleting a flow detaches it, which takes busy
+			while (w->expired) {
+				struct rist_flow *f = w->expired;
+				w->expired = f->expired_next;
+				receiver_flow_timeout(ctx, f);
+			}
+			pthread_mutex_unlock(&ctx->common.peerlist_lock);
+		}
+
+		pthread_mutex_lock(&w->busy);
+		int wait_ms = rist_timer_wheel_wait_ms(&w->timers, timestampNTP_u64(), RIST_MAX_IDLE_WAIT);
+		pthread_mutex_unlock(&w->busy);
+		pthread_mutex_lock(&w->lock);
+		if (w->queue_count == 0 && wait_ms > 0)
+			pthread_cond_timedwait_ms(&w->condition, &w->lock, wait_ms);
+		pthread_mutex_unlock(&w->lock);
+
+		// The protocol thread purges items under busy, so they are popped under it as well
+		pthread_mutex_lock(&w->busy);
+		for (;;) {
+			size_t count = 0;
+			pthread_mutex_lock(&w->lock);
+			while (count < RIST_RECV_BATCH_SIZE && w->queue_count > 0) {
+				batch[count++] = w->queue[w->queue_head];
+				w->queue_head = (w->queue_head + 1) & (RIST_RECEIVER_WORKER_QUEUE_SIZE - 1);
+				w->queue_count--;
+			}
+			pthread_mutex_unlock(&w->lock);
+			if (count == 0)
+				break;
+			for (size_t i = 0; i < count; i++) {
+				receiver_deliver_data(ctx, &batch[i], &batch[i].block);
+				receiver_worker_item_release(&batch[i]);
+			}
+		}
+		pthread_mutex_unlock(&w->busy);
+	}
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Exiting receiver worker %zu\n", w->index);
+	return 0;
+}
+
+int rist_receiver_workers_start(struct rist_receiver *ctx)
+{
+	if (ctx->worker_count == 0)
+		return 0;
+	ctx->workers = calloc(ctx->worker_count, sizeof(*ctx->workers));
+	if (!ctx->workers)
+		return -1;
+	for (uint32_t i = 0; i < ctx->worker_count; i++) {
+		struct rist_receiver_worker *w = &ctx->workers[i];
+		w->ctx = ctx;
+		w->index = i;
+		rist_timer_wheel_init(&w->timers, timestampNTP_u64());
+		w->queue = calloc(RIST_RECEIVER_WORKER_QUEUE_SIZE, sizeof(*w->queue));
+		if (!w->queue || pthread_mutex_init(&w->lock, NULL) != 0 || pthread_mutex_init(&w->busy, NULL) != 0
+			|| pthread_cond_init(&w->condition, NULL) != 0) {
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not initialize receiver worker %u\n", i);
+			return -1;
+		}
+		if (rist_thread_create(&ctx->common, &w->thread, NULL, receiver_pthread_worker, (void *)w) != 0) {
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not start receiver worker %u\n", i);
+			return -1;
+		}
+		w->thread_running = true;
+	}
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Started %u receiver worker threads\n", ctx->worker_count);
+	return 0;
+}
+
+/* Joins the workers, flows go back to being handled by the caller */
+void rist_receiver_workers_stop(struct rist_receiver *ctx)
+{
+	if (!ctx->workers)
+		return;
+	for (uint32_t i = 0; i < ctx->worker_count; i++) {
+		struct rist_receiver_worker *w = &ctx->workers[i];
+		if (w->thread_running) {
+			pthread_mutex_lock(&w->lock);
+			pthread_cond_signal(&w->condition);
+			pthread_mutex_unlock(&w->lock);
+			pthread_join(w->thread, NULL);
+		}
+	}
+	for (uint32_t i = 0; i < ctx->worker_count; i++) {
+		struct rist_receiver_worker *w = &ctx->workers[i];
+		if (w->queue) {
+			for (size_t j = 0; j < w->queue_count; j++)
+				receiver_worker_item_release(&w->queue[(w->queue_head + j) & (RIST_RECEIVER_WORKER_QUEUE_SIZE - 1)]);
+			pthread_mutex_destroy(&w->lock);
+			pthread_mutex_destroy(&w->busy);
+			pthread_cond_destroy(&w->condition);
+		}
+		for (size_t j = 0; j < w->flow_count; j++) {
+			struct rist_flow *f = w->flows[j];
+			rist_timer_cancel(&f->checks_timer);
+			rist_timer_cancel(&f->nack_timer);
+			f->timers = &ctx->common.timers;
+			f->worker = NULL;
+		}
+		free(w->flows);
+		free(w->queue);
+	}
+	free(ctx->workers);
+	ctx->workers = NULL;
+}
+
 PTHREAD_START_FUNC(receiver_pthread_protocol, arg)
 {
 	struct rist_receiver *ctx = (struct rist_receiver *) arg;
 	uint64_t now = timestampNTP_u64();
 	int max_oobperloop = 100;
 
-	uint64_t rist_nack_interval = (uint64_t)ctx->common.rist_max_jitter;
 	int max_jitter_ms = ctx->common.rist_max_jitter / RIST_CLOCK;
-	ctx->common.nacks_next_time = timestampNTP_u64();
-	uint64_t checks_next_time = now;
 	uint64_t buffer_check_next_time = now + ONE_SECOND;
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Starting receiver protocol loop with %d ms timer\n", max_jitter_ms);
 
 	while (!atomic_load_explicit(&ctx->common.shutdown, memory_order_acquire)) {
-		now  = timestampNTP_u64();
 		pthread_mutex_lock(&ctx->common.peerlist_lock);
 		if (ctx->common.PEERS == NULL) {
 			pthread_mutex_unlock(&ctx->common.peerlist_lock);
 			usleep(5000);
 			continue;
 		}
-		pthread_mutex_unlock(&ctx->common.peerlist_lock);
 
-		// Limit scope of `struct rist_flow *f` for clarity since it is used again later in this loop.
-		{
-			// stats and session timeout timer
-			struct rist_flow *f = ctx->common.FLOWS;
-			while (f) {
-				pthread_mutex_lock(&f->mutex);
-				if (!f->receiver_queue_has_items) {
-					pthread_mutex_unlock(&f->mutex);
-					f = f->next;
-					continue;
-				}
-				if (now > f->checks_next_time) {
-					if (f->last_recv_ts == 0)
-						f->last_recv_ts = now;
-					uint64_t flow_age = (now - f->last_recv_ts);
-					f->checks_next_time += f->recovery_buffer_ticks;
-					if (flow_age > f->flow_timeout) {
-						if (f->dead != 1) {
-							f->dead = 1;
-							rist_log_priv(&ctx->common, RIST_LOG_WARN,
-								"Flow with id %"PRIu32" is dead, age is %"PRIu64"ms\n",
-									f->flow_id, flow_age / RIST_CLOCK);
-						}
-					}
-					else {
-						if (f->dead != 0) {
-							f->dead = 0;
-							rist_log_priv(&ctx->common, RIST_LOG_INFO,
-								"Flow with id %"PRIu32" was dead and is now alive again\n", f->flow_id);
-						}
-					}
-					if (flow_age > f->session_timeout) {
-						f->dead = 2;
-						struct rist_flow *next = f->next;
-						rist_receiver_flow_statistics(ctx, f);
-						rist_log_priv(&ctx->common, RIST_LOG_INFO,
-								"\t************** Session Timeout after %" PRIu64 "s of no data, deleting flow with id %"PRIu32" ***************\n",
-								flow_age / RIST_CLOCK / 1000, f->flow_id);
-						pthread_mutex_unlock(&f->mutex);
-						pthread_mutex_lock(&ctx->common.peerlist_lock);
-						for (size_t i = 0; i < f->peer_lst_len; i++) {
-							struct rist_peer *peer = f->peer_lst[i];
-							peer->flow = NULL;
-						}
-						rist_delete_flow(ctx, f);
-						pthread_mutex_unlock(&ctx->common.peerlist_lock);
-						f = next;
-						continue;
-					}
-				}
-				if (now > f->stats_next_time) {
-					f->stats_next_time += f->stats_report_time;
-					rist_receiver_flow_statistics(ctx, f);
-				}
-				pthread_mutex_unlock(&f->mutex);
-				f = f->next;
-			}
-		}
+		// keepalive and session timeout timers, plus the flow timers when flows are not sharded
+		now  = timestampNTP_u64();
+		rist_timer_wheel_run(&ctx->common.timers, now);
 
 		// TODO: rist_max_jitter should be proportional to the max bitrate according to the
 		// following table
@@ -3958,34 +5023,20 @@ PTHREAD_START_FUNC(receiver_pthread_protocol, arg)
 		//520	1.92
 		//1000	1.00
 
-		// socket polls (returns in max_jitter_ms max and processes the next 100 socket events)
-		pthread_mutex_lock(&ctx->common.peerlist_lock);
-		evsocket_loop_single(ctx->common.evctx, max_jitter_ms, 100);
+		// socket polls (returns when the next timer is due, in max_jitter_ms max, and processes
+		// the next 100 socket events), the cap keeps peerlist_lock available to the API
+		int wait_ms = rist_timer_wheel_wait_ms(&ctx->common.timers, timestampNTP_u64(), max_jitter_ms);
+		if (rist_impairment_active(&ctx->common.impairment))
+			wait_ms = rist_impairment_wait_ms(&ctx->common.impairment, timestampNTP_u64(), wait_ms);
+		evsocket_loop_single(ctx->common.evctx, wait_ms, 100);
 		pthread_mutex_unlock(&ctx->common.peerlist_lock);
-		// keepalive timer
-		receiver_peer_events(ctx, now);
 
-		// nacks timer
-		if (now > ctx->common.nacks_next_time) {
-			ctx->common.nacks_next_time += rist_nack_interval;
-			// process nacks on every loop (5 ms interval max)
-			struct rist_flow *f = ctx->common.FLOWS;
-			while (f) {
-				receiver_nack_output(ctx, f);
-				f = f->next;
-			}
-		}
-		/* marks peer as dead, run every second */
-		if (now > checks_next_time)
-		{
-			checks_next_time += (uint64_t)50 * (uint64_t)RIST_CLOCK;
-			pthread_mutex_lock(&ctx->common.peerlist_lock);
-			rist_timeout_check(&ctx->common, now);
-			pthread_mutex_unlock(&ctx->common.peerlist_lock);
-		}
 		// Send oob data
 		if (ctx->common.oob_queue_bytesize > 0)
 			rist_oob_dequeue(&ctx->common, max_oobperloop);
+		// Datagrams held back by the impairment that are due
+		if (rist_impairment_active(&ctx->common.impairment))
+			rist_impairment_flush(&ctx->common.impairment, timestampNTP_u64());
 
 		if (now >= buffer_check_next_time) {
 			_librist_receiver_buffer_calc(ctx);
@@ -4025,35 +5076,46 @@ void rist_sender_destroy_local(struct rist_sender *ctx)
 	pthread_mutex_unlock(&ctx->common.peerlist_lock);
 	pthread_mutex_destroy(&ctx->common.peerlist_lock);
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Peers cleanup complete\n");
+	rist_sender_tx_workers_stop(ctx);
+	rist_impairment_destroy(&ctx->common.impairment);
+	rist_fec_encoder_destroy(&ctx->fec);
 
 	if (ctx->common.oob_data_enabled) {
 		rist_log_priv(&ctx->common, RIST_LOG_INFO, "Freeing oob fifo queue\n");
 		rist_empty_oob_queue(&ctx->common);
+		free(ctx->common.oob_queue);
 		rist_log_priv(&ctx->common, RIST_LOG_INFO, "Removing oob_queue_lock\n");
 		pthread_rwlock_destroy(&ctx->common.oob_queue_lock);
 	}
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Freeing up context memory allocations\n");
 	free(ctx->sender_retry_queue);
+	free(ctx->sender_retry_index);
+	rist_tx_batch_destroy(ctx->tx_batch);
+	rist_sender_queue_collect(ctx);
 	struct rist_buffer *b = NULL;
 	while(1) {
-		b = ctx->sender_queue[ctx->sender_queue_delete_index];
+		b = rist_sender_queue_get(ctx, ctx->sender_queue_delete_index);
 		while (!b) {
 			ctx->sender_queue_delete_index = (ctx->sender_queue_delete_index + 1)& (ctx->sender_queue_max -1);
-			b = ctx->sender_queue[ctx->sender_queue_delete_index];
+			b = rist_sender_queue_get(ctx, ctx->sender_queue_delete_index);
 			if ((size_t)atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_relaxed) == ctx->sender_queue_delete_index)
 				break;
 		}
 		if (b) {
 			ctx->sender_queue_bytesize -= b->size;
 			free_rist_buffer(&ctx->common, b);
-			ctx->sender_queue[ctx->sender_queue_delete_index] = NULL;
+			rist_sender_queue_set(ctx, ctx->sender_queue_delete_index, NULL);
 		}
 		if ((size_t)atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_acquire) == ctx->sender_queue_delete_index) {
 			break;
 		}
 		ctx->sender_queue_delete_index = (ctx->sender_queue_delete_index + 1)& (ctx->sender_queue_max -1);
 	}
+	free(ctx->sender_queue);
+	free(ctx->compression_state);
+	rist_buffer_pool_destroy(&ctx->common);
+	free(ctx->common.recv_ring);
 	free(ctx);
 	ctx = NULL;
 }
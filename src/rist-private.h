@@ -27,6 +27,10 @@
 #include "librist.h"
 #include "udpsocket.h"
 #include "crypto/psk.h"
+#include "rist_timer_wheel.h"
+#include "rist_pacer.h"
+#include "rist_impairment.h"
+#include "rist_fec.h"
 #include <errno.h>
 #include <stdatomic.h>
 #include "librist/logging.h"
@@ -36,18 +40,48 @@
 #define UINT16_SIZE (UINT16_MAX + 1)
 // These 4 control the memory footprint and buffer capacity of the lib
 // They MUST be a power of two or wrap-around index calculations will break
+// The sender and receiver queues start at RIST_QUEUE_MIN_SLOTS, are sized from the configured
+// bitrate and buffer length and grow at runtime up to RIST_SERVER_QUEUE_BUFFERS
 #define RIST_SERVER_QUEUE_BUFFERS ((UINT16_SIZE) * 8)
 #define RIST_RETRY_QUEUE_BUFFERS ((UINT16_SIZE) * 4)
-#define RIST_OOB_QUEUE_BUFFERS ((UINT16_SIZE) * 2)
+#define RIST_OOB_QUEUE_BUFFERS (UINT16_SIZE)
 #define RIST_DATAOUT_QUEUE_BUFFERS (1024)
+#define RIST_QUEUE_MIN_SLOTS (1024)
+// Payload size used to turn a bitrate into a packet count when sizing queues (7 TS packets)
+#define RIST_QUEUE_SIZING_PACKET_SIZE (1316)
 // This will restrict the use of the library to the configured maximum packet size
 #define RIST_MAX_PACKET_SIZE (10000)
+// Per context rist_buffer pool: payload size classes are 1316 (7 TS packets), 1472 (MTU sized)
+// and RIST_MAX_PACKET_SIZE. Each class caches at most RIST_BUFFER_POOL_MAX_BYTES worth of buffers,
+// the smallest one is preallocated from the peers' buffer and bitrate.
+#define RIST_BUFFER_POOL_CLASSES (3)
+#define RIST_BUFFER_POOL_MAX_BYTES (8 * 1024 * 1024)
+#define RIST_BUFFER_POOL_MAX_EMPTY (4096)
+// Number of datagrams read per recvmmsg call when batched receive is available
+#define RIST_RECV_BATCH_SIZE (32)
+// Zero-copy receive block pool (receiver only): blocks preallocated and kept cached
+#define RIST_BLOCK_POOL_PREALLOC (256)
+#define RIST_BLOCK_POOL_MAX_FREE (4096)
+// Maximum number of datagrams the sender collects before flushing them with sendmmsg/GSO
+#define RIST_TX_BATCH_SIZE (32)
+// Sharded receiver: maximum number of worker threads and queued datagrams per worker
+#define RIST_RECEIVER_MAX_WORKERS (64)
+#define RIST_RECEIVER_WORKER_QUEUE_SIZE (8192)
+// Sender transmit workers: maximum number of threads and queued packets per worker
+#define RIST_SENDER_MAX_TX_WORKERS (64)
+#define RIST_SENDER_TX_QUEUE_SIZE (4096)
+// Encrypted datagrams of one tx batch are copied into a scratch area of this size
+#define RIST_TX_BATCH_SCRATCH_SIZE (RIST_TX_BATCH_SIZE * 2048)
+// Per peer scratch buffer for encrypting datagrams outside of a tx batch
+#define RIST_TX_SCRATCH_SIZE (RIST_MAX_PACKET_SIZE + RIST_MAX_HEADER_SIZE)
 #define RIST_RTT_MIN (3)
 
 /* nack requests are sent every time a data packet is received. */
 /* this timer will be triggered to ensure we output nacks even when there is no data coming in */
 #define RIST_MAX_JITTER (5) /* In milliseconds */
 #define RIST_PING_INTERVAL (100)  /* In milliseconds, how long to space ping requests */
+#define RIST_EAP_PERIODIC_INTERVAL (50) /* In milliseconds, how often a peer's EAP retries are checked */
+#define RIST_MAX_IDLE_WAIT (1000) /* In milliseconds, longest a receiver worker sleeps with no timer due */
 #define RIST_PBKDF2_HMAC_SHA256_ITERATIONS (1024)
 #define RIST_AES_KEY_REUSE_TIMES UINT32_MAX
 #define RIST_MAX_HOSTNAME (128)
@@ -77,6 +111,11 @@ enum rist_peer_state {
 	RIST_PEER_STATE_PING = 1,
 	RIST_PEER_STATE_CONNECT = 2
 };
+struct rist_tx_batch;
+struct rist_block_pool;
+struct rist_pooled_block;
+struct rist_receiver_worker;
+
 struct rist_buffer {
 	void *data;
 	size_t size;
@@ -99,19 +138,35 @@ struct rist_buffer {
 	uint8_t transmit_count;
 	struct rist_peer *peer;
 
-	struct rist_buffer *next_free;
 	size_t alloc_size;
 	bool free;
 	bool retry_queued;
+	/* payload starts at data + data_offset, data belongs to pooled_block when set */
+	size_t data_offset;
+	struct rist_pooled_block *pooled_block;
+	/* Transmit workers that still have to copy the payload, the sender keeps the buffer until they did */
+	atomic_uint tx_refs;
+};
+
+/* Lock free stack of cached buffers over a fixed array of slots: full links the slots holding
+ * a buffer, empty the unused ones. The heads pack an ABA tag above the slot index + 1, 0 ends
+ * a list, so a slot popped and pushed back while another thread pops fails that thread's CAS */
+struct rist_buffer_stack {
+	struct rist_buffer **slots;
+	atomic_uint *next;
+	atomic_uint_fast64_t full;
+	atomic_uint_fast64_t empty;
+	atomic_ulong count;
+	uint32_t max;
 };
 
+/* Slot of the per flow missing ring, indexed like receiver_queue */
 struct rist_missing_buffer {
 	uint32_t seq;
+	uint32_t nack_count;
 	uint64_t next_nack;
 	uint64_t insertion_time;
-	uint32_t nack_count;
 	struct rist_peer *peer;
-	struct rist_missing_buffer *next;
 };
 
 struct rist_bandwidth_estimation {
@@ -127,17 +182,7 @@ struct rist_bandwidth_estimation {
 
 struct rist_peer_flow_stats {
 	uint32_t lost;
-	uint32_t received;
-	uint32_t dupe;
-	uint32_t dropped_full;
-	uint32_t dropped_late;
-	size_t buffer_duration_count;
-	uint32_t buffer_duration[2048];
-
-	uint32_t missing;
-	uint32_t retries;
-	uint32_t recovered;
-	uint32_t reordered;
+
 	uint32_t dups;
 	uint32_t recovered_0nack;
 	uint32_t recovered_1nack;
@@ -157,6 +202,74 @@ struct rist_peer_flow_stats {
 	uint64_t total_ips;
 };
 
+/* Counters of the flow's data output thread, their only writer. They only grow, so the stats
+ * report and the buffer sizing read them without a lock and use the difference since the
+ * last report. Everything in rist_peer_flow_stats belongs to the thread owning the flow */
+struct RIST_CACHE_ALIGNED rist_flow_output_stats {
+	atomic_ulong lost;
+	atomic_ulong buffer_duration_sum; /* ms */
+	atomic_ulong buffer_duration_count;
+	/* values at the last report, written by the thread owning the flow */
+	atomic_ulong lost_reported;
+	unsigned long buffer_duration_sum_reported;
+	unsigned long buffer_duration_count_reported;
+};
+
+/* Running totals of a flow since it was created, written only by the thread owning the flow
+ * and read without a lock from any thread (rist_receiver_flow_counters_get). The stats report
+ * uses the difference since the last report */
+struct RIST_CACHE_ALIGNED rist_flow_counters {
+	atomic_ulong received;
+	atomic_ulong missing;
+	atomic_ulong recovered;
+	atomic_ulong fec_recovered;
+	atomic_ulong reordered;
+	atomic_ulong retries;
+	atomic_ulong duplicates;
+	atomic_ulong dropped_late;
+	atomic_ulong dropped_full;
+};
+
+struct rist_flow_counter_values {
+	unsigned long received;
+	unsigned long missing;
+	unsigned long recovered;
+	unsigned long fec_recovered;
+	unsigned long reordered;
+	unsigned long retries;
+	unsigned long duplicates;
+	unsigned long dropped_late;
+	unsigned long dropped_full;
+};
+
+static inline void rist_stats_counter_add(atomic_ulong *counter, unsigned long value)
+{
+	// Single writer, no need for a locked read-modify-write
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline void rist_stats_counter_sub(atomic_ulong *counter, unsigned long value)
+{
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) - value, memory_order_relaxed);
+}
+
+static inline void rist_flow_counters_load(struct rist_flow_counters *counters, struct rist_flow_counter_values *values)
+{
+	values->received = atomic_load_explicit(&counters->received, memory_order_relaxed);
+	values->missing = atomic_load_explicit(&counters->missing, memory_order_relaxed);
+	values->recovered = atomic_load_explicit(&counters->recovered, memory_order_relaxed);
+	values->fec_recovered = atomic_load_explicit(&counters->fec_recovered, memory_order_relaxed);
+	values->reordered = atomic_load_explicit(&counters->reordered, memory_order_relaxed);
+	values->retries = atomic_load_explicit(&counters->retries, memory_order_relaxed);
+	values->duplicates = atomic_load_explicit(&counters->duplicates, memory_order_relaxed);
+	values->dropped_late = atomic_load_explicit(&counters->dropped_late, memory_order_relaxed);
+	values->dropped_full = atomic_load_explicit(&counters->dropped_full, memory_order_relaxed);
+}
+
+/* Increase of a flow counter since the last flow reset or stats report, for the thread owning the flow */
+#define rist_flow_counter_interval(f, counter) \
+	(atomic_load_explicit(&(f)->counters.counter, memory_order_relaxed) - (f)->counters_checked.counter)
+
 struct rist_peer_sender_stats {
 	uint64_t sent;
 	uint32_t received;
@@ -164,6 +277,7 @@ struct rist_peer_sender_stats {
 	uint32_t bloat_skip;
 	uint32_t bandwidth_skip;
 	uint32_t retrans_skip;
+	uint32_t duplicate_skip;
 };
 
 struct rist_peer_receiver_stats {
@@ -177,11 +291,17 @@ struct nacks {
 	size_t counter;
 };
 
+struct rist_flow_peer_slot {
+	struct rist_peer *peer; /* NULL for an empty slot */
+	size_t idx; /* position in peer_lst */
+};
+
 struct rist_flow {
 	atomic_int shutdown;
 	int max_output_jitter;
 
-	struct rist_buffer *receiver_queue[RIST_SERVER_QUEUE_BUFFERS]; /* output queue */
+	/* output queue of receiver_queue_max slots, grown by the thread doing the enqueue under mutex */
+	struct rist_buffer **receiver_queue;
 
 	pthread_rwlock_t queue_lock;
 
@@ -196,12 +316,24 @@ struct rist_flow {
 	bool flag_flow_buffer_start;
 
 	/* Missing incoming packets, waiting for retransmission */
+	/* Ring of receiver_queue_max slots indexed by seq & (receiver_queue_max - 1),
+	 * outstanding holes are flagged in missing_bitmap and every non zero bitmap
+	 * word is flagged in missing_summary */
 	struct rist_missing_buffer *missing;
-	struct rist_missing_buffer *missing_tail;
+	uint64_t *missing_bitmap;
+	uint64_t *missing_summary;
 	uint32_t missing_counter;
 
 	struct rist_peer_flow_stats stats_instant;
 	struct rist_peer_flow_stats stats_total;//TODO: use the total stats!
+	struct rist_flow_counters counters;
+	/* counters at the last report */
+	struct rist_flow_counter_values counters_reported;
+	/* counters at the last flow reset or report, the late and full drop checks count from here */
+	struct rist_flow_counter_values counters_checked;
+	struct rist_flow_output_stats output_stats;
+	/* last report, handed out directly in RIST_STATS_FORMAT_BINARY */
+	struct rist_stats stats_report;
 	struct rist_bandwidth_estimation bw;
 	uint64_t stats_next_time;
 	uint64_t checks_next_time;
@@ -213,8 +345,12 @@ struct rist_flow {
 	uint32_t flow_id_actual;
 	int dead;
 	struct rist_flow *next;
+	struct rist_flow *prev;
 	struct rist_peer **peer_lst;
 	size_t peer_lst_len;
+	/* peer_lst indexed by adv_peer_id, open addressing over peer_set_size (power of 2) slots */
+	struct rist_flow_peer_slot *peer_set;
+	size_t peer_set_size;
 	uint32_t last_seq_output;
 	uint64_t last_seq_output_source_time;
 	uint32_t last_seq_found;
@@ -261,13 +397,47 @@ struct rist_flow {
 	/* Temporary buffer for grouping and sending nacks */
 	struct nacks nacks;
 	struct rist_logging_settings *logging_settings;
+
+	/* Sharded receiver: worker thread owning this flow, NULL when the protocol thread does */
+	struct rist_receiver_worker *worker;
+
+	/* Parity packets received for this flow, allocated when the first one arrives */
+	struct rist_fec_decoder *fec;
+
+	/* Stats/session timeout and NACK deadline timers, on the wheel of the owning thread */
+	struct rist_timer_wheel *timers;
+	struct rist_timer checks_timer;
+	struct rist_timer nack_timer;
+	/* Worker list of flows whose session timed out while its wheel was running */
+	struct rist_flow *expired_next;
 };
 
+/* Starts the late and full drop checks over, on a flow reset and a stats report */
+static inline void rist_flow_counters_rebase(struct rist_flow *f)
+{
+	rist_flow_counters_load(&f->counters, &f->counters_checked);
+}
+
+/* Whether late drops call for a flow reset, too_many is set when that is worth an error */
+static inline bool rist_flow_dropped_late_reset(struct rist_flow *f, bool *too_many)
+{
+	unsigned long dropped_late = rist_flow_counter_interval(f, dropped_late);
+	unsigned long received = rist_flow_counter_interval(f, received);
+	*too_many = (dropped_late > received * 5 && received > 100) || (dropped_late > 100 && received == 0);
+	return dropped_late > 5 * received;
+}
+
+static inline bool rist_flow_dropped_full_reset(struct rist_flow *f)
+{
+	return rist_flow_counter_interval(f, dropped_full) > 100;
+}
+
 struct rist_retry {
 	struct rist_peer *peer;
 	uint64_t insert_time;
 	uint32_t seq;
 	bool active;//signal whether this retry has been consumed (false) or not
+	size_t hash_next;//previous retry in the same sender_retry_index bucket
 };
 
 struct rist_common_ctx {
@@ -282,6 +452,12 @@ struct rist_common_ctx {
 
 	/* Flows */
 	struct rist_flow *FLOWS;
+	struct rist_flow *FLOWS_tail;
+	/* FLOWS indexed by flow_id, open addressing with linear probing over flow_table_size
+	 * (power of 2) slots, guarded by flows_lock */
+	struct rist_flow **flow_table;
+	size_t flow_table_size;
+	size_t flow_table_count;
 	pthread_mutex_t flows_lock;
 
 	/* evsocket */
@@ -302,14 +478,28 @@ struct rist_common_ctx {
 		uint8_t recv[RIST_MAX_PACKET_SIZE];
 		uint8_t rtcp[RIST_MAX_PACKET_SIZE];
 	} buf;
-	struct rist_buffer *rist_free_buffer;
-	pthread_mutex_t rist_free_buffer_mutex;
-	uint64_t rist_free_buffer_count;
-
-	/* timers */
-	uint64_t nacks_next_time;
+	/* receive ring for batched (recvmmsg) receive, RIST_RECV_BATCH_SIZE entries */
+	uint8_t (*recv_ring)[RIST_MAX_PACKET_SIZE];
+	bool recvmmsg_disabled;
+	/* zero-copy receive: each recv_ring entry has a pooled block the datagram lands in,
+	 * rx_block is the one being parsed and is set to NULL when its payload gets queued */
+	struct rist_block_pool *block_pool;
+	struct rist_pooled_block *recv_blocks[RIST_RECV_BATCH_SIZE];
+	struct rist_pooled_block *rx_block;
+	/* rist_buffer pool, lock free as the producer threads allocate and the protocol thread
+	 * frees. rist_free_buffer holds buffers without payload */
+	struct rist_buffer_stack rist_free_buffer;
+	struct rist_buffer_stack rist_buffer_pool[RIST_BUFFER_POOL_CLASSES];
+	atomic_uint_fast64_t rist_buffer_pool_hits;
+	atomic_uint_fast64_t rist_buffer_pool_misses;
+
+	/* timers, the wheel is run by the protocol thread and guarded by peerlist_lock */
+	struct rist_timer_wheel timers;
 	uint64_t stats_report_time;
 
+	/* emulated network conditions on the way out, see rist_impairment_set */
+	struct rist_impairment impairment;
+
 	enum rist_profile profile;
 	uint8_t cname[RIST_MAX_HOSTNAME];
 
@@ -335,10 +525,11 @@ struct rist_common_ctx {
 
 	int (*stats_callback)(void *arg, const struct rist_stats *stats_container);
 	void *stats_callback_argument;
+	enum rist_stats_format stats_format;
 	pthread_mutex_t stats_lock;
 
 	pthread_rwlock_t oob_queue_lock;
-	struct rist_buffer *oob_queue[RIST_OOB_QUEUE_BUFFERS]; /* oob queue */
+	struct rist_buffer **oob_queue; /* oob queue, allocated when oob is enabled */
 	size_t oob_queue_bytesize;
 	uint16_t oob_queue_read_index;
 	uint16_t oob_queue_write_index;
@@ -354,6 +545,59 @@ struct rist_common_ctx {
 	void *thread_callback_arg;
 };
 
+/* Data packet handed from the receiver protocol thread to the worker owning its flow */
+struct rist_receiver_worker_item {
+	struct rist_flow *flow;
+	struct rist_peer *peer;
+	/* payload lives in block (zero-copy receive) or in copy, data points into either */
+	struct rist_pooled_block *block;
+	uint8_t *copy;
+	const uint8_t *data;
+	size_t len;
+	uint64_t source_time;
+	uint64_t packet_recv_time;
+	uint64_t rtt;
+	uint32_t seq;
+	uint32_t flow_id;
+	uint16_t src_port;
+	uint16_t dst_port;
+	uint8_t payload_type;
+	bool retry;
+	/* data and rtcp peer disagree on the ssrc, the flow id may have changed */
+	bool ssrc_mismatch;
+	/* parity packet, data starts at the FEC header */
+	bool fec;
+};
+
+/* Sharded receiver worker: owns the flows hashed to it by flow_id and does their reorder
+ * buffer insertion, missing packet tracking, NACK timer and stats/session timeout checks */
+struct rist_receiver_worker {
+	struct rist_receiver *ctx;
+	pthread_t thread;
+	bool thread_running;
+	size_t index;
+
+	/* Ring of items from the protocol thread, guarded by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t condition;
+	struct rist_receiver_worker_item *queue;
+	size_t queue_head;
+	size_t queue_count;
+	uint64_t queue_dropped;
+
+	/* Held while items are processed, peer removal and flow deletion wait on it */
+	pthread_mutex_t busy;
+
+	/* Flows owned by this worker, changed under busy and peerlist_lock */
+	struct rist_flow **flows;
+	size_t flow_count;
+	size_t flow_capacity;
+
+	/* Timers of the owned flows, guarded by busy */
+	struct rist_timer_wheel timers;
+	struct rist_flow *expired;
+};
+
 struct rist_receiver {
 	/* data out thread signaling for fifo */
 	pthread_cond_t condition;
@@ -363,6 +607,10 @@ struct rist_receiver {
 	receiver_data_callback2_t receiver_data_callback;
 	void *receiver_data_callback_argument;
 	int receiver_data_ready_notify_fd;
+	/* Library owned eventfd for data ready notification, -1 when unused */
+	atomic_int receiver_data_ready_eventfd;
+	/* Set by a reader that found the fifo empty, the next queued block signals the eventfd */
+	atomic_bool receiver_data_ready_armed;
 
 	/* Receiver thread variables */
 	bool protocol_running;
@@ -376,9 +624,55 @@ struct rist_receiver {
 
 	enum rist_nack_type nack_type;
 
-	bool simulate_loss;
-	uint16_t loss_percentage;
 	uint32_t fifo_queue_size;
+
+	/* Sharded receiver worker threads, 0 keeps all flow processing on the protocol thread */
+	uint32_t worker_count;
+	struct rist_receiver_worker *workers;
+	/* Items of the recvmmsg batch being parsed, handed to the workers with one lock each at its end */
+	struct rist_receiver_worker_item worker_stage[RIST_RECV_BATCH_SIZE];
+	size_t worker_stage_count;
+	bool worker_staging;
+};
+
+/* Packet handed from the sender protocol thread to the transmit worker of its peer */
+struct rist_sender_tx_item {
+	struct rist_buffer *buffer;
+	struct rist_peer *peer;
+	uint64_t source_time;
+	uint16_t src_port;
+	uint16_t dst_port;
+	bool retry;
+};
+
+/* Sender transmit worker: encrypts and sends the data packets and retransmits of the
+ * peers assigned to it, referencing the queued buffer the other peers share */
+struct rist_sender_tx_worker {
+	struct rist_sender *ctx;
+	pthread_t thread;
+	bool thread_running;
+	size_t index;
+	size_t peer_count;
+
+	/* Lock free ring: the protocol thread is the only producer and moves the tail, whoever
+	 * holds busy is the only consumer and moves the head */
+	struct rist_sender_tx_item *queue;
+	atomic_ulong queue_head;
+	atomic_ulong queue_tail;
+	uint64_t queue_dropped;
+
+	/* Wakes the worker, only taken when the ring ran empty */
+	pthread_mutex_t lock;
+	pthread_cond_t condition;
+	atomic_bool sleeping;
+
+	/* Held while items are sent, peer removal waits on it */
+	pthread_mutex_t busy;
+
+	/* Guarded by busy: the batch and private copies of its payloads, the RTP header
+	 * is written in front of each copy instead of into the shared buffer */
+	struct rist_tx_batch *tx_batch;
+	uint8_t *scratch;
 };
 
 struct rist_sender {
@@ -389,6 +683,12 @@ struct rist_sender {
 	uint32_t recovery_maxbitrate_max;
 	uint32_t max_nacksperloop;
 	bool null_packet_suppression;
+	/* LZ4 level applied to data payloads before they are queued, the highest level any
+	 * peer asked for as retransmits and all peers share the queued payload (0 is off) */
+	atomic_int compression_level;
+	/* LZ4HC working state, producers that find it busy fall back to plain LZ4 */
+	void *compression_state;
+	atomic_bool compression_state_busy;
 
 	/* Sender thread variables */
 	bool protocol_running;
@@ -399,18 +699,29 @@ struct rist_sender {
 
 	bool sender_initialized;
 	uint32_t total_weight;
-	struct rist_buffer *sender_queue[RIST_SERVER_QUEUE_BUFFERS]; /* input queue */
+	/* Input queue: multi producer, the protocol thread is the only consumer and deleter.
+	 * Producers claim a slot through sender_queue_claim and publish the buffer
+	 * pointer into it, the protocol thread moves sender_queue_write_index over the
+	 * published slots in order (see rist_sender_queue_collect) */
+	atomic_uintptr_t *sender_queue;
 	size_t sender_queue_bytesize;
 	size_t sender_queue_delete_index;
 	atomic_ulong sender_queue_read_index;
 	atomic_ulong sender_queue_write_index;
+	/* Next slot in the low 32 bits and next seq_rtp above them, claimed with one CAS so
+	 * seq order is slot order */
+	atomic_uint_fast64_t sender_queue_claim;
 	size_t sender_queue_max;
+	/* The protocol thread grows the queue once the producers inside it have left,
+	 * see rist_sender_queue_enter and rist_sender_queue_grow */
+	atomic_ulong sender_queue_producers;
+	atomic_bool sender_queue_resizing;
+	/* Slots wanted by the peers' bitrate and buffer settings */
+	atomic_ulong sender_queue_target;
 	int weight_counter;
 	uint64_t last_datagram_time;
-	bool simulate_loss;
-	uint16_t loss_percentage;
 	uint64_t stats_next_time;
-	uint64_t checks_next_time;
+	struct rist_timer stats_timer;
 	uint32_t session_timeout;
 
 	/* retry queue */
@@ -418,6 +729,8 @@ struct rist_sender {
 	size_t sender_retry_queue_write_index;
 	size_t sender_retry_queue_read_index;
 	size_t sender_retry_queue_size;
+	/* newest retry queue slot per (peer, seq) hash, SIZE_MAX when empty, chained through hash_next */
+	size_t *sender_retry_index;
 	uint64_t cooldown_time;
 	int cooldown_mode;
 
@@ -438,8 +751,26 @@ struct rist_sender {
 	struct rist_peer **peer_lst;
 	size_t peer_lst_len;
 
-	/* Queue lock for fifo buffer */
-	pthread_mutex_t queue_lock;
+	/* Transmit batching (sendmmsg/UDP GSO), NULL when unsupported */
+	struct rist_tx_batch *tx_batch;
+
+	/* Output pacing (rist_sender_pacing_enable): data goes out at the measured input
+	 * bitrate plus headroom, retransmits at what recovery_maxbitrate leaves on top */
+	bool pacing;
+	struct rist_bandwidth_estimation input_bw;
+	struct rist_pacer data_pacer;
+	struct rist_pacer retry_pacer;
+
+	/* Transmit workers (rist_sender_set_transmit_threads), each data peer is assigned to one */
+	uint32_t tx_worker_count;
+	struct rist_sender_tx_worker *tx_workers;
+
+	/* Row/column parity (rist_sender_fec_set), generated by the protocol thread as it sends the
+	 * data and sent once fec_sent_seq, the last data seq it sent, passes the packets they cover */
+	struct rist_fec_encoder fec;
+	uint16_t fec_sent_seq;
+	/* Payload with compression and null packet deletion undone, for the parity */
+	uint8_t fec_buf[RIST_MAX_PACKET_SIZE];
 };
 
 enum rist_ctx_mode {
@@ -473,6 +804,7 @@ struct rist_keepalive_data {
 struct rist_peer {
 	/* linked list */
 	pthread_mutex_t peer_lock;//Currently only used for setting password & in sending/receiving
+	uint8_t *tx_scratch;//Encryption scratch of non batched sends, guarded by peer_lock
 	struct rist_peer *next;
 	struct rist_peer *prev;
 
@@ -491,6 +823,11 @@ struct rist_peer {
 	struct rist_peer *sibling_next;
 	struct rist_peer *child;
 	uint32_t child_alive_count;
+	/* Listening peers: children indexed by remote address and port, open addressing over
+	 * child_index_size (power of 2) slots. NULL means walk the children instead */
+	struct rist_peer **child_index;
+	size_t child_index_size;
+	size_t child_index_count;
 
 	/* Flow for incoming traffic */
 	struct rist_flow *flow;
@@ -514,12 +851,19 @@ struct rist_peer {
 	bool receiver_mode;
 
 	int sd;
+	/* SO_TXTIME state of sd, on the peer that opened it */
+	bool txtime_checked;
+	bool txtime_enabled;
+	/* Transmit worker sending the data of this peer and its children, sender only */
+	struct rist_sender_tx_worker *tx_worker;
+	/* Impairment PRNG and burst state, lock free for the threads sending for this peer */
+	struct rist_impairment_peer impairment;
 
 	/* State */
 	bool authenticated;
 
-	/* Data sending */
-	uint32_t seq;
+	/* Data sending, the GRE sequence is shared with the transmit worker of the peer */
+	atomic_uint seq;
 	uint64_t eight_times_rtt;
 	uint32_t w_count; /* Counter for weight in distributed send */
 
@@ -542,8 +886,8 @@ struct rist_peer {
 	int eap_authentication_state;
 	uint8_t rist_gre_version;
 
-	/* compression flag (sender only) */
-	bool compression;
+	/* LZ4 compression level (sender only) */
+	int compression;
 
 	/* Addressing */
 	uint16_t local_port;
@@ -585,6 +929,8 @@ struct rist_peer {
 	/* Statistics Receiver */
 	struct rist_peer_receiver_stats stats_receiver_instant;
 	struct rist_peer_receiver_stats stats_receiver_total;
+	/* last sender report, handed out directly in RIST_STATS_FORMAT_BINARY */
+	struct rist_stats stats_report;
 
 	int dead;
 	int timed_out;
@@ -604,6 +950,8 @@ struct rist_peer {
 	uint64_t next_periodic_rtcp;
 	uint64_t next_keepalive_packet;
 	uint64_t session_timeout;
+	/* keepalive, rtcp, eap and session timeout events, on the context wheel */
+	struct rist_timer timer;
 	uint64_t last_pkt_received;
 	uint64_t last_sender_report_time;
 	uint64_t last_sender_report_ts;
@@ -618,6 +966,22 @@ struct rist_peer {
 	struct rist_keepalive_data data;
 };
 
+static inline struct rist_buffer *rist_sender_queue_get(struct rist_sender *ctx, size_t idx) {
+	return (struct rist_buffer *)atomic_load_explicit(&ctx->sender_queue[idx], memory_order_acquire);
+}
+
+static inline void rist_sender_queue_set(struct rist_sender *ctx, size_t idx, struct rist_buffer *b) {
+	atomic_store_explicit(&ctx->sender_queue[idx], (uintptr_t)b, memory_order_release);
+}
+
+static inline size_t rist_sender_claim_index(uint64_t claim) {
+	return (size_t)(claim & UINT32_MAX);
+}
+
+static inline uint16_t rist_sender_claim_seq(uint64_t claim) {
+	return (uint16_t)(claim >> 32);
+}
+
 static inline struct rist_common_ctx *rist_struct_get_common(struct rist_ctx *ctx) {
 	if (RIST_UNLIKELY(!ctx))
 		return NULL;
@@ -635,12 +999,34 @@ RIST_PRIV void rist_sender_peer_statistics(struct rist_peer *peer);
 RIST_PRIV void rist_delete_flow(struct rist_receiver *ctx, struct rist_flow *f);
 RIST_PRIV void rist_receiver_missing(struct rist_flow *f, struct rist_peer *peer,uint64_t nack_time, uint32_t seq, uint64_t rtt);
 RIST_PRIV int rist_receiver_associate_flow(struct rist_peer *p, uint32_t flow_id);
+/* Called with flows_lock held */
+RIST_PRIV struct rist_flow *rist_flow_table_lookup(struct rist_common_ctx *cctx, uint32_t flow_id);
+/* Takes p out of f->peer_lst, returns false if it was not in there */
+RIST_PRIV bool rist_flow_remove_peer(struct rist_flow *f, struct rist_peer *p);
+RIST_PRIV size_t rist_queue_slots_for(uint32_t bitrate_kbps, uint32_t buffer_ms, size_t max_slots);
+RIST_PRIV int rist_receiver_queue_grow(struct rist_flow *f, size_t slots);
+RIST_PRIV size_t rist_receiver_queue_footprint(struct rist_flow *f);
+RIST_PRIV int rist_receiver_workers_start(struct rist_receiver *ctx);
+RIST_PRIV void rist_receiver_workers_stop(struct rist_receiver *ctx);
+RIST_PRIV void rist_receiver_worker_attach_flow(struct rist_receiver *ctx, struct rist_flow *f);
+RIST_PRIV void rist_receiver_worker_detach_flow(struct rist_flow *f);
+RIST_PRIV void rist_receiver_workers_forget_peer(struct rist_receiver *ctx, struct rist_peer *peer);
+RIST_PRIV void rist_receiver_worker_stage_flush(struct rist_receiver *ctx);
+RIST_PRIV void rist_receiver_flow_timers_init(struct rist_receiver *ctx, struct rist_flow *f);
 RIST_PRIV size_t rist_best_rtt_index(struct rist_flow *f);
-RIST_PRIV struct rist_buffer *rist_new_buffer(struct rist_common_ctx *ctx, const void *buf, size_t len, uint8_t type, uint32_t seq, uint64_t source_time, uint16_t src_port, uint16_t dst_port);
+RIST_PRIV struct rist_buffer *rist_new_buffer(struct rist_common_ctx *ctx, const void *buf, size_t len, uint8_t type, uint32_t seq, uint64_t source_time, uint16_t src_port, uint16_t dst_port, uint64_t now);
 RIST_PRIV void free_rist_buffer(struct rist_common_ctx *ctx, struct rist_buffer *b);
-RIST_PRIV void rist_calculate_bitrate(size_t len, struct rist_bandwidth_estimation *bw);
+RIST_PRIV int rist_buffer_pool_init(struct rist_common_ctx *ctx);
+RIST_PRIV void rist_buffer_pool_reserve(struct rist_common_ctx *ctx, size_t slots);
+RIST_PRIV void rist_buffer_pool_destroy(struct rist_common_ctx *ctx);
+RIST_PRIV void rist_buffer_pool_get_stats(struct rist_common_ctx *ctx, uint64_t *hits, uint64_t *misses);
+RIST_PRIV void rist_receiver_zero_copy_init(struct rist_common_ctx *ctx);
+RIST_PRIV void rist_receiver_zero_copy_destroy(struct rist_common_ctx *ctx);
+RIST_PRIV void rist_calculate_bitrate(size_t len, struct rist_bandwidth_estimation *bw, uint64_t now);
 RIST_PRIV void empty_receiver_queue(struct rist_flow *f, struct rist_common_ctx *ctx);
 RIST_PRIV void rist_flush_missing_flow_queue(struct rist_flow *flow);
+RIST_PRIV size_t rist_receiver_missing_next(struct rist_flow *f, size_t idx);
+RIST_PRIV void rist_receiver_missing_remove(struct rist_flow *f, size_t idx);
 
 /* defined in rist-common.c */
 RIST_PRIV void rist_peer_authenticate(struct rist_peer *peer);
@@ -671,14 +1057,20 @@ RIST_PRIV int rist_auth_handler(struct rist_common_ctx *ctx,
 								int (*disconn_cb)(void *arg, struct rist_peer *peer),
 								void *arg);
 RIST_PRIV void sender_peer_append(struct rist_sender *ctx, struct rist_peer *peer);
+RIST_PRIV void rist_peer_timer_start(struct rist_peer *peer);
 
 /* Get common context */
 RIST_PRIV struct rist_common_ctx *get_cctx(struct rist_peer *peer);
 
+/* defined in peer.c */
+RIST_PRIV void _librist_peer_child_index_add(struct rist_peer *parent, struct rist_peer *child);
+RIST_PRIV void _librist_peer_child_index_remove(struct rist_peer *parent, struct rist_peer *child);
+
 /*static inline in header file */
 static inline void peer_append(struct rist_peer *p)
 {
 	struct rist_common_ctx *cctx = get_cctx(p);
+	rist_peer_timer_start(p);
 	struct rist_peer **PEERS = &cctx->PEERS;
 	struct rist_peer *plist = *PEERS;
 	if (!plist)
@@ -709,6 +1101,8 @@ static inline void peer_append(struct rist_peer *p)
 			}
 		}
 		++peer->child_alive_count;
+		if (peer->listening)
+			_librist_peer_child_index_add(peer, p);
 	}
 	while (plist)
 	{
@@ -20,9 +20,13 @@
 #include "proto/eap.h"
 #endif
 #include <assert.h>
+#include <limits.h>
 #ifdef _WIN32
 #include <processthreadsapi.h>
 #endif
+#if HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 
 #undef RIST_DEPRECATED
 
@@ -54,16 +58,18 @@ int rist_receiver_create(struct rist_ctx **_ctx, enum rist_profile profile,
 	ctx->id = (intptr_t)ctx;
 	if (init_common_ctx(&ctx->common, profile))
 		goto fail;
+	rist_receiver_zero_copy_init(&ctx->common);
 
 	ctx->common.logging_settings = logging_settings;
 	ctx->common.stats_report_time = (uint64_t)1000 * (uint64_t)RIST_CLOCK;
 	ctx->fifo_queue_size = RIST_DATAOUT_QUEUE_BUFFERS;
+	atomic_init(&ctx->receiver_data_ready_eventfd, -1);
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "RIST Receiver Library version:%s \n", LIBRIST_VERSION);
 
 	if (logging_settings && logging_settings->log_level == RIST_LOG_SIMULATE)
 	{
-		ctx->simulate_loss = true;
-		ctx->loss_percentage = 1;//Actually 0.1%
+		struct rist_impairment_config impairment = { .loss_model = RIST_IMPAIRMENT_LOSS_BERNOULLI, .loss = 1000 };
+		rist_impairment_configure(&ctx->common.impairment, &impairment);
 		rist_log_priv(&ctx->common, RIST_LOG_WARN, "RIST receiver has been configured with self-imposed (outgoing) packet loss (0.1%%)\n");
 	}
 
@@ -146,22 +152,33 @@ int rist_receiver_data_read(struct rist_ctx *ctx, const struct rist_data_block *
 	return rist_receiver_data_read2(ctx, (struct rist_data_block **)data_block, timeout);
 }
 
-int rist_receiver_data_read2(struct rist_ctx *rist_ctx, struct rist_data_block **data_buffer, int timeout)
+/* Claims up to max blocks from the flow fifo with a single compare and swap of the read index */
+static size_t rist_flow_fifo_pop(struct rist_receiver *ctx, struct rist_flow *f, struct rist_data_block **blocks, size_t max, size_t *available)
 {
-	if (RIST_UNLIKELY(!rist_ctx))
-	{
-		rist_log_priv3(RIST_LOG_ERROR, "ctx is null on rist_receiver_data_read call!\n");
-		return -1;
-	}
-	if (RIST_UNLIKELY(rist_ctx->mode != RIST_RECEIVER_MODE || !rist_ctx->receiver_ctx))
-	{
-		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_data_read call with CTX not set up for receiving\n");
-		return -2;
-	}
-
-	struct rist_receiver *ctx = rist_ctx->receiver_ctx;
+	const unsigned long mask = ctx->fifo_queue_size - 1;
+	unsigned long read_index = atomic_load_explicit(&f->dataout_fifo_queue_read_index, memory_order_relaxed);
+	size_t count;
+	for (;;) {
+		unsigned long write_index = atomic_load_explicit(&f->dataout_fifo_queue_write_index, memory_order_acquire);
+		*available = (write_index - read_index) & mask;
+		count = *available < max ? *available : max;
+		if (count == 0)
+			return 0;
+		// The writer leaves the slots between read and write index alone, copy them out before claiming
+		for (size_t i = 0; i < count; i++)
+			blocks[i] = f->dataout_fifo_queue[(read_index + i) & mask];
+		if (atomic_compare_exchange_weak(&f->dataout_fifo_queue_read_index, &read_index, (read_index + count) & mask))
+			break;
+	}
+	// Claimed slots are left as they are, the writer may already be filling them again
+
+	if (atomic_exchange_explicit(&f->fifo_overflow, false, memory_order_acq_rel))
+		blocks[0]->flags |= RIST_DATA_FLAGS_OVERFLOW;
+	return count;
+}
 
-	struct rist_data_block *data_block = NULL;
+static size_t rist_receiver_fifo_read(struct rist_receiver *ctx, struct rist_data_block **blocks, size_t max, int timeout, size_t *available)
+{
 	/* We could enter the lock now, to read the counter. However performance penalties apply.
 	   The risks for not entering the lock are either sleeping too much (a packet gets added while we read)
 	   or not at all when we should (i.e.: the calling application is reading from multiple threads). Both
@@ -178,39 +195,83 @@ int rist_receiver_data_read2(struct rist_ctx *rist_ctx, struct rist_data_block *
 		f = rist_get_longest_flow(ctx, &num);
 	}
 
-	if (RIST_UNLIKELY(!num || !f))
+	size_t count = 0;
+	*available = 0;
+	while (num && f && count < max) {
+		size_t avail = 0;
+		size_t got = rist_flow_fifo_pop(ctx, f, &blocks[count], max - count, &avail);
+		if (count == 0)
+			*available = avail;
+		count += got;
+		if (got == 0 || count == max)
+			break;
+		num = 0;
+		f = rist_get_longest_flow(ctx, &num);
+	}
+
+#if HAVE_EVENTFD
+	if (count == 0 && atomic_load_explicit(&ctx->receiver_data_ready_eventfd, memory_order_acquire) >= 0) {
+		// Going idle: ask the output thread for a wakeup, then look again so a block queued
+		// before the flag was visible does not get stuck
+		atomic_store_explicit(&ctx->receiver_data_ready_armed, true, memory_order_release);
+		atomic_thread_fence(memory_order_seq_cst);
+		num = 0;
+		f = rist_get_longest_flow(ctx, &num);
+		if (num && f)
+			count = rist_flow_fifo_pop(ctx, f, blocks, max, available);
+	}
+#endif
+	return count;
+}
+
+int rist_receiver_data_read2(struct rist_ctx *rist_ctx, struct rist_data_block **data_buffer, int timeout)
+{
+	if (RIST_UNLIKELY(!rist_ctx))
 	{
-		//No need to log, these can be triggered by gaps in data or low bitrate stream with low timeout values
-		//rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_data_read call with no flow data, %d/%"PRIu32"\n", num, f);
-		return 0;
+		rist_log_priv3(RIST_LOG_ERROR, "ctx is null on rist_receiver_data_read call!\n");
+		return -1;
+	}
+	if (RIST_UNLIKELY(rist_ctx->mode != RIST_RECEIVER_MODE || !rist_ctx->receiver_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_data_read call with CTX not set up for receiving\n");
+		return -2;
 	}
 
-	unsigned long dataout_read_index = atomic_load_explicit(&f->dataout_fifo_queue_read_index, memory_order_relaxed);
-	size_t write_index = atomic_load_explicit(&f->dataout_fifo_queue_write_index, memory_order_acquire);
-	if (write_index != dataout_read_index)
+	struct rist_receiver *ctx = rist_ctx->receiver_ctx;
+
+	struct rist_data_block *data_block = NULL;
+	size_t available = 0;
+	if (!rist_receiver_fifo_read(ctx, &data_block, 1, timeout, &available))
 	{
-		do {
-			num = (atomic_load_explicit(&f->dataout_fifo_queue_write_index, memory_order_acquire) - dataout_read_index) &(ctx->fifo_queue_size -1);
-			if (atomic_compare_exchange_weak(&f->dataout_fifo_queue_read_index, &dataout_read_index, (dataout_read_index +1)&(ctx->fifo_queue_size -1)))
-			{
-				data_block = f->dataout_fifo_queue[dataout_read_index];
-				f->dataout_fifo_queue[dataout_read_index] = NULL;
-				break;
-			}
-		} while (num > 0);
+		//No need to log, these can be triggered by gaps in data or low bitrate stream with low timeout values
+		*data_buffer = NULL;
+		return 0;
 	}
-	assert(!(data_block == NULL && num > 0));
 
 	*data_buffer = data_block;
+	return (int)available;
+}
 
-	bool overflow = false;
-	while (!atomic_compare_exchange_weak(&f->fifo_overflow, &overflow, false)) {
-		//
+int rist_receiver_data_read_batch(struct rist_ctx *rist_ctx, struct rist_data_block **data_blocks, size_t max, int timeout)
+{
+	if (RIST_UNLIKELY(!rist_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "ctx is null on rist_receiver_data_read_batch call!\n");
+		return -1;
+	}
+	if (RIST_UNLIKELY(rist_ctx->mode != RIST_RECEIVER_MODE || !rist_ctx->receiver_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_data_read_batch call with CTX not set up for receiving\n");
+		return -2;
+	}
+	if (RIST_UNLIKELY(!data_blocks || max == 0 || max > INT_MAX))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_data_read_batch call with invalid block array\n");
+		return -1;
 	}
-	if (overflow)
-		data_block->flags |= RIST_DATA_FLAGS_OVERFLOW;
 
-	return (int)num;
+	size_t available = 0;
+	return (int)rist_receiver_fifo_read(rist_ctx->receiver_ctx, data_blocks, max, timeout, &available);
 }
 
 void rist_receiver_data_block_free(struct rist_data_block **const block)
@@ -250,6 +311,42 @@ int rist_receiver_data_notify_fd_set(struct rist_ctx *rist_ctx, int fd)
 	return 0;
 }
 
+int rist_receiver_data_notify_eventfd(struct rist_ctx *rist_ctx)
+{
+	if (RIST_UNLIKELY(!rist_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "ctx is null on rist_receiver_data_notify_eventfd call!\n");
+		return -1;
+	}
+	if (RIST_UNLIKELY(rist_ctx->mode != RIST_RECEIVER_MODE || !rist_ctx->receiver_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_data_notify_eventfd call with CTX not set up for receiving\n");
+		return -1;
+	}
+#if HAVE_EVENTFD
+	struct rist_receiver *ctx = rist_ctx->receiver_ctx;
+	int current = atomic_load_explicit(&ctx->receiver_data_ready_eventfd, memory_order_acquire);
+	if (current < 0) {
+		int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd < 0) {
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not create data notify eventfd, error %d\n", errno);
+			return -1;
+		}
+		// The first queued block signals
+		atomic_store_explicit(&ctx->receiver_data_ready_armed, true, memory_order_release);
+		// The protocol thread may already be running, publish the fd once and keep the first one created
+		if (atomic_compare_exchange_strong_explicit(&ctx->receiver_data_ready_eventfd, &current, fd, memory_order_acq_rel, memory_order_acquire))
+			current = fd;
+		else
+			close(fd);
+	}
+	return current;
+#else
+	rist_log_priv(&rist_ctx->receiver_ctx->common, RIST_LOG_ERROR, "eventfd is not supported on this platform\n");
+	return -1;
+#endif
+}
+
 int rist_connection_status_callback_set(struct rist_ctx *ctx, connection_status_callback_t connection_status_callback,
 										void *arg)
 {
@@ -364,10 +461,43 @@ int rist_sender_create(struct rist_ctx **_ctx, enum rist_profile profile,
 		ctx->sender_retry_queue_size = RIST_RETRY_QUEUE_BUFFERS;
 	}
 
+	ctx->sender_retry_index = malloc(RIST_RETRY_QUEUE_BUFFERS * sizeof(*ctx->sender_retry_index));
+	if (RIST_UNLIKELY(!ctx->sender_retry_index))
+	{
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not create sender retry index, OOM\n");
+		ret = -1;
+		goto free_ctx_and_ret;
+	}
+	memset(ctx->sender_retry_index, 0xff, RIST_RETRY_QUEUE_BUFFERS * sizeof(*ctx->sender_retry_index));
+
+	ctx->tx_batch = rist_tx_batch_create();
+
+	if (rist_fec_encoder_init(&ctx->fec) != 0)
+	{
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Failed to init ctx->fec\n");
+		ret = -1;
+		goto free_ctx_and_ret;
+	}
+
+	// Starts small, the protocol thread grows it once peers tell us the bitrate and buffer
+	ctx->sender_queue_max = RIST_QUEUE_MIN_SLOTS;
+	ctx->sender_queue = calloc(ctx->sender_queue_max, sizeof(*ctx->sender_queue));
+	if (RIST_UNLIKELY(!ctx->sender_queue))
+	{
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not create sender queue, OOM\n");
+		ret = -1;
+		goto free_ctx_and_ret;
+	}
+	atomic_init(&ctx->sender_queue_producers, 0);
+	atomic_init(&ctx->sender_queue_resizing, false);
+	atomic_init(&ctx->sender_queue_target, RIST_QUEUE_MIN_SLOTS);
+	atomic_init(&ctx->compression_level, 0);
+	atomic_init(&ctx->compression_state_busy, false);
+
 	ctx->sender_queue_delete_index = 1;
-	ctx->sender_queue_max = RIST_SERVER_QUEUE_BUFFERS;
 	atomic_init(&ctx->sender_queue_write_index, 1);
 	atomic_init(&ctx->sender_queue_read_index, 0);
+	atomic_init(&ctx->sender_queue_claim, 1);
 
 	rist_log_priv(&ctx->common, RIST_LOG_INFO, "RIST Sender Library %s\n", LIBRIST_VERSION);
 
@@ -376,8 +506,8 @@ int rist_sender_create(struct rist_ctx **_ctx, enum rist_profile profile,
 
 	if (logging_settings && logging_settings->log_level == RIST_LOG_SIMULATE)
 	{
-		ctx->simulate_loss = true;
-		ctx->loss_percentage = 1;//Actually 0.1%
+		struct rist_impairment_config impairment = { .loss_model = RIST_IMPAIRMENT_LOSS_BERNOULLI, .loss = 1000 };
+		rist_impairment_configure(&ctx->common.impairment, &impairment);
 		rist_log_priv(&ctx->common, RIST_LOG_WARN, "RIST Sender has been configured with self-imposed (outgoing) packet loss (0.1%%)\n");
 	}
 
@@ -405,13 +535,6 @@ int rist_sender_create(struct rist_ctx **_ctx, enum rist_profile profile,
 		goto free_ctx_and_ret;
 	}
 
-	ret = pthread_mutex_init(&ctx->queue_lock, NULL);
-	if (ret)
-	{
-		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Error %d initializing pthread_mutex\n", ret);
-		goto free_ctx_and_ret;
-	}
-
 	ctx->sender_initialized = true;
 
 	*_ctx = rist_ctx;
@@ -419,6 +542,9 @@ int rist_sender_create(struct rist_ctx **_ctx, enum rist_profile profile,
 
 	// Failed!
 free_ctx_and_ret:
+	free(ctx->sender_queue);
+	free(ctx->sender_retry_index);
+	free(ctx->sender_retry_queue);
 	free(ctx);
 	free(rist_ctx);
 	return ret;
@@ -477,6 +603,106 @@ int rist_sender_npd_disable(struct rist_ctx *rist_ctx)
 	return 0;
 }
 
+int rist_sender_pacing_enable(struct rist_ctx *rist_ctx)
+{
+	if (RIST_UNLIKELY(!rist_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_pacing_enable call with null context");
+		return -1;
+	}
+	if (RIST_UNLIKELY(rist_ctx->mode != RIST_SENDER_MODE || !rist_ctx->sender_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_pacing_enable call with ctx not set up for sending\n");
+		return -1;
+	}
+	struct rist_sender *ctx = rist_ctx->sender_ctx;
+	ctx->pacing = true;
+	rist_log_priv2(ctx->common.logging_settings, RIST_LOG_INFO, "Enabled output pacing\n");
+	return 0;
+}
+
+int rist_sender_pacing_disable(struct rist_ctx *rist_ctx)
+{
+	if (RIST_UNLIKELY(!rist_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_pacing_disable call with null context");
+		return -1;
+	}
+	if (RIST_UNLIKELY(rist_ctx->mode != RIST_SENDER_MODE || !rist_ctx->sender_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_pacing_disable call with ctx not set up for sending\n");
+		return -1;
+	}
+	struct rist_sender *ctx = rist_ctx->sender_ctx;
+	ctx->pacing = false;
+	rist_log_priv2(ctx->common.logging_settings, RIST_LOG_INFO, "Disabled output pacing\n");
+	return 0;
+}
+
+int rist_sender_fec_set(struct rist_ctx *rist_ctx, uint32_t columns, uint32_t rows)
+{
+	if (RIST_UNLIKELY(!rist_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_fec_set call with null context");
+		return -1;
+	}
+	if (RIST_UNLIKELY(rist_ctx->mode != RIST_SENDER_MODE || !rist_ctx->sender_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_fec_set call with ctx not set up for sending\n");
+		return -1;
+	}
+	struct rist_sender *ctx = rist_ctx->sender_ctx;
+	if (columns == 0 && rows == 0)
+	{
+		rist_fec_encoder_configure(&ctx->fec, 0, 0);
+		rist_log_priv2(ctx->common.logging_settings, RIST_LOG_INFO, "Disabled FEC\n");
+		return 0;
+	}
+	if (ctx->common.profile == RIST_PROFILE_SIMPLE)
+	{
+		rist_log_priv2(ctx->common.logging_settings, RIST_LOG_ERROR, "FEC needs main or advanced profile\n");
+		return -1;
+	}
+	if (columns < 1 || columns > RIST_FEC_MAX_COLUMNS || rows < 1 || rows > RIST_FEC_MAX_ROWS ||
+		columns * rows > RIST_FEC_MAX_MATRIX || columns * rows == 1)
+	{
+		rist_log_priv2(ctx->common.logging_settings, RIST_LOG_ERROR, "Invalid FEC matrix %ux%u, columns and rows go up to %d and %d with at most %d packets\n",
+			columns, rows, RIST_FEC_MAX_COLUMNS, RIST_FEC_MAX_ROWS, RIST_FEC_MAX_MATRIX);
+		return -1;
+	}
+	rist_fec_encoder_configure(&ctx->fec, (uint8_t)columns, (uint8_t)rows);
+	rist_log_priv2(ctx->common.logging_settings, RIST_LOG_INFO, "Enabled FEC with %u columns and %u rows\n", columns, rows);
+	return 0;
+}
+
+int rist_sender_set_transmit_threads(struct rist_ctx *rist_ctx, uint32_t count)
+{
+	if (RIST_UNLIKELY(!rist_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_set_transmit_threads call with null context");
+		return -1;
+	}
+	if (RIST_UNLIKELY(rist_ctx->mode != RIST_SENDER_MODE || !rist_ctx->sender_ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_sender_set_transmit_threads call with ctx not set up for sending\n");
+		return -2;
+	}
+	struct rist_sender *ctx = rist_ctx->sender_ctx;
+	if (ctx->protocol_running)
+	{
+		rist_log_priv2(ctx->common.logging_settings, RIST_LOG_ERROR, "rist_sender_set_transmit_threads must be called before starting\n");
+		return -3;
+	}
+	if (count > RIST_SENDER_MAX_TX_WORKERS)
+	{
+		rist_log_priv2(ctx->common.logging_settings, RIST_LOG_ERROR, "Transmit thread count must not exceed %d\n", RIST_SENDER_MAX_TX_WORKERS);
+		return -4;
+	}
+	ctx->tx_worker_count = count;
+	rist_log_priv2(ctx->common.logging_settings, RIST_LOG_INFO, "Using %u transmit threads\n", count);
+	return 0;
+}
+
 int rist_sender_flow_id_set(struct rist_ctx *rist_ctx, uint32_t flow_id)
 {
 	if (RIST_UNLIKELY(!rist_ctx))
@@ -523,16 +749,15 @@ int rist_sender_data_write(struct rist_ctx *rist_ctx, const struct rist_data_blo
 		return -1;
 	}
 
-	uint64_t ts_ntp = data_block->ts_ntp == 0 ? timestampNTP_u64() : data_block->ts_ntp;
-	uint32_t seq_rtp;
-	if (data_block->flags & RIST_DATA_FLAGS_USE_SEQ)
-		seq_rtp = (uint32_t)data_block->seq;
-	else
-		seq_rtp = ctx->common.seq_rtp++;
+	uint64_t now = timestampNTP_u64();
+	uint64_t ts_ntp = data_block->ts_ntp == 0 ? now : data_block->ts_ntp;
+	// Our own seqs are handed out together with the queue slot
+	int32_t seq_rtp = -1;
 	//When we support 32bit seq this should be changed
-	seq_rtp = seq_rtp & (UINT16_MAX);
+	if (data_block->flags & RIST_DATA_FLAGS_USE_SEQ)
+		seq_rtp = (int32_t)(data_block->seq & UINT16_MAX);
 
-	int ret = rist_sender_enqueue(ctx, data_block->payload, data_block->payload_len, ts_ntp, data_block->virt_src_port, data_block->virt_dst_port, seq_rtp);
+	int ret = rist_sender_enqueue(ctx, data_block->payload, data_block->payload_len, ts_ntp, data_block->virt_src_port, data_block->virt_dst_port, seq_rtp, now);
 	// Wake up data/nack output thread when data comes in
 	if (pthread_cond_signal(&ctx->condition))
 		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Call to pthread_cond_signal failed.\n");
@@ -612,6 +837,13 @@ int rist_oob_callback_set(struct rist_ctx *ctx,
 		rist_log_priv(cctx, RIST_LOG_ERROR, "Failed to init ctx->common.oob_queue_lock\n");
 		return -1;
 	}
+	cctx->oob_queue = calloc(RIST_OOB_QUEUE_BUFFERS, sizeof(*cctx->oob_queue));
+	if (!cctx->oob_queue)
+	{
+		rist_log_priv(cctx, RIST_LOG_ERROR, "Could not allocate oob queue, OOM\n");
+		pthread_rwlock_destroy(&cctx->oob_queue_lock);
+		return -1;
+	}
 	cctx->oob_data_enabled = true;
 	cctx->oob_data_callback = oob_callback;
 	cctx->oob_data_callback_argument = arg;
@@ -631,6 +863,31 @@ int rist_jitter_max_set(struct rist_ctx *ctx, int t)
 	return rist_max_jitter_set(cctx, t);
 }
 
+int rist_impairment_set(struct rist_ctx *ctx, const struct rist_impairment_config *config)
+{
+	if (RIST_UNLIKELY(!ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_impairment_set call with null ctx!\n");
+		return -1;
+	}
+	struct rist_common_ctx *cctx = rist_struct_get_common(ctx);
+	if (RIST_UNLIKELY(!cctx))
+		return -1;
+	if (config && (config->loss_model > RIST_IMPAIRMENT_LOSS_GILBERT_ELLIOTT || config->loss > 1000000
+			|| config->loss_bad > 1000000 || config->good_to_bad > 1000000 || config->bad_to_good > 1000000
+			|| config->duplicate > 1000000 || config->reorder > 1000000)) {
+		rist_log_priv2(cctx->logging_settings, RIST_LOG_ERROR, "Invalid impairment configuration, probabilities are in parts per million\n");
+		return -1;
+	}
+	rist_impairment_configure(&cctx->impairment, config);
+	if (config)
+		rist_log_priv2(cctx->logging_settings, RIST_LOG_INFO, "Impairment set: loss model %d, loss %u/%u ppm, duplicate %u ppm, reorder %u ppm, delay %u+-%u ms, rate %u kbps, seed %"PRIu64"\n",
+			config->loss_model, config->loss, config->loss_bad, config->duplicate, config->reorder, config->delay, config->jitter, config->rate, config->seed);
+	else
+		rist_log_priv2(cctx->logging_settings, RIST_LOG_INFO, "Impairment disabled\n");
+	return 0;
+}
+
 int rist_auth_handler_set(struct rist_ctx *ctx,
 						  int (*conn_cb)(void *arg, const char *connecting_ip, uint16_t connecting_port, const char *local_ip, uint16_t local_port, struct rist_peer *peer),
 						  int (*disconn_cb)(void *arg, struct rist_peer *peer),
@@ -651,8 +908,10 @@ int rist_stats_free(const struct rist_stats *stats_container)
 {
 	if (!stats_container)
 		return -1;
-	if (stats_container->stats_json)
-		free(stats_container->stats_json);
+	// Binary reports are cached in the flow or peer they describe
+	if (stats_container->library_owned)
+		return 0;
+	free(stats_container->stats_json);
 	free((void *)stats_container);
 	return 0;
 }
@@ -759,6 +1018,63 @@ int rist_stats_callback_set(struct rist_ctx *ctx, int statsinterval, int (*stats
 	return 0;
 }
 
+int rist_stats_format_set(struct rist_ctx *ctx, enum rist_stats_format format)
+{
+	if (RIST_UNLIKELY(!ctx))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_stats_format_set call with null ctx!\n");
+		return -1;
+	}
+	if (format != RIST_STATS_FORMAT_JSON && format != RIST_STATS_FORMAT_BINARY)
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_stats_format_set call with invalid format %d\n", format);
+		return -1;
+	}
+	struct rist_common_ctx *cctx = rist_struct_get_common(ctx);
+	if (RIST_UNLIKELY(!cctx))
+		return -1;
+	pthread_mutex_lock(&cctx->stats_lock);
+	cctx->stats_format = format;
+	pthread_mutex_unlock(&cctx->stats_lock);
+	return 0;
+}
+
+int rist_receiver_flow_counters_get(struct rist_ctx *ctx, uint32_t flow_id, struct rist_receiver_flow_counters *counters)
+{
+	if (RIST_UNLIKELY(!ctx || !counters))
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_flow_counters_get call with null ctx or counters!\n");
+		return -1;
+	}
+	if (ctx->mode != RIST_RECEIVER_MODE || !ctx->receiver_ctx)
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_flow_counters_get can only be called on receiver\n");
+		return -1;
+	}
+	struct rist_common_ctx *cctx = &ctx->receiver_ctx->common;
+	// The writers never take flows_lock, it only keeps the flow from being freed under us
+	pthread_mutex_lock(&cctx->flows_lock);
+	struct rist_flow *f = rist_flow_table_lookup(cctx, flow_id);
+	if (f)
+	{
+		struct rist_flow_counter_values total;
+		rist_flow_counters_load(&f->counters, &total);
+		counters->flow_id = flow_id;
+		counters->received = total.received;
+		counters->missing = total.missing;
+		counters->recovered = total.recovered;
+		counters->fec_recovered = total.fec_recovered;
+		counters->reordered = total.reordered;
+		counters->retries = total.retries;
+		counters->duplicates = total.duplicates;
+		counters->dropped_late = total.dropped_late;
+		counters->dropped_full = total.dropped_full;
+		counters->lost = atomic_load_explicit(&f->output_stats.lost, memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&cctx->flows_lock);
+	return f ? 0 : -1;
+}
+
 /* Utility functions */
 const char *librist_version(void)
 {
@@ -949,6 +1265,12 @@ static int rist_sender_peer_create(struct rist_sender *ctx,
 		newpeer->peer_data = newpeer;
 		newpeer->is_rtcp = true;
 		newpeer->compression = config->compression;
+		if (newpeer->compression > 0)
+			rist_sender_compression_set(ctx, newpeer->compression);
+		int compression_level = atomic_load_explicit(&ctx->compression_level, memory_order_relaxed);
+		if (newpeer->compression != compression_level)
+			rist_log_priv(&ctx->common, RIST_LOG_NOTICE, "Peer asked for compression level %d, the sender compresses all peers at level %d\n",
+				newpeer->compression, compression_level);
 	}
 
 	/* jumpstart communication */
@@ -1068,6 +1390,12 @@ static int rist_sender_start(struct rist_sender *ctx)
 {
 	pthread_mutex_lock(&ctx->mutex);
 	if (!ctx->protocol_running) {
+		// Workers must be up before the first peer gets assigned to them
+		if (rist_sender_tx_workers_start(ctx) != 0)
+		{
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not start transmit worker threads.\n");
+			goto unlock_failed;
+		}
 		if (rist_thread_create(&ctx->common, &ctx->sender_thread, NULL, sender_pthread_protocol, (void *)ctx) != 0)
 		{
 			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not created sender thread.\n");
@@ -1097,6 +1425,12 @@ static int rist_receiver_start(struct rist_receiver *ctx)
 	pthread_mutex_lock(&ctx->mutex);
 	if (!ctx->protocol_running)
 	{
+		// Workers must be up before the first flow gets hashed to them
+		if (rist_receiver_workers_start(ctx) != 0)
+		{
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not start receiver worker threads.\n");
+			goto unlock_failed;
+		}
 		if (rist_thread_create(&ctx->common, &ctx->receiver_thread, NULL, receiver_pthread_protocol, (void *)ctx) != 0)
 		{
 			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not create receiver protocol thread.\n");
@@ -1207,6 +1541,32 @@ int rist_receiver_set_output_fifo_size(struct rist_ctx *ctx, uint32_t desired_si
 	return 0;
 }
 
+int rist_receiver_set_worker_threads(struct rist_ctx *ctx, uint32_t count)
+{
+	if (!ctx)
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_set_worker_threads called with null ctx\n");
+		return -1;
+	}
+	if (ctx->mode != RIST_RECEIVER_MODE || !ctx->receiver_ctx)
+	{
+		rist_log_priv3(RIST_LOG_ERROR, "rist_receiver_set_worker_threads can only be called on receiver\n");
+		return -2;
+	}
+	if (ctx->receiver_ctx->receiver_thread)
+	{
+		rist_log_priv2(ctx->receiver_ctx->common.logging_settings, RIST_LOG_ERROR, "rist_receiver_set_worker_threads must be called before starting\n");
+		return -3;
+	}
+	if (count > RIST_RECEIVER_MAX_WORKERS)
+	{
+		rist_log_priv2(ctx->receiver_ctx->common.logging_settings, RIST_LOG_ERROR, "Worker thread count must not exceed %d\n", RIST_RECEIVER_MAX_WORKERS);
+		return -4;
+	}
+	ctx->receiver_ctx->worker_count = count;
+	return 0;
+}
+
 int rist_set_opt(struct rist_ctx *ctx, enum rist_opt opt, void* optval1, void* optval2, void* optval3)
 {
 	struct rist_common_ctx *cctx = NULL;
@@ -0,0 +1,100 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "rist_block_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void rist_block_pool_free(struct rist_block_pool *pool)
+{
+	struct rist_pooled_block *pb = pool->free_list;
+	while (pb) {
+		struct rist_pooled_block *next = pb->next_free;
+		free(pb);
+		pb = next;
+	}
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+static inline void rist_block_pool_unref(struct rist_block_pool *pool)
+{
+	if (atomic_fetch_sub(&pool->refcnt, 1) == 1)
+		rist_block_pool_free(pool);
+}
+
+struct rist_block_pool *rist_block_pool_create(size_t prealloc, size_t max_free)
+{
+	struct rist_block_pool *pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		free(pool);
+		return NULL;
+	}
+	atomic_init(&pool->refcnt, 1);
+	pool->max_free = max_free;
+	for (size_t i = 0; i < prealloc; i++) {
+		struct rist_pooled_block *pb = malloc(sizeof(*pb));
+		if (!pb)
+			break;
+		pb->pool = pool;
+		pb->next_free = pool->free_list;
+		pool->free_list = pb;
+		pool->free_count++;
+	}
+	return pool;
+}
+
+/* Drops the owner reference, outstanding blocks keep the pool alive */
+void rist_block_pool_release(struct rist_block_pool *pool)
+{
+	if (!pool)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->closing = true;
+	pthread_mutex_unlock(&pool->lock);
+	rist_block_pool_unref(pool);
+}
+
+struct rist_pooled_block *rist_block_pool_get(struct rist_block_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	struct rist_pooled_block *pb = pool->free_list;
+	if (pb) {
+		pool->free_list = pb->next_free;
+		pool->free_count--;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	if (!pb) {
+		pb = malloc(sizeof(*pb));
+		if (!pb)
+			return NULL;
+		pb->pool = pool;
+	}
+	atomic_fetch_add(&pool->refcnt, 1);
+	memset(&pb->block, 0, sizeof(pb->block));
+	pb->block.ref = &pb->ref;
+	pb->ref.ptr = &pb->block;
+	pb->ref.pooled = true;
+	atomic_init(&pb->ref.refcnt, 1);
+	pb->next_free = NULL;
+	return pb;
+}
+
+void rist_block_pool_put(struct rist_pooled_block *pb)
+{
+	struct rist_block_pool *pool = pb->pool;
+	pthread_mutex_lock(&pool->lock);
+	if (!pool->closing && pool->free_count < pool->max_free) {
+		pb->next_free = pool->free_list;
+		pool->free_list = pb;
+		pool->free_count++;
+		pb = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	free(pb);
+	rist_block_pool_unref(pool);
+}
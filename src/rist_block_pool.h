@@ -0,0 +1,51 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef RIST_BLOCK_POOL_H
+#define RIST_BLOCK_POOL_H
+
+#include "common/attributes.h"
+#include "rist_ref.h"
+#include "librist/headers.h"
+#include "pthread-shim.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Datagrams up to this size are received straight into a pooled block,
+// large enough for a 7 TS packets payload after null packet expansion
+#define RIST_BLOCK_POOL_DATA_SIZE (2048)
+
+struct rist_block_pool;
+
+/* Zero-copy receive element: the datagram lands in data, its payload is then
+ * exposed through block and the element goes back to the pool once the last
+ * reference on ref is dropped */
+struct rist_pooled_block {
+	struct rist_data_block block;
+	struct rist_ref ref;
+	struct rist_block_pool *pool;
+	struct rist_pooled_block *next_free;
+	uint8_t data[RIST_BLOCK_POOL_DATA_SIZE];
+};
+
+/* The pool holds one reference for its owner and one per block handed out,
+ * so blocks freed by the application after the context is gone stay valid */
+struct rist_block_pool {
+	pthread_mutex_t lock;
+	atomic_int refcnt;
+	bool closing;
+	struct rist_pooled_block *free_list;
+	size_t free_count;
+	size_t max_free;
+};
+
+RIST_PRIV struct rist_block_pool *rist_block_pool_create(size_t prealloc, size_t max_free);
+RIST_PRIV void rist_block_pool_release(struct rist_block_pool *pool);
+RIST_PRIV struct rist_pooled_block *rist_block_pool_get(struct rist_block_pool *pool);
+RIST_PRIV void rist_block_pool_put(struct rist_pooled_block *pb);
+
+#endif
@@ -0,0 +1,348 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "rist_fec.h"
+#include "proto/rtp.h"
+#include "endian-shim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RIST_FEC_XOR_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RIST_FEC_XOR_NEON 1
+#endif
+
+/*
+SMPTE 2022-1 FEC header, after the RTP header of a parity packet
+
+ 0                   1                   2                   3
+ 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|      SNBase low bits          |        Length Recovery        |
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|E| PT recovery |                    Mask                       |
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|                          TS recovery                          |
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|N|D|type |index|    Offset     |      NA       |SNBase ext bits|
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+The payload is the XOR of the protected payloads, the shorter ones padded with zeros.
+*/
+
+void rist_fec_xor(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t i = 0;
+#if RIST_FEC_XOR_SSE2
+	for (; i + 64 <= len; i += 64) {
+		__m128i a0 = _mm_loadu_si128((const __m128i *)&dst[i]);
+		__m128i a1 = _mm_loadu_si128((const __m128i *)&dst[i + 16]);
+		__m128i a2 = _mm_loadu_si128((const __m128i *)&dst[i + 32]);
+		__m128i a3 = _mm_loadu_si128((const __m128i *)&dst[i + 48]);
+		a0 = _mm_xor_si128(a0, _mm_loadu_si128((const __m128i *)&src[i]));
+		a1 = _mm_xor_si128(a1, _mm_loadu_si128((const __m128i *)&src[i + 16]));
+		a2 = _mm_xor_si128(a2, _mm_loadu_si128((const __m128i *)&src[i + 32]));
+		a3 = _mm_xor_si128(a3, _mm_loadu_si128((const __m128i *)&src[i + 48]));
+		_mm_storeu_si128((__m128i *)&dst[i], a0);
+		_mm_storeu_si128((__m128i *)&dst[i + 16], a1);
+		_mm_storeu_si128((__m128i *)&dst[i + 32], a2);
+		_mm_storeu_si128((__m128i *)&dst[i + 48], a3);
+	}
+	for (; i + 16 <= len; i += 16)
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_xor_si128(_mm_loadu_si128((const __m128i *)&dst[i]),
+			_mm_loadu_si128((const __m128i *)&src[i])));
+#elif RIST_FEC_XOR_NEON
+	for (; i + 16 <= len; i += 16)
+		vst1q_u8(&dst[i], veorq_u8(vld1q_u8(&dst[i]), vld1q_u8(&src[i])));
+#endif
+	for (; i + 8 <= len; i += 8) {
+		uint64_t a, b;
+		memcpy(&a, &dst[i], sizeof(a));
+		memcpy(&b, &src[i], sizeof(b));
+		a ^= b;
+		memcpy(&dst[i], &a, sizeof(a));
+	}
+	for (; i < len; i++)
+		dst[i] ^= src[i];
+}
+
+void rist_fec_header_write(uint8_t *buf, const struct rist_fec_header *hdr)
+{
+	buf[0] = hdr->sn_base >> 8;
+	buf[1] = hdr->sn_base & 0xff;
+	buf[2] = hdr->length_recovery >> 8;
+	buf[3] = hdr->length_recovery & 0xff;
+	buf[4] = 0x80 | (hdr->pt_recovery & 0x7f);
+	buf[5] = buf[6] = buf[7] = 0;
+	uint32_t ts = htobe32(hdr->ts_recovery);
+	memcpy(&buf[8], &ts, sizeof(ts));
+	buf[12] = hdr->row ? 0x40 : 0;
+	buf[13] = hdr->offset;
+	buf[14] = hdr->na;
+	buf[15] = 0;
+}
+
+int rist_fec_header_read(const uint8_t *buf, size_t len, struct rist_fec_header *hdr)
+{
+	if (len < RIST_FEC_HEADER_SIZE)
+		return -1;
+	// Only the XOR type without the N bit extension is generated
+	if (!(buf[4] & 0x80) || (buf[12] & 0xbf) != 0)
+		return -1;
+	hdr->sn_base = (uint16_t)(buf[0] << 8 | buf[1]);
+	hdr->length_recovery = (uint16_t)(buf[2] << 8 | buf[3]);
+	hdr->pt_recovery = buf[4] & 0x7f;
+	uint32_t ts;
+	memcpy(&ts, &buf[8], sizeof(ts));
+	hdr->ts_recovery = be32toh(ts);
+	hdr->row = (buf[12] & 0x40) != 0;
+	hdr->offset = buf[13];
+	hdr->na = buf[14];
+	if (hdr->offset == 0 || hdr->na == 0 || hdr->na > RIST_FEC_MAX_MATRIX)
+		return -1;
+	return 0;
+}
+
+uint32_t rist_fec_rtp_ts(uint64_t source_time)
+{
+	/* source_time is rtp << 32 / 90000 rounded down, rounding the way back up gives the
+	   exact timestamp. Split up as the full product does not fit 64 bits */
+	uint64_t hi = source_time >> 32;
+	uint64_t lo = source_time & UINT32_MAX;
+	return (uint32_t)(hi * RTP_PTYPE_MPEGTS_CLOCKHZ + ((lo * RTP_PTYPE_MPEGTS_CLOCKHZ + UINT32_MAX) >> 32));
+}
+
+static void fec_queue_clear(struct rist_fec_encoder *enc)
+{
+	for (size_t i = 0; i < enc->queue_count; i++)
+		free(enc->queue[(enc->queue_head + i) & (RIST_FEC_QUEUE_SIZE - 1)].data);
+	enc->queue_head = 0;
+	enc->queue_count = 0;
+}
+
+static void fec_matrix_clear(struct rist_fec_matrix *m)
+{
+	memset(m->seen, 0, sizeof(m->seen));
+	for (size_t i = 0; i < RIST_FEC_MAX_ROWS; i++)
+		m->rows[i].count = 0;
+	for (size_t i = 0; i < RIST_FEC_MAX_COLUMNS; i++)
+		m->columns[i].count = 0;
+}
+
+int rist_fec_encoder_init(struct rist_fec_encoder *enc)
+{
+	memset(enc, 0, sizeof(*enc));
+	atomic_init(&enc->config, 0);
+	return 0;
+}
+
+void rist_fec_encoder_destroy(struct rist_fec_encoder *enc)
+{
+	fec_queue_clear(enc);
+	for (size_t m = 0; m < 2; m++) {
+		for (size_t i = 0; i < RIST_FEC_MAX_ROWS; i++)
+			free(enc->matrix[m].rows[i].payload);
+		for (size_t i = 0; i < RIST_FEC_MAX_COLUMNS; i++)
+			free(enc->matrix[m].columns[i].payload);
+	}
+	memset(enc->matrix, 0, sizeof(enc->matrix));
+}
+
+void rist_fec_encoder_configure(struct rist_fec_encoder *enc, uint8_t columns, uint8_t rows)
+{
+	if (columns == 0 || rows == 0)
+		columns = rows = 0;
+	// The generation makes setting the same matrix again start over too
+	unsigned int config = atomic_load_explicit(&enc->config, memory_order_relaxed);
+	unsigned int next;
+	do {
+		next = ((config >> 16) + 1) << 16 | (unsigned int)columns << 8 | rows;
+	} while (!atomic_compare_exchange_weak_explicit(&enc->config, &config, next, memory_order_release, memory_order_relaxed));
+}
+
+/* Protocol thread only, starts over when the matrix was set since the last call */
+static bool fec_config_apply(struct rist_fec_encoder *enc)
+{
+	unsigned int config = atomic_load_explicit(&enc->config, memory_order_acquire);
+	if (config != enc->applied) {
+		enc->applied = config;
+		enc->columns = (uint8_t)(config >> 8);
+		enc->rows = (uint8_t)config;
+		enc->started = false;
+		fec_matrix_clear(&enc->matrix[0]);
+		fec_matrix_clear(&enc->matrix[1]);
+		fec_queue_clear(enc);
+	}
+	return enc->columns > 0 && enc->rows > 0;
+}
+
+static int fec_parity_add(struct rist_fec_parity *par, uint32_t rtp_ts, const uint8_t *data, size_t len)
+{
+	if (len > par->capacity) {
+		uint8_t *payload = realloc(par->payload, len);
+		if (!payload)
+			return -1;
+		par->payload = payload;
+		par->capacity = len;
+	}
+	if (par->count == 0) {
+		memcpy(par->payload, data, len);
+		par->size = len;
+		par->length_recovery = 0;
+		par->ts_recovery = 0;
+	} else {
+		if (len > par->size) {
+			memset(&par->payload[par->size], 0, len - par->size);
+			par->size = len;
+		}
+		rist_fec_xor(par->payload, data, len);
+	}
+	par->count++;
+	par->length_recovery ^= (uint16_t)len;
+	par->ts_recovery ^= rtp_ts;
+	return 0;
+}
+
+static void fec_parity_emit(struct rist_fec_encoder *enc, struct rist_fec_parity *par, uint16_t sn_base, bool row, uint8_t offset, uint8_t na, uint16_t src_port, uint16_t dst_port)
+{
+	if (enc->queue_count == RIST_FEC_QUEUE_SIZE)
+		return;
+	size_t len = sizeof(struct rist_rtp_hdr) + RIST_FEC_HEADER_SIZE + par->size;
+	uint8_t *data = malloc(len);
+	if (!data)
+		return;
+
+	struct rist_rtp_hdr *rtp = (struct rist_rtp_hdr *)data;
+	rtp->flags = RTP_MPEGTS_FLAGS;
+	rtp->payload_type = RTP_PTYPE_FEC;
+	rtp->seq = htobe16(enc->seq);
+	enc->seq++;
+	rtp->ts = 0;
+	rtp->ssrc = 0; // filled in per peer
+	struct rist_fec_header hdr = {
+		.sn_base = sn_base,
+		.length_recovery = par->length_recovery,
+		.pt_recovery = (na & 1) ? RTP_PTYPE_MPEGTS : 0,
+		.ts_recovery = par->ts_recovery,
+		.row = row,
+		.offset = offset,
+		.na = na,
+	};
+	rist_fec_header_write(&data[sizeof(*rtp)], &hdr);
+	memcpy(&data[sizeof(*rtp) + RIST_FEC_HEADER_SIZE], par->payload, par->size);
+
+	struct rist_fec_packet *pkt = &enc->queue[(enc->queue_head + enc->queue_count++) & (RIST_FEC_QUEUE_SIZE - 1)];
+	pkt->last_seq = (uint16_t)(sn_base + (na - 1) * offset);
+	pkt->src_port = src_port;
+	pkt->dst_port = dst_port;
+	pkt->len = len;
+	pkt->data = data;
+}
+
+void rist_fec_encoder_add(struct rist_fec_encoder *enc, uint16_t seq, uint32_t rtp_ts, const uint8_t *data, size_t len, uint16_t src_port, uint16_t dst_port)
+{
+	if (!fec_config_apply(enc))
+		return;
+	const int columns = enc->columns;
+	const int rows = enc->rows;
+	const int size = columns * rows;
+	int distance = (int16_t)(uint16_t)(seq - enc->base);
+	// First packet, or the seq jumped somewhere else altogether
+	if (!enc->started || distance < -2 * size || distance >= 3 * size) {
+		enc->started = true;
+		enc->base = seq;
+		enc->current = 0;
+		fec_matrix_clear(&enc->matrix[0]);
+		fec_matrix_clear(&enc->matrix[1]);
+		distance = 0;
+	}
+	// Its matrix was given up already
+	if (distance < 0)
+		return;
+	// Opens the matrix after the newer one, whatever is left of the older one never completes
+	if (distance >= 2 * size) {
+		fec_matrix_clear(&enc->matrix[enc->current]);
+		enc->current ^= 1;
+		enc->base = (uint16_t)(enc->base + size);
+		distance -= size;
+	}
+	int which = distance / size;
+	int pos = distance % size;
+	struct rist_fec_matrix *m = &enc->matrix[enc->current ^ which];
+	uint16_t base = (uint16_t)(enc->base + which * size);
+	if (m->seen[pos])
+		return;
+	m->seen[pos] = true;
+
+	int row = pos / columns;
+	int column = pos % columns;
+	// A row of 1 or a column of 1 would just be a copy of the packet
+	if (columns > 1) {
+		struct rist_fec_parity *par = &m->rows[row];
+		if (fec_parity_add(par, rtp_ts, data, len) == 0 && par->count == columns)
+			fec_parity_emit(enc, par, (uint16_t)(base + row * columns), true, 1, (uint8_t)columns, src_port, dst_port);
+	}
+	if (rows > 1) {
+		struct rist_fec_parity *par = &m->columns[column];
+		if (fec_parity_add(par, rtp_ts, data, len) == 0 && par->count == rows)
+			fec_parity_emit(enc, par, (uint16_t)(base + column), false, (uint8_t)columns, (uint8_t)rows, src_port, dst_port);
+	}
+}
+
+bool rist_fec_encoder_pop(struct rist_fec_encoder *enc, uint16_t sent_seq, struct rist_fec_packet *pkt)
+{
+	if (!fec_config_apply(enc) || enc->queue_count == 0)
+		return false;
+	struct rist_fec_packet *head = &enc->queue[enc->queue_head];
+	if ((int16_t)(uint16_t)(sent_seq - head->last_seq) < 0)
+		return false;
+	*pkt = *head;
+	head->data = NULL;
+	enc->queue_head = (enc->queue_head + 1) & (RIST_FEC_QUEUE_SIZE - 1);
+	enc->queue_count--;
+	return true;
+}
+
+struct rist_fec_pending *rist_fec_decoder_add(struct rist_fec_decoder *dec, const struct rist_fec_header *hdr, const uint8_t *payload, size_t size)
+{
+	size_t oldest = 0;
+	for (size_t i = 0; i < dec->count; i++) {
+		struct rist_fec_pending *e = &dec->pending[i];
+		if (e->hdr.sn_base == hdr->sn_base && e->hdr.row == hdr->row)
+			return NULL;
+		if (e->order < dec->pending[oldest].order)
+			oldest = i;
+	}
+	if (dec->count == RIST_FEC_PENDING)
+		rist_fec_decoder_remove(dec, oldest);
+	uint8_t *copy = malloc(size ? size : 1);
+	if (!copy)
+		return NULL;
+	memcpy(copy, payload, size);
+	struct rist_fec_pending *e = &dec->pending[dec->count++];
+	e->hdr = *hdr;
+	e->order = dec->order++;
+	e->size = size;
+	e->payload = copy;
+	return e;
+}
+
+void rist_fec_decoder_remove(struct rist_fec_decoder *dec, size_t i)
+{
+	free(dec->pending[i].payload);
+	dec->pending[i] = dec->pending[--dec->count];
+}
+
+void rist_fec_decoder_free(struct rist_fec_decoder *dec)
+{
+	if (!dec)
+		return;
+	while (dec->count > 0)
+		rist_fec_decoder_remove(dec, dec->count - 1);
+	free(dec);
+}
@@ -0,0 +1,123 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef RIST_FEC_H
+#define RIST_FEC_H
+
+#include "common/attributes.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* SMPTE 2022-1 limits on the matrix, L columns by D rows */
+#define RIST_FEC_MAX_COLUMNS (20)
+#define RIST_FEC_MAX_ROWS (20)
+#define RIST_FEC_MAX_MATRIX (100)
+
+/* 2022-1 FEC header that follows the RTP header of a parity packet */
+#define RIST_FEC_HEADER_SIZE (16)
+/* Parity packets waiting for the protocol thread, power of 2 */
+#define RIST_FEC_QUEUE_SIZE (256)
+/* Parity packets a flow holds on to while their rows and columns can still be repaired */
+#define RIST_FEC_PENDING (64)
+
+struct rist_fec_header {
+	uint16_t sn_base;
+	uint16_t length_recovery;
+	uint8_t pt_recovery;
+	uint32_t ts_recovery;
+	bool row; /* D bit, row parity protects consecutive packets, column parity every offset-th */
+	uint8_t offset;
+	uint8_t na;
+};
+
+/* One row or column parity being accumulated by the sender */
+struct rist_fec_parity {
+	uint8_t count;
+	uint16_t length_recovery;
+	uint32_t ts_recovery;
+	size_t size;
+	size_t capacity;
+	uint8_t *payload;
+};
+
+struct rist_fec_matrix {
+	bool seen[RIST_FEC_MAX_MATRIX];
+	struct rist_fec_parity rows[RIST_FEC_MAX_ROWS];
+	struct rist_fec_parity columns[RIST_FEC_MAX_COLUMNS];
+};
+
+/* A finished parity packet, data holds the RTP header, the FEC header and the payload */
+struct rist_fec_packet {
+	uint16_t last_seq; /* highest seq it covers, it goes out once that one did */
+	uint16_t src_port;
+	uint16_t dst_port;
+	size_t len;
+	uint8_t *data;
+};
+
+/* Sender side, fed and drained by the protocol thread as it sends the queued data, config is
+ * the only field other threads touch. Two matrices are open at a time so packets queued
+ * with their own seq slightly out of order do not cut a matrix short */
+struct rist_fec_encoder {
+	/* Requested matrix, generation << 16 | columns << 8 | rows, applied by the protocol thread */
+	atomic_uint config;
+	unsigned int applied;
+	uint8_t columns;
+	uint8_t rows;
+	bool started;
+	uint16_t base; /* first seq of the older open matrix */
+	int current; /* index of the older open matrix */
+	struct rist_fec_matrix matrix[2];
+	uint16_t seq;
+	struct rist_fec_packet queue[RIST_FEC_QUEUE_SIZE];
+	size_t queue_head;
+	size_t queue_count;
+};
+
+struct rist_fec_pending {
+	struct rist_fec_header hdr;
+	uint64_t order;
+	size_t size;
+	uint8_t *payload;
+};
+
+/* Receiver side, one per flow, only touched by the thread owning the flow */
+struct rist_fec_decoder {
+	struct rist_fec_pending pending[RIST_FEC_PENDING];
+	size_t count;
+	uint64_t order;
+};
+
+/* dst ^= src over len bytes */
+RIST_PRIV void rist_fec_xor(uint8_t *dst, const uint8_t *src, size_t len);
+RIST_PRIV void rist_fec_header_write(uint8_t *buf, const struct rist_fec_header *hdr);
+RIST_PRIV int rist_fec_header_read(const uint8_t *buf, size_t len, struct rist_fec_header *hdr);
+/* The MPEG-TS RTP timestamp a source_time was converted from */
+RIST_PRIV uint32_t rist_fec_rtp_ts(uint64_t source_time);
+
+RIST_PRIV int rist_fec_encoder_init(struct rist_fec_encoder *enc);
+RIST_PRIV void rist_fec_encoder_destroy(struct rist_fec_encoder *enc);
+/* 0 columns and rows turns FEC off, anything else starts over with a new matrix. Safe from
+ * any thread, the protocol thread picks it up on its next add or pop */
+RIST_PRIV void rist_fec_encoder_configure(struct rist_fec_encoder *enc, uint8_t columns, uint8_t rows);
+/* Adds the payload of a packet being sent, queues the parity of the rows and columns it completes */
+RIST_PRIV void rist_fec_encoder_add(struct rist_fec_encoder *enc, uint16_t seq, uint32_t rtp_ts, const uint8_t *data, size_t len, uint16_t src_port, uint16_t dst_port);
+/* Hands out the next parity packet once the data it covers up to sent_seq went out, the
+ * caller frees pkt->data */
+RIST_PRIV bool rist_fec_encoder_pop(struct rist_fec_encoder *enc, uint16_t sent_seq, struct rist_fec_packet *pkt);
+
+static inline bool rist_fec_encoder_active(struct rist_fec_encoder *enc)
+{
+	return (atomic_load_explicit(&enc->config, memory_order_relaxed) & 0xffff) != 0;
+}
+
+/* Stores a parity packet, returns NULL for one that is already held */
+RIST_PRIV struct rist_fec_pending *rist_fec_decoder_add(struct rist_fec_decoder *dec, const struct rist_fec_header *hdr, const uint8_t *payload, size_t size);
+RIST_PRIV void rist_fec_decoder_remove(struct rist_fec_decoder *dec, size_t i);
+RIST_PRIV void rist_fec_decoder_free(struct rist_fec_decoder *dec);
+
+#endif
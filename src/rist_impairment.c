@@ -0,0 +1,308 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "rist_impairment.h"
+#include "rist-private.h"
+#include "proto/rist_time.h"
+#include "socket-shim.h"
+#include <string.h>
+
+#define RIST_IMPAIRMENT_PPM (1000000)
+
+static uint64_t impairment_splitmix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+/* xorshift64*, the state is never 0 */
+static inline uint64_t impairment_random(struct rist_impairment_peer *s)
+{
+	uint_fast64_t prng = atomic_load_explicit(&s->prng, memory_order_relaxed);
+	uint64_t x;
+	do {
+		x = prng;
+		x ^= x >> 12;
+		x ^= x << 25;
+		x ^= x >> 27;
+	} while (!atomic_compare_exchange_weak_explicit(&s->prng, &prng, x, memory_order_relaxed, memory_order_relaxed));
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline bool impairment_chance(struct rist_impairment_peer *s, uint32_t ppm)
+{
+	if (ppm == 0)
+		return false;
+	return (((impairment_random(s) >> 32) * RIST_IMPAIRMENT_PPM) >> 32) < ppm;
+}
+
+static void impairment_peer_seed(const struct rist_impairment_params *params, struct rist_impairment_peer *s, struct rist_peer *p)
+{
+	uint64_t prng = impairment_splitmix64(params->config.seed ^ ((uint64_t)p->adv_peer_id << 32));
+	if (prng == 0)
+		prng = 0x9E3779B97F4A7C15ULL;
+	atomic_store_explicit(&s->prng, prng, memory_order_relaxed);
+	atomic_store_explicit(&s->bad, false, memory_order_relaxed);
+	atomic_store_explicit(&s->rate_next, 0, memory_order_relaxed);
+	atomic_store_explicit(&s->generation, params->generation, memory_order_release);
+}
+
+static bool impairment_lost(const struct rist_impairment_params *params, struct rist_impairment_peer *s)
+{
+	const struct rist_impairment_config *config = &params->config;
+	switch (config->loss_model) {
+	case RIST_IMPAIRMENT_LOSS_BERNOULLI:
+		return impairment_chance(s, config->loss);
+	case RIST_IMPAIRMENT_LOSS_GILBERT_ELLIOTT: {
+		bool bad = atomic_load_explicit(&s->bad, memory_order_relaxed);
+		if (bad ? impairment_chance(s, config->bad_to_good) : impairment_chance(s, config->good_to_bad)) {
+			bad = !bad;
+			atomic_store_explicit(&s->bad, bad, memory_order_relaxed);
+		}
+		return impairment_chance(s, bad ? config->loss_bad : config->loss);
+	}
+	default:
+		return false;
+	}
+}
+
+/* Moves the peer's rate cap past this datagram, returns when it may leave */
+static uint64_t impairment_rate_cap(const struct rist_impairment_params *params, struct rist_impairment_peer *s, uint64_t departure, size_t len)
+{
+	uint64_t cost = ((uint64_t)len * params->byte_cost) >> 16;
+	uint_fast64_t rate_next = atomic_load_explicit(&s->rate_next, memory_order_relaxed);
+	uint64_t leave;
+	do {
+		leave = departure < rate_next ? rate_next : departure;
+	} while (!atomic_compare_exchange_weak_explicit(&s->rate_next, &rate_next, leave + cost, memory_order_relaxed, memory_order_relaxed));
+	return leave;
+}
+
+static inline bool impairment_before(const struct rist_impairment_packet *a, const struct rist_impairment_packet *b)
+{
+	return a->departure < b->departure || (a->departure == b->departure && a->order < b->order);
+}
+
+static void impairment_sift_up(struct rist_impairment *imp, size_t i)
+{
+	struct rist_impairment_packet pkt = imp->queue[i];
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (!impairment_before(&pkt, &imp->queue[parent]))
+			break;
+		imp->queue[i] = imp->queue[parent];
+		i = parent;
+	}
+	imp->queue[i] = pkt;
+}
+
+static void impairment_sift_down(struct rist_impairment *imp, size_t i)
+{
+	struct rist_impairment_packet pkt = imp->queue[i];
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= imp->count)
+			break;
+		if (child + 1 < imp->count && impairment_before(&imp->queue[child + 1], &imp->queue[child]))
+			child++;
+		if (!impairment_before(&imp->queue[child], &pkt))
+			break;
+		imp->queue[i] = imp->queue[child];
+		i = child;
+	}
+	imp->queue[i] = pkt;
+}
+
+static void impairment_pop(struct rist_impairment *imp)
+{
+	free(imp->queue[0].data);
+	if (--imp->count == 0)
+		return;
+	imp->queue[0] = imp->queue[imp->count];
+	impairment_sift_down(imp, 0);
+}
+
+static bool impairment_hold(struct rist_impairment *imp, const struct rist_impairment_params *params, struct rist_peer *p, uint64_t departure, const uint8_t *hdr, size_t hdr_len, const uint8_t *data, size_t data_len)
+{
+	bool held = false;
+	pthread_mutex_lock(&imp->lock);
+	// Reconfigured since the caller looked, the new configuration already cleared the heap
+	if (atomic_load_explicit(&imp->params, memory_order_relaxed) != (uintptr_t)params)
+		goto out;
+	if (imp->count >= params->queue_limit)
+		goto out;
+	if (imp->count == imp->size) {
+		size_t size = imp->size ? imp->size * 2 : 64;
+		struct rist_impairment_packet *queue = realloc(imp->queue, size * sizeof(*queue));
+		if (!queue)
+			goto out;
+		imp->queue = queue;
+		imp->size = size;
+	}
+	uint8_t *copy = malloc(hdr_len + data_len);
+	if (!copy)
+		goto out;
+	if (hdr_len)
+		memcpy(copy, hdr, hdr_len);
+	memcpy(copy + hdr_len, data, data_len);
+
+	struct rist_impairment_packet *pkt = &imp->queue[imp->count];
+	pkt->departure = departure;
+	pkt->order = imp->order++;
+	pkt->peer = p;
+	pkt->len = hdr_len + data_len;
+	pkt->data = copy;
+	impairment_sift_up(imp, imp->count++);
+	held = true;
+out:
+	pthread_mutex_unlock(&imp->lock);
+	return held;
+}
+
+static void impairment_clear(struct rist_impairment *imp)
+{
+	for (size_t i = 0; i < imp->count; i++)
+		free(imp->queue[i].data);
+	imp->count = 0;
+}
+
+int rist_impairment_init(struct rist_impairment *imp)
+{
+	memset(imp, 0, sizeof(*imp));
+	atomic_init(&imp->params, 0);
+	return pthread_mutex_init(&imp->lock, NULL) != 0 ? -1 : 0;
+}
+
+void rist_impairment_destroy(struct rist_impairment *imp)
+{
+	atomic_store_explicit(&imp->params, 0, memory_order_relaxed);
+	impairment_clear(imp);
+	free(imp->queue);
+	imp->queue = NULL;
+	imp->size = 0;
+	while (imp->published) {
+		struct rist_impairment_params *older = imp->published->older;
+		free(imp->published);
+		imp->published = older;
+	}
+	pthread_mutex_destroy(&imp->lock);
+}
+
+int rist_impairment_configure(struct rist_impairment *imp, const struct rist_impairment_config *config)
+{
+	int ret = 0;
+	pthread_mutex_lock(&imp->lock);
+	atomic_store_explicit(&imp->params, 0, memory_order_relaxed);
+	impairment_clear(imp);
+	if (config && (config->loss_model != RIST_IMPAIRMENT_LOSS_NONE || config->duplicate || config->reorder
+			|| config->delay || config->jitter || config->rate)) {
+		struct rist_impairment_params *params = calloc(1, sizeof(*params));
+		if (!params) {
+			ret = -1;
+			goto out;
+		}
+		params->config = *config;
+		params->generation = ++imp->generation;
+		params->delay = (uint64_t)config->delay * RIST_CLOCK;
+		params->jitter = (uint64_t)config->jitter * RIST_CLOCK;
+		params->reorder_delay = (uint64_t)config->reorder_delay * RIST_CLOCK;
+		params->byte_cost = config->rate ? (((uint64_t)RIST_CLOCK * 1000) << 16) / ((uint64_t)config->rate * 125) : 0;
+		params->queue_limit = config->queue_limit ? config->queue_limit : RIST_IMPAIRMENT_QUEUE_LIMIT;
+		params->older = imp->published;
+		imp->published = params;
+		atomic_store_explicit(&imp->params, (uintptr_t)params, memory_order_release);
+	}
+out:
+	pthread_mutex_unlock(&imp->lock);
+	return ret;
+}
+
+bool rist_impairment_filter(struct rist_impairment *imp, struct rist_peer *p, const uint8_t *hdr, size_t hdr_len, const uint8_t *data, size_t data_len)
+{
+	const struct rist_impairment_params *params = (const struct rist_impairment_params *)atomic_load_explicit(&imp->params, memory_order_acquire);
+	if (!params)
+		return false;
+	size_t len = hdr_len + data_len;
+	uint64_t now = timestampNTP_u64();
+	bool held = false;
+
+	struct rist_impairment_peer *s = &p->impairment;
+	if (atomic_load_explicit(&s->generation, memory_order_acquire) != params->generation)
+		impairment_peer_seed(params, s, p);
+
+	if (impairment_lost(params, s))
+		return true;
+
+	int copies = impairment_chance(s, params->config.duplicate) ? 2 : 1;
+	for (int i = 0; i < copies; i++) {
+		uint64_t delay = params->delay;
+		if (params->jitter) {
+			uint64_t offset = impairment_random(s) % (2 * params->jitter + 1);
+			delay = delay + offset > params->jitter ? delay + offset - params->jitter : 0;
+		}
+		if (impairment_chance(s, params->config.reorder))
+			delay += params->reorder_delay;
+		uint64_t departure = now + delay;
+		if (params->byte_cost)
+			departure = impairment_rate_cap(params, s, departure, len);
+		// The original leaves right away when nothing holds it back, a duplicate always queues
+		if (i == 0 && departure <= now)
+			continue;
+		// A full queue drops the datagram like a full router buffer, the original of one that
+		// raced a reconfiguration is sent as is
+		if (!impairment_hold(imp, params, p, departure, hdr, hdr_len, data, data_len) && i == 0
+				&& atomic_load_explicit(&imp->params, memory_order_relaxed) != (uintptr_t)params)
+			continue;
+		if (i == 0)
+			held = true;
+	}
+	return held;
+}
+
+void rist_impairment_flush(struct rist_impairment *imp, uint64_t now)
+{
+	pthread_mutex_lock(&imp->lock);
+	while (imp->count > 0 && imp->queue[0].departure <= now) {
+		struct rist_impairment_packet *pkt = &imp->queue[0];
+		struct rist_peer *p = pkt->peer;
+		if (p->sd >= 0 && p->address_len)
+			sendto(p->sd, (const char *)pkt->data, pkt->len, 0, &p->u.address, p->address_len);
+		impairment_pop(imp);
+	}
+	pthread_mutex_unlock(&imp->lock);
+}
+
+int rist_impairment_wait_ms(struct rist_impairment *imp, uint64_t now, int max_ms)
+{
+	pthread_mutex_lock(&imp->lock);
+	uint64_t next = imp->count > 0 ? imp->queue[0].departure : UINT64_MAX;
+	pthread_mutex_unlock(&imp->lock);
+	if (next == UINT64_MAX)
+		return max_ms;
+	if (next <= now)
+		return 0;
+	uint64_t wait_ms = (next - now + RIST_CLOCK - 1) / RIST_CLOCK;
+	return wait_ms < (uint64_t)max_ms ? (int)wait_ms : max_ms;
+}
+
+void rist_impairment_forget_peer(struct rist_impairment *imp, struct rist_peer *p)
+{
+	pthread_mutex_lock(&imp->lock);
+	size_t kept = 0;
+	for (size_t i = 0; i < imp->count; i++) {
+		if (imp->queue[i].peer == p)
+			free(imp->queue[i].data);
+		else
+			imp->queue[kept++] = imp->queue[i];
+	}
+	if (kept != imp->count) {
+		imp->count = kept;
+		for (size_t i = kept / 2; i-- > 0;)
+			impairment_sift_down(imp, i);
+	}
+	pthread_mutex_unlock(&imp->lock);
+}
@@ -0,0 +1,85 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef RIST_IMPAIRMENT_H
+#define RIST_IMPAIRMENT_H
+
+#include "common/attributes.h"
+#include "librist/headers.h"
+#include "pthread-shim.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Datagrams held back by delay, reordering or the rate cap before more get dropped */
+#define RIST_IMPAIRMENT_QUEUE_LIMIT (10000)
+
+struct rist_peer;
+
+struct rist_impairment_packet {
+	uint64_t departure;
+	uint64_t order; /* keeps datagrams with the same departure in sending order */
+	struct rist_peer *peer;
+	size_t len;
+	uint8_t *data;
+};
+
+/* Per peer state, seeded the first time the peer sends under a configuration. Atomics so the
+ * thread sending for the peer never locks, a datagram racing a reseed may use the old state */
+struct rist_impairment_peer {
+	atomic_uint generation;
+	atomic_uint_fast64_t prng;
+	atomic_bool bad; /* Gilbert-Elliott state */
+	atomic_uint_fast64_t rate_next; /* NTP time the rate cap lets the next datagram leave */
+};
+
+/* Immutable once published, replaced ones are kept until destroy as senders may still read them */
+struct rist_impairment_params {
+	struct rist_impairment_config config;
+	uint32_t generation;
+	/* NTP ticks */
+	uint64_t delay;
+	uint64_t jitter;
+	uint64_t reorder_delay;
+	uint64_t byte_cost; /* NTP ticks per byte in 16.16 fixed point, 0 without a rate cap */
+	size_t queue_limit;
+	struct rist_impairment_params *older;
+};
+
+/* Sits between building a datagram and the socket, the held back datagrams are kept in a
+ * min-heap on their departure and sent by the protocol loop. params is NULL while off, lock
+ * only guards the heap so datagrams that are just dropped or sent never take it */
+struct rist_impairment {
+	atomic_uintptr_t params;
+	pthread_mutex_t lock;
+	uint32_t generation;
+	struct rist_impairment_params *published; /* newest first, linked through older */
+	struct rist_impairment_packet *queue;
+	size_t count;
+	size_t size;
+	uint64_t order;
+};
+
+RIST_PRIV int rist_impairment_init(struct rist_impairment *imp);
+RIST_PRIV void rist_impairment_destroy(struct rist_impairment *imp);
+/* NULL turns the impairment off and drops whatever is held back */
+RIST_PRIV int rist_impairment_configure(struct rist_impairment *imp, const struct rist_impairment_config *config);
+/* Runs a datagram about to be sent by p through loss, duplication, delay and the rate cap.
+ * Returns true when it was dropped or held back and must not be sent by the caller */
+RIST_PRIV bool rist_impairment_filter(struct rist_impairment *imp, struct rist_peer *p, const uint8_t *hdr, size_t hdr_len, const uint8_t *data, size_t data_len);
+/* Sends the held back datagrams that are due */
+RIST_PRIV void rist_impairment_flush(struct rist_impairment *imp, uint64_t now);
+/* Milliseconds until the next held back datagram is due, at most max_ms */
+RIST_PRIV int rist_impairment_wait_ms(struct rist_impairment *imp, uint64_t now, int max_ms);
+/* Drops the datagrams held back for a peer that is going away */
+RIST_PRIV void rist_impairment_forget_peer(struct rist_impairment *imp, struct rist_peer *p);
+
+static inline bool rist_impairment_active(struct rist_impairment *imp)
+{
+	return atomic_load_explicit(&imp->params, memory_order_relaxed) != 0;
+}
+
+#endif
@@ -0,0 +1,18 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "rist_pacer.h"
+
+void rist_pacer_set_rate(struct rist_pacer *pacer, uint64_t rate, uint64_t burst)
+{
+	pacer->burst = burst;
+	if (rate && rate < RIST_PACER_MIN_RATE)
+		rate = RIST_PACER_MIN_RATE;
+	if (rate == pacer->rate)
+		return;
+	pacer->rate = rate;
+	// 2^32 ticks per second, with 16 fractional bits
+	pacer->byte_cost = rate ? ((uint64_t)1 << 48) / rate : 0;
+}
@@ -0,0 +1,43 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef RIST_PACER_H
+#define RIST_PACER_H
+
+#include "common/attributes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lowest rate the pacer runs at, keeps the per byte cost in range (100 kbps) */
+#define RIST_PACER_MIN_RATE (12500)
+
+/* Token bucket kept as a virtual clock: every datagram departs len / rate after the previous
+ * one, and up to burst of idle time is credited so a quiet period can be made up at line rate.
+ * Times are NTP timestamps (timestampNTP_u64), not thread safe */
+struct rist_pacer {
+	uint64_t rate; /* bytes per second, 0 leaves the traffic unpaced */
+	uint64_t byte_cost; /* NTP ticks per byte in 16.16 fixed point */
+	uint64_t burst;
+	uint64_t next; /* departure of the next datagram */
+};
+
+RIST_PRIV void rist_pacer_set_rate(struct rist_pacer *pacer, uint64_t rate, uint64_t burst);
+
+/* Departure time of the next datagram, before now when it may leave straight away */
+static inline uint64_t rist_pacer_departure(const struct rist_pacer *pacer, uint64_t now)
+{
+	if (!pacer->rate || pacer->next + pacer->burst <= now)
+		return now - pacer->burst;
+	return pacer->next;
+}
+
+/* Accounts len bytes that left at departure (from rist_pacer_departure) */
+static inline void rist_pacer_sent(struct rist_pacer *pacer, uint64_t departure, size_t len)
+{
+	if (pacer->rate)
+		pacer->next = departure + (((uint64_t)len * pacer->byte_cost) >> 16);
+}
+
+#endif
@@ -15,6 +15,7 @@ struct rist_ref *rist_ref_create(void *data)
 	if (!ref)
 		return NULL;
 	ref->ptr = data;
+	ref->pooled = false;
 	atomic_init(&ref->refcnt, 1);
 	return ref;
 }
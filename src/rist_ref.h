@@ -5,6 +5,9 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#ifndef RIST_REF_H
+#define RIST_REF_H
+
 #include "common/attributes.h"
 #include <stdint.h>
 #include <stdatomic.h>
@@ -13,8 +16,11 @@
 struct rist_ref {
 	atomic_int refcnt;
 	const void *ptr;
+	bool pooled;
 };
 
 RIST_PRIV bool rist_ref_iswritable(struct rist_ref *ref);
 RIST_PRIV struct rist_ref *rist_ref_create(void *data);
 RIST_PRIV void rist_ref_inc(struct rist_ref *ref);
+
+#endif
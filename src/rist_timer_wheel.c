@@ -0,0 +1,180 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "rist_timer_wheel.h"
+#include "proto/rist_time.h"
+#include <string.h>
+
+#define RIST_TIMER_WHEEL_MASK ((uint64_t)RIST_TIMER_WHEEL_SLOTS - 1)
+#define RIST_TIMER_WHEEL_SPAN ((uint64_t)1 << (RIST_TIMER_WHEEL_BITS * RIST_TIMER_WHEEL_LEVELS))
+/* level of a timer sitting on the list of the tick being run */
+#define RIST_TIMER_LEVEL_PENDING RIST_TIMER_WHEEL_LEVELS
+
+static inline uint64_t timer_deadline_tick(uint64_t expires)
+{
+	return (expires + RIST_CLOCK - 1) / RIST_CLOCK;
+}
+
+static void timer_unlink(struct rist_timer *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	if (timer->level < RIST_TIMER_LEVEL_PENDING)
+		timer->wheel->count[timer->level]--;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+/* Level and slot follow from how far the deadline is, slots are indexed by the absolute tick
+ * so a higher level slot gets cascaded down when the lower levels wrap around to it */
+static void timer_link(struct rist_timer_wheel *wheel, struct rist_timer *timer)
+{
+	uint64_t tick = timer_deadline_tick(timer->expires);
+	if (tick < wheel->tick)
+		tick = wheel->tick;
+	if (tick - wheel->tick >= RIST_TIMER_WHEEL_SPAN)
+		tick = wheel->tick + RIST_TIMER_WHEEL_SPAN - 1;
+	uint64_t delta = tick - wheel->tick;
+	uint8_t level = 0;
+	while (level < RIST_TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (RIST_TIMER_WHEEL_BITS * (level + 1))))
+		level++;
+
+	struct rist_timer **head = &wheel->slots[level][(tick >> (RIST_TIMER_WHEEL_BITS * level)) & RIST_TIMER_WHEEL_MASK];
+	timer->next = *head;
+	if (*head)
+		(*head)->pprev = &timer->next;
+	*head = timer;
+	timer->pprev = head;
+	timer->wheel = wheel;
+	timer->expires_tick = tick;
+	timer->level = level;
+	wheel->count[level]++;
+}
+
+static void timer_cascade(struct rist_timer_wheel *wheel, int level, size_t idx)
+{
+	struct rist_timer *timer = wheel->slots[level][idx];
+	wheel->slots[level][idx] = NULL;
+	while (timer) {
+		struct rist_timer *next = timer->next;
+		wheel->count[level]--;
+		timer_link(wheel, timer);
+		timer = next;
+	}
+}
+
+void rist_timer_wheel_init(struct rist_timer_wheel *wheel, uint64_t now)
+{
+	memset(wheel, 0, sizeof(*wheel));
+	wheel->tick = now / RIST_CLOCK;
+}
+
+void rist_timer_init(struct rist_timer *timer, rist_timer_cb cb, void *arg)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->cb = cb;
+	timer->arg = arg;
+}
+
+void rist_timer_arm(struct rist_timer_wheel *wheel, struct rist_timer *timer, uint64_t expires)
+{
+	if (timer->pprev)
+		timer_unlink(timer);
+	timer->expires = expires;
+	timer_link(wheel, timer);
+}
+
+void rist_timer_arm_before(struct rist_timer_wheel *wheel, struct rist_timer *timer, uint64_t expires)
+{
+	if (timer->pprev && timer->wheel == wheel && timer->expires <= expires)
+		return;
+	rist_timer_arm(wheel, timer, expires);
+}
+
+void rist_timer_cancel(struct rist_timer *timer)
+{
+	if (timer->pprev)
+		timer_unlink(timer);
+}
+
+void rist_timer_wheel_run(struct rist_timer_wheel *wheel, uint64_t now)
+{
+	uint64_t now_tick = now / RIST_CLOCK;
+	while (wheel->tick <= now_tick) {
+		uint64_t tick = wheel->tick;
+		size_t idx = (size_t)(tick & RIST_TIMER_WHEEL_MASK);
+		if (idx != 0 && wheel->count[0] == 0) {
+			// Nothing on level 0, skip ahead to the next cascade
+			uint64_t boundary = (tick | RIST_TIMER_WHEEL_MASK) + 1;
+			wheel->tick = boundary <= now_tick ? boundary : now_tick + 1;
+			continue;
+		}
+		if (idx == 0) {
+			for (int level = 1; level < RIST_TIMER_WHEEL_LEVELS; level++) {
+				size_t level_idx = (size_t)((tick >> (RIST_TIMER_WHEEL_BITS * level)) & RIST_TIMER_WHEEL_MASK);
+				timer_cascade(wheel, level, level_idx);
+				if (level_idx != 0)
+					break;
+			}
+		}
+
+		// Move the slot to a local list first, callbacks may cancel or arm any timer
+		struct rist_timer *pending = wheel->slots[0][idx];
+		wheel->slots[0][idx] = NULL;
+		if (pending)
+			pending->pprev = &pending;
+		for (struct rist_timer *t = pending; t; t = t->next) {
+			wheel->count[0]--;
+			t->level = RIST_TIMER_LEVEL_PENDING;
+		}
+		wheel->tick = tick + 1;
+
+		while (pending) {
+			struct rist_timer *timer = pending;
+			timer_unlink(timer);
+			if (timer_deadline_tick(timer->expires) > tick) {
+				// Deadline was beyond the wheel span, it goes around again
+				timer_link(wheel, timer);
+				continue;
+			}
+			timer->cb(timer, timer->arg, now);
+		}
+	}
+}
+
+uint64_t rist_timer_wheel_next(const struct rist_timer_wheel *wheel)
+{
+	uint64_t next = UINT64_MAX;
+	if (wheel->count[0] > 0) {
+		for (uint64_t i = 0; i < RIST_TIMER_WHEEL_SLOTS; i++) {
+			if (wheel->slots[0][(wheel->tick + i) & RIST_TIMER_WHEEL_MASK]) {
+				next = wheel->tick + i;
+				break;
+			}
+		}
+	}
+	for (int level = 1; level < RIST_TIMER_WHEEL_LEVELS; level++) {
+		if (wheel->count[level] > 0) {
+			// Upper levels are only looked at when level 0 wraps
+			uint64_t cascade = (wheel->tick + RIST_TIMER_WHEEL_MASK) & ~RIST_TIMER_WHEEL_MASK;
+			if (cascade < next)
+				next = cascade;
+			break;
+		}
+	}
+	return next == UINT64_MAX ? UINT64_MAX : next * RIST_CLOCK;
+}
+
+int rist_timer_wheel_wait_ms(const struct rist_timer_wheel *wheel, uint64_t now, int max_ms)
+{
+	uint64_t next = rist_timer_wheel_next(wheel);
+	if (next == UINT64_MAX)
+		return max_ms;
+	if (next <= now)
+		return 0;
+	uint64_t wait_ms = (next - now + RIST_CLOCK - 1) / RIST_CLOCK;
+	return wait_ms < (uint64_t)max_ms ? (int)wait_ms : max_ms;
+}
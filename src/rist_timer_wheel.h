@@ -0,0 +1,63 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef RIST_TIMER_WHEEL_H
+#define RIST_TIMER_WHEEL_H
+
+#include "common/attributes.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Hierarchical timer wheel with a 1 ms tick: 4 levels of 64 slots cover ~4.6 hours,
+ * later deadlines are clamped to the end of the last level */
+#define RIST_TIMER_WHEEL_BITS (6)
+#define RIST_TIMER_WHEEL_SLOTS (1 << RIST_TIMER_WHEEL_BITS)
+#define RIST_TIMER_WHEEL_LEVELS (4)
+
+struct rist_timer;
+typedef void (*rist_timer_cb)(struct rist_timer *timer, void *arg, uint64_t now);
+
+/* Embedded in its owner, a timer is armed while it is linked into a slot (pprev set).
+ * The callback runs unarmed, so it may re-arm the timer or free its owner */
+struct rist_timer {
+	struct rist_timer *next;
+	struct rist_timer **pprev;
+	struct rist_timer_wheel *wheel;
+	uint64_t expires;
+	uint64_t expires_tick;
+	uint8_t level;
+	rist_timer_cb cb;
+	void *arg;
+};
+
+/* Not thread safe, each wheel is run by one thread and guarded by the lock it
+ * already holds around the state the timers touch */
+struct rist_timer_wheel {
+	uint64_t tick; /* next tick to run, all earlier ones have fired */
+	size_t count[RIST_TIMER_WHEEL_LEVELS];
+	struct rist_timer *slots[RIST_TIMER_WHEEL_LEVELS][RIST_TIMER_WHEEL_SLOTS];
+};
+
+RIST_PRIV void rist_timer_wheel_init(struct rist_timer_wheel *wheel, uint64_t now);
+RIST_PRIV void rist_timer_init(struct rist_timer *timer, rist_timer_cb cb, void *arg);
+/* Deadlines are NTP timestamps (timestampNTP_u64), a timer never fires before its deadline */
+RIST_PRIV void rist_timer_arm(struct rist_timer_wheel *wheel, struct rist_timer *timer, uint64_t expires);
+/* Like rist_timer_arm, but leaves an armed timer alone unless the new deadline is earlier */
+RIST_PRIV void rist_timer_arm_before(struct rist_timer_wheel *wheel, struct rist_timer *timer, uint64_t expires);
+RIST_PRIV void rist_timer_cancel(struct rist_timer *timer);
+/* Fires every timer due at now, timers armed from a callback for now or earlier fire on the next run */
+RIST_PRIV void rist_timer_wheel_run(struct rist_timer_wheel *wheel, uint64_t now);
+/* Earliest time the next run can have work, UINT64_MAX when nothing is armed */
+RIST_PRIV uint64_t rist_timer_wheel_next(const struct rist_timer_wheel *wheel);
+/* Milliseconds to sleep from now until the next run, at most max_ms */
+RIST_PRIV int rist_timer_wheel_wait_ms(const struct rist_timer_wheel *wheel, uint64_t now, int max_ms);
+
+static inline bool rist_timer_armed(const struct rist_timer *timer)
+{
+	return timer->pprev != NULL;
+}
+
+#endif
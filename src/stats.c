@@ -20,6 +20,127 @@ static double round_two_digits(double number)
 	return (double)(new_number) / 100;
 }
 
+/* Builds the json of a report from its stats structs, peers is the per peer array of a
+ * receiver flow when there is one */
+static cJSON *rist_stats_json_tree(const struct rist_stats *stats_container, cJSON *peers)
+{
+	cJSON *stats = cJSON_CreateObject();
+	if (stats_container->stats_type == RIST_STATS_SENDER_PEER)
+	{
+		const struct rist_stats_sender_peer *s = &stats_container->stats.sender_peer;
+		cJSON *rist_sender_stats = cJSON_AddObjectToObject(stats, "sender-stats");
+		cJSON *peer_obj = cJSON_AddObjectToObject(rist_sender_stats, "peer");
+		cJSON_AddNumberToObject(peer_obj, "flow_id", s->flow_id);
+		cJSON_AddNumberToObject(peer_obj, "id", s->peer_id);
+		cJSON_AddStringToObject(peer_obj, "cname", s->cname);
+		cJSON_AddStringToObject(peer_obj, "type", s->is_data ? "data" : "rtcp");
+		cJSON *json_stats = cJSON_AddObjectToObject(peer_obj, "stats");
+		cJSON_AddNumberToObject(json_stats, "quality", s->quality);
+		cJSON_AddNumberToObject(json_stats, "sent", (double)s->sent);
+		cJSON_AddNumberToObject(json_stats, "received", (double)s->received);
+		cJSON_AddNumberToObject(json_stats, "retransmitted", (double)s->retransmitted);
+		cJSON_AddNumberToObject(json_stats, "bandwidth", (double)s->bandwidth);
+		cJSON_AddNumberToObject(json_stats, "retry_bandwidth", (double)s->retry_bandwidth);
+		cJSON_AddNumberToObject(json_stats, "bandwidth_skipped", (double)s->bandwidth_skipped);
+		cJSON_AddNumberToObject(json_stats, "bloat_skipped", (double)s->bloat_skipped);
+		cJSON_AddNumberToObject(json_stats, "retransmit_skipped", (double)s->retransmit_skipped);
+		cJSON_AddNumberToObject(json_stats, "duplicate_skipped", (double)s->duplicate_skipped);
+		cJSON_AddNumberToObject(json_stats, "rtt", s->last_rtt);
+		cJSON_AddNumberToObject(json_stats, "avg_rtt", s->avg_rtt);
+		cJSON_AddNumberToObject(json_stats, "retry_buffer_size", (double)s->retry_buffer_size);
+		cJSON_AddNumberToObject(json_stats, "cooldown_time", (double)s->cooldown_time);
+		cJSON_AddNumberToObject(json_stats, "queue_slots", (double)s->queue_slots);
+		cJSON_AddNumberToObject(json_stats, "queue_memory", (double)s->queue_memory);
+		cJSON_AddNumberToObject(json_stats, "buffer_pool_hits", (double)s->buffer_pool_hits);
+		cJSON_AddNumberToObject(json_stats, "buffer_pool_misses", (double)s->buffer_pool_misses);
+	}
+	else
+	{
+		const struct rist_stats_receiver_flow *s = &stats_container->stats.receiver_flow;
+		cJSON *stats_obj = cJSON_AddObjectToObject(stats, "receiver-stats");
+		cJSON *flow_obj = cJSON_AddObjectToObject(stats_obj, "flowinstant");
+		cJSON_AddNumberToObject(flow_obj, "flow_id", s->flow_id);
+		cJSON_AddNumberToObject(flow_obj, "dead", s->status);
+		cJSON *json_stats = cJSON_AddObjectToObject(flow_obj, "stats");
+		if (peers)
+			cJSON_AddItemToObject(flow_obj, "peers", peers);
+		cJSON_AddNumberToObject(json_stats, "quality", s->quality);
+		cJSON_AddNumberToObject(json_stats, "received", (double)s->received);
+		cJSON_AddNumberToObject(json_stats, "dropped_late", (double)s->dropped_late);
+		cJSON_AddNumberToObject(json_stats, "dropped_full", (double)s->dropped_full);
+		cJSON_AddNumberToObject(json_stats, "missing", (double)s->missing);
+		cJSON_AddNumberToObject(json_stats, "recovered_total", (double)s->recovered);
+		cJSON_AddNumberToObject(json_stats, "reordered", (double)s->reordered);
+		cJSON_AddNumberToObject(json_stats, "retries", (double)s->retries);
+		cJSON_AddNumberToObject(json_stats, "recovered_one_nack", (double)s->recovered_one_retry);
+		cJSON_AddNumberToObject(json_stats, "recovered_two_nacks", (double)s->recovered_two_retries);
+		cJSON_AddNumberToObject(json_stats, "recovered_three_nacks", (double)s->recovered_three_retries);
+		cJSON_AddNumberToObject(json_stats, "recovered_four_nacks", (double)s->recovered_four_retries);
+		cJSON_AddNumberToObject(json_stats, "recovered_more_nacks", (double)s->recovered_more_retries);
+		cJSON_AddNumberToObject(json_stats, "recovered_fec", (double)s->fec_recovered);
+		cJSON_AddNumberToObject(json_stats, "lost", (double)s->lost);
+		cJSON_AddNumberToObject(json_stats, "avg_buffer_time", (double)s->avg_buffer_time);
+		cJSON_AddNumberToObject(json_stats, "duplicates", (double)s->duplicates);
+		cJSON_AddNumberToObject(json_stats, "missing_queue", (double)s->missing_queue);
+		cJSON_AddNumberToObject(json_stats, "missing_queue_max", (double)s->missing_queue_max);
+		cJSON_AddNumberToObject(json_stats, "queue_slots", (double)s->queue_slots);
+		cJSON_AddNumberToObject(json_stats, "queue_memory", (double)s->queue_memory);
+		cJSON_AddNumberToObject(json_stats, "min_inter_packet_spacing", (double)s->min_inter_packet_spacing);
+		cJSON_AddNumberToObject(json_stats, "cur_inter_packet_spacing", (double)s->cur_inter_packet_spacing);
+		cJSON_AddNumberToObject(json_stats, "max_inter_packet_spacing", (double)s->max_inter_packet_spacing);
+		cJSON_AddNumberToObject(json_stats, "bitrate", (double)s->bandwidth);
+		cJSON_AddNumberToObject(json_stats, "buffer_pool_hits", (double)s->buffer_pool_hits);
+		cJSON_AddNumberToObject(json_stats, "buffer_pool_misses", (double)s->buffer_pool_misses);
+	}
+	return stats;
+}
+
+char *rist_stats_to_json(const struct rist_stats *stats_container)
+{
+	if (!stats_container)
+		return NULL;
+	cJSON *stats = rist_stats_json_tree(stats_container, NULL);
+	char *stats_string = cJSON_PrintUnformatted(stats);
+	cJSON_Delete(stats);
+	return stats_string;
+}
+
+/* Called after stats_lock is released. Binary reports are handed out as they are, json ones
+ * in a container the callback owns */
+static void rist_stats_report(int (*stats_cb)(void *arg, const struct rist_stats *stats_container), void *arg,
+	enum rist_stats_format format, const struct rist_stats *report, cJSON *peers)
+{
+	if (stats_cb == NULL)
+	{
+		cJSON_Delete(peers);
+		return;
+	}
+	if (format == RIST_STATS_FORMAT_BINARY)
+	{
+		stats_cb(arg, report);
+		return;
+	}
+
+	struct rist_stats *stats_container = malloc(sizeof(struct rist_stats));
+	if (!stats_container)
+	{
+		cJSON_Delete(peers);
+		return;
+	}
+	*stats_container = *report;
+	stats_container->library_owned = false;
+	cJSON *stats = rist_stats_json_tree(report, peers);
+	stats_container->stats_json = cJSON_PrintUnformatted(stats);
+	cJSON_Delete(stats);
+	if (!stats_container->stats_json)
+	{
+		free(stats_container);
+		return;
+	}
+	stats_container->json_size = (uint32_t)strlen(stats_container->stats_json);
+	stats_cb(arg, stats_container);
+}
+
 void rist_sender_peer_statistics(struct rist_peer *peer)
 {
 	// TODO: print warning here?? stale flow?
@@ -27,10 +148,8 @@ void rist_sender_peer_statistics(struct rist_peer *peer)
 	{
 		return;
 	}
-	pthread_mutex_lock(&(get_cctx(peer)->stats_lock));
-	struct rist_stats *stats_container = malloc(sizeof(struct rist_stats));
-	stats_container->stats_type = RIST_STATS_SENDER_PEER;
-	stats_container->version = RIST_STATS_VERSION;
+	struct rist_common_ctx *cctx = get_cctx(peer);
+	pthread_mutex_lock(&cctx->stats_lock);
 
 	peer->stats_sender_total.received += peer->stats_sender_instant.received;
 
@@ -39,8 +158,9 @@ void rist_sender_peer_statistics(struct rist_peer *peer)
 	struct rist_bandwidth_estimation *cli_bw = &peer->bw;
 	struct rist_bandwidth_estimation *retry_bw = &peer->retry_bw;
 	// Refresh stats value just in case
-	rist_calculate_bitrate(0, cli_bw);
-	rist_calculate_bitrate(0, retry_bw);
+	uint64_t now = timestampNTP_u64();
+	rist_calculate_bitrate(0, cli_bw, now);
+	rist_calculate_bitrate(0, retry_bw, now);
 
 	double Q = 100;
 	if (peer->stats_sender_instant.sent > 0)
@@ -53,90 +173,107 @@ void rist_sender_peer_statistics(struct rist_peer *peer)
 	uint32_t time_left = 0;
 	if (peer->sender_ctx->cooldown_time > 0)
 	{
-		time_left = (uint32_t)(timestampNTP_u64() - peer->sender_ctx->cooldown_time) / 1000;
+		time_left = (uint32_t)(now - peer->sender_ctx->cooldown_time) / 1000;
 	}
 
-	size_t bitrate = cli_bw->eight_times_bitrate_fast / 8;
-	size_t retry_bitrate = retry_bw->eight_times_bitrate_fast / 8;
 	double avg_rtt = ((double)peer->eight_times_rtt / 8);
 
-	struct rist_common_ctx *cctx = get_cctx(peer);
+	struct rist_stats *report = &peer->stats_report;
+	memset(report, 0, sizeof(*report));
+	report->stats_type = RIST_STATS_SENDER_PEER;
+	report->version = RIST_STATS_VERSION;
+	report->library_owned = true;
+	struct rist_stats_sender_peer *s = &report->stats.sender_peer;
+	snprintf(s->cname, sizeof(s->cname), "%s", peer->receiver_name);
+	s->peer_id = peer->adv_peer_id;
+	s->flow_id = peer->adv_flow_id;
+	s->is_data = peer->is_data;
+	s->bandwidth = cli_bw->eight_times_bitrate_fast / 8;
+	s->retry_bandwidth = retry_bw->eight_times_bitrate_fast / 8;
+	s->sent = peer->stats_sender_instant.sent;
+	s->received = peer->stats_sender_instant.received;
+	s->retransmitted = peer->stats_sender_instant.retrans;
+	s->quality = Q;
+	s->rtt = (uint32_t)(avg_rtt / RIST_CLOCK);
+	s->last_rtt = (double)peer->last_rtt / RIST_CLOCK;
+	s->avg_rtt = avg_rtt / RIST_CLOCK;
+	s->bloat_skipped = peer->stats_sender_instant.bloat_skip;
+	s->bandwidth_skipped = peer->stats_sender_instant.bandwidth_skip;
+	s->retransmit_skipped = peer->stats_sender_instant.retrans_skip;
+	s->duplicate_skipped = peer->stats_sender_instant.duplicate_skip;
+	s->retry_buffer_size = retry_buf_size;
+	s->cooldown_time = time_left;
+	s->queue_slots = peer->sender_ctx->sender_queue_max;
+	s->queue_memory = peer->sender_ctx->sender_queue_max * sizeof(*peer->sender_ctx->sender_queue);
+	rist_buffer_pool_get_stats(cctx, &s->buffer_pool_hits, &s->buffer_pool_misses);
 
-	cJSON *stats = cJSON_CreateObject();
-	cJSON *rist_sender_stats = cJSON_AddObjectToObject(stats, "sender-stats");
-	cJSON *peer_obj = cJSON_AddObjectToObject(rist_sender_stats, "peer");
-	cJSON_AddNumberToObject(peer_obj, "flow_id", peer->adv_flow_id);
-	cJSON_AddNumberToObject(peer_obj, "id", peer->adv_peer_id);
-	cJSON_AddStringToObject(peer_obj, "cname", peer->receiver_name);
-	cJSON_AddStringToObject(peer_obj, "type", peer->is_data ? "data" : "rtcp");
-	cJSON *json_stats = cJSON_AddObjectToObject(peer_obj, "stats");
-	cJSON_AddNumberToObject(json_stats, "quality", Q);
-	cJSON_AddNumberToObject(json_stats, "sent", (double)peer->stats_sender_instant.sent);
-	cJSON_AddNumberToObject(json_stats, "received", (double)peer->stats_sender_instant.received);
-	cJSON_AddNumberToObject(json_stats, "retransmitted", (double)peer->stats_sender_instant.retrans);
-	cJSON_AddNumberToObject(json_stats, "bandwidth", (double)bitrate);
-	cJSON_AddNumberToObject(json_stats, "retry_bandwidth", (double)retry_bitrate);
-	cJSON_AddNumberToObject(json_stats, "bandwidth_skipped", (double)peer->stats_sender_instant.bandwidth_skip);
-	cJSON_AddNumberToObject(json_stats, "bloat_skipped", (double)peer->stats_sender_instant.bloat_skip);
-	cJSON_AddNumberToObject(json_stats, "retransmit_skipped", (double)peer->stats_sender_instant.retrans_skip);
-	cJSON_AddNumberToObject(json_stats, "rtt", (double)peer->last_rtt / RIST_CLOCK);
-	cJSON_AddNumberToObject(json_stats, "avg_rtt", (double)avg_rtt / RIST_CLOCK);
-	cJSON_AddNumberToObject(json_stats, "retry_buffer_size", (double)retry_buf_size);
-	cJSON_AddNumberToObject(json_stats, "cooldown_time", (double)time_left);
-	char *stats_string = cJSON_PrintUnformatted(stats);
-	cJSON_Delete(stats);
+	memset(&peer->stats_sender_instant, 0, sizeof(peer->stats_sender_instant));
 
-	stats_container->stats_json = stats_string;
-	stats_container->json_size = (uint32_t)strlen(stats_string);
-	stats_container->stats.sender_peer.cname[0] = '\0';
-	strncpy(stats_container->stats.sender_peer.cname, peer->receiver_name, RIST_MAX_STRING_SHORT);
-	stats_container->stats.sender_peer.peer_id = peer->adv_peer_id;
-	stats_container->stats.sender_peer.bandwidth = bitrate;
-	stats_container->stats.sender_peer.retry_bandwidth = retry_bitrate;
-	stats_container->stats.sender_peer.sent = peer->stats_sender_instant.sent;
-	stats_container->stats.sender_peer.received = peer->stats_sender_instant.received;
-	stats_container->stats.sender_peer.retransmitted = peer->stats_sender_instant.retrans;
-	stats_container->stats.sender_peer.quality = Q;
-	stats_container->stats.sender_peer.rtt = avg_rtt / RIST_CLOCK;
-
-	if (cctx->stats_callback != NULL)
-		cctx->stats_callback(cctx->stats_callback_argument, stats_container);
-	else
-		rist_stats_free(stats_container);
+	int (*stats_cb)(void *arg, const struct rist_stats *stats_container) = cctx->stats_callback;
+	void *stats_cb_arg = cctx->stats_callback_argument;
+	enum rist_stats_format format = cctx->stats_format;
+	pthread_mutex_unlock(&cctx->stats_lock);
 
-	memset(&peer->stats_sender_instant, 0, sizeof(peer->stats_sender_instant));
-	pthread_mutex_unlock(&(get_cctx(peer)->stats_lock));
+	rist_stats_report(stats_cb, stats_cb_arg, format, report, NULL);
 }
 
 void rist_receiver_flow_statistics(struct rist_receiver *ctx, struct rist_flow *flow)
 {
 	if (!flow)
 		return;
-	pthread_mutex_lock(&ctx->common.stats_lock);
+	// Runs on the thread owning the flow, fold in what the data output thread counted since
+	// the last report
+	unsigned long lost = atomic_load_explicit(&flow->output_stats.lost, memory_order_relaxed);
+	flow->stats_instant.lost += (uint32_t)(lost - atomic_load_explicit(&flow->output_stats.lost_reported, memory_order_relaxed));
+	atomic_store_explicit(&flow->output_stats.lost_reported, lost, memory_order_relaxed);
+	unsigned long buffer_duration_count = atomic_load_explicit(&flow->output_stats.buffer_duration_count, memory_order_relaxed);
+	unsigned long buffer_duration_sum = atomic_load_explicit(&flow->output_stats.buffer_duration_sum, memory_order_relaxed);
+	uint64_t avg_buffer_duration = 0;
+	if (buffer_duration_count != flow->output_stats.buffer_duration_count_reported)
+	{
+		avg_buffer_duration = (buffer_duration_sum - flow->output_stats.buffer_duration_sum_reported) /
+			(buffer_duration_count - flow->output_stats.buffer_duration_count_reported);
+	}
+	flow->output_stats.buffer_duration_sum_reported = buffer_duration_sum;
+	flow->output_stats.buffer_duration_count_reported = buffer_duration_count;
+
+	// The running totals only have this thread as writer, the report covers what they grew by
+	struct rist_flow_counter_values total;
+	struct rist_flow_counter_values interval;
+	rist_flow_counters_load(&flow->counters, &total);
+	interval.received = total.received - flow->counters_reported.received;
+	interval.missing = total.missing - flow->counters_reported.missing;
+	interval.recovered = total.recovered - flow->counters_reported.recovered;
+	interval.fec_recovered = total.fec_recovered - flow->counters_reported.fec_recovered;
+	interval.reordered = total.reordered - flow->counters_reported.reordered;
+	interval.retries = total.retries - flow->counters_reported.retries;
+	interval.duplicates = total.duplicates - flow->counters_reported.duplicates;
+	interval.dropped_late = total.dropped_late - flow->counters_reported.dropped_late;
+	interval.dropped_full = total.dropped_full - flow->counters_reported.dropped_full;
+	flow->counters_reported = total;
+	flow->counters_checked = total;
+
 	//Log errors that used to be packet
-	if (flow->stats_instant.dropped_full)
-		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Dropped %u packets due to buffers being full\n", flow->stats_instant.dropped_full );
-	if (flow->stats_instant.dropped_late)
-		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Dropped %u late packets\n", flow->stats_instant.dropped_late);
+	if (interval.dropped_full)
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Dropped %lu packets due to buffers being full\n", interval.dropped_full);
+	if (interval.dropped_late)
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Dropped %lu late packets\n", interval.dropped_late);
 	if (flow->stats_instant.lost)
 		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Lost %u packets\n", flow->stats_instant.lost);
 
-	struct rist_stats *stats_container = malloc(sizeof(struct rist_stats));
-	stats_container->stats_type = RIST_STATS_RECEIVER_FLOW;
-	stats_container->version = RIST_STATS_VERSION;
+	pthread_mutex_lock(&ctx->common.stats_lock);
+	int (*stats_cb)(void *arg, const struct rist_stats *stats_container) = ctx->common.stats_callback;
+	void *stats_cb_arg = ctx->common.stats_callback_argument;
+	enum rist_stats_format format = ctx->common.stats_format;
+	pthread_mutex_unlock(&ctx->common.stats_lock);
 
 	if (flow->stats_instant.avg_count)
 	{
 		flow->stats_instant.cur_ips = (flow->stats_instant.total_ips / flow->stats_instant.avg_count);
 	}
 
-	cJSON *stats = cJSON_CreateObject();
-	cJSON *stats_obj = cJSON_AddObjectToObject(stats, "receiver-stats");
-	cJSON *flow_obj = cJSON_AddObjectToObject(stats_obj, "flowinstant");
-	cJSON_AddNumberToObject(flow_obj, "flow_id", flow->flow_id);
-	cJSON_AddNumberToObject(flow_obj, "dead",  flow->dead);
-	cJSON *json_stats = cJSON_AddObjectToObject(flow_obj, "stats");
-	cJSON *peers = cJSON_AddArrayToObject(flow_obj, "peers");
+	// The per peer breakdown only goes into json reports
+	cJSON *peers = (stats_cb != NULL && format == RIST_STATS_FORMAT_JSON) ? cJSON_CreateArray() : NULL;
 	uint32_t flow_rtt = 0;
 	uint32_t flow_sent_instant = 0;
 	for (size_t i = 0; i < flow->peer_lst_len; i++)
@@ -144,30 +281,32 @@ void rist_receiver_flow_statistics(struct rist_receiver *ctx, struct rist_flow *
 		struct rist_peer *peer = flow->peer_lst[i];
 		if (!peer->is_data && peer->peer_data)
 			peer = peer->peer_data;
-		double avg_rtt = ((double)peer->eight_times_rtt / 8);
-
-		size_t bitrate = peer->bw.eight_times_bitrate_fast / 8;
-		size_t avg_bitrate = peer->bw.eight_times_bitrate / 8;
 		flow_sent_instant += peer->stats_receiver_instant.sent_rtcp;
-		flow_rtt =+ peer->eight_times_rtt / 8;
-
-		cJSON *peer_obj = cJSON_CreateObject();
-		cJSON_AddNumberToObject(peer_obj, "id", peer->adv_peer_id);
-		cJSON_AddNumberToObject(peer_obj, "dead", peer->dead);
-		cJSON *peer_stats = cJSON_AddObjectToObject(peer_obj, "stats");
-		cJSON_AddNumberToObject(peer_stats, "received_data", (double)peer->stats_receiver_instant.received);
-		cJSON_AddNumberToObject(peer_stats, "received_rtcp", (double)peer->stats_receiver_instant.received_rtcp);
-		cJSON_AddNumberToObject(peer_stats, "sent_rtcp", (double)peer->stats_receiver_instant.sent_rtcp);
-		cJSON_AddNumberToObject(peer_stats, "rtt", (double)peer->last_rtt / RIST_CLOCK);
-		cJSON_AddNumberToObject(peer_stats, "avg_rtt", (double)avg_rtt / RIST_CLOCK);
-		cJSON_AddNumberToObject(peer_stats, "bitrate", (double)bitrate);
-		cJSON_AddNumberToObject(peer_stats, "avg_bitrate", (double)avg_bitrate);
-		cJSON_AddItemToArray(peers, peer_obj);
+		flow_rtt += peer->eight_times_rtt / 8;
+
+		if (peers)
+		{
+			double avg_rtt = ((double)peer->eight_times_rtt / 8);
+			size_t bitrate = peer->bw.eight_times_bitrate_fast / 8;
+			size_t avg_bitrate = peer->bw.eight_times_bitrate / 8;
+			cJSON *peer_obj = cJSON_CreateObject();
+			cJSON_AddNumberToObject(peer_obj, "id", peer->adv_peer_id);
+			cJSON_AddNumberToObject(peer_obj, "dead", peer->dead);
+			cJSON *peer_stats = cJSON_AddObjectToObject(peer_obj, "stats");
+			cJSON_AddNumberToObject(peer_stats, "received_data", (double)peer->stats_receiver_instant.received);
+			cJSON_AddNumberToObject(peer_stats, "received_rtcp", (double)peer->stats_receiver_instant.received_rtcp);
+			cJSON_AddNumberToObject(peer_stats, "sent_rtcp", (double)peer->stats_receiver_instant.sent_rtcp);
+			cJSON_AddNumberToObject(peer_stats, "rtt", (double)peer->last_rtt / RIST_CLOCK);
+			cJSON_AddNumberToObject(peer_stats, "avg_rtt", (double)avg_rtt / RIST_CLOCK);
+			cJSON_AddNumberToObject(peer_stats, "bitrate", (double)bitrate);
+			cJSON_AddNumberToObject(peer_stats, "avg_bitrate", (double)avg_bitrate);
+			cJSON_AddItemToArray(peers, peer_obj);
+		}
 		// Clear peer instant stats
 		memset(&peer->stats_receiver_instant, 0, sizeof(peer->stats_receiver_instant));
 	}
 
-	flow->stats_instant.recovered_average = (flow->stats_instant.recovered_sum * 100) - flow->stats_instant.recovered;
+	flow->stats_instant.recovered_average = (flow->stats_instant.recovered_sum * 100) - (uint32_t)interval.recovered;
 	flow->stats_instant.recovered_slope = flow->stats_instant.recovered_3nack - flow->stats_instant.recovered_0nack;
 	if ((int32_t)(flow->stats_instant.recovered_1nack - flow->stats_instant.recovered_0nack) > 0 &&
 		flow->stats_instant.recovered_1nack != 0 && flow->stats_instant.recovered_0nack != 0)
@@ -188,93 +327,68 @@ void rist_receiver_flow_statistics(struct rist_receiver *ctx, struct rist_flow *
 	}
 
 	double Q = 100;
-	if (flow->stats_instant.received > 0)
+	if (interval.received > 0)
 	{
-		Q = (double)((flow->stats_instant.received)*100.0) /
-			(double)(flow->stats_instant.received + flow->stats_instant.missing);
+		Q = (double)((interval.received)*100.0) /
+			(double)(interval.received + interval.missing);
 		Q = round_two_digits(Q);
 	}
 
 	// This last one should trigger buffer protection immediately
-	if ((flow->missing_counter == 0 || flow->stats_instant.recovered == 0 ||
-		 (flow->stats_instant.recovered * 10) < flow->stats_instant.missing) &&
-		flow->stats_instant.received > 10 &&
-		flow->stats_instant.received < flow->stats_instant.missing)
+	if ((flow->missing_counter == 0 || interval.recovered == 0 ||
+		 (interval.recovered * 10) < interval.missing) &&
+		interval.received > 10 &&
+		interval.received < interval.missing)
 	{
-		rist_log_priv(&ctx->common, RIST_LOG_INFO, "\tThe flow link is dead %" PRIu32 " > %" PRIu64 ", deleting all missing queue elements!\n",
-			flow->stats_instant.missing, flow->stats_instant.received);
+		rist_log_priv(&ctx->common, RIST_LOG_INFO, "\tThe flow link is dead %lu > %lu, deleting all missing queue elements!\n",
+			interval.missing, interval.received);
 		/* Delete all missing queue elements (if any) */
 		rist_flush_missing_flow_queue(flow);
 	}
 
-	uint64_t avg_buffer_duration = 0;
-	if (flow->stats_instant.buffer_duration_count > 0)
-	{
-
-		for (size_t i = 0; i < flow->stats_instant.buffer_duration_count; i++)
-		{
-			avg_buffer_duration += flow->stats_instant.buffer_duration[i];
-		}
-		avg_buffer_duration /= flow->stats_instant.buffer_duration_count;
-		flow->stats_instant.buffer_duration_count = 0;
-	}
-	cJSON_AddNumberToObject(json_stats, "quality", Q);
-	cJSON_AddNumberToObject(json_stats, "received", (double)flow->stats_instant.received);
-	cJSON_AddNumberToObject(json_stats, "dropped_late", (double)flow->stats_instant.dropped_late);
-	cJSON_AddNumberToObject(json_stats, "dropped_full", (double)flow->stats_instant.dropped_full);
-	cJSON_AddNumberToObject(json_stats, "missing", (double)flow->stats_instant.missing);
-	cJSON_AddNumberToObject(json_stats, "recovered_total", (double)flow->stats_instant.recovered);
-	cJSON_AddNumberToObject(json_stats, "reordered", (double)flow->stats_instant.reordered);
-	cJSON_AddNumberToObject(json_stats, "retries", (double)flow->stats_instant.retries);
-	cJSON_AddNumberToObject(json_stats, "recovered_one_nack", (double)flow->stats_instant.recovered_0nack);
-	cJSON_AddNumberToObject(json_stats, "recovered_two_nacks", (double)flow->stats_instant.recovered_1nack);
-	cJSON_AddNumberToObject(json_stats, "recovered_three_nacks", (double)flow->stats_instant.recovered_2nack);
-	cJSON_AddNumberToObject(json_stats, "recovered_four_nacks", (double)flow->stats_instant.recovered_3nack);
-	cJSON_AddNumberToObject(json_stats, "recovered_more_nacks", (double)flow->stats_instant.recovered_morenack);
-	cJSON_AddNumberToObject(json_stats, "lost", (double)flow->stats_instant.lost);
-	cJSON_AddNumberToObject(json_stats, "avg_buffer_time", (double)avg_buffer_duration);
-	cJSON_AddNumberToObject(json_stats, "duplicates", (double)flow->stats_instant.dupe);
-	cJSON_AddNumberToObject(json_stats, "missing_queue", (double)flow->missing_counter);
-	cJSON_AddNumberToObject(json_stats, "missing_queue_max", (double)flow->missing_counter_max);
-	cJSON_AddNumberToObject(json_stats, "min_inter_packet_spacing", (double)flow->stats_instant.min_ips);
-	cJSON_AddNumberToObject(json_stats, "cur_inter_packet_spacing", (double)flow->stats_instant.cur_ips);
-	cJSON_AddNumberToObject(json_stats, "max_inter_packet_spacing", (double)flow->stats_instant.max_ips);
-	cJSON_AddNumberToObject(json_stats, "bitrate", (double)flow->bw.bitrate);
-
-	char *stats_string = cJSON_PrintUnformatted(stats);
-	cJSON_Delete(stats);
-
-	stats_container->stats_json = stats_string;
-	stats_container->json_size = (uint32_t)strlen(stats_string);
-
-	stats_container->stats.receiver_flow.peer_count = (uint32_t)flow->peer_lst_len;
+	struct rist_stats *report = &flow->stats_report;
+	memset(report, 0, sizeof(*report));
+	report->stats_type = RIST_STATS_RECEIVER_FLOW;
+	report->version = RIST_STATS_VERSION;
+	report->library_owned = true;
+	struct rist_stats_receiver_flow *s = &report->stats.receiver_flow;
+	s->peer_count = (uint32_t)flow->peer_lst_len;
 	// TODO: populate stats_receiver_flow->cname
-	stats_container->stats.receiver_flow.cname[0] = '\0';
-	stats_container->stats.receiver_flow.flow_id = flow->flow_id;
-	stats_container->stats.receiver_flow.status = flow->dead;
-	stats_container->stats.receiver_flow.bandwidth = flow->bw.bitrate;
+	s->flow_id = flow->flow_id;
+	s->status = flow->dead;
+	s->bandwidth = flow->bw.bitrate;
 	//TODO: populate retry_bandwidth;
-	stats_container->stats.receiver_flow.retry_bandwidth = 0;
-	stats_container->stats.receiver_flow.sent = flow->peer_lst_len ? flow_sent_instant / flow->peer_lst_len : 0;
-	stats_container->stats.receiver_flow.received = flow->stats_instant.received;
-	stats_container->stats.receiver_flow.missing = flow->stats_instant.missing;
-	stats_container->stats.receiver_flow.reordered = flow->stats_instant.reordered;
-	stats_container->stats.receiver_flow.recovered = flow->stats_instant.recovered;
-	stats_container->stats.receiver_flow.recovered_one_retry = flow->stats_instant.recovered_0nack;
-	stats_container->stats.receiver_flow.lost = flow->stats_instant.lost;
-	stats_container->stats.receiver_flow.quality = Q;
-	stats_container->stats.receiver_flow.min_inter_packet_spacing = flow->stats_instant.min_ips;
-	stats_container->stats.receiver_flow.cur_inter_packet_spacing = flow->stats_instant.cur_ips;
-	stats_container->stats.receiver_flow.max_inter_packet_spacing = flow->stats_instant.max_ips;
-	stats_container->stats.receiver_flow.rtt = flow->peer_lst_len ? (flow_rtt / flow->peer_lst_len)/RIST_CLOCK : 0;
-
-	/* CALLBACK CALL */
-	if (ctx->common.stats_callback != NULL)
-		ctx->common.stats_callback(ctx->common.stats_callback_argument, stats_container);
-	else
-		rist_stats_free(stats_container);
+	s->retry_bandwidth = 0;
+	s->sent = flow->peer_lst_len ? flow_sent_instant / flow->peer_lst_len : 0;
+	s->received = interval.received;
+	s->missing = (uint32_t)interval.missing;
+	s->reordered = (uint32_t)interval.reordered;
+	s->recovered = (uint32_t)interval.recovered;
+	s->fec_recovered = (uint32_t)interval.fec_recovered;
+	s->recovered_one_retry = flow->stats_instant.recovered_0nack;
+	s->recovered_two_retries = flow->stats_instant.recovered_1nack;
+	s->recovered_three_retries = flow->stats_instant.recovered_2nack;
+	s->recovered_four_retries = flow->stats_instant.recovered_3nack;
+	s->recovered_more_retries = flow->stats_instant.recovered_morenack;
+	s->lost = flow->stats_instant.lost;
+	s->quality = Q;
+	s->min_inter_packet_spacing = flow->stats_instant.min_ips;
+	s->cur_inter_packet_spacing = flow->stats_instant.cur_ips;
+	s->max_inter_packet_spacing = flow->stats_instant.max_ips;
+	s->rtt = flow->peer_lst_len ? (flow_rtt / (uint32_t)flow->peer_lst_len) / RIST_CLOCK : 0;
+	s->dropped_late = (uint32_t)interval.dropped_late;
+	s->dropped_full = (uint32_t)interval.dropped_full;
+	s->retries = (uint32_t)interval.retries;
+	s->duplicates = (uint32_t)interval.duplicates;
+	s->avg_buffer_time = avg_buffer_duration;
+	s->missing_queue = flow->missing_counter;
+	s->missing_queue_max = flow->missing_counter_max;
+	s->queue_slots = flow->receiver_queue_max;
+	s->queue_memory = rist_receiver_queue_footprint(flow);
+	rist_buffer_pool_get_stats(&ctx->common, &s->buffer_pool_hits, &s->buffer_pool_misses);
 
 	memset(&flow->stats_instant, 0, sizeof(flow->stats_instant));
 	flow->stats_instant.min_ips = 0xFFFFFFFFFFFFFFFFULL;
-	pthread_mutex_unlock(&ctx->common.stats_lock);
+
+	rist_stats_report(stats_cb, stats_cb_arg, format, report, peers);
 }
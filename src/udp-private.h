@@ -22,6 +22,7 @@
 #define RIST_PAYLOAD_TYPE_DATA_OOB          0x6 // Out-of-band data
 #define RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT  0x7
 #define RIST_PAYLOAD_TYPE_EAPOL				0x8
+#define RIST_PAYLOAD_TYPE_FEC               0x9 // Row/column parity
 
 // Maximum offset before the payload that the code can use to put in headers
 #define RIST_MAX_PAYLOAD_OFFSET (sizeof(struct rist_gre_key_seq) + sizeof(struct rist_protocol_hdr))
@@ -34,14 +35,34 @@ RIST_PRIV void rist_sender_periodic_rtcp(struct rist_peer *peer);
 RIST_PRIV int rist_respond_echoreq(struct rist_peer *peer, const uint64_t echo_request_time, uint32_t ssrc);
 RIST_PRIV int rist_request_echo(struct rist_peer *peer);
 RIST_PRIV int rist_send_common_rtcp(struct rist_peer *p, uint8_t payload_type, uint8_t *payload, size_t payload_len, uint64_t source_time, uint16_t src_port, uint16_t dst_port, uint32_t seq_rtp);
-RIST_PRIV void rist_sender_send_data_balanced(struct rist_sender *ctx, struct rist_buffer *buffer);
-RIST_PRIV int rist_sender_enqueue(struct rist_sender *ctx, const void *data, size_t len, uint64_t datagram_time, uint16_t src_port, uint16_t dst_port, uint32_t seq_rtp);
-RIST_PRIV void rist_clean_sender_enqueue(struct rist_sender *ctx);
-RIST_PRIV void rist_retry_enqueue(struct rist_sender *ctx, uint32_t seq, struct rist_peer *peer);
-RIST_PRIV ssize_t rist_retry_dequeue(struct rist_sender *ctx);
+RIST_PRIV void rist_sender_send_data_balanced(struct rist_sender *ctx, struct rist_buffer *buffer, uint64_t now);
+RIST_PRIV void rist_sender_fec_add(struct rist_sender *ctx, struct rist_buffer *buffer);
+RIST_PRIV void rist_sender_send_fec(struct rist_sender *ctx, uint64_t now);
+RIST_PRIV int rist_sender_enqueue(struct rist_sender *ctx, const void *data, size_t len, uint64_t datagram_time, uint16_t src_port, uint16_t dst_port, int32_t seq_rtp, uint64_t now);
+RIST_PRIV void rist_clean_sender_enqueue(struct rist_sender *ctx, uint64_t now);
+RIST_PRIV size_t rist_sender_queue_collect(struct rist_sender *ctx);
+RIST_PRIV int rist_sender_compression_set(struct rist_sender *ctx, int level);
+RIST_PRIV int rist_sender_queue_grow(struct rist_sender *ctx, size_t slots);
+RIST_PRIV void rist_sender_queue_check_size(struct rist_sender *ctx);
+RIST_PRIV void rist_retry_enqueue(struct rist_sender *ctx, uint32_t seq, struct rist_peer *peer, uint64_t now);
+RIST_PRIV ssize_t rist_retry_dequeue(struct rist_sender *ctx, uint64_t now);
 RIST_PRIV int rist_set_url(struct rist_peer *peer);
 RIST_PRIV void rist_create_socket(struct rist_peer *peer);
 RIST_PRIV size_t rist_get_sender_retry_queue_size(struct rist_sender *ctx);
+RIST_PRIV struct rist_tx_batch *rist_tx_batch_create(void);
+RIST_PRIV void rist_tx_batch_destroy(struct rist_tx_batch *batch);
+RIST_PRIV void rist_tx_batch_begin(struct rist_sender *ctx);
+RIST_PRIV void rist_tx_batch_flush(struct rist_sender *ctx);
+RIST_PRIV bool rist_tx_batch_txtime_usable(struct rist_sender *ctx);
+RIST_PRIV void rist_tx_batch_departure(struct rist_sender *ctx, uint64_t departure, uint64_t now);
+RIST_PRIV bool rist_tx_batch_add(struct rist_peer *p, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t data_len);
+RIST_PRIV uint8_t *rist_tx_batch_reserve(struct rist_peer *p, size_t len);
+RIST_PRIV void rist_tx_batch_add_encrypted(struct rist_peer *p, struct rist_peer *key_peer, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t data_len, struct rist_key *key, const uint8_t iv[AES_BLOCK_SIZE]);
+RIST_PRIV bool rist_tx_batch_has_pending_crypt(struct rist_peer *p);
+RIST_PRIV void rist_tx_batch_encrypt_pending(struct rist_peer *p);
+RIST_PRIV int rist_sender_tx_workers_start(struct rist_sender *ctx);
+RIST_PRIV void rist_sender_tx_workers_stop(struct rist_sender *ctx);
+RIST_PRIV void rist_sender_tx_workers_forget_peer(struct rist_sender *ctx, struct rist_peer *peer);
 
 
 #endif
@@ -20,21 +20,34 @@
 #include "proto/eap.h"
 #endif
 #include "crypto/psk.h"
+#include "rist-thread.h"
 #include "mpegts.h"
+#include <lz4.h>
+#include <lz4hc.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <errno.h>
 #include <stdint.h>
 #include <assert.h>
 #include <fcntl.h>
+#include "config.h"
+#ifndef _WIN32
+#include <sched.h>
+#endif
+#if HAVE_UDP_SEGMENT
+#include <netinet/udp.h>
+#endif
+#if HAVE_SO_TXTIME
+#include <linux/net_tstamp.h>
+#endif
 
-void rist_clean_sender_enqueue(struct rist_sender *ctx)
+void rist_clean_sender_enqueue(struct rist_sender *ctx, uint64_t now)
 {
 	int delete_count = 1;
 
 	// Delete old packets (max 10 entries per function call)
 	while (delete_count++ < 10) {
-		struct rist_buffer *b = ctx->sender_queue[ctx->sender_queue_delete_index];
+		struct rist_buffer *b = rist_sender_queue_get(ctx, ctx->sender_queue_delete_index);
 
 		/* our buffer size is zero, it must be just building up */
 		if ((size_t)atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_acquire) == ctx->sender_queue_delete_index) {
@@ -48,15 +61,18 @@ void rist_clean_sender_enqueue(struct rist_sender *ctx)
 			rist_log_priv(&ctx->common, RIST_LOG_ERROR,
 				"Moving delete index to %zu\n",
 				ctx->sender_queue_delete_index);
-			b = ctx->sender_queue[ctx->sender_queue_delete_index];
+			b = rist_sender_queue_get(ctx, ctx->sender_queue_delete_index);
 			if (safety_counter++ > 1000)
 				return;
 		}
 		if (!b)
 			return;
+		/* a transmit worker has yet to copy it */
+		if (atomic_load_explicit(&b->tx_refs, memory_order_acquire) > 0)
+			break;
 
 		/* perform the deletion based on the buffer size plus twice the configured/measured avg_rtt */
-		uint64_t delay = (timestampNTP_u64() - b->time) / RIST_CLOCK;
+		uint64_t delay = (now - b->time) / RIST_CLOCK;
 		if (delay < ctx->sender_recover_min_time) {
 			break;
 		}
@@ -68,13 +84,426 @@ void rist_clean_sender_enqueue(struct rist_sender *ctx)
 		/* now delete it */
 		ctx->sender_queue_bytesize -= b->size;
 		free_rist_buffer(&ctx->common, b);
-		ctx->sender_queue[ctx->sender_queue_delete_index] = NULL;
+		rist_sender_queue_set(ctx, ctx->sender_queue_delete_index, NULL);
 		ctx->sender_queue_delete_index = (ctx->sender_queue_delete_index + 1)& (ctx->sender_queue_max -1);
 
 	}
 
 }
 
+struct rist_tx_batch_entry {
+	struct rist_peer *peer;
+	// GRE header followed by a private copy of the start of the datagram
+	uint8_t hdr[MAX_GRE_SIZE + RIST_MAX_HEADER_SIZE];
+	size_t hdr_len;
+	uint8_t *data;
+	size_t data_len;
+	// CLOCK_MONOTONIC departure in ns for SO_TXTIME, 0 sends right away
+	uint64_t txtime;
+};
+
+struct rist_tx_batch {
+	bool active;
+	bool gso_disabled;
+	bool txtime_disabled;
+	// Departure given to the datagrams added from now on
+	uint64_t txtime;
+	size_t count;
+	struct rist_tx_batch_entry entries[RIST_TX_BATCH_SIZE];
+	// Encrypted datagrams are copied here and crypted in one pass right before sending
+	uint8_t *scratch;
+	size_t scratch_used;
+	size_t job_count;
+	struct rist_crypto_ctr_job jobs[RIST_TX_BATCH_SIZE];
+	// Peer whose peer_lock guards the key of each job
+	struct rist_peer *job_peers[RIST_TX_BATCH_SIZE];
+};
+
+/* Data packets of a peer with a transmit worker only go out from that worker, through its batch */
+static inline struct rist_sender_tx_worker *rist_peer_tx_worker(struct rist_peer *p)
+{
+	return p->parent ? p->parent->tx_worker : p->tx_worker;
+}
+
+static inline struct rist_tx_batch *rist_peer_tx_batch(struct rist_peer *p)
+{
+	struct rist_sender_tx_worker *w = rist_peer_tx_worker(p);
+	if (w)
+		return w->tx_batch;
+	return p->sender_ctx ? p->sender_ctx->tx_batch : NULL;
+}
+
+/* Must not be called with a peer_lock held: the keys are only used under the peer_lock of their
+   peer, like every other key access, as the API thread may set a new passphrase meanwhile */
+static void rist_tx_batch_crypt(struct rist_tx_batch *batch)
+{
+	size_t i = 0;
+	while (i < batch->job_count) {
+		struct rist_peer *key_peer = batch->job_peers[i];
+		size_t end = i + 1;
+		while (end < batch->job_count && batch->job_peers[end] == key_peer)
+			end++;
+		pthread_mutex_lock(&key_peer->peer_lock);
+		_librist_crypto_psk_ctr_batch(&batch->jobs[i], end - i);
+		pthread_mutex_unlock(&key_peer->peer_lock);
+		i = end;
+	}
+	batch->job_count = 0;
+}
+
+#if HAVE_SENDMMSG
+// Kernel limits for a single UDP GSO send
+#define RIST_TX_GSO_MAX_SEGMENTS (64)
+#define RIST_TX_GSO_MAX_BYTES (65000)
+
+static void rist_tx_batch_sendmmsg(struct rist_common_ctx *cctx, int sd, struct mmsghdr *msgs, size_t count)
+{
+	size_t sent = 0;
+	while (sent < count) {
+		int ret = sendmmsg(sd, &msgs[sent], (unsigned int)(count - sent), MSG_DONTWAIT);
+		if (RIST_UNLIKELY(ret < 0)) {
+			int errorcode = errno;
+			rist_log_priv(cctx, RIST_LOG_ERROR, "Send failed: errno=%d, reason=%s, ret=%d, socket=%d\n", errorcode, strerror(errorcode), ret, sd);
+			// Drop the datagram that failed, same as the single send path would
+			sent++;
+			continue;
+		}
+		sent += ret;
+	}
+}
+
+#if HAVE_SO_TXTIME
+/* SO_TXTIME is set on a socket the first time a departure time goes out through it, the
+ * peer that opened the socket keeps the result */
+static bool rist_tx_batch_txtime_enable(struct rist_tx_batch *batch, struct rist_common_ctx *cctx, struct rist_peer *peer)
+{
+	struct rist_peer *owner = peer->parent ? peer->parent : peer;
+	if (!owner->txtime_checked) {
+		struct sock_txtime config = { .clockid = CLOCK_MONOTONIC, .flags = 0 };
+		owner->txtime_checked = true;
+		owner->txtime_enabled = setsockopt(owner->sd, SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) == 0;
+		if (!owner->txtime_enabled) {
+			rist_log_priv(cctx, RIST_LOG_WARN, "SO_TXTIME is not usable (errno=%d), pacing from the protocol loop only\n", errno);
+			batch->txtime_disabled = true;
+		}
+	}
+	return owner->txtime_enabled;
+}
+#endif
+
+#if HAVE_UDP_SEGMENT
+static int rist_tx_batch_send_gso(struct rist_tx_batch *batch, struct rist_common_ctx *cctx, struct rist_peer *peer, struct iovec *iov, size_t count, size_t segment_size)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &peer->u.address;
+	msg.msg_namelen = peer->address_len;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2 * count;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = IPPROTO_UDP;
+	cm->cmsg_type = UDP_SEGMENT;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	uint16_t gso_size = (uint16_t)segment_size;
+	memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+
+	if (RIST_LIKELY(sendmsg(peer->sd, &msg, MSG_DONTWAIT) >= 0))
+		return 0;
+	int errorcode = errno;
+	if (errorcode == EINVAL || errorcode == EIO || errorcode == ENOPROTOOPT || errorcode == EOPNOTSUPP) {
+		rist_log_priv(cctx, RIST_LOG_WARN, "UDP GSO is not usable (errno=%d), falling back to sendmmsg\n", errorcode);
+		batch->gso_disabled = true;
+		return -1;
+	}
+	rist_log_priv(cctx, RIST_LOG_ERROR, "Send failed: errno=%d, reason=%s, socket=%d\n", errorcode, strerror(errorcode), peer->sd);
+	return 0;
+}
+#endif
+
+/* Sends entries [start, end), which all go out through the same socket */
+static void rist_tx_batch_send_run(struct rist_tx_batch *batch, struct rist_common_ctx *cctx, size_t start, size_t end)
+{
+	struct iovec iov[RIST_TX_BATCH_SIZE][2];
+	struct mmsghdr msgs[RIST_TX_BATCH_SIZE];
+#if HAVE_SO_TXTIME
+	// uint64_t keeps the control space aligned for struct cmsghdr
+	uint64_t txtime_control[RIST_TX_BATCH_SIZE][(CMSG_SPACE(sizeof(uint64_t)) + 7) / 8];
+#endif
+	int sd = batch->entries[start].peer->sd;
+	size_t n = end - start;
+
+	for (size_t i = 0; i < n; i++) {
+		struct rist_tx_batch_entry *e = &batch->entries[start + i];
+		iov[i][0].iov_base = e->hdr;
+		iov[i][0].iov_len = e->hdr_len;
+		iov[i][1].iov_base = e->data;
+		iov[i][1].iov_len = e->data_len;
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_name = &e->peer->u.address;
+		msgs[i].msg_hdr.msg_namelen = e->peer->address_len;
+		msgs[i].msg_hdr.msg_iov = iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 2;
+#if HAVE_SO_TXTIME
+		if (e->txtime && rist_tx_batch_txtime_enable(batch, cctx, e->peer)) {
+			memset(&txtime_control[i], 0, sizeof(txtime_control[i]));
+			msgs[i].msg_hdr.msg_control = txtime_control[i];
+			msgs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+			struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+			cm->cmsg_level = SOL_SOCKET;
+			cm->cmsg_type = SCM_TXTIME;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+			memcpy(CMSG_DATA(cm), &e->txtime, sizeof(e->txtime));
+		}
+#endif
+	}
+
+	size_t pending = 0;
+#if HAVE_UDP_SEGMENT
+	size_t k = 0;
+	while (k < n && !batch->gso_disabled) {
+		// Equal sized datagrams to the same destination can go out as a single GSO send
+		struct rist_tx_batch_entry *first = &batch->entries[start + k];
+		size_t segment_size = first->hdr_len + first->data_len;
+		size_t seg_end = k + 1;
+		// Paced datagrams each carry their own departure time
+		while (!first->txtime && seg_end < n && (seg_end - k) < RIST_TX_GSO_MAX_SEGMENTS && (seg_end - k + 1) * segment_size <= RIST_TX_GSO_MAX_BYTES) {
+			struct rist_tx_batch_entry *e = &batch->entries[start + seg_end];
+			if (e->peer != first->peer || (e->hdr_len + e->data_len) != segment_size || e->txtime)
+				break;
+			seg_end++;
+		}
+		if (seg_end - k > 1) {
+			rist_tx_batch_sendmmsg(cctx, sd, &msgs[pending], k - pending);
+			pending = k;
+			if (rist_tx_batch_send_gso(batch, cctx, first->peer, &iov[k][0], seg_end - k, segment_size) == 0)
+				pending = seg_end;
+		}
+		k = seg_end;
+	}
+#endif
+	rist_tx_batch_sendmmsg(cctx, sd, &msgs[pending], n - pending);
+}
+
+/* Takes the datagrams the impairment drops or holds back out of the batch */
+static void rist_tx_batch_impair(struct rist_tx_batch *batch, struct rist_common_ctx *cctx)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < batch->count; i++) {
+		struct rist_tx_batch_entry *e = &batch->entries[i];
+		if (rist_impairment_filter(&cctx->impairment, e->peer, e->hdr, e->hdr_len, e->data, e->data_len))
+			continue;
+		if (kept != i)
+			batch->entries[kept] = *e;
+		kept++;
+	}
+	batch->count = kept;
+}
+
+static void rist_tx_batch_send(struct rist_tx_batch *batch, struct rist_common_ctx *cctx)
+{
+	rist_tx_batch_crypt(batch);
+	if (RIST_UNLIKELY(rist_impairment_active(&cctx->impairment)))
+		rist_tx_batch_impair(batch, cctx);
+	size_t i = 0;
+	while (i < batch->count) {
+		size_t end = i + 1;
+		while (end < batch->count && batch->entries[end].peer->sd == batch->entries[i].peer->sd)
+			end++;
+		rist_tx_batch_send_run(batch, cctx, i, end);
+		i = end;
+	}
+	batch->count = 0;
+	batch->scratch_used = 0;
+}
+#endif
+
+struct rist_tx_batch *rist_tx_batch_create(void)
+{
+#if HAVE_SENDMMSG
+	struct rist_tx_batch *batch = calloc(1, sizeof(*batch));
+	if (!batch)
+		return NULL;
+	batch->scratch = malloc(RIST_TX_BATCH_SCRATCH_SIZE);
+	if (!batch->scratch) {
+		free(batch);
+		return NULL;
+	}
+	return batch;
+#else
+	return NULL;
+#endif
+}
+
+void rist_tx_batch_destroy(struct rist_tx_batch *batch)
+{
+	if (!batch)
+		return;
+	free(batch->scratch);
+	free(batch);
+}
+
+void rist_tx_batch_begin(struct rist_sender *ctx)
+{
+	if (ctx->tx_batch)
+		ctx->tx_batch->active = true;
+}
+
+/* Whether departure times set with rist_tx_batch_departure reach the kernel, which then
+   spaces the datagrams out (with the fq qdisc) instead of the protocol loop */
+bool rist_tx_batch_txtime_usable(struct rist_sender *ctx)
+{
+#if HAVE_SO_TXTIME
+	return ctx->tx_batch && !ctx->tx_batch->txtime_disabled;
+#else
+	RIST_MARK_UNUSED(ctx);
+	return false;
+#endif
+}
+
+/* Departure time for the datagrams queued until the next call or the flush, NTP time */
+void rist_tx_batch_departure(struct rist_sender *ctx, uint64_t departure, uint64_t now)
+{
+	if (!ctx->tx_batch)
+		return;
+	ctx->tx_batch->txtime = departure > now ? rist_ntp_to_monotonic_ns(departure) : 0;
+}
+
+static void rist_tx_batch_flush_batch(struct rist_tx_batch *batch, struct rist_common_ctx *cctx)
+{
+	if (!batch)
+		return;
+	batch->active = false;
+	batch->txtime = 0;
+#if HAVE_SENDMMSG
+	if (batch->count > 0)
+		rist_tx_batch_send(batch, cctx);
+#else
+	RIST_MARK_UNUSED(cctx);
+#endif
+}
+
+void rist_tx_batch_flush(struct rist_sender *ctx)
+{
+	rist_tx_batch_flush_batch(ctx->tx_batch, &ctx->common);
+}
+
+/* Queue a datagram for the next flush. Returns false when batching is not active, the caller
+   then sends the datagram directly. data must stay valid until the flush. */
+bool rist_tx_batch_add(struct rist_peer *p, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t data_len)
+{
+	struct rist_tx_batch *batch = rist_peer_tx_batch(p);
+	if (!batch || !batch->active || p->sd < 0)
+		return false;
+#if HAVE_SENDMMSG
+	if (batch->count == RIST_TX_BATCH_SIZE)
+		rist_tx_batch_send(batch, get_cctx(p));
+
+	struct rist_tx_batch_entry *e = &batch->entries[batch->count++];
+	e->peer = p;
+	e->txtime = batch->txtime;
+	if (hdr_len)
+		memcpy(e->hdr, hdr, hdr_len);
+	// The RTP header in front of the payload is rewritten in place for every peer and
+	// retransmission, so take a copy of it instead of referencing the shared buffer
+	size_t prefix = data_len < RIST_MAX_HEADER_SIZE ? data_len : RIST_MAX_HEADER_SIZE;
+	memcpy(&e->hdr[hdr_len], data, prefix);
+	e->hdr_len = hdr_len + prefix;
+	e->data = data + prefix;
+	e->data_len = data_len - prefix;
+	return true;
+#else
+	RIST_MARK_UNUSED(hdr);
+	RIST_MARK_UNUSED(hdr_len);
+	RIST_MARK_UNUSED(data);
+	RIST_MARK_UNUSED(data_len);
+	return false;
+#endif
+}
+
+/* Room for an encrypted datagram of len bytes in the batch scratch area, or NULL when batching
+   is not active and the caller has to encrypt and send on its own. May flush the batch. */
+uint8_t *rist_tx_batch_reserve(struct rist_peer *p, size_t len)
+{
+	struct rist_sender *ctx = p->sender_ctx;
+	// The protocol thread may rekey underneath a transmit worker, so workers crypt right away
+	if (!ctx || rist_peer_tx_worker(p))
+		return NULL;
+	if (!ctx->tx_batch || !ctx->tx_batch->active || p->sd < 0)
+		return NULL;
+#if HAVE_SENDMMSG
+	struct rist_tx_batch *batch = ctx->tx_batch;
+	if (len > RIST_TX_BATCH_SCRATCH_SIZE)
+		return NULL;
+	if (batch->count == RIST_TX_BATCH_SIZE || batch->scratch_used + len > RIST_TX_BATCH_SCRATCH_SIZE)
+		rist_tx_batch_send(batch, &ctx->common);
+	return &batch->scratch[batch->scratch_used];
+#else
+	RIST_MARK_UNUSED(len);
+	return NULL;
+#endif
+}
+
+/* Queue a datagram written to the space handed out by rist_tx_batch_reserve, data is crypted in
+   place with key and iv together with the rest of the batch */
+void rist_tx_batch_add_encrypted(struct rist_peer *p, struct rist_peer *key_peer, const uint8_t *hdr, size_t hdr_len, uint8_t *data, size_t data_len, struct rist_key *key, const uint8_t iv[AES_BLOCK_SIZE])
+{
+#if HAVE_SENDMMSG
+	struct rist_tx_batch *batch = p->sender_ctx->tx_batch;
+	struct rist_tx_batch_entry *e = &batch->entries[batch->count++];
+	e->peer = p;
+	e->txtime = batch->txtime;
+	memcpy(e->hdr, hdr, hdr_len);
+	e->hdr_len = hdr_len;
+	e->data = data;
+	e->data_len = data_len;
+	batch->scratch_used += data_len;
+
+	batch->job_peers[batch->job_count] = key_peer;
+	struct rist_crypto_ctr_job *job = &batch->jobs[batch->job_count++];
+	job->key = key;
+	memcpy(job->iv, iv, AES_BLOCK_SIZE);
+	job->buf = data;
+	job->len = data_len;
+#else
+	RIST_MARK_UNUSED(p);
+	RIST_MARK_UNUSED(key_peer);
+	RIST_MARK_UNUSED(hdr);
+	RIST_MARK_UNUSED(hdr_len);
+	RIST_MARK_UNUSED(data);
+	RIST_MARK_UNUSED(data_len);
+	RIST_MARK_UNUSED(key);
+	RIST_MARK_UNUSED(iv);
+#endif
+}
+
+/* Whether datagrams queued by the thread sending for p still wait to be crypted */
+bool rist_tx_batch_has_pending_crypt(struct rist_peer *p)
+{
+	struct rist_sender *ctx = p->sender_ctx;
+	if (!ctx || !ctx->tx_batch || rist_peer_tx_worker(p))
+		return false;
+	return ctx->tx_batch->job_count > 0;
+}
+
+/* Crypts queued datagrams now, needed before the key they reference gets rotated. Takes the
+   peer_lock of their peers, so the caller must not hold one */
+void rist_tx_batch_encrypt_pending(struct rist_peer *p)
+{
+	struct rist_sender *ctx = p->sender_ctx;
+	if (!ctx || !ctx->tx_batch || rist_peer_tx_worker(p))
+		return;
+#if HAVE_SENDMMSG
+	rist_tx_batch_crypt(ctx->tx_batch);
+#endif
+}
+
 size_t rist_send_seq_rtcp(struct rist_peer *p, uint16_t seq_rtp, uint8_t payload_type, uint8_t *payload, size_t payload_len, uint64_t source_time, uint16_t src_port, uint16_t dst_port, bool retry)
 {
 	struct rist_common_ctx *ctx = get_cctx(p);
@@ -134,25 +563,22 @@ size_t rist_send_seq_rtcp(struct rist_peer *p, uint16_t seq_rtp, uint8_t payload
 	// and warn when the difference is a multiple of 10 (slow CPU or overtaxed algorithm)
 	// The difference should always stay very low < 10
 
-	if (RIST_UNLIKELY((p->sender_ctx && p->sender_ctx->simulate_loss) || (p->receiver_ctx && p->receiver_ctx->simulate_loss))) {
-		uint16_t loss_percentage = p->sender_ctx? p->sender_ctx->loss_percentage : p->receiver_ctx->loss_percentage;
-		/* very crude calculation to see if we "randomly" drop packets, good enough for testing */
-		uint16_t compare = rand() % 1001;
-		if (compare <= loss_percentage) {
+	if (ctx->profile == RIST_PROFILE_SIMPLE) {
+		if ((payload_type == RIST_PAYLOAD_TYPE_DATA_RAW || payload_type == RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT) &&
+			rist_tx_batch_add(p, NULL, 0, data, len))
 			ret = len;
-			goto out;
-		}
-	}
-
-	if (ctx->profile == RIST_PROFILE_SIMPLE)
-		ret = sendto(p->sd,(const char*)data, len, 0, &(p->u.address), p->address_len);
-	else
+		else if (RIST_UNLIKELY(rist_impairment_active(&ctx->impairment)) &&
+			rist_impairment_filter(&ctx->impairment, p, NULL, 0, data, len))
+			ret = len;
+		else
+			ret = sendto(p->sd,(const char*)data, len, 0, &(p->u.address), p->address_len);
+	} else
 		ret = _librist_proto_gre_send_data(p, payload_type, proto_type, data, len, src_port, dst_port, p->rist_gre_version);
 
-out:
 	if (RIST_UNLIKELY(ret <= 0)) {
 		rist_log_priv(ctx, RIST_LOG_ERROR, "\tSend failed: errno=%d, ret=%d, socket=%d\n", errno, ret, p->sd);
-	} else {
+	} else if (!rist_peer_tx_worker(p) || (payload_type != RIST_PAYLOAD_TYPE_DATA_RAW && payload_type != RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT)) {
+		// Data sent by a transmit worker was accounted for when it was handed over
 		p->stats_sender_instant.sent++;
 		p->stats_receiver_instant.sent_rtcp++;
 	}
@@ -205,7 +631,7 @@ int rist_send_common_rtcp(struct rist_peer *p, uint8_t payload_type, uint8_t *pa
 	else
 	{
 		// update bandwidth value
-		rist_calculate_bitrate(ret, &p->bw);
+		rist_calculate_bitrate(ret, &p->bw, timestampNTP_u64());
 	}
 
 	// TODO:
@@ -625,7 +1051,110 @@ int rist_request_echo(struct rist_peer *peer) {
 	}
 }
 
-int rist_sender_enqueue(struct rist_sender *ctx, const void *data, size_t len, uint64_t datagram_time, uint16_t src_port, uint16_t dst_port, uint32_t seq_rtp)
+#define RIST_SENDER_QUEUE_PAUSE_SPINS (64)
+
+/* Waits inside the resize handshake are short, pause the cpu for a while and
+ * then give the core away so a preempted peer thread can make progress */
+static inline void rist_sender_queue_backoff(unsigned *spins)
+{
+	if (*spins < RIST_SENDER_QUEUE_PAUSE_SPINS) {
+		(*spins)++;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+		__asm__ __volatile__("yield");
+#endif
+		return;
+	}
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+/* Producers register themselves before touching the queue so rist_sender_queue_grow can
+ * wait for them to leave, and back off while a resize is in progress */
+static inline void rist_sender_queue_enter(struct rist_sender *ctx)
+{
+	while (true) {
+		atomic_fetch_add(&ctx->sender_queue_producers, 1);
+		if (RIST_LIKELY(!atomic_load(&ctx->sender_queue_resizing)))
+			return;
+		atomic_fetch_sub(&ctx->sender_queue_producers, 1);
+		unsigned spins = 0;
+		while (atomic_load(&ctx->sender_queue_resizing))
+			rist_sender_queue_backoff(&spins);
+	}
+}
+
+static inline void rist_sender_queue_leave(struct rist_sender *ctx)
+{
+	atomic_fetch_sub_explicit(&ctx->sender_queue_producers, 1, memory_order_release);
+}
+
+/* Called with peerlist_lock held when a peer asks for compression, levels from
+ * LZ4HC_CLEVEL_MIN up use LZ4HC, lower ones the fast LZ4 compressor. The level is
+ * per context: the queued payload is shared, so every peer gets the highest level */
+int rist_sender_compression_set(struct rist_sender *ctx, int level)
+{
+	if (level <= atomic_load_explicit(&ctx->compression_level, memory_order_relaxed))
+		return 0;
+	if (level >= LZ4HC_CLEVEL_MIN && !ctx->compression_state) {
+		ctx->compression_state = malloc(LZ4_sizeofStateHC());
+		if (!ctx->compression_state) {
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not allocate LZ4HC state, OOM\n");
+			return -1;
+		}
+	}
+	atomic_store_explicit(&ctx->compression_level, level, memory_order_release);
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Enabling LZ4 payload compression for all peers, level %d\n", level);
+	return 0;
+}
+
+/* Compresses the payload behind a RIST RTP header extension, keeping the null packet deletion
+ * bits when the payload already carries one. Returns the new length, or 0 when it does not pay */
+static size_t rist_sender_compress(struct rist_sender *ctx, int level, const uint8_t *payload, size_t len, bool has_ext, uint8_t out[])
+{
+	struct rist_rtp_hdr_ext *hdr_ext = (struct rist_rtp_hdr_ext *)out;
+	if (has_ext) {
+		memcpy(hdr_ext, payload, sizeof(*hdr_ext));
+		payload += sizeof(*hdr_ext);
+		len -= sizeof(*hdr_ext);
+	} else {
+		memset(hdr_ext, 0, sizeof(*hdr_ext));
+		memcpy(&hdr_ext->identifier, "RI", 2);
+		hdr_ext->length = htobe16(1);
+	}
+	// Anything that does not come out smaller than the original is sent as is
+	int max_len = (int)len - (has_ext ? 1 : (int)sizeof(*hdr_ext) + 1);
+	if (max_len <= 0)
+		return 0;
+	char *dst = (char *)&out[sizeof(*hdr_ext)];
+	int compressed_len = 0;
+	if (level >= LZ4HC_CLEVEL_MIN && ctx->compression_state &&
+		!atomic_exchange_explicit(&ctx->compression_state_busy, true, memory_order_acquire)) {
+		compressed_len = LZ4_compress_HC_extStateHC(ctx->compression_state, (const char *)payload, dst, (int)len, max_len, level);
+		atomic_store_explicit(&ctx->compression_state_busy, false, memory_order_release);
+	} else
+		compressed_len = LZ4_compress_default((const char *)payload, dst, (int)len, max_len);
+	if (compressed_len <= 0)
+		return 0;
+	SET_BIT(hdr_ext->flags, RIST_RTP_EXT_FLAG_LZ4);
+	return sizeof(*hdr_ext) + (size_t)compressed_len;
+}
+
+static inline void rist_sender_npd_header(struct rist_rtp_hdr_ext *hdr_ext, uint8_t npd_bits)
+{
+	memset(hdr_ext, 0, sizeof(*hdr_ext));
+	memcpy(&hdr_ext->identifier, "RI", 2);
+	hdr_ext->length = htobe16(1);
+	hdr_ext->npd_bits = npd_bits;
+	SET_BIT(hdr_ext->flags, RIST_RTP_EXT_FLAG_NPD);
+}
+
+/* A negative seq_rtp takes the next one from the claim */
+int rist_sender_enqueue(struct rist_sender *ctx, const void *data, size_t len, uint64_t datagram_time, uint16_t src_port, uint16_t dst_port, int32_t seq_rtp, uint64_t now)
 {
 	uint8_t payload_type = RIST_PAYLOAD_TYPE_DATA_RAW;
 	const void * payload = data;
@@ -635,40 +1164,388 @@ int rist_sender_enqueue(struct rist_sender *ctx, const void *data, size_t len, u
 	}
 
 	ctx->last_datagram_time = datagram_time;
-	uint8_t tmp_buf[6 * 204 + 4];//Max size needed with at least 1 pkt suppressed
-	if (ctx->null_packet_suppression && len <= 7 * 204)
+	uint8_t npd_bits = 0;
+	size_t npd_len = 0;
+	int npd_count = 0;
+	if (ctx->null_packet_suppression)
+		npd_count = scan_null_packets(data, len, &npd_bits, &npd_len);
+
+	int compression_level = atomic_load_explicit(&ctx->compression_level, memory_order_acquire);
+	uint8_t tmp_buf[6 * 204 + sizeof(struct rist_rtp_hdr_ext)];//Max size needed with at least 1 pkt suppressed
+	if (npd_count > 0 && compression_level > 0)
 	{
+		// LZ4 wants the suppressed payload in one piece
+		rist_sender_npd_header((struct rist_rtp_hdr_ext *)tmp_buf, npd_bits);
+		suppress_null_packets(data, len, npd_bits, &tmp_buf[sizeof(struct rist_rtp_hdr_ext)]);
+		len = sizeof(struct rist_rtp_hdr_ext) + npd_len;
+		payload = tmp_buf;
+		payload_type = RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT;
+		npd_count = 0;
+	}
 
-		struct rist_rtp_hdr_ext *hdr_ext = (struct rist_rtp_hdr_ext *)&tmp_buf;
-		memset(tmp_buf, 0, sizeof(*hdr_ext));//hdr_ext
-		if (suppress_null_packets(data, &tmp_buf[sizeof(*hdr_ext)], &len, hdr_ext) > 0)
-		{
-			memcpy(&hdr_ext->identifier, "RI", 2);
-			hdr_ext->length = htobe16(1);
-			len += sizeof(*hdr_ext);
-			payload = tmp_buf;
-			payload_type = RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT;
+	struct rist_buffer *b;
+	if (compression_level > 0) {
+		/* Compressed once, straight into the queued buffer, so retransmits and encryption work
+		 * on the compressed payload. Only results smaller than the input are kept so len fits */
+		b = rist_new_buffer(&ctx->common, NULL, len, RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT, 0, datagram_time, src_port, dst_port, now);
+		if (b) {
+			uint8_t *out = (uint8_t *)b->data + RIST_MAX_PAYLOAD_OFFSET;
+			size_t compressed_len = rist_sender_compress(ctx, compression_level, payload, len,
+				payload_type == RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT, out);
+			if (compressed_len > 0)
+				b->size = compressed_len;
+			else {
+				memcpy(out, payload, len);
+				b->type = payload_type;
+			}
+		}
+	} else if (npd_count > 0) {
+		// The kept packets are gathered straight into the queued buffer
+		b = rist_new_buffer(&ctx->common, NULL, sizeof(struct rist_rtp_hdr_ext) + npd_len, RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT, 0, datagram_time, src_port, dst_port, now);
+		if (b) {
+			uint8_t *out = (uint8_t *)b->data + RIST_MAX_PAYLOAD_OFFSET;
+			rist_sender_npd_header((struct rist_rtp_hdr_ext *)out, npd_bits);
+			suppress_null_packets(data, len, npd_bits, &out[sizeof(struct rist_rtp_hdr_ext)]);
 		}
+	} else
+		b = rist_new_buffer(&ctx->common, payload, len, payload_type, 0, datagram_time, src_port, dst_port, now);
+	if (RIST_UNLIKELY(!b)) {
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "\t Could not create packet buffer inside sender buffer, OOM, decrease max bitrate or buffer time length\n");
+		return -1;
 	}
 
-	/* insert into sender fifo queue */
-	pthread_mutex_lock(&ctx->queue_lock);
-	size_t sender_write_index = atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_acquire);
-	ctx->sender_queue[sender_write_index] = rist_new_buffer(&ctx->common, payload, len, payload_type, 0, datagram_time, src_port, dst_port);
-	if (RIST_UNLIKELY(!ctx->sender_queue[sender_write_index])) {
-		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "\t Could not create packet buffer inside sender buffer, OOM, decrease max bitrate or buffer time length\n");
-		pthread_mutex_unlock(&ctx->queue_lock);
+	/* insert into sender fifo queue: claim a slot (and the seq with it), then publish the buffer into it */
+	rist_sender_queue_enter(ctx);
+	uint64_t claim = atomic_load_explicit(&ctx->sender_queue_claim, memory_order_relaxed);
+	uint64_t next;
+	size_t claim_index;
+	uint16_t seq;
+	do {
+		claim_index = rist_sender_claim_index(claim);
+		/* slots are released by rist_clean_sender_enqueue, a used slot means the queue is full */
+		if (RIST_UNLIKELY(rist_sender_queue_get(ctx, claim_index) != NULL)) {
+			rist_sender_queue_leave(ctx);
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "\t Sender buffer is full, dropping packet\n");
+			free_rist_buffer(&ctx->common, b);
+			return -1;
+		}
+		uint16_t next_seq = rist_sender_claim_seq(claim);
+		seq = seq_rtp < 0 ? next_seq++ : (uint16_t)seq_rtp;
+		next = (uint64_t)next_seq << 32 | ((claim_index + 1) & (ctx->sender_queue_max - 1));
+	} while (!atomic_compare_exchange_weak_explicit(&ctx->sender_queue_claim, &claim, next,
+				memory_order_acq_rel, memory_order_relaxed));
+	b->seq_rtp = seq;
+	rist_sender_queue_set(ctx, claim_index, b);
+	rist_sender_queue_leave(ctx);
+
+	return 0;
+}
+
+/* Called from the protocol thread only. Producers are held off while the live slots are
+ * laid out again from the delete index, which lands on slot 1 as it does at creation */
+int rist_sender_queue_grow(struct rist_sender *ctx, size_t slots)
+{
+	const size_t old_max = ctx->sender_queue_max;
+	const size_t mask = old_max - 1;
+	size_t new_max = old_max;
+	while (new_max < slots && new_max < RIST_SERVER_QUEUE_BUFFERS)
+		new_max <<= 1;
+	if (new_max == old_max)
 		return -1;
+	atomic_uintptr_t *queue = calloc(new_max, sizeof(*queue));
+	if (!queue) {
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not grow sender queue to %zu slots, OOM\n", new_max);
+		return -1;
+	}
+
+	atomic_store(&ctx->sender_queue_resizing, true);
+	unsigned spins = 0;
+	while (atomic_load(&ctx->sender_queue_producers) != 0)
+		rist_sender_queue_backoff(&spins);
+
+	const size_t delete_index = ctx->sender_queue_delete_index;
+	for (size_t d = 0; d < old_max; d++) {
+		size_t pos = (delete_index + d) & mask;
+		struct rist_buffer *b = rist_sender_queue_get(ctx, pos);
+		if (!b)
+			continue;
+		atomic_init(&queue[1 + d], (uintptr_t)b);
+		if (ctx->seq_index[b->seq_rtp] == pos)
+			ctx->seq_index[b->seq_rtp] = (uint32_t)(1 + d);
+	}
+	size_t read_index = atomic_load_explicit(&ctx->sender_queue_read_index, memory_order_relaxed);
+	size_t write_index = atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_relaxed);
+	uint64_t claim = atomic_load_explicit(&ctx->sender_queue_claim, memory_order_relaxed);
+	size_t claimed = (rist_sender_claim_index(claim) - delete_index) & mask;
+	// A claim index back on the delete index with the slot in use means every slot is taken
+	if (claimed == 0 && rist_sender_queue_get(ctx, delete_index) != NULL)
+		claimed = old_max;
+	atomic_store_explicit(&ctx->sender_queue_read_index, (read_index + 1 - delete_index) & mask, memory_order_relaxed);
+	atomic_store_explicit(&ctx->sender_queue_write_index, 1 + ((write_index - delete_index) & mask), memory_order_relaxed);
+	atomic_store_explicit(&ctx->sender_queue_claim, (claim & ~(uint64_t)UINT32_MAX) | (1 + claimed), memory_order_relaxed);
+	ctx->sender_queue_delete_index = 1;
+
+	free(ctx->sender_queue);
+	ctx->sender_queue = queue;
+	ctx->sender_queue_max = new_max;
+	atomic_store(&ctx->sender_queue_resizing, false);
+
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Sender queue grown from %zu to %zu slots\n", old_max, new_max);
+	return 0;
+}
+
+/* Grows the queue towards the size the peers asked for, or when it is running full */
+void rist_sender_queue_check_size(struct rist_sender *ctx)
+{
+	const size_t max = ctx->sender_queue_max;
+	if (max >= RIST_SERVER_QUEUE_BUFFERS)
+		return;
+	size_t target = atomic_load_explicit(&ctx->sender_queue_target, memory_order_relaxed);
+	size_t used = (rist_sender_claim_index(atomic_load_explicit(&ctx->sender_queue_claim, memory_order_relaxed)) - ctx->sender_queue_delete_index) & (max - 1);
+	if (target > max)
+		rist_sender_queue_grow(ctx, target);
+	else if (used >= max - max / 4)
+		rist_sender_queue_grow(ctx, max * 2);
+}
+
+/* Called from the protocol thread only: advances the write index over the slots
+ * producers have published, stopping at the first one still being filled */
+size_t rist_sender_queue_collect(struct rist_sender *ctx)
+{
+	size_t write_index = atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_relaxed);
+	size_t start_index = write_index;
+	size_t bytes = 0;
+	struct rist_buffer *b;
+	while (((write_index + 1) & (ctx->sender_queue_max - 1)) != ctx->sender_queue_delete_index &&
+			(b = rist_sender_queue_get(ctx, write_index)) != NULL) {
+		bytes += b->size;
+		write_index = (write_index + 1) & (ctx->sender_queue_max - 1);
+	}
+	ctx->sender_queue_bytesize += bytes;
+	if (write_index != start_index)
+		atomic_store_explicit(&ctx->sender_queue_write_index, write_index, memory_order_release);
+	return bytes;
+}
+
+/* Each payload copy of a worker batch gets the headroom the RTP and GRE headers are written into */
+#define RIST_TX_WORKER_SLOT_SIZE (RIST_MAX_PAYLOAD_OFFSET + RIST_MAX_PACKET_SIZE)
+
+/* Hands a packet to the worker, the buffer stays queued until the worker copied it */
+static bool sender_tx_worker_post(struct rist_sender_tx_worker *w, struct rist_peer *peer, struct rist_buffer *buffer, uint64_t source_time, uint16_t src_port, uint16_t dst_port, bool retry)
+{
+	size_t tail = atomic_load_explicit(&w->queue_tail, memory_order_relaxed);
+	size_t next = (tail + 1) & (RIST_SENDER_TX_QUEUE_SIZE - 1);
+	if (RIST_UNLIKELY(next == atomic_load_explicit(&w->queue_head, memory_order_acquire))) {
+		if (w->queue_dropped++ % 1000 == 0)
+			rist_log_priv(&w->ctx->common, RIST_LOG_WARN, "Transmit worker %zu cannot keep up, %"PRIu64" packets dropped\n", w->index, w->queue_dropped);
+		return false;
 	}
-	ctx->sender_queue[sender_write_index]->seq_rtp = (uint16_t)seq_rtp;
-	ctx->sender_queue_bytesize += len;
-	atomic_store_explicit(&ctx->sender_queue_write_index, (sender_write_index + 1) & (ctx->sender_queue_max - 1), memory_order_release);
-	pthread_mutex_unlock(&ctx->queue_lock);
+	struct rist_sender_tx_item *item = &w->queue[tail];
+	item->buffer = buffer;
+	item->peer = peer;
+	item->source_time = source_time;
+	item->src_port = src_port;
+	item->dst_port = dst_port;
+	item->retry = retry;
+	atomic_fetch_add_explicit(&buffer->tx_refs, 1, memory_order_relaxed);
+	// Pairs with the worker announcing it sleeps and then looking at the tail once more
+	atomic_store(&w->queue_tail, next);
+	if (atomic_load(&w->sleeping)) {
+		pthread_mutex_lock(&w->lock);
+		pthread_cond_signal(&w->condition);
+		pthread_mutex_unlock(&w->lock);
+	}
+	// Stats and bandwidth are accounted here, the peer counters stay with the protocol thread
+	peer->stats_sender_instant.sent++;
+	peer->stats_receiver_instant.sent_rtcp++;
+	return true;
+}
 
+/* Sends up to a batch worth of queued items, those for skip or its children are dropped.
+ * Caller holds w->busy. Returns false once the ring is empty */
+static bool sender_tx_worker_run(struct rist_sender_tx_worker *w, struct rist_peer *skip)
+{
+	size_t head = atomic_load_explicit(&w->queue_head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&w->queue_tail, memory_order_acquire);
+	if (head == tail)
+		return false;
+	size_t count = 0;
+	if (w->tx_batch)
+		w->tx_batch->active = true;
+	while (head != tail && count < RIST_TX_BATCH_SIZE) {
+		struct rist_sender_tx_item item = w->queue[head];
+		struct rist_buffer *buffer = item.buffer;
+		bool drop = skip && (item.peer == skip || item.peer->parent == skip);
+		if (RIST_UNLIKELY(buffer->size > RIST_MAX_PACKET_SIZE)) {
+			rist_log_priv(&w->ctx->common, RIST_LOG_ERROR, "Transmit worker %zu cannot send a %zu byte packet\n", w->index, buffer->size);
+			drop = true;
+		}
+		uint8_t *payload = &w->scratch[count * RIST_TX_WORKER_SLOT_SIZE + RIST_MAX_PAYLOAD_OFFSET];
+		size_t size = buffer->size;
+		uint16_t seq_rtp = buffer->seq_rtp;
+		uint8_t type = buffer->type;
+		if (!drop)
+			memcpy(payload, (uint8_t *)buffer->data + RIST_MAX_PAYLOAD_OFFSET, size);
+		atomic_fetch_sub_explicit(&buffer->tx_refs, 1, memory_order_release);
+		head = (head + 1) & (RIST_SENDER_TX_QUEUE_SIZE - 1);
+		atomic_store_explicit(&w->queue_head, head, memory_order_release);
+		if (drop)
+			continue;
+		rist_send_seq_rtcp(item.peer, seq_rtp, type, payload, size, item.source_time, item.src_port, item.dst_port, item.retry);
+		count++;
+	}
+	rist_tx_batch_flush_batch(w->tx_batch, &w->ctx->common);
+	return true;
+}
+
+static PTHREAD_START_FUNC(sender_pthread_tx_worker, arg)
+{
+	struct rist_sender_tx_worker *w = (struct rist_sender_tx_worker *)arg;
+	struct rist_sender *ctx = w->ctx;
+
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Starting transmit worker %zu\n", w->index);
+
+	while (!atomic_load_explicit(&ctx->common.shutdown, memory_order_acquire)) {
+		pthread_mutex_lock(&w->busy);
+		while (sender_tx_worker_run(w, NULL))
+			;
+		pthread_mutex_unlock(&w->busy);
+
+		pthread_mutex_lock(&w->lock);
+		atomic_store(&w->sleeping, true);
+		if (atomic_load(&w->queue_tail) == atomic_load_explicit(&w->queue_head, memory_order_relaxed))
+			pthread_cond_timedwait_ms(&w->condition, &w->lock, RIST_MAX_IDLE_WAIT);
+		atomic_store(&w->sleeping, false);
+		pthread_mutex_unlock(&w->lock);
+	}
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Exiting transmit worker %zu\n", w->index);
 	return 0;
 }
 
-void rist_sender_send_data_balanced(struct rist_sender *ctx, struct rist_buffer *buffer)
+/* A data peer goes to the worker with the fewest peers, caller holds peerlist_lock */
+static void sender_tx_worker_attach(struct rist_sender *ctx, struct rist_peer *peer)
+{
+	struct rist_sender_tx_worker *w = &ctx->tx_workers[0];
+	for (uint32_t i = 1; i < ctx->tx_worker_count; i++) {
+		if (ctx->tx_workers[i].peer_count < w->peer_count)
+			w = &ctx->tx_workers[i];
+	}
+	w->peer_count++;
+	peer->tx_worker = w;
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Peer %"PRIu32" assigned to transmit worker %zu\n", peer->adv_peer_id, w->index);
+}
+
+/* Caller holds peerlist_lock, sends what is queued for the other peers of the worker and
+ * drops the rest before the peer is freed */
+void rist_sender_tx_workers_forget_peer(struct rist_sender *ctx, struct rist_peer *peer)
+{
+	RIST_MARK_UNUSED(ctx);
+	struct rist_sender_tx_worker *w = rist_peer_tx_worker(peer);
+	if (!w)
+		return;
+	pthread_mutex_lock(&w->busy);
+	while (sender_tx_worker_run(w, peer))
+		;
+	if (peer->tx_worker == w) {
+		peer->tx_worker = NULL;
+		w->peer_count--;
+	}
+	pthread_mutex_unlock(&w->busy);
+}
+
+int rist_sender_tx_workers_start(struct rist_sender *ctx)
+{
+	if (ctx->tx_worker_count == 0)
+		return 0;
+	ctx->tx_workers = calloc(ctx->tx_worker_count, sizeof(*ctx->tx_workers));
+	if (!ctx->tx_workers)
+		return -1;
+	for (uint32_t i = 0; i < ctx->tx_worker_count; i++) {
+		struct rist_sender_tx_worker *w = &ctx->tx_workers[i];
+		w->ctx = ctx;
+		w->index = i;
+		atomic_init(&w->queue_head, 0);
+		atomic_init(&w->queue_tail, 0);
+		atomic_init(&w->sleeping, false);
+		w->queue = calloc(RIST_SENDER_TX_QUEUE_SIZE, sizeof(*w->queue));
+		w->scratch = malloc(RIST_TX_BATCH_SIZE * RIST_TX_WORKER_SLOT_SIZE);
+		w->tx_batch = rist_tx_batch_create();
+		if (!w->queue || !w->scratch || pthread_mutex_init(&w->lock, NULL) != 0 || pthread_mutex_init(&w->busy, NULL) != 0
+			|| pthread_cond_init(&w->condition, NULL) != 0) {
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not initialize transmit worker %u\n", i);
+			return -1;
+		}
+		if (rist_thread_create(&ctx->common, &w->thread, NULL, sender_pthread_tx_worker, (void *)w) != 0) {
+			rist_log_priv(&ctx->common, RIST_LOG_ERROR, "Could not start transmit worker %u\n", i);
+			return -1;
+		}
+		w->thread_running = true;
+	}
+	rist_log_priv(&ctx->common, RIST_LOG_INFO, "Started %u transmit worker threads\n", ctx->tx_worker_count);
+	return 0;
+}
+
+/* Joins the workers after the peers are gone, what is still queued is dropped */
+void rist_sender_tx_workers_stop(struct rist_sender *ctx)
+{
+	if (!ctx->tx_workers)
+		return;
+	for (uint32_t i = 0; i < ctx->tx_worker_count; i++) {
+		struct rist_sender_tx_worker *w = &ctx->tx_workers[i];
+		if (w->thread_running) {
+			pthread_mutex_lock(&w->lock);
+			pthread_cond_signal(&w->condition);
+			pthread_mutex_unlock(&w->lock);
+			pthread_join(w->thread, NULL);
+		}
+	}
+	for (uint32_t i = 0; i < ctx->tx_worker_count; i++) {
+		struct rist_sender_tx_worker *w = &ctx->tx_workers[i];
+		if (w->queue) {
+			size_t head = atomic_load_explicit(&w->queue_head, memory_order_relaxed);
+			size_t tail = atomic_load_explicit(&w->queue_tail, memory_order_acquire);
+			for (; head != tail; head = (head + 1) & (RIST_SENDER_TX_QUEUE_SIZE - 1))
+				atomic_fetch_sub_explicit(&w->queue[head].buffer->tx_refs, 1, memory_order_release);
+			pthread_mutex_destroy(&w->lock);
+			pthread_mutex_destroy(&w->busy);
+			pthread_cond_destroy(&w->condition);
+		}
+		rist_tx_batch_destroy(w->tx_batch);
+		free(w->scratch);
+		free(w->queue);
+	}
+	free(ctx->tx_workers);
+	ctx->tx_workers = NULL;
+}
+
+/* Data for a peer with a transmit worker is handed to it, everything else goes out right here */
+static void rist_sender_send_peer(struct rist_sender *ctx, struct rist_peer *peer, struct rist_buffer *buffer, uint64_t now)
+{
+	struct rist_peer *owner = peer->parent ? peer->parent : peer;
+	if (ctx->tx_workers && !owner->tx_worker)
+		sender_tx_worker_attach(ctx, owner);
+	if (!owner->tx_worker) {
+		uint8_t *payload = buffer->data;
+		rist_send_common_rtcp(peer, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, buffer->src_port, buffer->dst_port, buffer->seq_rtp);
+		return;
+	}
+	// Same defaults as rist_send_common_rtcp
+	uint16_t src_port = buffer->src_port ? buffer->src_port : (uint16_t)(32768 + peer->adv_peer_id);
+	uint16_t dst_port = buffer->dst_port ? buffer->dst_port : peer->config.virt_dst_port;
+	uint64_t source_time = buffer->source_time;
+	if (RIST_UNLIKELY(peer->config.timing_mode == RIST_TIMING_MODE_ARRIVAL))
+		source_time = now;
+	if (peer->sd < 0 || !peer->address_len) {
+		rist_log_priv(&ctx->common, RIST_LOG_ERROR, "rist_sender_send_peer failed\n");
+		return;
+	}
+	if (buffer->type == RIST_PAYLOAD_TYPE_DATA_RAW && (ctx->common.oob_current_peer == NULL || ctx->common.oob_current_peer->dead))
+		ctx->common.oob_current_peer = peer;
+	if (sender_tx_worker_post(owner->tx_worker, peer, buffer, source_time, src_port, dst_port, false))
+		rist_calculate_bitrate(buffer->size, &peer->bw, now);
+}
+
+void rist_sender_send_data_balanced(struct rist_sender *ctx, struct rist_buffer *buffer, uint64_t now)
 {
 	struct rist_peer *peer;
 	struct rist_peer *selected_peer_by_weight = NULL;
@@ -678,7 +1555,6 @@ void rist_sender_send_data_balanced(struct rist_sender *ctx, struct rist_buffer
 
 	//We can do it safely here, since this function is only to be called once per packet
 	buffer->seq = ctx->common.seq++;
-	uint64_t now = timestampNTP_u64();
 
 peer_select:
 
@@ -719,14 +1595,12 @@ peer_select:
 					} else
 #endif
 					if (child->authenticated && child->is_data && (!child->dead || (child->dead && (child->dead_since + peer->recovery_buffer_ticks) < now))) {
-						uint8_t *payload = buffer->data;
-						rist_send_common_rtcp(child, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, buffer->src_port, buffer->dst_port, buffer->seq_rtp);
+						rist_sender_send_peer(ctx, child, buffer, now);
 					}
 					child = child->sibling_next;
 				}
 			} else if (!peer->dead || (peer->dead && (peer->dead_since + peer->recovery_buffer_ticks) < now)) {
-				uint8_t *payload = buffer->data;
-				rist_send_common_rtcp(peer, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, buffer->src_port, buffer->dst_port, buffer->seq_rtp);
+				rist_sender_send_peer(ctx, peer, buffer, now);
 			}
 		} else {
 			/* Election of next peer */
@@ -751,14 +1625,12 @@ peer_select:
 					} else
 #endif
 				if (child->authenticated && child->is_data && (!child->dead || (child->dead && (child->dead_since + peer->recovery_buffer_ticks) < now))) {
-					uint8_t *payload = buffer->data;
-					rist_send_common_rtcp(child, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, buffer->src_port, buffer->dst_port,  buffer->seq_rtp);
+					rist_sender_send_peer(ctx, child, buffer, now);
 				}
 				child = child->sibling_next;
 			}
 		} else if (!peer->dead || (peer->dead && (peer->dead_since + peer->recovery_buffer_ticks) < now)) {
-			uint8_t *payload = buffer->data;
-			rist_send_common_rtcp(peer, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, buffer->src_port, buffer->dst_port, buffer->seq_rtp);
+			rist_sender_send_peer(ctx, peer, buffer, now);
 		}
 		ctx->weight_counter--;
 		peer->w_count--;
@@ -775,6 +1647,78 @@ peer_select:
 	}
 }
 
+static void rist_sender_send_fec_peer(struct rist_peer *p, struct rist_fec_packet *pkt, uint64_t now)
+{
+	if (!p->authenticated || !p->is_data || p->dead || p->rist_gre_version < 2 || p->sd < 0 || !p->address_len)
+		return;
+#if HAVE_SRP_SUPPORT
+	if (!eap_is_authenticated(p->eap_ctx))
+		return;
+#endif
+	uint16_t src_port = pkt->src_port ? pkt->src_port : 32768 + p->adv_peer_id;
+	uint16_t dst_port = pkt->dst_port ? pkt->dst_port : p->config.virt_dst_port;
+	struct rist_rtp_hdr *rtp = (struct rist_rtp_hdr *)pkt->data;
+	rtp->ssrc = htobe32(p->adv_flow_id);
+	ssize_t ret = _librist_proto_gre_send_data(p, 0, RIST_VSF_PROTOCOL_SUBTYPE_FEC, pkt->data, pkt->len, src_port, dst_port, p->rist_gre_version);
+	if (ret > 0)
+		rist_calculate_bitrate((size_t)ret, &p->bw, now);
+}
+
+/* Called from the protocol thread as it sends a queued data packet. Parity covers the payload
+ * as the application handed it over, which is what the receiver has in its queue after
+ * undoing compression and null packet deletion */
+void rist_sender_fec_add(struct rist_sender *ctx, struct rist_buffer *buffer)
+{
+	uint8_t *payload = (uint8_t *)buffer->data + RIST_MAX_PAYLOAD_OFFSET;
+	size_t len = buffer->size;
+	if (buffer->type == RIST_PAYLOAD_TYPE_DATA_RAW_RTP_EXT) {
+		struct rist_rtp_hdr_ext *hdr_ext = (struct rist_rtp_hdr_ext *)payload;
+		if (len < sizeof(*hdr_ext))
+			return;
+		payload += sizeof(*hdr_ext);
+		len -= sizeof(*hdr_ext);
+		if (CHECK_BIT(hdr_ext->flags, RIST_RTP_EXT_FLAG_LZ4)) {
+			int decompressed_len = LZ4_decompress_safe((const char *)payload, (char *)ctx->fec_buf,
+				(int)len, (int)sizeof(ctx->fec_buf));
+			if (decompressed_len < 0)
+				return;
+			payload = ctx->fec_buf;
+			len = (size_t)decompressed_len;
+		}
+		if (CHECK_BIT(hdr_ext->flags, RIST_RTP_EXT_FLAG_NPD)) {
+			// Expanded in place, the queued buffer has to stay as it goes out
+			if (payload != ctx->fec_buf) {
+				memcpy(ctx->fec_buf, payload, len);
+				payload = ctx->fec_buf;
+			}
+			if (expand_null_packets(payload, &len, hdr_ext->npd_bits) < 0)
+				return;
+		}
+	}
+	rist_fec_encoder_add(&ctx->fec, buffer->seq_rtp, timestampRTP_u32(0, buffer->source_time), payload, len, buffer->src_port, buffer->dst_port);
+}
+
+/* Parity goes to every data peer whatever the weights, the receiver merges the flow back
+ * together and skips the copies it already holds */
+void rist_sender_send_fec(struct rist_sender *ctx, uint64_t now)
+{
+	if (ctx->common.profile == RIST_PROFILE_SIMPLE)
+		return;
+	struct rist_fec_packet pkt;
+	while (rist_fec_encoder_pop(&ctx->fec, ctx->fec_sent_seq, &pkt)) {
+		for (struct rist_peer *peer = ctx->common.PEERS; peer; peer = peer->next) {
+			if (!peer->is_data || peer->parent)
+				continue;
+			if (peer->listening) {
+				for (struct rist_peer *child = peer->child; child; child = child->sibling_next)
+					rist_sender_send_fec_peer(child, &pkt, now);
+			} else
+				rist_sender_send_fec_peer(peer, &pkt, now);
+		}
+		free(pkt.data);
+	}
+}
+
 static size_t rist_sender_index_get(struct rist_sender *ctx, uint32_t seq)
 {
 	size_t idx = ctx->seq_index[(uint16_t)seq];
@@ -789,7 +1733,7 @@ size_t rist_get_sender_retry_queue_size(struct rist_sender *ctx)
 }
 
 /* This function must return, 0 when there is nothing to send, < 0 on error and > 0 for bytes sent */
-ssize_t rist_retry_dequeue(struct rist_sender *ctx)
+ssize_t rist_retry_dequeue(struct rist_sender *ctx, uint64_t now)
 {
 	size_t sender_retry_queue_read_index = (ctx->sender_retry_queue_read_index + 1)& (ctx->sender_retry_queue_size -1);
 
@@ -804,23 +1748,23 @@ ssize_t rist_retry_dequeue(struct rist_sender *ctx)
 	// the one on that buffer position and it does not match
 
 	size_t idx = rist_sender_index_get(ctx, retry->seq);
-	if (RIST_UNLIKELY(ctx->sender_queue[idx] == NULL)) {
+	if (RIST_UNLIKELY(rist_sender_queue_get(ctx, idx) == NULL)) {
 		rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
 			" Couldn't find block %" PRIu32 " (i=%zu/r=%zu/w=%zu/d=%zu/rs=%zu), consider increasing the buffer size\n",
 			retry->seq, idx, atomic_load_explicit(&ctx->sender_queue_read_index, memory_order_acquire), atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_acquire), ctx->sender_queue_delete_index,
 			rist_get_sender_retry_queue_size(ctx));
 		retry->peer->stats_sender_instant.retrans_skip++;
 		return -1;
-	} else if (RIST_UNLIKELY((uint16_t)retry->seq != ctx->sender_queue[idx]->seq_rtp)) {
+	} else if (RIST_UNLIKELY((uint16_t)retry->seq != rist_sender_queue_get(ctx, idx)->seq_rtp)) {
 		rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
 			" Couldn't find block %" PRIu16 " (i=%zu/r=%zu/w=%zu/d=%zu/rs=%zu), found an old one instead %" PRIu32 " (%" PRIu64 "), bitrate is too high\n",
 			(uint16_t)retry->seq, idx, atomic_load_explicit(&ctx->sender_queue_read_index, memory_order_acquire), atomic_load_explicit(&ctx->sender_queue_write_index, memory_order_acquire), ctx->sender_queue_delete_index,
-			rist_get_sender_retry_queue_size(ctx), ctx->sender_queue[idx]->seq_rtp, ctx->sender_queue_max);
+			rist_get_sender_retry_queue_size(ctx), rist_sender_queue_get(ctx, idx)->seq_rtp, ctx->sender_queue_max);
 		retry->peer->stats_sender_instant.retrans_skip++;
 		return -1;
 	}
 	/* we're consuming the retry for an existing buffer, set it to false to allow new retries to come in */
-	ctx->sender_queue[idx]->retry_queued = false;
+	rist_sender_queue_get(ctx, idx)->retry_queued = false;
 	retry->active = false;
 
 	// TODO: re-enable rist_send_data_allowed (cooldown feature)
@@ -832,8 +1776,8 @@ ssize_t rist_retry_dequeue(struct rist_sender *ctx)
 		retry_bw = &retry->peer->peer_data->retry_bw;
 	}
 	// update bandwidth values
-	rist_calculate_bitrate(0, cli_bw);
-	rist_calculate_bitrate(0, retry_bw);
+	rist_calculate_bitrate(0, cli_bw, now);
+	rist_calculate_bitrate(0, retry_bw, now);
 
 	// Make sure we do not flood the network with retries
 	size_t current_bitrate = 0;
@@ -859,9 +1803,8 @@ ssize_t rist_retry_dequeue(struct rist_sender *ctx)
 	}
 
 	// Check buffer element age
-	uint64_t now = timestampNTP_u64();
 	/* queue_time holds the original insertion time for this seq */
-	uint64_t data_age = (now - ctx->sender_queue[idx]->time) / RIST_CLOCK;
+	uint64_t data_age = (now - rist_sender_queue_get(ctx, idx)->time) / RIST_CLOCK;
 	uint64_t retry_age = (now - retry->insert_time) / RIST_CLOCK;
 	if (RIST_UNLIKELY(retry_age > retry->peer->config.recovery_length_max)) {
 		rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
@@ -872,7 +1815,7 @@ ssize_t rist_retry_dequeue(struct rist_sender *ctx)
 		return -1;
 	}
 
-	struct rist_buffer *buffer = ctx->sender_queue[idx];
+	struct rist_buffer *buffer = rist_sender_queue_get(ctx, idx);
 	if (ctx->common.debug)
 		rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
 			"Resending %"PRIu32"/%"PRIu32"/%"PRIu16" (idx %zu) after %" PRIu64
@@ -894,9 +1837,14 @@ ssize_t rist_retry_dequeue(struct rist_sender *ctx)
 	uint16_t src_port = buffer->src_port;
 	if (src_port == 0)
 		src_port = 32768 + retry->peer->peer_data->adv_peer_id;
-	ret = (size_t)rist_send_seq_rtcp(retry->peer->peer_data, buffer->seq_rtp, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, src_port, (retry->peer->peer_data->config.virt_dst_port & ~1UL), true);
+	uint16_t dst_port = (uint16_t)(retry->peer->peer_data->config.virt_dst_port & ~1UL);
+	struct rist_sender_tx_worker *w = rist_peer_tx_worker(retry->peer->peer_data);
+	if (w)
+		ret = sender_tx_worker_post(w, retry->peer->peer_data, buffer, buffer->source_time, src_port, dst_port, true) ? buffer->size : 0;
+	else
+		ret = (size_t)rist_send_seq_rtcp(retry->peer->peer_data, buffer->seq_rtp, buffer->type, &payload[RIST_MAX_PAYLOAD_OFFSET], buffer->size, buffer->source_time, src_port, dst_port, true);
 	// update bandwidth value
-	rist_calculate_bitrate(ret, retry_bw);
+	rist_calculate_bitrate(ret, retry_bw, now);
 
 	if (ret < buffer->size) {
 		rist_log_priv(&ctx->common, RIST_LOG_ERROR,
@@ -913,11 +1861,42 @@ ssize_t rist_retry_dequeue(struct rist_sender *ctx)
 	return ret;
 }
 
-void rist_retry_enqueue(struct rist_sender *ctx, uint32_t seq, struct rist_peer *peer)
+static inline size_t rist_retry_hash(struct rist_sender *ctx, uint32_t seq, struct rist_peer *peer)
+{
+	// Consecutive seqs of one peer land in consecutive buckets
+	uint32_t h = seq ^ ((uint32_t)((uintptr_t)peer >> 4) * 2654435761u);
+	return h & (ctx->sender_retry_queue_size - 1);
+}
+
+/* Newest queued retry of seq for peer inserted after not_before (or the first one past it),
+ * same answer as walking the retry queue backwards but only visiting entries of its bucket */
+static struct rist_retry *rist_retry_lookup(struct rist_sender *ctx, uint32_t seq, struct rist_peer *peer, uint64_t not_before)
+{
+	size_t mask = ctx->sender_retry_queue_size - 1;
+	size_t hash = rist_retry_hash(ctx, seq, peer);
+	size_t index = ctx->sender_retry_index[hash];
+	size_t age = 0;
+	while (index != SIZE_MAX) {
+		// Chains only go back in time, a slot that got reused since it was linked is newer
+		// than the entry pointing to it (or belongs to another bucket) and ends the chain
+		size_t index_age = (ctx->sender_retry_queue_write_index - index) & mask;
+		if (index_age <= age)
+			break;
+		struct rist_retry *lookup = &ctx->sender_retry_queue[index];
+		if (lookup->seq == seq && lookup->peer == peer)
+			return lookup;
+		if (rist_retry_hash(ctx, lookup->seq, lookup->peer) != hash || lookup->insert_time < not_before)
+			break;
+		age = index_age;
+		index = lookup->hash_next;
+	}
+	return NULL;
+}
+
+void rist_retry_enqueue(struct rist_sender *ctx, uint32_t seq, struct rist_peer *peer, uint64_t now)
 {
-	uint64_t now = timestampNTP_u64();
 	size_t idx = rist_sender_index_get(ctx, seq);
-	struct rist_buffer *buffer = ctx->sender_queue[idx];
+	struct rist_buffer *buffer = rist_sender_queue_get(ctx, idx);
 	struct rist_retry *retry;
 
 	// Even though all the checks are on the dequeue function, we leave one here
@@ -954,8 +1933,10 @@ void rist_retry_enqueue(struct rist_sender *ctx, uint32_t seq, struct rist_peer
 					seq, age_ticks / RIST_CLOCK, peer->config.recovery_rtt_min / RIST_CLOCK, peer->adv_peer_id);
 		} else if (ctx->peer_lst_len == 1) {
 			/* there is a retry outstanding for this buffer, no need to add another */
-			if (buffer->retry_queued)
+			if (buffer->retry_queued) {
+				peer->stats_sender_instant.duplicate_skip++;
 				return;
+			}
 			// Only one peer (faster algorithm with no lookups)
 			if (buffer->last_retry_request != 0)
 			{
@@ -994,31 +1975,24 @@ void rist_retry_enqueue(struct rist_sender *ctx, uint32_t seq, struct rist_peer
 		} else {
 			// Multiple peers, we need to search for other retries in the queue for comparison
 			uint64_t delta = 0;
-			//We work backwards from the write index till we either find a retry with same peer & seq
-			//or it's too old to matter,looking up to 8 RTT's ago (4 in normal mode, 8 in aggressive)
-			size_t index = (ctx->sender_retry_queue_write_index -1) & (ctx->sender_retry_queue_size -1);
+			//We follow the index chain of this (peer, seq) bucket from the newest entry till we either
+			//find a retry with same peer & seq or it's too old to matter, looking up to 8 RTT's ago
+			//(4 in normal mode, 8 in aggressive)
 			uint64_t rtt = peer->last_rtt;
 			if (peer->config.recovery_length_min > rtt)
 				rtt = peer->config.recovery_length_min;
 			// Aggressive congestion control only allows every two RTTs
 			if (peer->config.congestion_control_mode == RIST_CONGESTION_CONTROL_MODE_AGGRESSIVE)
 				rtt *= 2;
-			struct rist_retry *lookup = NULL;
 			uint64_t search_period = rtt * 4;
-			while (index != ctx->sender_retry_queue_write_index) {
-				lookup = &ctx->sender_retry_queue[index];
-				if (lookup->seq == seq && lookup->peer == peer)
-					break;
-				if (lookup->insert_time < (now - search_period))
-					break;
-				index = (index -1 ) & (ctx->sender_retry_queue_size -1);
-			}
-			retry = &ctx->sender_retry_queue[index];
-			if (retry->seq == seq && retry->peer == peer) {
+			retry = rist_retry_lookup(ctx, seq, peer, now - search_period);
+			if (retry) {
 				delta = (now - retry->insert_time);
 				/* this retry hasn't been handled yet, it makes no sense to insert a duplicate */
-				if (retry->active)
+				if (retry->active) {
+					peer->stats_sender_instant.duplicate_skip++;
 					return;
+				}
 				if (delta < rtt)
 				{
 					rist_log_priv(&ctx->common, RIST_LOG_DEBUG,
@@ -1042,6 +2016,9 @@ void rist_retry_enqueue(struct rist_sender *ctx, uint32_t seq, struct rist_peer
 	retry->peer = peer;
 	retry->insert_time = now;
 	retry->active = true;
+	size_t *bucket = &ctx->sender_retry_index[rist_retry_hash(ctx, seq, peer)];
+	retry->hash_next = *bucket;
+	*bucket = ctx->sender_retry_queue_write_index;
 	if (++ctx->sender_retry_queue_write_index >= ctx->sender_retry_queue_size) {
 		ctx->sender_retry_queue_write_index = 0;
 	}
@@ -0,0 +1,353 @@
+/* librist. Copyright © 2020 SipRadius LLC. All right reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Loopback benchmark: one sender and one receiver context in this process, the
+ * sender writes stamped payloads at a fixed packet rate and the receiver reads
+ * them back. Reports throughput, process CPU time per packet and end to end
+ * latency percentiles as a single JSON object. The sender output can be run
+ * through the impairment (rist_impairment_set) to measure recovery. */
+
+#include "librist/librist.h"
+#include "pthread-shim.h"
+#include "time-shim.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define BENCH_MAX_PEERS (8)
+#define BENCH_STAMP_SIZE (16)
+
+struct bench_config {
+	int profile;
+	uint32_t rate;
+	uint32_t payload_size;
+	uint32_t duration;
+	uint32_t warmup;
+	uint32_t peers;
+	int aes;
+	uint32_t buffer;
+	uint32_t port;
+	uint32_t tx_threads;
+	uint32_t rx_threads;
+	const char *json;
+	/* Applied to what the sender sends */
+	struct rist_impairment_config impairment;
+};
+
+struct bench_state {
+	struct bench_config cfg;
+	struct rist_ctx *sender;
+	struct rist_ctx *receiver;
+	atomic_ulong stop;
+	/* Written by the send thread, read after it is joined */
+	uint64_t sent;
+	uint64_t write_errors;
+	uint64_t window_start;
+	uint64_t window_end;
+	uint64_t cpu_start;
+	uint64_t cpu_end;
+	/* Receive side, main thread only */
+	uint64_t received;
+	uint64_t latency_count;
+	uint32_t *latency_us;
+};
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* CPU time of the whole process, sender and receiver threads together */
+static uint64_t bench_cpu_ns(void)
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+	struct timespec ts;
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0)
+		return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+	return 0;
+}
+
+static int bench_parse_args(struct bench_config *cfg, int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = strchr(arg, '=');
+		if (strncmp(arg, "--", 2) != 0 || !value) {
+			fprintf(stderr, "Unknown argument %s\n", arg);
+			return -1;
+		}
+		size_t key_len = (size_t)(value - arg) - 2;
+		const char *key = arg + 2;
+		value++;
+#define BENCH_KEY(name) (key_len == strlen(name) && strncmp(key, name, key_len) == 0)
+		if (BENCH_KEY("profile"))
+			cfg->profile = atoi(value);
+		else if (BENCH_KEY("rate"))
+			cfg->rate = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("size"))
+			cfg->payload_size = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("duration"))
+			cfg->duration = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("warmup"))
+			cfg->warmup = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("peers"))
+			cfg->peers = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("aes"))
+			cfg->aes = atoi(value);
+		else if (BENCH_KEY("buffer"))
+			cfg->buffer = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("port"))
+			cfg->port = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("tx-threads"))
+			cfg->tx_threads = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("rx-threads"))
+			cfg->rx_threads = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("json"))
+			cfg->json = value;
+		else if (BENCH_KEY("seed"))
+			cfg->impairment.seed = strtoull(value, NULL, 10);
+		else if (BENCH_KEY("loss-model"))
+			cfg->impairment.loss_model = (enum rist_impairment_loss_model)atoi(value);
+		else if (BENCH_KEY("loss"))
+			cfg->impairment.loss = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("loss-bad"))
+			cfg->impairment.loss_bad = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("good-to-bad"))
+			cfg->impairment.good_to_bad = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("bad-to-good"))
+			cfg->impairment.bad_to_good = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("duplicate"))
+			cfg->impairment.duplicate = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("reorder"))
+			cfg->impairment.reorder = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("reorder-delay"))
+			cfg->impairment.reorder_delay = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("delay"))
+			cfg->impairment.delay = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("jitter"))
+			cfg->impairment.jitter = (uint32_t)strtoul(value, NULL, 10);
+		else if (BENCH_KEY("rate-cap"))
+			cfg->impairment.rate = (uint32_t)strtoul(value, NULL, 10);
+		else {
+			fprintf(stderr, "Unknown argument %s\n", arg);
+			return -1;
+		}
+#undef BENCH_KEY
+	}
+	if (cfg->impairment.loss_model == RIST_IMPAIRMENT_LOSS_NONE && cfg->impairment.loss)
+		cfg->impairment.loss_model = RIST_IMPAIRMENT_LOSS_BERNOULLI;
+	if (cfg->profile < RIST_PROFILE_SIMPLE || cfg->profile > RIST_PROFILE_ADVANCED || cfg->rate == 0
+		|| cfg->payload_size < BENCH_STAMP_SIZE || cfg->payload_size > 1500 || cfg->duration == 0
+		|| cfg->peers == 0 || cfg->peers > BENCH_MAX_PEERS || (cfg->aes != 0 && cfg->aes != 128 && cfg->aes != 256)) {
+		fprintf(stderr, "Invalid benchmark configuration\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* Every peer of the sender gets all packets (weight 0), the receiver merges them like 2022-7 */
+static int bench_add_peer(struct rist_ctx *ctx, const struct bench_config *cfg, bool listen, uint32_t index)
+{
+	char url[256];
+	// Room for the stream plus retransmits, the default would cap fast runs
+	uint64_t bandwidth = (uint64_t)cfg->rate * (cfg->payload_size + 64) * 8 / 1000 * 2 + 1000;
+	int len = snprintf(url, sizeof(url), "rist://%s127.0.0.1:%u?buffer=%u&bandwidth=%"PRIu64"&weight=0",
+			listen ? "@" : "", cfg->port + 2 * index, cfg->buffer, bandwidth);
+	if (cfg->aes)
+		snprintf(url + len, sizeof(url) - (size_t)len, "&secret=benchmark-secret&aes-type=%d", cfg->aes);
+
+	struct rist_peer_config *peer_config = NULL;
+	if (rist_parse_address2(url, (void *)&peer_config))
+		return -1;
+	struct rist_peer *peer;
+	int ret = rist_peer_create(ctx, &peer, peer_config);
+	free((void *)peer_config);
+	return ret;
+}
+
+static PTHREAD_START_FUNC(bench_send, arg)
+{
+	struct bench_state *s = arg;
+	const struct bench_config *cfg = &s->cfg;
+	uint8_t *payload = calloc(1, cfg->payload_size);
+	if (!payload) {
+		atomic_store(&s->stop, 1);
+		return 0;
+	}
+	struct rist_data_block block = { 0 };
+	block.payload = payload;
+	block.payload_len = cfg->payload_size;
+
+	uint64_t warmup_packets = (uint64_t)cfg->rate * cfg->warmup;
+	uint64_t total = warmup_packets + (uint64_t)cfg->rate * cfg->duration;
+	uint64_t start = bench_now_ns();
+	uint64_t seq = 0;
+	while (seq < total && !atomic_load(&s->stop)) {
+		// Catch up with the schedule, then sleep for a millisecond
+		uint64_t due = (bench_now_ns() - start) * cfg->rate / 1000000000ULL;
+		while (seq < due && seq < total) {
+			uint64_t now = bench_now_ns();
+			if (seq == warmup_packets) {
+				s->window_start = now;
+				s->cpu_start = bench_cpu_ns();
+			}
+			memcpy(payload, &seq, sizeof(seq));
+			memcpy(payload + sizeof(seq), &now, sizeof(now));
+			if (rist_sender_data_write(s->sender, &block) < 0)
+				s->write_errors++;
+			seq++;
+		}
+		usleep(1000);
+	}
+	s->window_end = bench_now_ns();
+	s->cpu_end = bench_cpu_ns();
+	s->sent = seq;
+	free(payload);
+
+	// Whatever is still in flight comes out one buffer later
+	usleep((cfg->buffer + 1000) * 1000);
+	atomic_store(&s->stop, 1);
+	return 0;
+}
+
+static int bench_compare_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t bench_percentile(const struct bench_state *s, double p)
+{
+	if (s->latency_count == 0)
+		return 0;
+	uint64_t idx = (uint64_t)(p * (double)(s->latency_count - 1) + 0.5);
+	return s->latency_us[idx];
+}
+
+static void bench_report(struct bench_state *s)
+{
+	const struct bench_config *cfg = &s->cfg;
+	uint64_t warmup_packets = (uint64_t)cfg->rate * cfg->warmup;
+	uint64_t measured_sent = s->sent > warmup_packets ? s->sent - warmup_packets : 0;
+	double window = s->window_end > s->window_start ? (double)(s->window_end - s->window_start) / 1e9 : 0;
+	double pps = window > 0 ? (double)s->received / window : 0;
+	double cpu_per_packet = -1;
+	if (s->cpu_end > s->cpu_start && measured_sent > 0)
+		cpu_per_packet = (double)(s->cpu_end - s->cpu_start) / 1000.0 / (double)measured_sent;
+	qsort(s->latency_us, s->latency_count, sizeof(*s->latency_us), bench_compare_u32);
+
+	FILE *out = stdout;
+	if (cfg->json && !(out = fopen(cfg->json, "w"))) {
+		fprintf(stderr, "Could not open %s\n", cfg->json);
+		out = stdout;
+	}
+	fprintf(out, "{\"benchmark\": \"send_receive\", \"profile\": %d, \"rate\": %u, \"payload_size\": %u, "
+			"\"duration_s\": %u, \"peers\": %u, \"aes\": %d, \"buffer_ms\": %u, \"tx_threads\": %u, \"rx_threads\": %u, "
+			"\"sent\": %"PRIu64", \"received\": %"PRIu64", \"lost\": %"PRIu64", \"write_errors\": %"PRIu64", "
+			"\"packets_per_second\": %.1f, \"mbps\": %.2f, \"cpu_us_per_packet\": %.3f, "
+			"\"latency_us\": {\"min\": %u, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}, "
+			"\"impairment\": {\"seed\": %"PRIu64", \"loss_model\": %d, \"loss_ppm\": %u, \"loss_bad_ppm\": %u, "
+			"\"duplicate_ppm\": %u, \"reorder_ppm\": %u, \"delay_ms\": %u, \"jitter_ms\": %u, \"rate_kbps\": %u}}\n",
+			cfg->profile, cfg->rate, cfg->payload_size, cfg->duration, cfg->peers, cfg->aes, cfg->buffer,
+			cfg->tx_threads, cfg->rx_threads, measured_sent, s->received,
+			measured_sent > s->received ? measured_sent - s->received : 0, s->write_errors,
+			pps, pps * cfg->payload_size * 8 / 1e6, cpu_per_packet,
+			bench_percentile(s, 0.0), bench_percentile(s, 0.5), bench_percentile(s, 0.9),
+			bench_percentile(s, 0.99), bench_percentile(s, 0.999), bench_percentile(s, 1.0),
+			cfg->impairment.seed, (int)cfg->impairment.loss_model, cfg->impairment.loss, cfg->impairment.loss_bad,
+			cfg->impairment.duplicate, cfg->impairment.reorder, cfg->impairment.delay, cfg->impairment.jitter,
+			cfg->impairment.rate);
+	if (out != stdout)
+		fclose(out);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_state s;
+	memset(&s, 0, sizeof(s));
+	s.cfg.profile = RIST_PROFILE_MAIN;
+	s.cfg.rate = 10000;
+	s.cfg.payload_size = 1316;
+	s.cfg.duration = 5;
+	s.cfg.warmup = 1;
+	s.cfg.peers = 1;
+	s.cfg.buffer = 200;
+	s.cfg.port = 8000;
+	atomic_init(&s.stop, 0);
+	if (bench_parse_args(&s.cfg, argc, argv) != 0)
+		return 99;
+	const struct bench_config *cfg = &s.cfg;
+
+	int ret = 99;
+	struct rist_logging_settings *logging_settings = NULL;
+	if (rist_logging_set(&logging_settings, RIST_LOG_ERROR, NULL, NULL, NULL, stderr) != 0)
+		return 99;
+	s.latency_us = malloc(((size_t)cfg->rate * cfg->duration + 1) * sizeof(*s.latency_us));
+	if (!s.latency_us)
+		goto out;
+
+	if (rist_receiver_create(&s.receiver, cfg->profile, logging_settings) != 0
+		|| rist_sender_create(&s.sender, cfg->profile, 0, logging_settings) != 0)
+		goto out;
+	if (cfg->rx_threads && rist_receiver_set_worker_threads(s.receiver, cfg->rx_threads) != 0)
+		goto out;
+	if (cfg->tx_threads && rist_sender_set_transmit_threads(s.sender, cfg->tx_threads) != 0)
+		goto out;
+	for (uint32_t i = 0; i < cfg->peers; i++) {
+		if (bench_add_peer(s.receiver, cfg, true, i) != 0 || bench_add_peer(s.sender, cfg, false, i) != 0) {
+			fprintf(stderr, "Could not create peer %u\n", i);
+			goto out;
+		}
+	}
+	if (rist_impairment_set(s.sender, &cfg->impairment) != 0)
+		goto out;
+	if (rist_start(s.receiver) != 0 || rist_start(s.sender) != 0)
+		goto out;
+
+	pthread_t send_thread;
+	if (pthread_create(&send_thread, NULL, bench_send, &s) != 0)
+		goto out;
+
+	uint64_t warmup_packets = (uint64_t)cfg->rate * cfg->warmup;
+	uint64_t capacity = (uint64_t)cfg->rate * cfg->duration + 1;
+	while (!atomic_load(&s.stop)) {
+		struct rist_data_block *b = NULL;
+		if (rist_receiver_data_read2(s.receiver, &b, 5) <= 0 || !b)
+			continue;
+		uint64_t now = bench_now_ns();
+		uint64_t seq, sent_time;
+		if (b->payload_len >= BENCH_STAMP_SIZE) {
+			memcpy(&seq, b->payload, sizeof(seq));
+			memcpy(&sent_time, (const uint8_t *)b->payload + sizeof(seq), sizeof(sent_time));
+			if (seq >= warmup_packets) {
+				s.received++;
+				if (s.latency_count < capacity)
+					s.latency_us[s.latency_count++] = (uint32_t)((now - sent_time) / 1000);
+			}
+		}
+		rist_receiver_data_block_free2(&b);
+	}
+	pthread_join(send_thread, NULL);
+	bench_report(&s);
+	ret = 0;
+
+out:
+	if (s.sender)
+		rist_destroy(s.sender);
+	if (s.receiver)
+		rist_destroy(s.receiver);
+	free(s.latency_us);
+	rist_logging_settings_free2(&logging_settings);
+	return ret;
+}
@@ -12,9 +12,13 @@
 #ifdef _WIN32
 #include <windows.h>
 #endif
+#ifdef __linux__
+#include <poll.h>
+#endif
 
 atomic_ulong failed;
 atomic_ulong stop;
+atomic_ulong fec_recovered;
 
 struct rist_logging_settings *logging_settings_sender = NULL;
 struct rist_logging_settings *logging_settings_receiver = NULL;
@@ -38,12 +42,24 @@ int log_callback(void *arg, int level, const char *msg) {
     return 0;
 }
 
-struct rist_ctx *setup_rist_receiver(int profile, const char *url) {
+int stats_callback(void *arg, const struct rist_stats *stats_container) {
+    (void)arg;
+    if (stats_container->stats_type == RIST_STATS_RECEIVER_FLOW)
+        atomic_fetch_add(&fec_recovered, stats_container->stats.receiver_flow.fec_recovered);
+    rist_stats_free(stats_container);
+    return 0;
+}
+
+struct rist_ctx *setup_rist_receiver(int profile, const char *url, unsigned worker_threads) {
     struct rist_ctx *ctx;
 	if (rist_receiver_create(&ctx, profile, logging_settings_receiver) != 0) {
 		rist_log(logging_settings_receiver, RIST_LOG_ERROR, "Could not create rist receiver context\n");
 		return NULL;
 	}
+    if (worker_threads > 0 && rist_receiver_set_worker_threads(ctx, worker_threads) != 0) {
+		rist_log(logging_settings_receiver, RIST_LOG_ERROR, "Could not set receiver worker threads\n");
+		return NULL;
+	}
     // Rely on the library to parse the url
     struct rist_peer_config *peer_config = NULL;
     if (rist_parse_address2(url, (void *)&peer_config))
@@ -75,7 +91,7 @@ struct rist_ctx *setup_rist_receiver(int profile, const char *url) {
     return ctx;
 }
 
-struct rist_ctx *setup_rist_sender(int profile, const char *url) {
+struct rist_ctx *setup_rist_sender(int profile, const char *url, bool pacing) {
     struct rist_ctx *ctx;
     if (rist_sender_create(&ctx, profile, 0, logging_settings_sender) != 0) {
 		rist_log(logging_settings_sender, RIST_LOG_ERROR, "Could not create rist sender context\n");
@@ -108,6 +124,10 @@ struct rist_ctx *setup_rist_sender(int profile, const char *url) {
 #endif
 
 	free((void *)peer_config_link);
+    if (pacing && rist_sender_pacing_enable(ctx) != 0) {
+		rist_log(logging_settings_sender, RIST_LOG_ERROR, "Could not enable sender pacing\n");
+		return NULL;
+	}
 	if (rist_start(ctx) == -1) {
 		rist_log(logging_settings_sender, RIST_LOG_ERROR, "Could not start rist sender\n");
 		return NULL;
@@ -158,21 +178,76 @@ static PTHREAD_START_FUNC(send_data, arg) {
     return 0;
 }
 
+enum receive_mode {
+    RECEIVE_READ,
+    RECEIVE_READ_BATCH,
+    RECEIVE_EVENTFD
+};
+
+#define RECEIVE_BATCH (16)
+
+/* Reads up to max blocks the way the test was told to, returns the number read */
+static int receive_blocks(struct rist_ctx *ctx, enum receive_mode mode, int event_fd, struct rist_data_block **blocks, size_t max) {
+    if (mode == RECEIVE_READ)
+        return rist_receiver_data_read2(ctx, &blocks[0], 5) > 0? 1 : 0;
+    if (mode == RECEIVE_EVENTFD) {
+#ifdef __linux__
+        // The eventfd is only signaled once the fifo was found empty, so drain before polling
+        int count = rist_receiver_data_read_batch(ctx, blocks, max, 0);
+        if (count != 0)
+            return count;
+        struct pollfd pfd = { .fd = event_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 5) == 1) {
+            uint64_t value;
+            if (read(event_fd, &value, sizeof(value)) < 0)
+                return -1;
+        }
+        return rist_receiver_data_read_batch(ctx, blocks, max, 0);
+#else
+        return -1;
+#endif
+    }
+    return rist_receiver_data_read_batch(ctx, blocks, max, 5);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
+    if (argc < 5) {
         return 99;
     }
     int profile = atoi(argv[1]);
+    int losspercent = atoi(argv[4]) * 10;
+    // optional settings: fec=columns,rows workers=count read-batch eventfd pacing
+    unsigned fec_columns = 0, fec_rows = 0;
+    unsigned worker_threads = 0;
+    bool pacing = false;
+    enum receive_mode mode = RECEIVE_READ;
+    for (int i = 5; i < argc; i++) {
+        if (!strncmp(argv[i], "fec=", 4)) {
+            if (sscanf(argv[i] + 4, "%u,%u", &fec_columns, &fec_rows) != 2) {
+                return 99;
+            }
+        } else if (!strncmp(argv[i], "workers=", 8)) {
+            worker_threads = (unsigned)atoi(argv[i] + 8);
+        } else if (!strcmp(argv[i], "pacing")) {
+            pacing = true;
+        } else if (!strcmp(argv[i], "read-batch")) {
+            mode = RECEIVE_READ_BATCH;
+        } else if (!strcmp(argv[i], "eventfd")) {
+            mode = RECEIVE_EVENTFD;
+        } else {
+            return 99;
+        }
+    }
     char *url1 = strdup(argv[2]);
     char *url2 = strdup(argv[3]);
-    int losspercent = atoi(argv[4]) * 10;
-	int ret = 0;
+    int ret = 0;
 
     struct rist_ctx *receiver_ctx = NULL;
     struct rist_ctx *sender_ctx = NULL;
 
     atomic_init(&failed, 0);
     atomic_init(&stop, 0);
+    atomic_init(&fec_recovered, 0);
 
 
     fprintf(stdout, "Testing profile %i with receiver url %s and sender url %s and losspercentage: %i\n", profile, url1, url2, losspercent);
@@ -189,18 +264,30 @@ int main(int argc, char *argv[]) {
 		ret = 99;
 		goto out;
 	}
-	receiver_ctx = setup_rist_receiver(profile, url1);
-    sender_ctx = setup_rist_sender(profile, url2);
+	receiver_ctx = setup_rist_receiver(profile, url1, worker_threads);
+    sender_ctx = setup_rist_sender(profile, url2, pacing);
 	if (!sender_ctx || !receiver_ctx) {
 		ret = 99;
 		goto out;
 	}
 
+    if (fec_columns > 0 && rist_sender_fec_set(sender_ctx, fec_columns, fec_rows) != 0) {
+		ret = 99;
+		goto out;
+	}
+    // The FEC test has to see the parity rebuild packets, not only the retransmits
+    if (fec_columns > 0 && rist_stats_callback_set(receiver_ctx, 250, stats_callback, NULL) != 0) {
+		ret = 99;
+		goto out;
+	}
+
     if (losspercent > 0) {
-        receiver_ctx->receiver_ctx->simulate_loss = true;
-        receiver_ctx->receiver_ctx->loss_percentage = losspercent;
-        sender_ctx->sender_ctx->simulate_loss = true;
-        sender_ctx->sender_ctx->loss_percentage = losspercent;
+        // losspercent is in 1/1000, fixed seeds keep the lost packets the same from run to run
+        struct rist_impairment_config impairment = { .loss_model = RIST_IMPAIRMENT_LOSS_BERNOULLI, .loss = (uint32_t)losspercent * 1000 };
+        impairment.seed = 1;
+        rist_impairment_set(receiver_ctx, &impairment);
+        impairment.seed = 2;
+        rist_impairment_set(sender_ctx, &impairment);
     }
     pthread_t send_loop;
     if (pthread_create(&send_loop, NULL, send_data, (void *)sender_ctx) != 0)
@@ -210,34 +297,59 @@ int main(int argc, char *argv[]) {
 		goto out;
 	}
 
-    struct rist_data_block *b = NULL;
+    int event_fd = -1;
+    if (mode == RECEIVE_EVENTFD && (event_fd = rist_receiver_data_notify_eventfd(receiver_ctx)) < 0) {
+        fprintf(stderr, "Could not get the receiver eventfd\n");
+        atomic_store(&failed, 1);
+        atomic_store(&stop, 1);
+    }
+
+    struct rist_data_block *blocks[RECEIVE_BATCH];
     char rcompare[1316];
     int receive_count = 1;
     bool got_first = false;
+    uint32_t flow_id = 0;
     while (receive_count < 16000) {
         if (atomic_load(&stop))
             break;
-        int queue_length = rist_receiver_data_read2(receiver_ctx, &b, 5);
-        if (queue_length > 0) {
+        int count = receive_blocks(receiver_ctx, mode, event_fd, blocks, RECEIVE_BATCH);
+        if (count < 0) {
+            fprintf(stderr, "Failed to read data with error code %d!\n", count);
+            atomic_store(&failed, 1);
+            atomic_store(&stop, 1);
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            struct rist_data_block *b = blocks[i];
             if (!got_first) {
                 receive_count = (int)b->seq;
+                flow_id = b->flow_id;
 				got_first = true;
 			}
             sprintf(rcompare, "DEADBEAF TEST PACKET #%i", receive_count);
-            if (strcmp(rcompare, b->payload)) {
+            if (!atomic_load(&failed) && strcmp(rcompare, b->payload)) {
                 fprintf(stderr, "Packet contents not as expected!\n");
                 fprintf(stderr, "Got : %s\n", (char*)b->payload);
                 fprintf(stderr, "Expected : %s\n", (char*)rcompare);
                 atomic_store(&failed, 1);
                 atomic_store(&stop, 1);
-                break;
             }
             receive_count++;
-            rist_receiver_data_block_free2((struct rist_data_block **const)&b);
+            rist_receiver_data_block_free2(&b);
         }
     }
 	if (!got_first || receive_count < 12500)
 		atomic_store(&failed, 1);
+    // The flow totals can be read from this thread while the flow is running
+    struct rist_receiver_flow_counters counters;
+    if (got_first && (rist_receiver_flow_counters_get(receiver_ctx, flow_id, &counters) != 0 || counters.received == 0)) {
+        fprintf(stderr, "Could not read the flow counters of flow %u\n", flow_id);
+        atomic_store(&failed, 1);
+    }
+    if (fec_columns > 0 && atomic_load(&fec_recovered) == 0) {
+        fprintf(stderr, "FEC did not recover any packets\n");
+        atomic_store(&failed, 1);
+    }
 	if (atomic_load(&failed))
 		ret = 1;
 	pthread_join(send_loop, NULL);
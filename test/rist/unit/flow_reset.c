@@ -0,0 +1,82 @@
+//Unit tests for the receiver flow reset checks: every reset starts the late and full drop counts over
+
+#include "config.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/rist-private.h"
+
+// Static storage keeps the cache line alignment of the counters
+static struct rist_flow flow;
+
+static void reset_flow(void) {
+	memset(&flow, 0, sizeof(flow));
+	rist_flow_counters_rebase(&flow);
+}
+
+static int full_drops_until_reset(struct rist_flow *f, int max) {
+	for (int i = 1; i <= max; i++) {
+		rist_stats_counter_add(&f->counters.dropped_full, 1);
+		if (rist_flow_dropped_full_reset(f))
+			return i;
+	}
+	return 0;
+}
+
+static void test_two_full_resets_in_one_interval(void **state) {
+	(void)state;
+	reset_flow();
+	assert_int_equal(full_drops_until_reset(&flow, 1000), 101);
+	rist_flow_counters_rebase(&flow);
+	// No stats report in between, the second reset needs as many drops as the first
+	assert_false(full_drops_until_reset(&flow, 1));
+	assert_int_equal(full_drops_until_reset(&flow, 1000), 100);
+	rist_flow_counters_rebase(&flow);
+	assert_false(rist_flow_dropped_full_reset(&flow));
+	// The report still covers all of them
+	assert_int_equal(rist_flow_counter_interval(&flow, dropped_full), 0);
+	assert_int_equal(atomic_load(&flow.counters.dropped_full) - flow.counters_reported.dropped_full, 202);
+}
+
+static void test_two_late_resets_in_one_interval(void **state) {
+	(void)state;
+	bool too_many;
+	reset_flow();
+	for (int i = 0; i < 100; i++) {
+		rist_stats_counter_add(&flow.counters.dropped_late, 1);
+		assert_true(rist_flow_dropped_late_reset(&flow, &too_many));
+		assert_false(too_many);
+	}
+	rist_stats_counter_add(&flow.counters.dropped_late, 1);
+	assert_true(rist_flow_dropped_late_reset(&flow, &too_many));
+	assert_true(too_many);
+	rist_flow_counters_rebase(&flow);
+
+	// A flow receiving again after the reset shrugs off a late packet
+	rist_stats_counter_add(&flow.counters.received, 20);
+	rist_stats_counter_add(&flow.counters.dropped_late, 1);
+	assert_false(rist_flow_dropped_late_reset(&flow, &too_many));
+	assert_false(too_many);
+
+	// Until late ones outnumber it five to one again
+	rist_stats_counter_add(&flow.counters.dropped_late, 100);
+	assert_true(rist_flow_dropped_late_reset(&flow, &too_many));
+	assert_false(too_many);
+	rist_flow_counters_rebase(&flow);
+	assert_false(rist_flow_dropped_late_reset(&flow, &too_many));
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_two_full_resets_in_one_interval),
+		cmocka_unit_test(test_two_late_resets_in_one_interval),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,115 @@
+//Unit tests for the network impairment: the same seed loses the same datagrams
+
+#include "config.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/rist_impairment.c"
+#include "src/proto/rist_time.c"
+
+#define TEST_DATAGRAMS (5000)
+
+static const uint8_t test_payload[188];
+
+// Runs TEST_DATAGRAMS through the filter, lost[i] tells whether datagram i was dropped
+static size_t run_datagrams(struct rist_impairment *imp, struct rist_peer *p, bool *lost) {
+	size_t count = 0;
+	for (size_t i = 0; i < TEST_DATAGRAMS; i++) {
+		lost[i] = rist_impairment_filter(imp, p, NULL, 0, test_payload, sizeof(test_payload));
+		count += lost[i];
+	}
+	return count;
+}
+
+static struct rist_peer *new_peer(uint32_t adv_peer_id) {
+	struct rist_peer *p = calloc(1, sizeof(*p));
+	assert_non_null(p);
+	p->adv_peer_id = adv_peer_id;
+	p->sd = -1;
+	return p;
+}
+
+static void check_same_seed_same_losses(const struct rist_impairment_config *config) {
+	static bool first[TEST_DATAGRAMS], again[TEST_DATAGRAMS], other[TEST_DATAGRAMS];
+	struct rist_impairment imp, imp2;
+	assert_int_equal(rist_impairment_init(&imp), 0);
+	assert_int_equal(rist_impairment_init(&imp2), 0);
+	struct rist_peer *p = new_peer(1);
+	struct rist_peer *p2 = new_peer(1);
+
+	assert_int_equal(rist_impairment_configure(&imp, config), 0);
+	assert_true(rist_impairment_active(&imp));
+	size_t lost = run_datagrams(&imp, p, first);
+	// Roughly the configured rate, nothing is held back without delay or a rate cap
+	assert_true(lost > TEST_DATAGRAMS / 20 && lost < TEST_DATAGRAMS / 5);
+	assert_int_equal(imp.count, 0);
+
+	// Another context and peer with the same id and seed
+	assert_int_equal(rist_impairment_configure(&imp2, config), 0);
+	assert_int_equal(run_datagrams(&imp2, p2, again), lost);
+	assert_memory_equal(first, again, sizeof(first));
+
+	// Configuring again starts the sequence over
+	assert_int_equal(rist_impairment_configure(&imp, config), 0);
+	assert_int_equal(run_datagrams(&imp, p, again), lost);
+	assert_memory_equal(first, again, sizeof(first));
+
+	// Another seed, or another peer, loses other datagrams
+	struct rist_impairment_config reseeded = *config;
+	reseeded.seed++;
+	assert_int_equal(rist_impairment_configure(&imp, &reseeded), 0);
+	run_datagrams(&imp, p, other);
+	assert_true(memcmp(first, other, sizeof(first)) != 0);
+	p2->adv_peer_id = 2;
+	assert_int_equal(rist_impairment_configure(&imp2, config), 0);
+	run_datagrams(&imp2, p2, other);
+	assert_true(memcmp(first, other, sizeof(first)) != 0);
+
+	// Off lets everything through
+	assert_int_equal(rist_impairment_configure(&imp, NULL), 0);
+	assert_false(rist_impairment_active(&imp));
+	assert_int_equal(run_datagrams(&imp, p, other), 0);
+
+	rist_impairment_destroy(&imp);
+	rist_impairment_destroy(&imp2);
+	free(p);
+	free(p2);
+}
+
+static void test_bernoulli_same_seed(void **state) {
+	(void)state;
+	struct rist_impairment_config config = {
+		.seed = 42,
+		.loss_model = RIST_IMPAIRMENT_LOSS_BERNOULLI,
+		.loss = 100000,
+	};
+	check_same_seed_same_losses(&config);
+}
+
+static void test_gilbert_elliott_same_seed(void **state) {
+	(void)state;
+	struct rist_impairment_config config = {
+		.seed = 7,
+		.loss_model = RIST_IMPAIRMENT_LOSS_GILBERT_ELLIOTT,
+		.loss = 10000,
+		.loss_bad = 500000,
+		.good_to_bad = 20000,
+		.bad_to_good = 100000,
+	};
+	check_same_seed_same_losses(&config);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_bernoulli_same_seed),
+		cmocka_unit_test(test_gilbert_elliott_same_seed),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
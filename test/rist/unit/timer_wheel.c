@@ -0,0 +1,188 @@
+//Unit tests for the hierarchical timer wheel: deadlines on every level and past the wheel span
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/rist_timer_wheel.c"
+
+#define TEST_WHEEL_SPAN_MS ((uint64_t)1 << (RIST_TIMER_WHEEL_BITS * RIST_TIMER_WHEEL_LEVELS))
+#define TEST_RANDOM_TIMERS (2000)
+// Odd start so ticks do not line up with a cascade
+#define TEST_START (0xE000000012345678ULL)
+
+struct test_timer {
+	struct rist_timer timer;
+	uint64_t fired_at;
+	int fired;
+};
+
+static size_t fired_count;
+
+static void test_timer_cb(struct rist_timer *timer, void *arg, uint64_t now) {
+	struct test_timer *t = arg;
+	assert_ptr_equal(&t->timer, timer);
+	// Never early
+	assert_true(now >= timer->expires);
+	t->fired++;
+	t->fired_at = now;
+	fired_count++;
+}
+
+static uint32_t lcg_next(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state;
+}
+
+// Spread over all levels: pick a level by the top bits, then a delay inside it
+static uint64_t random_delay_ticks(uint32_t *state) {
+	uint32_t r = lcg_next(state);
+	int bits = RIST_TIMER_WHEEL_BITS * (1 + (int)(r >> 30));
+	uint64_t delay = ((uint64_t)lcg_next(state) << 8 | (r & 0xff)) & (((uint64_t)1 << bits) - 1);
+	return delay;
+}
+
+static struct test_timer *arm_timers(struct rist_timer_wheel *wheel, const uint64_t *delays, size_t count) {
+	struct test_timer *timers = calloc(count, sizeof(*timers));
+	assert_non_null(timers);
+	for (size_t i = 0; i < count; i++) {
+		rist_timer_init(&timers[i].timer, test_timer_cb, &timers[i]);
+		rist_timer_arm(wheel, &timers[i].timer, delays[i]);
+		assert_true(rist_timer_armed(&timers[i].timer));
+	}
+	return timers;
+}
+
+static void test_all_levels_every_tick(void **state) {
+	(void)state;
+	static const uint64_t boundaries_ms[] = {
+		0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145,
+		TEST_WHEEL_SPAN_MS - 1, TEST_WHEEL_SPAN_MS, TEST_WHEEL_SPAN_MS + 1, 3 * TEST_WHEEL_SPAN_MS + 17,
+	};
+	const size_t boundaries = sizeof(boundaries_ms) / sizeof(boundaries_ms[0]);
+	const size_t count = boundaries + TEST_RANDOM_TIMERS;
+	uint64_t *deadlines = calloc(count, sizeof(*deadlines));
+	assert_non_null(deadlines);
+	uint32_t seed = 1;
+	uint64_t last = 0;
+	for (size_t i = 0; i < count; i++) {
+		uint64_t delay = i < boundaries ? boundaries_ms[i] * RIST_CLOCK : random_delay_ticks(&seed) * RIST_CLOCK + lcg_next(&seed) % RIST_CLOCK;
+		deadlines[i] = TEST_START + delay;
+		if (deadlines[i] > last)
+			last = deadlines[i];
+	}
+
+	struct rist_timer_wheel wheel;
+	rist_timer_wheel_init(&wheel, TEST_START);
+	fired_count = 0;
+	struct test_timer *timers = arm_timers(&wheel, deadlines, count);
+
+	// Run on every tick up to the last deadline, each timer fires on the first run at or after it
+	uint64_t now = TEST_START;
+	while (now < last + RIST_CLOCK) {
+		rist_timer_wheel_run(&wheel, now);
+		now += RIST_CLOCK;
+	}
+	rist_timer_wheel_run(&wheel, now);
+
+	assert_int_equal(fired_count, count);
+	for (size_t i = 0; i < count; i++) {
+		assert_int_equal(timers[i].fired, 1);
+		assert_false(rist_timer_armed(&timers[i].timer));
+		assert_true(timers[i].fired_at - deadlines[i] < 2 * RIST_CLOCK);
+	}
+	assert_int_equal(rist_timer_wheel_next(&wheel), UINT64_MAX);
+	free(timers);
+	free(deadlines);
+}
+
+static void test_all_levels_irregular_runs(void **state) {
+	(void)state;
+	const size_t count = TEST_RANDOM_TIMERS;
+	uint64_t *deadlines = calloc(count, sizeof(*deadlines));
+	assert_non_null(deadlines);
+	uint32_t seed = 2;
+	uint64_t last = 0;
+	for (size_t i = 0; i < count; i++) {
+		// A quarter of them past the wheel span
+		uint64_t delay = random_delay_ticks(&seed);
+		if ((i & 3) == 0)
+			delay += TEST_WHEEL_SPAN_MS;
+		deadlines[i] = TEST_START + delay * RIST_CLOCK + lcg_next(&seed) % RIST_CLOCK;
+		if (deadlines[i] > last)
+			last = deadlines[i];
+	}
+
+	struct rist_timer_wheel wheel;
+	rist_timer_wheel_init(&wheel, TEST_START);
+	fired_count = 0;
+	struct test_timer *timers = arm_timers(&wheel, deadlines, count);
+
+	// Wake up when the wheel asks to, or earlier at random, like the protocol loop does
+	uint64_t now = TEST_START;
+	while (fired_count < count) {
+		uint64_t next = rist_timer_wheel_next(&wheel);
+		assert_true(next != UINT64_MAX);
+		uint64_t target = next > now ? next : now;
+		uint64_t early = now + (uint64_t)(lcg_next(&seed) % 5000) * RIST_CLOCK;
+		if (early < target && (lcg_next(&seed) & 1))
+			target = early;
+		now = target;
+		rist_timer_wheel_run(&wheel, now);
+		assert_true(now <= last + RIST_CLOCK);
+	}
+	for (size_t i = 0; i < count; i++)
+		assert_int_equal(timers[i].fired, 1);
+	free(timers);
+	free(deadlines);
+}
+
+static void test_cancel_and_rearm(void **state) {
+	(void)state;
+	const uint64_t delays_ms[] = { 10, 100, 5000, 300000, TEST_WHEEL_SPAN_MS + 100 };
+	const size_t count = sizeof(delays_ms) / sizeof(delays_ms[0]);
+	uint64_t deadlines[sizeof(delays_ms) / sizeof(delays_ms[0])];
+	for (size_t i = 0; i < count; i++)
+		deadlines[i] = TEST_START + delays_ms[i] * RIST_CLOCK;
+
+	struct rist_timer_wheel wheel;
+	rist_timer_wheel_init(&wheel, TEST_START);
+	fired_count = 0;
+	struct test_timer *timers = arm_timers(&wheel, deadlines, count);
+
+	// Cancelled timers stay quiet, later re-arms move the deadline out, earlier ones pull it in
+	rist_timer_cancel(&timers[1].timer);
+	assert_false(rist_timer_armed(&timers[1].timer));
+	rist_timer_arm_before(&wheel, &timers[2].timer, deadlines[2] + 1000 * RIST_CLOCK);
+	rist_timer_arm(&wheel, &timers[3].timer, deadlines[3] + 1000 * RIST_CLOCK);
+	rist_timer_arm_before(&wheel, &timers[4].timer, TEST_START + 20 * RIST_CLOCK);
+
+	uint64_t end = deadlines[4] + RIST_CLOCK;
+	for (uint64_t now = TEST_START; now < end; now += RIST_CLOCK)
+		rist_timer_wheel_run(&wheel, now);
+
+	assert_int_equal(timers[0].fired, 1);
+	assert_int_equal(timers[1].fired, 0);
+	assert_int_equal(timers[2].fired, 1);
+	assert_true(timers[2].fired_at - deadlines[2] < 2 * RIST_CLOCK);
+	assert_int_equal(timers[3].fired, 1);
+	assert_true(timers[3].fired_at >= deadlines[3] + 1000 * RIST_CLOCK);
+	assert_int_equal(timers[4].fired, 1);
+	assert_true(timers[4].fired_at < TEST_START + 22 * RIST_CLOCK);
+	assert_int_equal(fired_count, 4);
+	free(timers);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_all_levels_every_tick),
+		cmocka_unit_test(test_all_levels_irregular_runs),
+		cmocka_unit_test(test_cancel_and_rearm),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
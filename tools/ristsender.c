@@ -116,6 +116,9 @@ static struct option long_options[] = {
 { "encryption-type", required_argument, NULL, 'e' },
 { "profile",         required_argument, NULL, 'p' },
 { "null-packet-deletion",  no_argument, NULL, 'n' },
+{ "pacing",          no_argument,       NULL, 'P' },
+{ "transmit-threads", required_argument, NULL, 'T' },
+{ "fec",             required_argument, NULL, 'E' },
 #ifdef USE_TUN
 { "tun",             required_argument, NULL, 't' },
 { "tun-mode",        required_argument, NULL, 'm' },
@@ -158,6 +161,9 @@ const char help_str[] = "Usage: %s [OPTIONS] \nWhere OPTIONS are:\n"
 "       -e | --encryption-type TYPE               | Default Encryption type (0, 128 = AES-128, 256 = AES-256)|\n"
 "       -p | --profile number                     | Rist profile (0 = simple, 1 = main, 2 = advanced)        |\n"
 "       -n | --null-packet-deletion               | Enable NPD, receiver needs to support this!              |\n"
+"       -P | --pacing                             | Pace the output to the input bitrate instead of bursting |\n"
+"       -T | --transmit-threads count             | Send data from count worker threads (one per output peer)|\n"
+"       -E | --fec columns,rows                   | SMPTE 2022-1 FEC matrix, receiver needs to support this! |\n"
 "       -S | --statsinterval value (ms)           | Interval at which stats get printed, 0 to disable        |\n"
 "       -v | --verbose-level value                | To disable logging: -1, log levels match syslog levels   |\n"
 "       -r | --remote-logging IP:PORT             | Send logs and stats to this IP:PORT using udp messages   |\n"
@@ -655,7 +661,8 @@ static PTHREAD_START_FUNC(input_loop, arg)
 
 static struct rist_ctx_wrap *configure_rist_output_context(char* outputurl,
 	struct rist_sender_args *peer_args, const struct rist_udp_config *udp_config,
-	bool npd, enum rist_profile profile)
+	bool npd, bool pacing, uint32_t transmit_threads, uint32_t fec_columns, uint32_t fec_rows,
+	enum rist_profile profile)
 {
 	struct rist_ctx *sender_ctx;
 	// Setup the output rist objects (a brand new instance per receiver)
@@ -682,6 +689,12 @@ static struct rist_ctx_wrap *configure_rist_output_context(char* outputurl,
 			rist_log(&logging_settings, RIST_LOG_ERROR, "Failed to enable null packet deletion\n");
 		}
 	}
+	if (pacing && rist_sender_pacing_enable(sender_ctx) != 0)
+		rist_log(&logging_settings, RIST_LOG_ERROR, "Failed to enable output pacing\n");
+	if (transmit_threads > 0 && rist_sender_set_transmit_threads(sender_ctx, transmit_threads) != 0)
+		rist_log(&logging_settings, RIST_LOG_ERROR, "Failed to set %u transmit threads\n", transmit_threads);
+	if (fec_columns > 0 && rist_sender_fec_set(sender_ctx, fec_columns, fec_rows) != 0)
+		rist_log(&logging_settings, RIST_LOG_ERROR, "Failed to enable FEC with %u columns and %u rows\n", fec_columns, fec_rows);
 	for (size_t j = 0; j < MAX_OUTPUT_COUNT; j++) {
 		peer_args->token = outputtoken;
 		peer_args->stream_id = udp_config->stream_id;
@@ -719,6 +732,10 @@ int main(int argc, char *argv[])
 	enum rist_profile profile = RIST_PROFILE_MAIN;
 	enum rist_log_level loglevel = RIST_LOG_INFO;
 	bool npd = false;
+	bool pacing = false;
+	uint32_t transmit_threads = 0;
+	uint32_t fec_columns = 0;
+	uint32_t fec_rows = 0;
 	int faststart = 0;
 	struct rist_sender_args peer_args;
 	char *remote_log_address = NULL;
@@ -753,7 +770,7 @@ int main(int argc, char *argv[])
 
 	rist_log(&logging_settings, RIST_LOG_INFO, "Starting ristsender version: %s libRIST library: %s API version: %s\n", LIBRIST_VERSION, librist_version(), librist_api_version());
 
-	while ((c = getopt_long(argc, argv, "r:i:o:b:s:e:t:m:p:S:F:f:v:hunM", long_options, &option_index)) != -1) {
+	while ((c = getopt_long(argc, argv, "r:i:o:b:s:e:t:m:p:S:F:f:v:T:E:hunPM", long_options, &option_index)) != -1) {
 		switch (c) {
 		case 'i':
 			inputurl = strdup(optarg);
@@ -811,6 +828,18 @@ int main(int argc, char *argv[])
 		case 'n':
 			npd = true;
 			break;
+		case 'P':
+			pacing = true;
+			break;
+		case 'T':
+			transmit_threads = (uint32_t)atoi(optarg);
+			break;
+		case 'E':
+			if (sscanf(optarg, "%u,%u", &fec_columns, &fec_rows) != 2) {
+				rist_log(&logging_settings, RIST_LOG_ERROR, "Invalid FEC matrix %s, expected columns,rows\n", optarg);
+				exit(1);
+			}
+			break;
 #if HAVE_PROMETHEUS_SUPPORT
 		case 'M':
 			enable_prometheus = true;
@@ -957,7 +986,7 @@ int main(int argc, char *argv[])
 		else
 		{
 			// A brand new instance/context per receiver
-			callback_object[i].sender_ctx = configure_rist_output_context(outputurl, &peer_args, udp_config, npd, profile);
+			callback_object[i].sender_ctx = configure_rist_output_context(outputurl, &peer_args, udp_config, npd, pacing, transmit_threads, fec_columns, fec_rows, profile);
 			if (callback_object[i].sender_ctx == NULL)
 				goto shutdown;
 		}
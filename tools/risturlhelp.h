@@ -38,7 +38,7 @@ const char help_urlstr[] = "\nUsage: append to end of individual rist:// url(s)
 //"    param multiplex-filter=#  When using mux-mode=ipv4, this is the string to be used for data filter.\n"
 //"                        It should be written as destination IP:PORT\n"
 "  Advanced Profile\n"
-"    param compression=1|0  enable lz4 levels\n"
+"    param compression=#  lz4 level for sent data, 0 disables, 3-12 use lz4hc\n"
 "\n"
 "Usage: append to end of individual udp:// or rtp:// url(s) as ?param1=value1&param2=value2...\n"
 "  param miface=(device)  device name (e.g. eth0) for multicast\n"